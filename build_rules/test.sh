@@ -37,15 +37,27 @@ CheckSuccess "Defer TEST" $?
 ../src/test/dev-tools_test &> $TEMP_DIR/dev-tools_test.log
 CheckSuccess "Dev Tools TEST" $?
 
-../src/test/huffman_test &> $TEMP_DIR/huffman_test.log
+../src/test/huffman_test --data_path=../testdata/mytestdata &> $TEMP_DIR/huffman_test.log
 CheckSuccess "Huffman TEST" $?
 
+../src/test/lru-cache_test &> $TEMP_DIR/lru-cache_test.log
+CheckSuccess "LruCache TEST" $?
+
+../src/test/lz_test --data_path=../testdata/mytestdata &> $TEMP_DIR/lz_test.log
+CheckSuccess "LZ TEST" $?
+
 ../src/test/option-parser_test &> $TEMP_DIR/option-parser_test.log
 CheckSuccess "Option Parser TEST" $?
 
 ../src/test/packer_test --data_path=../testdata/mytestdata &> $TEMP_DIR/packer_test.log
 CheckSuccess "Packer TEST" $?
 
+../src/test/thread-pool_test &> $TEMP_DIR/thread-pool_test.log
+CheckSuccess "ThreadPool TEST" $?
+
 ../src/test/topset_test &> $TEMP_DIR/topset_test.log
 CheckSuccess "TopSet TEST" $?
 
+../src/test/xxhash_test &> $TEMP_DIR/xxhash_test.log
+CheckSuccess "XxHash TEST" $?
+
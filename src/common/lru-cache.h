@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// compile: -std=c++11 -lpthread
+namespace utility {
+
+/**
+ *  Thread-safe LRU cache of shared read-only values with a byte budget.
+ *  Usage:
+ *    utility::LruCache<uint64_t, std::vector<char> > cache(64 << 20);
+ *    cache.Put(key, std::make_shared<const std::vector<char> >(buffer), buffer.size());
+ *    std::shared_ptr<const std::vector<char> > handle;
+ *    if (cache.Get(key, handle)) { ... }  // no copy of the value
+ *
+ *  Values are charged with the size given to Put, least recently used values are evicted until
+ *  the charge fits the capacity. a handle keeps its value alive after eviction, the cache only
+ *  drops its own reference.
+ */
+template<typename key_t, typename value_t>
+class LruCache {
+public:
+    typedef std::shared_ptr<const value_t> handle_t;
+
+    struct Stats {
+        uint64_t hits;  // Get found the key
+        uint64_t misses;  // Get did not find the key
+        uint64_t evictions;  // values dropped for the capacity
+        uint64_t bytes;  // charge of cached values
+        uint64_t count;  // cached values
+    };
+
+    explicit LruCache(uint64_t capacity = 0) : capacity_(capacity), bytes_(0), hits_(0), misses_(0), evictions_(0) {}
+
+    /** @brief set byte budget, values are evicted until they fit. 0 disables the cache
+     *  @param capacity capacity in bytes
+     */
+    void SetCapacity(uint64_t capacity) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        EvictLocked(0);
+    }
+
+    uint64_t capacity() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return capacity_;
+    }
+
+    /** @brief get a cached value, the value becomes the most recently used
+     *  @param key key
+     *  @param handle output shared value
+     *  @return hit or miss
+     */
+    bool Get(const key_t &key, handle_t &handle) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            ++misses_;
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        handle = it->second->handle;
+        ++hits_;
+        return true;
+    }
+
+    /** @brief put a value as the most recently used, a cached value of the key is replaced
+     *  @param key key
+     *  @param handle shared value
+     *  @param charge bytes charged to the budget
+     *  @return false if the charge does not fit the capacity, the value is not cached
+     */
+    bool Put(const key_t &key, const handle_t &handle, uint64_t charge) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (charge > capacity_ || !handle) return false;
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            bytes_ -= it->second->charge;
+            entries_.erase(it->second);
+            map_.erase(it);
+        }
+        EvictLocked(charge);
+        entries_.push_front(Entry{key, handle, charge});
+        map_[key] = entries_.begin();
+        bytes_ += charge;
+        return true;
+    }
+
+    /** @brief drop a cached value
+     *  @param key key
+     */
+    void Erase(const key_t &key) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end()) return;
+        bytes_ -= it->second->charge;
+        entries_.erase(it->second);
+        map_.erase(it);
+    }
+
+    /** @brief drop all cached values, counters are kept
+     */
+    void Clear() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        entries_.clear();
+        map_.clear();
+        bytes_ = 0;
+    }
+
+    /** @brief clear hit/miss/eviction counters
+     */
+    void ResetStats() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        hits_ = misses_ = evictions_ = 0;
+    }
+
+    Stats GetStats() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return Stats{hits_, misses_, evictions_, bytes_, (uint64_t)map_.size()};
+    }
+
+private:
+    struct Entry {
+        key_t key;
+        handle_t handle;
+        uint64_t charge;
+    };
+
+    /** @brief evict least recently used values until charge fits, mutex_ is held
+     *  @param charge bytes to fit
+     */
+    void EvictLocked(uint64_t charge) {
+        while (!entries_.empty() && bytes_ + charge > capacity_) {
+            const Entry &entry = entries_.back();
+            bytes_ -= entry.charge;
+            map_.erase(entry.key);
+            entries_.pop_back();
+            ++evictions_;
+        }
+    }
+
+private:
+    uint64_t capacity_;  // byte budget
+    uint64_t bytes_;  // charge of cached values
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+    std::list<Entry> entries_;  // most recently used first
+    std::unordered_map<key_t, typename std::list<Entry>::iterator> map_;
+    mutable std::mutex mutex_;
+};
+
+}  // namespace utility
@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// compile: -std=c++11 -lpthread
+namespace utility {
+
+/**
+ *  Fixed size thread pool.
+ *  Usage:
+ *    utility::ThreadPool pool(4);
+ *    pool.Submit([&] () { ... });
+ *    pool.Wait();  // wait until all submitted tasks are done
+ *
+ *    // run func(0) ~ func(count-1) on the pool and the calling thread
+ *    pool.ParallelFor(count, [&] (size_t i) { ... });
+ *
+ *  ParallelFor may be called from a task of the same pool, the calling thread
+ *  takes items itself and never waits for a helper that has not started.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(int thread_count = 0) : stop_(false), running_(0) {
+        if (thread_count <= 0) thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int i=0; i<thread_count; i++) workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        task_cond_.notify_all();
+        for (auto &worker : workers_) worker.join();
+    }
+
+    /** @brief worker thread count
+     */
+    int size() const { return (int)workers_.size(); }
+
+    /** @brief queue a task
+     *  @param task task function
+     */
+    void Submit(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        task_cond_.notify_one();
+    }
+
+    /** @brief wait until the queue is empty and no task is running
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cond_.wait(lock, [this] () { return tasks_.empty() && 0 == running_; });
+    }
+
+    /** @brief run func(i) for i in [0, count), return when all of them are done
+     *  @param count item count
+     *  @param func item function
+     */
+    void ParallelFor(size_t count, const std::function<void(size_t)> &func) {
+        if (0 == count) return;
+        if (1 == count) return func(0);
+
+        // shared with helpers, a helper may start after this call returns
+        struct State {
+            std::atomic<size_t> next;
+            size_t done;
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+        std::shared_ptr<State> state(new State());
+        state->next = 0;
+        state->done = 0;
+        const std::function<void(size_t)> *pfunc = &func;
+        auto run = [state, pfunc, count] () {
+            size_t finished = 0;
+            for (size_t i = state->next++; i < count; i = state->next++) {
+                (*pfunc)(i);
+                finished++;
+            }
+            if (0 == finished) return;
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->done += finished;
+            if (state->done == count) state->cond.notify_all();
+        };
+
+        const size_t helpers = std::min(count - 1, workers_.size());
+        for (size_t i=0; i<helpers; i++) Submit(run);
+        run();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cond.wait(lock, [&state, count] () { return state->done == count; });
+    }
+
+private:
+    void WorkerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                task_cond_.wait(lock, [this] () { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                running_++;
+            }
+            task();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                running_--;
+                if (tasks_.empty() && 0 == running_) done_cond_.notify_all();
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool &);  // disable
+    ThreadPool &operator=(const ThreadPool &);  // disable
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_cond_;  // new task or stop
+    std::condition_variable done_cond_;  // queue drained
+    bool stop_;
+    int running_;  // running task count
+};
+
+}  // namespace utility
@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+namespace utility {
+
+/**
+ *  XXH64 hash, fast non-cryptographic hash of byte streams.
+ *  Usage:
+ *    uint64_t hash = utility::XxHash64::Hash(data, size);
+ *
+ *    // streams fed in pieces hash the same as the whole buffer
+ *    utility::XxHash64 hasher(seed);
+ *    hasher.Update(data, size);
+ *    ...
+ *    uint64_t hash = hasher.Digest();
+ */
+class XxHash64 {
+private:
+    static const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+    static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+    static const size_t kStripeSize = 32;  // 4 lanes of 64 bits
+
+public:
+    explicit XxHash64(uint64_t seed = 0) { Reset(seed); }
+
+    /** @brief restart hashing
+     *  @param seed hash seed
+     */
+    void Reset(uint64_t seed = 0) {
+        seed_ = seed;
+        lanes_[0] = seed + kPrime1 + kPrime2;
+        lanes_[1] = seed + kPrime2;
+        lanes_[2] = seed;
+        lanes_[3] = seed - kPrime1;
+        total_size_ = 0;
+        buffer_size_ = 0;
+    }
+
+    /** @brief hash the next bytes of the stream
+     *  @param data bytes
+     *  @param size byte count
+     */
+    void Update(const void *data, size_t size) {
+        const char *p = (const char *)data, *end = p + size;
+        total_size_ += size;
+        if (buffer_size_ + size < kStripeSize) {
+            if (size) memcpy(buffer_ + buffer_size_, p, size);
+            buffer_size_ += size;
+            return;
+        }
+        if (buffer_size_) {
+            const size_t fill = kStripeSize - buffer_size_;
+            memcpy(buffer_ + buffer_size_, p, fill);
+            Stripe(buffer_);
+            p += fill;
+            buffer_size_ = 0;
+        }
+        for (; p + kStripeSize <= end; p += kStripeSize) Stripe(p);
+        buffer_size_ = end - p;
+        if (buffer_size_) memcpy(buffer_, p, buffer_size_);
+    }
+
+    /** @brief hash of the bytes fed since Reset, hashing may go on
+     */
+    uint64_t Digest() const {
+        uint64_t h = 0;
+        if (total_size_ >= kStripeSize) {
+            h = Rotl(lanes_[0], 1) + Rotl(lanes_[1], 7) + Rotl(lanes_[2], 12) + Rotl(lanes_[3], 18);
+            for (int i=0; i<4; i++) h = (h ^ Round(0, lanes_[i])) * kPrime1 + kPrime4;
+        } else {
+            h = seed_ + kPrime5;
+        }
+        h += total_size_;
+
+        const char *p = buffer_, *end = buffer_ + buffer_size_;
+        for (; p + 8 <= end; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+        if (p + 4 <= end) {
+            h = Rotl(h ^ (Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        for (; p < end; p++) h = Rotl(h ^ ((uint8_t)*p * kPrime5), 11) * kPrime1;
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    /** @brief hash a buffer
+     *  @param data bytes
+     *  @param size byte count
+     *  @param seed hash seed
+     */
+    static uint64_t Hash(const void *data, size_t size, uint64_t seed = 0) {
+        XxHash64 hasher(seed);
+        hasher.Update(data, size);
+        return hasher.Digest();
+    }
+
+private:
+    static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t Round(uint64_t acc, uint64_t input) { return Rotl(acc + input * kPrime2, 31) * kPrime1; }
+
+    static uint64_t Read64(const char *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    static uint64_t Read32(const char *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    void Stripe(const char *p) {
+        lanes_[0] = Round(lanes_[0], Read64(p));
+        lanes_[1] = Round(lanes_[1], Read64(p + 8));
+        lanes_[2] = Round(lanes_[2], Read64(p + 16));
+        lanes_[3] = Round(lanes_[3], Read64(p + 24));
+    }
+
+private:
+    uint64_t seed_;
+    uint64_t lanes_[4];  // accumulators of 32 byte stripes
+    uint64_t total_size_;  // bytes fed since Reset
+    char buffer_[kStripeSize];  // bytes of the stripe not complete
+    size_t buffer_size_;
+};
+
+}  // namespace utility
@@ -15,67 +15,355 @@
 
 namespace huffman {
 
+/** @brief append a varint (7 bits per byte, low bits first) to buffer
+ *  @param buffer output buffer
+ *  @param val value
+ */
+static inline void WriteVarint(std::vector<char> &buffer, uint64_t val) {
+    while (val >= 0x80) {
+        buffer.push_back((char)(val | 0x80));
+        val >>= 7;
+    }
+    buffer.push_back((char)val);
+}
+
+/** @brief read a varint from buffer
+ *  @param ptr read pointer, moved after the varint
+ *  @param end end of buffer
+ *  @param val output value
+ *  @return success or fail
+ */
+static inline bool ReadVarint(const char *&ptr, const char *end, uint64_t &val) {
+    val = 0;
+    for (int shift = 0; shift < 64 && ptr < end; shift += 7) {
+        const uint8_t byte = (uint8_t)*ptr++;
+        val |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
 /** @brief encode a stream buffer use huffman
  *  @param stream_buffer input stream buffer
- *  @param encode_buffer outout encode buffer, code table | int(encode_bit_size) | encode buffer
+ *  @param encode_buffer outout encode buffer, code table | encode_bit_size | encode buffer
  *  @return success or fail
  */
 bool Huffman::Encode(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer) {
+    if (VERSION_BLOCKED == stream_version_) return EncodeBlocks(stream_buffer.data(), stream_buffer.size(), encode_buffer);
+    return EncodeStream(stream_buffer.data(), stream_buffer.size(), encode_buffer);
+}
+
+/** @brief encode a buffer as VERSION_BLOCKED stream, blocks are encoded on thread_pool_
+ *  @param input input buffer
+ *  @param size input size
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Huffman::EncodeBlocks(const char *input, size_t size, std::vector<char> &encode_buffer) {
     encode_buffer.clear();
+    const uint64_t block_size = block_size_;
+    const size_t block_count = (size + block_size - 1) / block_size;
+    std::vector<std::vector<char> > blocks(block_count);
+    std::vector<char> success(block_count, 0);
+    auto encode_block = [&] (size_t i) {
+        const size_t begin = i * block_size;
+        success[i] = EncodeBlock(input + begin, std::min((size_t)block_size, size - begin), blocks[i]);
+    };
+    if (nullptr != thread_pool_) {
+        thread_pool_->ParallelFor(block_count, encode_block);
+    } else {
+        for (size_t i=0; i<block_count; i++) encode_block(i);
+    }
+    if (std::find(success.begin(), success.end(), 0) != success.end()) {
+        LOG_ERR << "encode block error.";
+        return false;
+    }
 
-    if (!BuildFreqMap(stream_buffer)) {
-        LOG_ERR << "build frequency map error.";
+    // header and block offset table
+    encode_buffer.resize(sizeof(uint32_t));
+    *(uint32_t*)&encode_buffer[0] = kStreamTag | VERSION_BLOCKED;
+    WriteVarint(encode_buffer, size);
+    WriteVarint(encode_buffer, block_size);
+    WriteVarint(encode_buffer, block_count);
+    size_t result_size = encode_buffer.size();
+    for (const auto &block : blocks) {
+        WriteVarint(encode_buffer, block.size());
+        result_size += block.size();
+    }
+    encode_buffer.reserve(result_size);
+    for (const auto &block : blocks) encode_buffer.insert(encode_buffer.end(), block.begin(), block.end());
+    return true;
+}
+
+/** @brief encode one block of a VERSION_BLOCKED stream coded block by block, safe to call from many threads at once
+ *  @param input input block, block size of SetBlockSize except the last block
+ *  @param size input size
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Huffman::EncodeBlock(const char *input, size_t size, std::vector<char> &encode_buffer) const {
+    Huffman huffman;
+    huffman.SetStreamVersion(VERSION_INTERLEAVED);
+    huffman.SetMaxCodeLength(code_length_limit_);
+    huffman.SetInterleavedStreams(interleaved_streams_);
+    return huffman.EncodeStream(input, size, encode_buffer);
+}
+
+/** @brief write header and block offset table of a VERSION_BLOCKED stream coded block by block,
+ *      the header size only depends on the output size, blocks follow the header
+ *  @param output_size decoded size of the whole stream
+ *  @param block_sizes encode sizes of blocks, zeros to reserve the header before the blocks are coded
+ *  @param encode_buffer output header
+ *  @return success or fail
+ */
+bool Huffman::WriteBlockHeader(uint64_t output_size, const std::vector<uint64_t> &block_sizes, std::vector<char> &encode_buffer) const {
+    const uint64_t block_count = (output_size + block_size_ - 1) / block_size_;
+    if (block_sizes.size() != block_count) {
+        LOG_ERR << "check block count error. block count:" << block_count << ", block sizes:" << block_sizes.size();
         return false;
     }
+    encode_buffer.resize(sizeof(uint32_t));
+    *(uint32_t*)&encode_buffer[0] = kStreamTag | VERSION_BLOCKED;
+    WriteVarint(encode_buffer, output_size);
+    WriteVarint(encode_buffer, block_size_);
+    WriteVarint(encode_buffer, block_count);
+    for (uint64_t encode_size : block_sizes) {
+        if (encode_size >> (7 * kPaddedVarintBytes)) {
+            LOG_ERR << "check encode block size error. size:" << encode_size;
+            return false;
+        }
+        // a varint with continued zero groups, the width does not depend on the value
+        for (int i=0; i<kPaddedVarintBytes; i++, encode_size >>= 7) {
+            encode_buffer.push_back((char)((encode_size & 0x7F) | (i + 1 < kPaddedVarintBytes ? 0x80 : 0)));
+        }
+    }
+    return true;
+}
 
-    if (!BuildTree()) {
-        LOG_ERR << "build huffman tree error.";
+/** @brief encode a buffer as a single stream of stream_version_
+ *  @param input input buffer
+ *  @param size input size
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Huffman::EncodeStream(const char *input, size_t size, std::vector<char> &encode_buffer) {
+    encode_buffer.clear();
+    if (VERSION_SHARED == stream_version_ && !shared_table_) {
+        LOG_ERR << "shared table is not set.";
         return false;
     }
 
-    if (!BuildCodeTable()) {
-        LOG_ERR << "build huffman code table error.";
+    if (!BuildFreqMap(input, size)) {
+        LOG_ERR << "build frequency map error.";
         return false;
     }
 
-    huffman_code_t result;
-    for (auto ch : stream_buffer) {
-        const huffman_code_t &code = code_table_[ch];
-        result.insert(result.end(), code.begin(), code.end());
+    if (VERSION_SHARED == stream_version_) {
+        // codes_ hold the shared table, only the tag is written
+        encode_buffer.resize(sizeof(uint32_t));
+        *(uint32_t*)&encode_buffer[0] = kStreamTag | VERSION_SHARED;
+    } else if (VERSION_FREQ_MAP == stream_version_) {
+        shared_table_ = false;
+        // the decoder rebuilds the same tree from frequencies
+        if (!BuildTree() || !BuildCodesFromTree()) {
+            LOG_ERR << "build huffman code table error.";
+            return false;
+        }
+        // write freq map
+        if (!WriteFreqMap(encode_buffer)) {
+            LOG_ERR << "write huffman code table error.";
+            return false;
+        }
+    } else {
+        shared_table_ = false;
+        if (!BuildLimitedCodeLengths(code_length_limit_)) {
+            LOG_ERR << "build huffman code lengths error.";
+            return false;
+        }
+        // write code lengths
+        if (!BuildCanonicalCodes() || !WriteCodeLengths(encode_buffer)) {
+            LOG_ERR << "write huffman code lengths error.";
+            return false;
+        }
     }
 
-    // write freq map
-    if (!WriteFreqMap(encode_buffer)) {
-        LOG_ERR << "write huffman code table error.";
-        return false;
+    // the input is split into equal segments, one bit stream for each segment
+    const size_t stream_count = (VERSION_INTERLEAVED == stream_version_) ? interleaved_streams_ : 1;
+    const size_t segment_size = (size + stream_count - 1)/stream_count;
+    const uint8_t *in = (const uint8_t *)input;
+    std::vector<uint64_t> bit_sizes(stream_count, 0);
+    if (1 == stream_count) {
+        // the encode bit size is known from frequencies
+        for (int sym=0; sym<256; sym++) bit_sizes[0] += char_freq_[sym] * codes_[sym].len;
+    } else {
+        for (size_t i=0; i<stream_count; i++) {
+            const size_t begin = std::min(i*segment_size, size), end = std::min(begin + segment_size, size);
+            for (size_t j=begin; j<end; j++) bit_sizes[i] += codes_[in[j]].len;
+        }
+    }
+    if (VERSION_FREQ_MAP == stream_version_) {
+        const size_t code_table_size = encode_buffer.size();
+        encode_buffer.resize(code_table_size + sizeof(uint64_t));
+        *(uint64_t*)&encode_buffer[code_table_size] = bit_sizes[0];
+    } else {
+        WriteVarint(encode_buffer, size);
+        if (VERSION_INTERLEAVED == stream_version_) WriteVarint(encode_buffer, stream_count);
+        for (uint64_t bit_size : bit_sizes) WriteVarint(encode_buffer, bit_size);
     }
 
-    // append result to encode buffer
-    size_t code_table_size = encode_buffer.size();
-    size_t result_size = (result.size() + 7)/8;
-    // the new elements are initialized as copies of 0
-    encode_buffer.resize(code_table_size + result_size + sizeof(uint64_t), 0);
+    // append encode bits of each stream byte aligned, 8 bytes of slack for 64bit writes,
+    // the slack written by a stream is overwritten by the next one
+    const size_t header_size = encode_buffer.size();
+    size_t result_size = 0;
+    for (uint64_t bit_size : bit_sizes) result_size += (bit_size + 7)/8;
+    encode_buffer.resize(header_size + result_size + sizeof(uint64_t));
+    char *pencode = &encode_buffer[0] + header_size;
+    for (size_t i=0; i<stream_count; i++) {
+        const size_t begin = std::min(i*segment_size, size), end = std::min(begin + segment_size, size);
+        if (EncodeBits(input + begin, end - begin, pencode) != bit_sizes[i]) {
+            LOG_ERR << "check encode bit size error.";
+            return false;
+        }
+        pencode += (bit_sizes[i] + 7)/8;
+    }
+    encode_buffer.resize(header_size + result_size);
+    return true;
+}
+
+/** @brief train a shared table from sample buffers, symbols absent from samples get long codes
+ *      so that any buffer can be coded, the table is set as the shared table
+ *  @param samples sample buffers
+ *  @param table_buffer output table buffer
+ *  @return success or fail
+ */
+bool Huffman::TrainSharedTable(const std::vector<std::vector<char> > &samples, std::vector<char> &table_buffer) {
+    table_buffer.clear();
+    uint64_t freq[256];
+    for (int sym=0; sym<256; sym++) freq[sym] = 1;
+    for (const auto &sample : samples) {
+        if (!BuildFreqMap(sample.data(), sample.size())) {
+            LOG_ERR << "build frequency map error.";
+            return false;
+        }
+        for (int sym=0; sym<256; sym++) freq[sym] += char_freq_[sym];
+    }
+    memcpy(char_freq_, freq, sizeof(char_freq_));
 
-    char *pencode = &encode_buffer[code_table_size];
-    *(uint64_t*)pencode = (uint64_t)result.size(); pencode += sizeof(uint64_t);
-    for (int i=0; i<result.size(); i++) {
-        if (!result[i]) continue;
-        char &ch = pencode[i/8];
-        ch = ch|(1<<(i&7));
+    const StreamVersion stream_version = stream_version_;
+    stream_version_ = VERSION_SHARED;
+    const bool success = BuildLimitedCodeLengths(code_length_limit_) && BuildCanonicalCodes() && WriteCodeLengths(table_buffer);
+    stream_version_ = stream_version;
+    if (!success) {
+        LOG_ERR << "build shared table error.";
+        return false;
     }
+    return SetSharedTable(table_buffer);
+}
+
+/** @brief set shared table of VERSION_SHARED streams, codes and decode table are built once,
+ *      the shared table is dropped by encoding or decoding streams of other versions
+ *  @param table_buffer table buffer of TrainSharedTable
+ *  @return success or fail
+ */
+bool Huffman::SetSharedTable(const std::vector<char> &table_buffer) {
+    shared_table_ = false;
+    size_t table_size = 0;
+    if (table_buffer.size() < sizeof(uint32_t) || *(const uint32_t*)table_buffer.data() != (kStreamTag | VERSION_SHARED)) {
+        LOG_ERR << "check shared table tag error.";
+        return false;
+    }
+    if (!ReadCodeLengths(table_buffer.data(), table_buffer.size(), table_size) || table_size != table_buffer.size()) {
+        LOG_ERR << "read shared table error.";
+        return false;
+    }
+    for (int sym=0; sym<256; sym++) {
+        if (0 == codes_[sym].len) {
+            LOG_ERR << "symbol without code in shared table. symbol:" << sym;
+            return false;
+        }
+    }
+    if (!BuildDecodeTable()) {
+        LOG_ERR << "build huffman decode table error.";
+        return false;
+    }
+    shared_table_ = true;
     return true;
 }
 
+/** @brief encode symbols with codes_, 64bit words are written to output
+ *  @param input input symbols
+ *  @param size input size
+ *  @param pencode output buffer, holds encode bits and 8 bytes of slack
+ *  @return encode bit size
+ */
+uint64_t Huffman::EncodeBits(const char *input, size_t size, char *pencode) {
+    const uint8_t *in = (const uint8_t *)input, *in_end = in + size;
+    const HuffmanCode *codes = codes_;
+    char *pstart = pencode;
+    uint64_t bit_buf = 0;
+    int bit_count = 0, max_code_len = 0;
+    for (int sym=0; sym<256; sym++) max_code_len = std::max(max_code_len, (int)codes_[sym].len);
+
+    #define PUT_SYMBOL_() { \
+        const HuffmanCode &c = codes[*in++]; \
+        bit_buf |= c.code << bit_count; \
+        bit_count += c.len; \
+    }
+    // write the whole word, keep the bits of the last partial byte
+    #define FLUSH_BITS_() { \
+        *(uint64_t*)pencode = bit_buf; \
+        pencode += bit_count >> 3; \
+        bit_buf >>= bit_count & ~7; \
+        bit_count &= 7; \
+    }
+
+    // less than 8 bits are left after a flush, 4 codes up to 14 bits or 2 codes up to 28 bits fit the word
+    if (max_code_len <= 14) {
+        while (in_end - in >= 4) {
+            PUT_SYMBOL_();
+            PUT_SYMBOL_();
+            PUT_SYMBOL_();
+            PUT_SYMBOL_();
+            FLUSH_BITS_();
+        }
+    } else if (max_code_len <= 28) {
+        while (in_end - in >= 2) {
+            PUT_SYMBOL_();
+            PUT_SYMBOL_();
+            FLUSH_BITS_();
+        }
+    }
+    while (in < in_end) {
+        PUT_SYMBOL_();
+        FLUSH_BITS_();
+    }
+    if (bit_count) *pencode = (char)bit_buf;
+
+    #undef PUT_SYMBOL_
+    #undef FLUSH_BITS_
+
+    return (uint64_t)(pencode - pstart)*8 + bit_count;
+}
+
 /** @brief build frequency map
- *  @param stream_buffer input stream buffer
+ *  @param input input buffer
+ *  @param size input size
  *  @return success or fail
  */
-bool Huffman::BuildFreqMap(const std::vector<char> &stream_buffer) {
-    char_freq_map_.clear();
-    // Make frequency table from a input buffer.
-    for (char ch : stream_buffer) {
-        char_freq_map_[ch]++;
+bool Huffman::BuildFreqMap(const char *input, size_t size) {
+    // 4 interleaved counters, avoid store-to-load stalls on runs of the same symbol
+    uint64_t freq[4][256];
+    memset(freq, 0, sizeof(freq));
+    const uint8_t *in = (const uint8_t *)input, *in_end = in + size;
+    while (in_end - in >= 4) {
+        freq[0][in[0]]++;
+        freq[1][in[1]]++;
+        freq[2][in[2]]++;
+        freq[3][in[3]]++;
+        in += 4;
     }
+    while (in < in_end) freq[0][*in++]++;
+    for (int sym=0; sym<256; sym++) char_freq_[sym] = freq[0][sym] + freq[1][sym] + freq[2][sym] + freq[3][sym];
     return true;
 }
 
@@ -84,14 +372,26 @@ bool Huffman::BuildFreqMap(const std::vector<char> &stream_buffer) {
  *  @return success or fail
  */
 bool Huffman::WriteFreqMap(std::vector<char> &encode_buffer) {
-    const int need_size = sizeof(int) + (sizeof(char)+sizeof(int))*char_freq_map_.size();
+    int char_count = 0;
+    for (int sym=0; sym<256; sym++) {
+        if (0 == char_freq_[sym]) continue;
+        if (char_freq_[sym] > 0x7FFFFFFF) {
+            LOG_ERR << "frequency overflow, size of frequency map stream is limited to int.";
+            return false;
+        }
+        char_count++;
+    }
+    const int need_size = sizeof(int) + (sizeof(char)+sizeof(int))*char_count;
     encode_buffer.resize(need_size);
 
     char *pencode = &encode_buffer[0], *ptr_bak = pencode;
-    *(int*)pencode = (int)char_freq_map_.size(); pencode += sizeof(int);
-    for (auto it : char_freq_map_) {
-        *pencode = it.first;
-        *(int*)(pencode+sizeof(char)) = it.second;
+    *(int*)pencode = char_count; pencode += sizeof(int);
+    // symbols are ordered as signed char
+    for (int ch=-128; ch<128; ch++) {
+        const uint64_t freq = char_freq_[(uint8_t)ch];
+        if (0 == freq) continue;
+        *pencode = (char)ch;
+        *(int*)(pencode+sizeof(char)) = (int)freq;
         pencode += sizeof(char) + sizeof(int);
     }
     if (pencode - ptr_bak != need_size) {
@@ -102,20 +402,25 @@ bool Huffman::WriteFreqMap(std::vector<char> &encode_buffer) {
 }
 
 /** @brief read frequency map from compressed buffer
- *  @param encode_buffer input encode buffer
+ *  @param buffer input encode buffer
+ *  @param size encode buffer size
  *  @param table_size freq table size
  *  @return success or fail
  */
-bool Huffman::ReadFreqMap(const std::vector<char> &encode_buffer, size_t &table_size) {
-    char_freq_map_.clear();
+bool Huffman::ReadFreqMap(const char *buffer, size_t size, size_t &table_size) {
+    memset(char_freq_, 0, sizeof(char_freq_));
     table_size = 0;
 
-    size_t size = encode_buffer.size();
     if (size < sizeof(int)){
         LOG_ERR << "encode size error. size:" << size;
+        return false;
     }
-    const char *pencode = &encode_buffer[0];
+    const char *pencode = buffer;
     const int char_count = *(int*)pencode; pencode += sizeof(int);
+    if (char_count < 0 || char_count > 256) {
+        LOG_ERR << "char count error. char count:" << char_count;
+        return false;
+    }
     table_size = sizeof(int) + (sizeof(char) + sizeof(int))*char_count;
     if (size < table_size) {
         LOG_ERR << "encode size error. char count:" << char_count << ", size:" << size;
@@ -123,7 +428,12 @@ bool Huffman::ReadFreqMap(const std::vector<char> &encode_buffer, size_t &table_
     }
 
     for (int i=0; i<char_count; i++) {
-        char_freq_map_[*pencode] = *(int*)(pencode + sizeof(char));
+        const int freq = *(int*)(pencode + sizeof(char));
+        if (freq < 0) {
+            LOG_ERR << "frequency error. freq:" << freq;
+            return false;
+        }
+        char_freq_[(uint8_t)*pencode] = freq;
         pencode += sizeof(char) + sizeof(int);
     }
     return true;
@@ -133,12 +443,12 @@ bool Huffman::ReadFreqMap(const std::vector<char> &encode_buffer, size_t &table_
  *  @return success or fail
  */
 bool Huffman::BuildTree() {
-    root_ = nullptr;
+    if (nullptr != root_) delete root_, root_ = nullptr;
 
     // append to priority_queue
     std::priority_queue<HuffmanTree *, std::vector<HuffmanTree *>, CompareTree> char_freq_heap;
-    for (auto it : char_freq_map_) {
-        char_freq_heap.push(new HuffmanTree(it.first, it.second));
+    for (int sym=0; sym<256; sym++) {
+        if (char_freq_[sym]) char_freq_heap.push(new HuffmanTree((char)sym, char_freq_[sym]));
     }
 
     if (char_freq_heap.size() == 0) return true;
@@ -162,35 +472,1104 @@ bool Huffman::BuildTree() {
     return true;
 }
 
-/** @brief build code table
- *  @param htree huffman tree
+/** @brief collect codes of huffman tree into codes_
+ *  @return success or fail
  */
-bool Huffman::BuildCodeTable() {
-    code_table_.clear();
-    // maybe empty stream buffer
+bool Huffman::BuildCodesFromTree() {
+    memset(codes_, 0, sizeof(codes_));
     if (nullptr == root_) return true;
 
-    std::deque<std::pair<HuffmanTree *, huffman_code_t> > q;
-    q.push_back(std::make_pair(root_, huffman_code_t()));
-
-    while (!q.empty()) {
-        HuffmanTree *node = q.front().first;
-        huffman_code_t code = q.front().second;
-        q.pop_front();
-        HuffmanTree *left = node->left;
-        HuffmanTree *right = node->right;
-        if (nullptr != left && nullptr != right) {
-            // HuffmanTree's node is always full
-            // left child is appended a 0 and right child a 1.
-            huffman_code_t copy_code(code);
-            q.push_back(std::make_pair(left, (code.push_back(0), code)));
-            q.push_back(std::make_pair(right, (copy_code.push_back(1), copy_code)));
+    // the first bit of a code is stored at bit 0
+    std::vector<std::pair<const HuffmanTree *, HuffmanCode> > stack;
+    HuffmanCode root_code = {0, 0};
+    stack.push_back(std::make_pair(root_, root_code));
+    while (!stack.empty()) {
+        const HuffmanTree *node = stack.back().first;
+        HuffmanCode code = stack.back().second;
+        stack.pop_back();
+        if (nullptr != node->left && nullptr != node->right) {
+            if (code.len >= kMaxCodeLength) {
+                LOG_ERR << "code length exceeds " << kMaxCodeLength;
+                return false;
+            }
+            HuffmanCode right_code = {code.code | ((uint64_t)1 << code.len), code.len + 1};
+            code.len++;
+            stack.push_back(std::make_pair(node->left, code));
+            stack.push_back(std::make_pair(node->right, right_code));
+        } else if (node->freq > 0) {
+            // leaf node, the placeholder of single symbol tree has zero frequency
+            codes_[(uint8_t)node->ch] = code;
+        }
+    }
+    return true;
+}
+
+/** @brief build length-limited code lengths from frequencies with package-merge
+ *  @param max_code_length max code length
+ *  @return success or fail
+ */
+bool Huffman::BuildLimitedCodeLengths(int max_code_length) {
+    memset(codes_, 0, sizeof(codes_));
+
+    // package-merge node, a leaf (symbol) or a package of two nodes of the previous list
+    struct Node {
+        uint64_t weight;
+        int symbol;  // -1 for package
+        int left, right;
+    };
+    std::vector<Node> nodes;
+    std::vector<int> leaves;
+    for (int sym=0; sym<256; sym++) {
+        if (0 == char_freq_[sym]) continue;
+        Node leaf = {char_freq_[sym], sym, -1, -1};
+        leaves.push_back(nodes.size());
+        nodes.push_back(leaf);
+    }
+    if (leaves.empty()) return true;
+    if (leaves.size() == 1) {
+        codes_[nodes[leaves[0]].symbol].len = 1;
+        return true;
+    }
+    if (((size_t)1 << max_code_length) < leaves.size()) {
+        LOG_ERR << "max code length " << max_code_length << " is too small for " << leaves.size() << " symbols";
+        return false;
+    }
+    std::stable_sort(leaves.begin(), leaves.end(), [&nodes](int a, int b) { return nodes[a].weight < nodes[b].weight; });
+
+    // each round packages pairs of the list and merges them with the leaves
+    std::vector<int> list = leaves, packages, merged;
+    for (int level=1; level<max_code_length; level++) {
+        packages.clear();
+        for (size_t i=0; i+1<list.size(); i+=2) {
+            Node package = {nodes[list[i]].weight + nodes[list[i+1]].weight, -1, list[i], list[i+1]};
+            packages.push_back(nodes.size());
+            nodes.push_back(package);
+        }
+        merged.resize(leaves.size() + packages.size());
+        std::merge(leaves.begin(), leaves.end(), packages.begin(), packages.end(), merged.begin(),
+                   [&nodes](int a, int b) { return nodes[a].weight < nodes[b].weight; });
+        list.swap(merged);
+    }
+
+    // code length of a symbol is the times its leaf is selected by the first 2n-2 items
+    std::vector<int> stack(list.begin(), list.begin() + 2*leaves.size() - 2);
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        if (node.symbol >= 0) {
+            codes_[node.symbol].len++;
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return true;
+}
+
+/** @brief assign canonical codes from code lengths in codes_
+ *  @return success or fail
+ */
+bool Huffman::BuildCanonicalCodes() {
+    uint32_t len_count[kMaxCodeLength + 1] = {0};
+    for (int sym=0; sym<256; sym++) {
+        if (codes_[sym].len > kMaxCodeLength) {
+            LOG_ERR << "code length exceeds " << kMaxCodeLength;
+            return false;
+        }
+        len_count[codes_[sym].len]++;
+    }
+    len_count[0] = 0;
+
+    // kraft inequality, over-subscribed lengths are not a prefix code
+    uint64_t kraft = 0;
+    for (int len=1; len<=kMaxCodeLength; len++) kraft += (uint64_t)len_count[len] << (kMaxCodeLength - len);
+    if (kraft > ((uint64_t)1 << kMaxCodeLength)) {
+        LOG_ERR << "code lengths are over-subscribed.";
+        return false;
+    }
+
+    // first code of each length, codes of the same length are ordered by symbol
+    uint64_t next_code[kMaxCodeLength + 1] = {0};
+    uint64_t code = 0;
+    for (int len=1; len<=kMaxCodeLength; len++) {
+        code = (code + len_count[len-1]) << 1;
+        next_code[len] = code;
+    }
+    for (int sym=0; sym<256; sym++) {
+        const uint32_t len = codes_[sym].len;
+        if (0 == len) continue;
+        // canonical codes are msb first, reverse to stream order
+        const uint64_t canonical_code = next_code[len]++;
+        uint64_t reversed = 0;
+        for (uint32_t i=0; i<len; i++) reversed |= ((canonical_code >> i) & 1) << (len - 1 - i);
+        codes_[sym].code = reversed;
+    }
+    return true;
+}
+
+/** @brief write code lengths header of canonical stream
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Huffman::WriteCodeLengths(std::vector<char> &encode_buffer) {
+    std::vector<uint8_t> symbols;
+    uint32_t max_len = 0;
+    for (int sym=0; sym<256; sym++) {
+        if (0 == codes_[sym].len) continue;
+        symbols.push_back((uint8_t)sym);
+        max_len = std::max(max_len, codes_[sym].len);
+    }
+
+    // choose the smallest layout
+    const bool nibble = max_len <= 15;
+    const size_t count = symbols.size();
+    const size_t dense_size = nibble ? 128 : 256;
+    const size_t lengths_size = nibble ? (count + 1)/2 : count;
+    uint8_t layout = LENGTHS_LIST;
+    size_t table_size = count + lengths_size;
+    if (32 + lengths_size < table_size) layout = LENGTHS_BITMAP, table_size = 32 + lengths_size;
+    if (dense_size < table_size) layout = LENGTHS_DENSE, table_size = dense_size;
+    if (LENGTHS_DENSE == layout) {
+        symbols.clear();
+        for (int sym=0; sym<256; sym++) symbols.push_back((uint8_t)sym);
+    }
+
+    const size_t head_size = sizeof(uint32_t) + sizeof(uint8_t)*2 + sizeof(uint16_t);
+    encode_buffer.resize(head_size + table_size, 0);
+    char *pencode = &encode_buffer[0];
+    *(uint32_t*)pencode = kStreamTag | stream_version_; pencode += sizeof(uint32_t);
+    *pencode++ = (char)max_len;
+    *pencode++ = (char)(layout | (nibble ? kLengthsNibble : 0));
+    *(uint16_t*)pencode = (uint16_t)count; pencode += sizeof(uint16_t);
+    if (LENGTHS_BITMAP == layout) {
+        for (uint8_t sym : symbols) pencode[sym >> 3] |= (char)(1 << (sym & 7));
+        pencode += 32;
+    } else if (LENGTHS_LIST == layout) {
+        for (uint8_t sym : symbols) *pencode++ = (char)sym;
+    }
+    for (size_t i=0; i<symbols.size(); i++) {
+        const uint8_t len = (uint8_t)codes_[symbols[i]].len;
+        if (nibble) {
+            pencode[i/2] |= (char)(len << ((i & 1) * 4));
         } else {
-            // Leaf node: contains the character
-            code_table_.insert(std::make_pair(node->ch, code));
+            pencode[i] = (char)len;
         }
     }
     return true;
 }
 
+/** @brief read code lengths header of canonical stream
+ *  @param buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param table_size code lengths header size
+ *  @return success or fail
+ */
+bool Huffman::ReadCodeLengths(const char *buffer, size_t size, size_t &table_size) {
+    memset(codes_, 0, sizeof(codes_));
+    table_size = 0;
+
+    const size_t head_size = sizeof(uint32_t) + sizeof(uint8_t)*2 + sizeof(uint16_t);
+    if (size < head_size) {
+        LOG_ERR << "encode size error. size:" << size;
+        return false;
+    }
+    const char *pencode = buffer + sizeof(uint32_t);
+    const uint32_t max_len = (uint8_t)*pencode++;
+    const uint8_t flags = (uint8_t)*pencode++;
+    const size_t count = *(uint16_t*)pencode; pencode += sizeof(uint16_t);
+    const uint8_t layout = flags & kLengthsLayoutMask;
+    const bool nibble = flags & kLengthsNibble;
+    if (count > 256 || max_len > kMaxCodeLength || (nibble && max_len > 15)) {
+        LOG_ERR << "code lengths header error. count:" << count << ", max len:" << max_len;
+        return false;
+    }
+
+    std::vector<uint8_t> symbols;
+    size_t symbols_size = 0;
+    if (LENGTHS_DENSE == layout) {
+        for (int sym=0; sym<256; sym++) symbols.push_back((uint8_t)sym);
+    } else if (LENGTHS_BITMAP == layout) {
+        symbols_size = 32;
+        if (head_size + symbols_size > size) {
+            LOG_ERR << "encode size error. size:" << size;
+            return false;
+        }
+        for (int sym=0; sym<256; sym++) {
+            if (pencode[sym >> 3] & (1 << (sym & 7))) symbols.push_back((uint8_t)sym);
+        }
+    } else if (LENGTHS_LIST == layout) {
+        symbols_size = count;
+        if (head_size + symbols_size > size) {
+            LOG_ERR << "encode size error. size:" << size;
+            return false;
+        }
+        for (size_t i=0; i<count; i++) symbols.push_back((uint8_t)pencode[i]);
+    } else {
+        LOG_ERR << "unknown code lengths layout: " << (int)layout;
+        return false;
+    }
+    pencode += symbols_size;
+
+    const size_t lengths_size = nibble ? (symbols.size() + 1)/2 : symbols.size();
+    table_size = head_size + symbols_size + lengths_size;
+    if (table_size > size) {
+        LOG_ERR << "encode size error. size:" << size;
+        return false;
+    }
+    size_t present = 0;
+    uint32_t real_max_len = 0;
+    for (size_t i=0; i<symbols.size(); i++) {
+        const uint32_t len = nibble ? (((uint8_t)pencode[i/2] >> ((i & 1) * 4)) & 0x0F) : (uint8_t)pencode[i];
+        if (0 == len) continue;
+        codes_[symbols[i]].len = len;
+        real_max_len = std::max(real_max_len, len);
+        present++;
+    }
+    if (present != count || real_max_len != max_len) {
+        LOG_ERR << "check code lengths error.";
+        return false;
+    }
+    return BuildCanonicalCodes();
+}
+
+/** @brief read stream header and build decode table, bit sizes of streams are kept in stream_bit_sizes_,
+ *      the block offset table of VERSION_BLOCKED streams is kept in block_index_
+ *  @param buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param header_size header size, encode bits follow the header
+ *  @param output_size decoded size
+ *  @return success or fail
+ */
+bool Huffman::ReadHeader(const char *buffer, size_t size, size_t &header_size, uint64_t &output_size) {
+    header_size = 0, output_size = 0;
+    stream_bit_sizes_.clear();
+    block_index_.offsets.clear();
+    if (size < sizeof(uint32_t)) {
+        LOG_ERR << "encode size error. size:" << size;
+        return false;
+    }
+
+    const char *pbegin = buffer, *pend = pbegin + size;
+    const uint32_t tag = *(const uint32_t*)pbegin;
+    size_t table_size = 0;
+    const bool shared = (kStreamTag | VERSION_SHARED) == tag;
+    if (shared) {
+        // the decode table is built by SetSharedTable
+        uint64_t bit_size = 0;
+        if (!ReadSharedHeader(buffer, size, header_size, output_size, bit_size)) return false;
+        stream_bit_sizes_.assign(1, bit_size);
+        return true;
+    } else if ((tag & kStreamTagMask) == kStreamTag) {
+        shared_table_ = false;
+        const uint32_t version = tag & ~kStreamTagMask;
+        if (VERSION_BLOCKED == version) return ReadBlockIndex(buffer, size, size, header_size, output_size);
+        if (VERSION_CANONICAL != version && VERSION_INTERLEAVED != version) {
+            LOG_ERR << "unsupported stream version: " << version;
+            return false;
+        }
+        if (!ReadCodeLengths(buffer, size, table_size)) {
+            LOG_ERR << "read code lengths error.";
+            return false;
+        }
+        const char *pencode = pbegin + table_size;
+        uint64_t stream_count = 1;
+        if (!ReadVarint(pencode, pend, output_size)
+            || (VERSION_INTERLEAVED == version && !ReadVarint(pencode, pend, stream_count))) {
+            LOG_ERR << "read encode size error.";
+            return false;
+        }
+        if (stream_count < 1 || stream_count > kMaxInterleavedStreams) {
+            LOG_ERR << "stream count error. count:" << stream_count;
+            return false;
+        }
+        stream_bit_sizes_.resize(stream_count);
+        for (uint64_t &bit_size : stream_bit_sizes_) {
+            if (!ReadVarint(pencode, pend, bit_size)) {
+                LOG_ERR << "read encode size error.";
+                return false;
+            }
+        }
+        header_size = pencode - pbegin;
+    } else {
+        // VERSION_FREQ_MAP, the tree is rebuilt from frequencies
+        shared_table_ = false;
+        if (!ReadFreqMap(buffer, size, table_size)) {
+            LOG_ERR << "read frequency map error.";
+            return false;
+        }
+        if (!BuildTree() || !BuildCodesFromTree()) {
+            LOG_ERR << "build huffman tree error.";
+            return false;
+        }
+        // empty buffer
+        if (nullptr == root_) return true;
+        if (table_size + sizeof(uint64_t) > size) {
+            LOG_ERR << "encode buffer size error.";
+            return false;
+        }
+        stream_bit_sizes_.assign(1, *(const uint64_t*)(pbegin + table_size));
+        header_size = table_size + sizeof(uint64_t);
+        // the freq map holds the exact output size
+        for (int sym=0; sym<256; sym++) output_size += char_freq_[sym];
+    }
+
+    // every stream is byte aligned
+    uint64_t encode_bit_size = 0, encode_byte_size = 0;
+    for (uint64_t bit_size : stream_bit_sizes_) {
+        if (bit_size > (uint64_t)size*8) {
+            LOG_ERR << "check encode size error. bit size:" << bit_size;
+            return false;
+        }
+        encode_bit_size += bit_size;
+        encode_byte_size += (bit_size + 7)/8;
+    }
+    if (0 == output_size && 0 == encode_bit_size) return true;
+    // every symbol takes at least 1 bit
+    if (output_size > encode_bit_size || (size - header_size) < encode_byte_size) {
+        LOG_ERR << "check encode size error. output size:" << output_size << ", bit size:" << encode_bit_size;
+        return false;
+    }
+
+    if (!BuildDecodeTable()) {
+        LOG_ERR << "build huffman decode table error.";
+        return false;
+    }
+    return true;
+}
+
+/** @brief read header of VERSION_SHARED stream, the shared table is not changed
+ *  @param buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param header_size header size, encode bits follow the header
+ *  @param output_size decoded size
+ *  @param bit_size encode bit size
+ *  @return success or fail
+ */
+bool Huffman::ReadSharedHeader(const char *buffer, size_t size, size_t &header_size, uint64_t &output_size, uint64_t &bit_size) const {
+    header_size = 0, output_size = 0, bit_size = 0;
+    if (!shared_table_) {
+        LOG_ERR << "shared table is not set.";
+        return false;
+    }
+    if (size < sizeof(uint32_t) || (kStreamTag | VERSION_SHARED) != *(const uint32_t*)buffer) {
+        LOG_ERR << "check shared stream tag error.";
+        return false;
+    }
+    const char *pencode = buffer + sizeof(uint32_t), *pend = buffer + size;
+    if (!ReadVarint(pencode, pend, output_size) || !ReadVarint(pencode, pend, bit_size)) {
+        LOG_ERR << "read encode size error.";
+        return false;
+    }
+    header_size = pencode - buffer;
+    // the stream is byte aligned, every symbol takes at least 1 bit
+    if (bit_size > (uint64_t)size*8 || output_size > bit_size || (size - header_size) < (bit_size + 7)/8) {
+        LOG_ERR << "check encode size error. output size:" << output_size << ", bit size:" << bit_size;
+        return false;
+    }
+    return true;
+}
+
+/** @brief read block offset table of VERSION_BLOCKED stream into block_index_
+ *  @param buffer input encode buffer
+ *  @param size bytes of buffer, at least the header
+ *  @param stream_size encode buffer size, blocks are checked against it
+ *  @param header_size header size, blocks follow the header
+ *  @param output_size decoded size
+ *  @return success or fail
+ */
+bool Huffman::ReadBlockIndex(const char *buffer, size_t size, uint64_t stream_size, size_t &header_size, uint64_t &output_size) {
+    const char *pencode = buffer + sizeof(uint32_t), *pend = buffer + size;
+    uint64_t block_size = 0, block_count = 0;
+    if (!ReadVarint(pencode, pend, output_size) || !ReadVarint(pencode, pend, block_size)
+        || !ReadVarint(pencode, pend, block_count)) {
+        LOG_ERR << "read block header error.";
+        return false;
+    }
+    // every block holds at least a tag
+    if (0 == block_size || block_count > stream_size / sizeof(uint32_t) || block_count != output_size / block_size + (0 != output_size % block_size)) {
+        LOG_ERR << "check block header error. output size:" << output_size << ", block size:" << block_size
+                << ", block count:" << block_count;
+        return false;
+    }
+
+    std::vector<uint64_t> block_sizes(block_count);
+    for (uint64_t &encode_size : block_sizes) {
+        if (!ReadVarint(pencode, pend, encode_size)) {
+            LOG_ERR << "read block offset table error.";
+            return false;
+        }
+    }
+    header_size = pencode - buffer;
+    block_index_.block_size = block_size;
+    block_index_.offsets.resize(block_count + 1);
+    uint64_t offset = header_size;
+    for (size_t i=0; i<block_count; i++) {
+        block_index_.offsets[i] = offset;
+        if (block_sizes[i] > stream_size - offset) {
+            block_index_.offsets.clear();
+            LOG_ERR << "check block size error. block:" << i << ", size:" << block_sizes[i];
+            return false;
+        }
+        offset += block_sizes[i];
+    }
+    block_index_.offsets[block_count] = offset;
+    return true;
+}
+
+/** @brief read block offset table of a stream read in parts into block_index_
+ *  @param size encode buffer size
+ *  @param read_encode reads bytes of encode buffer, called with offset, size and output buffer
+ *  @param blocked output, the stream is VERSION_BLOCKED. nothing else is read from other streams
+ *  @param output_size decoded size of VERSION_BLOCKED stream
+ *  @return success or fail
+ */
+bool Huffman::ReadBlockIndex(uint64_t size, const std::function<bool(uint64_t, size_t, char *)> &read_encode,
+                             bool &blocked, uint64_t &output_size) {
+    blocked = false;
+    block_index_.offsets.clear();
+    std::vector<char> header((size_t)std::min(size, (uint64_t)kHeaderReadSize));
+    if (header.size() < sizeof(uint32_t)) return true;
+    if (!read_encode(0, header.size(), &header[0])) return false;
+    if ((kStreamTag | VERSION_BLOCKED) != *(const uint32_t*)&header[0]) return true;
+    blocked = true;
+
+    // the offset table of many blocks is longer than the bytes read first
+    const char *pencode = &header[0] + sizeof(uint32_t), *pend = &header[0] + header.size();
+    uint64_t value = 0, block_count = 0;
+    if (!ReadVarint(pencode, pend, value) || !ReadVarint(pencode, pend, value) || !ReadVarint(pencode, pend, block_count)
+        || block_count > size / sizeof(uint32_t)) {
+        LOG_ERR << "read block header error.";
+        return false;
+    }
+    const uint64_t header_size = std::min(size, (pencode - &header[0]) + block_count * kMaxVarintBytes);
+    if (header_size > header.size()) {
+        const size_t read_size = header.size();
+        header.resize(header_size);
+        if (!read_encode(read_size, header.size() - read_size, &header[read_size])) return false;
+    }
+    size_t table_size = 0;
+    return ReadBlockIndex(header.data(), header.size(), size, table_size, output_size);
+}
+
+/** @brief decode blocks [first, last) of block_index_ on thread_pool_
+ *  @param buffer input encode buffer
+ *  @param first first block
+ *  @param last end of blocks
+ *  @param output_size decoded size of the whole stream
+ *  @param output output buffer of the blocks, pre-sized
+ *  @param range_begin begin of decoded range in the whole stream, streams of blocks out of range are skipped
+ *  @param range_end end of decoded range in the whole stream
+ *  @return success or fail
+ */
+bool Huffman::DecodeBlocks(const char *buffer, size_t first, size_t last, uint64_t output_size, char *output,
+                           uint64_t range_begin, uint64_t range_end) {
+    const uint64_t block_size = block_index_.block_size;
+    const std::vector<uint64_t> &offsets = block_index_.offsets;
+    if (first > last || last >= offsets.size()) {
+        LOG_ERR << "block range error. first:" << first << ", last:" << last;
+        return false;
+    }
+    std::vector<char> success(last - first, 0);
+    auto decode_block = [&] (size_t i) {
+        const size_t block = first + i;
+        const uint64_t block_output_size = std::min(block_size, output_size - block * block_size);
+        Huffman huffman;
+        size_t header_size = 0;
+        uint64_t decode_size = 0;
+        const char *pblock = buffer + offsets[block];
+        const size_t size = offsets[block + 1] - offsets[block];
+        // blocks are not nested
+        if (!huffman.ReadHeader(pblock, size, header_size, decode_size) || !huffman.block_index_.offsets.empty()
+            || decode_size != block_output_size) {
+            LOG_ERR << "read block header error. block:" << block;
+            return;
+        }
+        // range relative to the block
+        const uint64_t block_begin = block * block_size;
+        const uint64_t begin = std::max(range_begin, block_begin) - block_begin;
+        const uint64_t end = std::min(range_end, block_begin + block_output_size) - block_begin;
+        success[i] = huffman.DecodeStreams(pblock + header_size, pblock + size, huffman.stream_bit_sizes_,
+                                           output + i * block_size, block_output_size, begin, end);
+    };
+    if (nullptr != thread_pool_) {
+        thread_pool_->ParallelFor(last - first, decode_block);
+    } else {
+        for (size_t i=0; i<last-first; i++) decode_block(i);
+    }
+    if (std::find(success.begin(), success.end(), 0) != success.end()) {
+        LOG_ERR << "decode block error.";
+        return false;
+    }
+    return true;
+}
+
+/** @brief build multi-level decode table from codes_
+ *  @return success or fail
+ */
+bool Huffman::BuildDecodeTable() {
+    decode_table_.clear();
+    max_code_len_ = 0;
+    primary_bits_ = 0;
+
+    std::vector<int> symbols;
+    for (int sym=0; sym<256; sym++) {
+        if (0 == codes_[sym].len) continue;
+        symbols.push_back(sym);
+        max_code_len_ = std::max(max_code_len_, (int)codes_[sym].len);
+    }
+    if (symbols.empty()) {
+        LOG_ERR << "no symbol in code table.";
+        return false;
+    }
+
+    primary_bits_ = std::min(max_code_len_, (int)kPrimaryTableBits);
+    DecodeEntry invalid = {0, 0, ENTRY_INVALID};
+    decode_table_.resize((size_t)1 << primary_bits_, invalid);
+    return BuildDecodeTableLevel(symbols, 0, primary_bits_, 0);
+}
+
+/** @brief fill a decode table level for codes sharing the same prefix
+ *  @param symbols symbols of the codes
+ *  @param consumed prefix bits resolved by upper levels
+ *  @param bits index bits of this level
+ *  @param offset offset of this level in decode table
+ *  @return success or fail
+ */
+bool Huffman::BuildDecodeTableLevel(const std::vector<int> &symbols, int consumed, int bits, size_t offset) {
+    const uint64_t mask = ((uint64_t)1 << bits) - 1;
+    // codes longer than this level, grouped by index
+    std::map<uint64_t, std::vector<int> > long_codes;
+    for (int sym : symbols) {
+        const HuffmanCode &code = codes_[sym];
+        const int remain = code.len - consumed;
+        const uint64_t index = (code.code >> consumed) & mask;
+        if (remain > bits) {
+            long_codes[index].push_back(sym);
+            continue;
+        }
+        // all indexes ending with the code resolve to the symbol
+        DecodeEntry entry = {(uint16_t)sym, (uint8_t)remain, ENTRY_SYMBOL};
+        for (uint64_t i = index; i <= mask; i += ((uint64_t)1 << remain)) {
+            decode_table_[offset + i] = entry;
+        }
+    }
+
+    for (auto &it : long_codes) {
+        int max_remain = 0;
+        for (int sym : it.second) max_remain = std::max(max_remain, (int)codes_[sym].len - consumed - bits);
+        const int sub_bits = std::min(max_remain, (int)kSubTableBits);
+        const size_t sub_offset = decode_table_.size();
+        if (sub_offset > 0xFFFF) {
+            LOG_ERR << "decode table size overflow.";
+            return false;
+        }
+        DecodeEntry invalid = {0, 0, ENTRY_INVALID};
+        decode_table_.resize(sub_offset + ((size_t)1 << sub_bits), invalid);
+        DecodeEntry link = {(uint16_t)sub_offset, (uint8_t)sub_bits, ENTRY_LINK};
+        decode_table_[offset + it.first] = link;
+        if (!BuildDecodeTableLevel(it.second, consumed + bits, sub_bits, sub_offset)) return false;
+    }
+    return true;
+}
+
+// resolve one symbol, sub tables are only visited by codes longer than primary_bits_
+#define DECODE_SYMBOL_(bit_buf, bit_count, out) { \
+    DecodeEntry e = table[bit_buf & primary_mask]; \
+    if (e.type != ENTRY_SYMBOL) { \
+        int width = primary_bits; \
+        while (e.type == ENTRY_LINK) { \
+            bit_buf >>= width; bit_count -= width; width = e.bits; \
+            e = table[e.value + (bit_buf & (((uint64_t)1 << width) - 1))]; \
+        } \
+        if (e.type != ENTRY_SYMBOL) { \
+            LOG_ERR << "invalid code in encode buffer."; \
+            return false; \
+        } \
+    } \
+    bit_buf >>= e.bits; bit_count -= e.bits; \
+    *out++ = (char)e.value; \
+}
+
+// fast path, refill at least 56 bits with a single 64bit load,
+// a refill holds 4 codes up to 14 bits, 2 codes up to 28 bits
+#define REFILL_BITS_(bit_buf, bit_count, pencode) { \
+    bit_buf |= *(const uint64_t*)pencode << bit_count; \
+    pencode += (63 - bit_count) >> 3; \
+    bit_count |= 56; \
+}
+
+/** @brief decode all streams, output is split into equal segments
+ *  @param pencode encode bits of the first stream
+ *  @param pencode_end end of encode buffer
+ *  @param bit_sizes bit sizes of streams
+ *  @param output output buffer, pre-sized
+ *  @param output_size output size
+ *  @param range_begin begin of decoded range, streams of segments out of range are skipped
+ *  @param range_end end of decoded range
+ *  @return success or fail
+ */
+bool Huffman::DecodeStreams(const char *pencode, const char *pencode_end, const std::vector<uint64_t> &bit_sizes,
+                            char *output, uint64_t output_size, uint64_t range_begin, uint64_t range_end) const {
+    const size_t stream_count = bit_sizes.size();
+    const uint64_t segment_size = (output_size + stream_count - 1)/stream_count;
+    std::vector<BitReader> readers(stream_count);
+    std::vector<char> skipped(stream_count, 0);
+    for (size_t i=0; i<stream_count; i++) {
+        const uint64_t begin = std::min(i*segment_size, output_size), end = std::min(begin + segment_size, output_size);
+        // streams after this one are readable, only the end of buffer is padded with zero bits
+        BitReader reader = {pencode, pencode, pencode_end, 0, 0, 0, bit_sizes[i], output + begin, output + end};
+        // segments are the seek points inside a stream, the fast path stops at an empty segment
+        if (begin < end && (end <= range_begin || begin >= range_end)) {
+            skipped[i] = 1;
+            reader.out_end = reader.out;
+        }
+        readers[i] = reader;
+        pencode += (bit_sizes[i] + 7)/8;
+    }
+
+    // interleaved fast path, 4 independent bit readers in one loop keep the cpu busy
+    // while each of them waits for its table lookups
+    if (max_code_len_ <= 14) {
+        const DecodeEntry *table = &decode_table_[0];
+        const int primary_bits = primary_bits_;
+        const uint64_t primary_mask = ((uint64_t)1 << primary_bits) - 1;
+        for (size_t i=0; i+4<=stream_count; i+=4) {
+            BitReader *r = &readers[i];
+            const char *p0 = r[0].pencode, *p1 = r[1].pencode, *p2 = r[2].pencode, *p3 = r[3].pencode;
+            uint64_t b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+            int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+            char *o0 = r[0].out, *o1 = r[1].out, *o2 = r[2].out, *o3 = r[3].out;
+            while (r[0].out_end - o0 >= 4 && r[1].out_end - o1 >= 4 && r[2].out_end - o2 >= 4 && r[3].out_end - o3 >= 4
+                   && pencode_end - p0 >= 8 && pencode_end - p1 >= 8 && pencode_end - p2 >= 8 && pencode_end - p3 >= 8) {
+                REFILL_BITS_(b0, c0, p0);
+                REFILL_BITS_(b1, c1, p1);
+                REFILL_BITS_(b2, c2, p2);
+                REFILL_BITS_(b3, c3, p3);
+                for (int n=0; n<4; n++) {
+                    DECODE_SYMBOL_(b0, c0, o0);
+                    DECODE_SYMBOL_(b1, c1, o1);
+                    DECODE_SYMBOL_(b2, c2, o2);
+                    DECODE_SYMBOL_(b3, c3, o3);
+                }
+            }
+            r[0].pencode = p0, r[1].pencode = p1, r[2].pencode = p2, r[3].pencode = p3;
+            r[0].bit_buf = b0, r[1].bit_buf = b1, r[2].bit_buf = b2, r[3].bit_buf = b3;
+            r[0].bit_count = c0, r[1].bit_count = c1, r[2].bit_count = c2, r[3].bit_count = c3;
+            r[0].out = o0, r[1].out = o1, r[2].out = o2, r[3].out = o3;
+        }
+    }
+
+    // the rest of each stream
+    for (size_t i=0; i<stream_count; i++) {
+        if (!skipped[i] && !DecodeBits(readers[i])) return false;
+    }
+    return true;
+}
+
+/** @brief decode the rest of a bit stream and check its bit size
+ *  @param reader bit stream decoder
+ *  @return success or fail
+ */
+bool Huffman::DecodeBits(BitReader &reader) const {
+    const DecodeEntry *table = &decode_table_[0];
+    const int primary_bits = primary_bits_, max_code_len = max_code_len_;
+    const uint64_t primary_mask = ((uint64_t)1 << primary_bits) - 1;
+    // keep the state in locals, stores to output may alias the reader
+    const char *pencode = reader.pencode, *pencode_end = reader.pencode_end;
+    char *out = reader.out, *out_end = reader.out_end;
+    uint64_t bit_buf = reader.bit_buf, pad_bits = reader.pad_bits;
+    int bit_count = reader.bit_count;
+
+    if (max_code_len <= 14) {
+        while (out_end - out >= 4 && pencode_end - pencode >= 8) {
+            REFILL_BITS_(bit_buf, bit_count, pencode);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+        }
+    } else if (max_code_len <= 28) {
+        while (out_end - out >= 2 && pencode_end - pencode >= 8) {
+            REFILL_BITS_(bit_buf, bit_count, pencode);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+        }
+    } else {
+        while (out < out_end && pencode_end - pencode >= 8) {
+            REFILL_BITS_(bit_buf, bit_count, pencode);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+        }
+    }
+
+    // tail, refill byte by byte, zero bits after the end of buffer
+    while (out < out_end) {
+        while (bit_count <= 56 && pencode < pencode_end) {
+            bit_buf |= (uint64_t)(uint8_t)*pencode++ << bit_count;
+            bit_count += 8;
+        }
+        if (bit_count < max_code_len) {
+            pad_bits += 64 - bit_count;
+            bit_count = 64;
+        }
+        DECODE_SYMBOL_(bit_buf, bit_count, out);
+    }
+
+    const uint64_t consumed_bits = (pencode - reader.pstart)*8 + pad_bits - bit_count;
+    if (consumed_bits != reader.encode_bit_size) {
+        LOG_ERR << "check encode bit size error. consumed:" << consumed_bits << ", bit size:" << reader.encode_bit_size;
+        return false;
+    }
+    return true;
+}
+
+/** @brief reset to decode a new stream, the shared table is kept
+ */
+void StreamDecoder::Reset() {
+    state_ = STATE_HEADER;
+    decode_table_ = &table_;
+    input_.clear();
+    input_pos_ = 0;
+    consumed_ = 0;
+    header_ready_ = false;
+    output_size_ = 0;
+    output_pos_ = 0;
+    block_size_ = 0;
+    block_ends_.clear();
+    block_ = 0;
+    bit_sizes_.clear();
+    unit_size_ = 0;
+    stream_ = 0;
+    symbols_left_ = 0;
+    bytes_left_ = 0;
+    bit_buf_ = 0;
+    bit_count_ = 0;
+    loaded_bits_ = 0;
+}
+
+/** @brief set shared table of VERSION_SHARED streams
+ *  @param huffman huffman with shared table, not owned
+ *  @return success or fail
+ */
+bool StreamDecoder::SetSharedTable(const Huffman *huffman) {
+    if (nullptr != huffman && !huffman->shared_table_) {
+        LOG_ERR << "shared table is not set.";
+        return false;
+    }
+    shared_table_ = huffman;
+    return true;
+}
+
+/** @brief get decoded size of the stream
+ *  @param output_size decoded size
+ *  @return false if the stream header is not decoded yet
+ */
+bool StreamDecoder::GetOutputSize(uint64_t &output_size) const {
+    output_size = output_size_;
+    return header_ready_;
+}
+
+/** @brief append input
+ *  @param data input chunk
+ *  @param size input chunk size
+ *  @return false if the decoder failed
+ */
+bool StreamDecoder::Push(const char *data, size_t size) {
+    if (STATE_ERROR == state_) return false;
+    // only the bytes not decoded yet are kept
+    if (input_pos_) {
+        input_.erase(input_.begin(), input_.begin() + input_pos_);
+        input_pos_ = 0;
+    }
+    input_.insert(input_.end(), data, data + size);
+    return true;
+}
+
+/** @brief read a varint of a buffer which may end inside the varint
+ *  @param ptr read pointer, moved after the varint
+ *  @param end end of buffer
+ *  @param val output value
+ *  @return 0 ok, 1 need more bytes, 2 error
+ */
+static inline int ParseVarint(const char *&ptr, const char *end, uint64_t &val) {
+    val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (ptr >= end) return 1;
+        const uint8_t byte = (uint8_t)*ptr++;
+        val |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return 2;
+}
+
+/** @brief parse header of a stream from input_, VERSION_BLOCKED is only allowed at top level
+ *  @param top_level top level stream or a block
+ *  @return PARSE_OK / PARSE_NEED_MORE / PARSE_ERROR
+ */
+StreamDecoder::ParseResult StreamDecoder::ParseHeader(bool top_level) {
+    const char *pbegin = input_.data() + input_pos_, *pend = input_.data() + input_.size();
+    const size_t size = pend - pbegin;
+    if (size < sizeof(uint32_t)) return PARSE_NEED_MORE;
+    const uint32_t tag = *(const uint32_t*)pbegin;
+    const uint32_t version = tag & ~Huffman::kStreamTagMask;
+    const bool tagged = (tag & Huffman::kStreamTagMask) == Huffman::kStreamTag;
+    const char *pencode = pbegin + sizeof(uint32_t);
+    uint64_t unit_size = 0, stream_count = 1;
+    int result = 0;
+    #define PARSE_VARINT_(val) { \
+        result = ParseVarint(pencode, pend, val); \
+        if (result) return 1 == result ? PARSE_NEED_MORE : PARSE_ERROR; \
+    }
+
+    decode_table_ = &table_;
+    if (tagged && VERSION_BLOCKED == version) {
+        if (!top_level) {
+            LOG_ERR << "blocks are nested.";
+            return PARSE_ERROR;
+        }
+        uint64_t block_count = 0;
+        PARSE_VARINT_(output_size_);
+        PARSE_VARINT_(block_size_);
+        PARSE_VARINT_(block_count);
+        if (0 == block_size_ || block_count != output_size_ / block_size_ + (0 != output_size_ % block_size_)) {
+            LOG_ERR << "check block header error. output size:" << output_size_ << ", block size:" << block_size_;
+            return PARSE_ERROR;
+        }
+        // the table is parsed again if it is not complete
+        std::vector<uint64_t> block_ends(block_count);
+        for (uint64_t &block_end : block_ends) PARSE_VARINT_(block_end);
+        const size_t header_size = pencode - pbegin;
+        uint64_t offset = consumed_ + header_size;
+        for (uint64_t &block_end : block_ends) block_end = offset += block_end;
+        block_ends_.swap(block_ends);
+        block_ = 0;
+        header_ready_ = true;
+        input_pos_ += header_size;
+        consumed_ += header_size;
+        state_ = block_ends_.empty() ? STATE_DONE : STATE_BLOCK_HEADER;
+        return PARSE_OK;
+    }
+
+    std::vector<uint64_t> bit_sizes;
+    if (tagged && VERSION_SHARED == version) {
+        if (!top_level || nullptr == shared_table_) {
+            LOG_ERR << "shared table is not set.";
+            return PARSE_ERROR;
+        }
+        decode_table_ = shared_table_;
+        bit_sizes.resize(1);
+        PARSE_VARINT_(unit_size);
+        PARSE_VARINT_(bit_sizes[0]);
+    } else if (tagged && (VERSION_CANONICAL == version || VERSION_INTERLEAVED == version)) {
+        // code lengths header size is known from its head
+        const size_t head_size = sizeof(uint32_t) + sizeof(uint8_t)*2 + sizeof(uint16_t);
+        if (size < head_size) return PARSE_NEED_MORE;
+        const uint8_t flags = (uint8_t)pbegin[sizeof(uint32_t) + 1];
+        const size_t count = *(const uint16_t*)(pbegin + sizeof(uint32_t) + 2);
+        const uint8_t layout = flags & Huffman::kLengthsLayoutMask;
+        const size_t symbols = (Huffman::LENGTHS_DENSE == layout) ? 256 : count;
+        const size_t symbols_size = (Huffman::LENGTHS_BITMAP == layout) ? 32 : (Huffman::LENGTHS_LIST == layout) ? count : 0;
+        const size_t table_size = head_size + symbols_size + ((flags & Huffman::kLengthsNibble) ? (symbols + 1)/2 : symbols);
+        if (size < table_size) return PARSE_NEED_MORE;
+        size_t read_size = 0;
+        if (!table_.ReadCodeLengths(pbegin, table_size, read_size) || read_size != table_size) {
+            LOG_ERR << "read code lengths error.";
+            return PARSE_ERROR;
+        }
+        pencode = pbegin + table_size;
+        PARSE_VARINT_(unit_size);
+        if (VERSION_INTERLEAVED == version) PARSE_VARINT_(stream_count);
+        if (stream_count < 1 || stream_count > Huffman::kMaxInterleavedStreams) {
+            LOG_ERR << "stream count error. count:" << stream_count;
+            return PARSE_ERROR;
+        }
+        bit_sizes.resize(stream_count);
+        for (uint64_t &bit_size : bit_sizes) PARSE_VARINT_(bit_size);
+    } else if (!tagged && top_level) {
+        // VERSION_FREQ_MAP, the tree is rebuilt from frequencies
+        const int char_count = *(const int*)pbegin;
+        if (char_count < 0 || char_count > 256) {
+            LOG_ERR << "char count error. char count:" << char_count;
+            return PARSE_ERROR;
+        }
+        const size_t table_size = sizeof(int) + (sizeof(char) + sizeof(int))*char_count;
+        if (size < table_size + sizeof(uint64_t)) return PARSE_NEED_MORE;
+        size_t read_size = 0;
+        if (!table_.ReadFreqMap(pbegin, table_size, read_size) || !table_.BuildTree() || !table_.BuildCodesFromTree()) {
+            LOG_ERR << "build huffman tree error.";
+            return PARSE_ERROR;
+        }
+        for (int sym=0; sym<256; sym++) unit_size += table_.char_freq_[sym];
+        bit_sizes.assign(1, *(const uint64_t*)(pbegin + table_size));
+        pencode = pbegin + table_size + sizeof(uint64_t);
+    } else {
+        LOG_ERR << "unsupported stream version: " << version;
+        return PARSE_ERROR;
+    }
+    #undef PARSE_VARINT_
+
+    // every symbol takes at least 1 bit
+    const size_t header_size = pencode - pbegin;
+    uint64_t encode_bit_size = 0, encode_byte_size = 0;
+    for (uint64_t bit_size : bit_sizes) {
+        if (bit_size > ((uint64_t)1 << 61)) {
+            LOG_ERR << "check encode size error. bit size:" << bit_size;
+            return PARSE_ERROR;
+        }
+        encode_bit_size += bit_size;
+        encode_byte_size += (bit_size + 7)/8;
+    }
+    if (unit_size > encode_bit_size) {
+        LOG_ERR << "check encode size error. output size:" << unit_size << ", bit size:" << encode_bit_size;
+        return PARSE_ERROR;
+    }
+    if (top_level) {
+        output_size_ = unit_size;
+        header_ready_ = true;
+    } else {
+        // a block holds its header and bit streams
+        const uint64_t block_output_size = std::min(block_size_, output_size_ - block_ * block_size_);
+        if (unit_size != block_output_size || consumed_ + header_size + encode_byte_size != block_ends_[block_]) {
+            LOG_ERR << "check block error. block:" << block_ << ", output size:" << unit_size;
+            return PARSE_ERROR;
+        }
+    }
+    if (unit_size && decode_table_ == &table_ && !table_.BuildDecodeTable()) {
+        LOG_ERR << "build huffman decode table error.";
+        return PARSE_ERROR;
+    }
+    input_pos_ += header_size;
+    consumed_ += header_size;
+    bit_sizes_.swap(bit_sizes);
+    unit_size_ = unit_size;
+    stream_ = 0;
+    state_ = STATE_BITS;
+    const uint64_t segment_size = (unit_size_ + bit_sizes_.size() - 1)/bit_sizes_.size();
+    symbols_left_ = std::min(segment_size, unit_size_);
+    bytes_left_ = (bit_sizes_[0] + 7)/8;
+    bit_buf_ = 0, bit_count_ = 0, loaded_bits_ = 0;
+    return PARSE_OK;
+}
+
+/** @brief start the next bit stream of the current header, or leave STATE_BITS
+ *  @return success or fail
+ */
+bool StreamDecoder::NextStream() {
+    // the finished stream is fully consumed
+    if (bytes_left_ || loaded_bits_ - bit_count_ != bit_sizes_[stream_]) {
+        LOG_ERR << "check encode bit size error. consumed:" << loaded_bits_ - bit_count_ << ", bit size:" << bit_sizes_[stream_];
+        return false;
+    }
+    stream_++;
+    if (stream_ < bit_sizes_.size()) {
+        const uint64_t segment_size = (unit_size_ + bit_sizes_.size() - 1)/bit_sizes_.size();
+        const uint64_t begin = std::min(stream_ * segment_size, unit_size_);
+        symbols_left_ = std::min(begin + segment_size, unit_size_) - begin;
+        bytes_left_ = (bit_sizes_[stream_] + 7)/8;
+        bit_buf_ = 0, bit_count_ = 0, loaded_bits_ = 0;
+        return true;
+    }
+    if (block_ends_.empty()) {
+        state_ = STATE_DONE;
+        return true;
+    }
+    block_++;
+    state_ = (block_ < block_ends_.size()) ? STATE_BLOCK_HEADER : STATE_DONE;
+    return true;
+}
+
+/** @brief decode symbols of the current bit stream
+ *  @param out output pointer, moved after the decoded symbols
+ *  @param out_end end of output buffer
+ *  @return success or fail
+ */
+bool StreamDecoder::DecodeSymbols(char *&out, char *out_end) {
+    typedef Huffman::DecodeEntry DecodeEntry;
+    const Huffman::DecodeEntryType ENTRY_SYMBOL = Huffman::ENTRY_SYMBOL, ENTRY_LINK = Huffman::ENTRY_LINK;
+    const DecodeEntry *table = &decode_table_->decode_table_[0];
+    const int primary_bits = decode_table_->primary_bits_, max_code_len = decode_table_->max_code_len_;
+    const uint64_t primary_mask = ((uint64_t)1 << primary_bits) - 1;
+    const char *in = input_.data() + input_pos_, *in_begin = in, *in_end = input_.data() + input_.size();
+    uint64_t bit_buf = bit_buf_, symbols_left = symbols_left_, bytes_left = bytes_left_, loaded_bits = loaded_bits_;
+    int bit_count = bit_count_;
+
+    // fast path, 64bit refills inside the stream, 4 codes up to 14 bits for each refill
+    if (max_code_len <= 14) {
+        while (symbols_left >= 4 && out_end - out >= 4 && bytes_left >= 8 && in_end - in >= 8) {
+            const int bytes = (63 - bit_count) >> 3;
+            bit_buf |= *(const uint64_t*)in << bit_count;
+            in += bytes, bytes_left -= bytes, loaded_bits += bytes*8;
+            bit_count |= 56;
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            symbols_left -= 4;
+        }
+    }
+
+    // refill byte by byte, zero bits after the end of stream
+    while (symbols_left && out < out_end) {
+        while (bit_count <= 56 && bytes_left && in < in_end) {
+            bit_buf |= (uint64_t)(uint8_t)*in++ << bit_count;
+            bit_count += 8, bytes_left--, loaded_bits += 8;
+        }
+        if (bit_count < max_code_len) {
+            if (bytes_left) break;  // wait for input
+            loaded_bits += 64 - bit_count;
+            bit_count = 64;
+        }
+        while (symbols_left && out < out_end && bit_count >= max_code_len) {
+            DECODE_SYMBOL_(bit_buf, bit_count, out);
+            symbols_left--;
+        }
+    }
+
+    input_pos_ += in - in_begin;
+    consumed_ += in - in_begin;
+    bit_buf_ = bit_buf, bit_count_ = bit_count, symbols_left_ = symbols_left, bytes_left_ = bytes_left, loaded_bits_ = loaded_bits;
+    return true;
+}
+
+/** @brief decode input pushed so far
+ *  @param output output buffer
+ *  @param capacity output buffer size
+ *  @param size output size, 0 if more input is needed or the stream is done
+ *  @return success or fail
+ */
+bool StreamDecoder::Pull(char *output, size_t capacity, size_t &size) {
+    size = 0;
+    char *out = output, *out_end = output + capacity;
+    bool ok = true;
+    while (ok) {
+        if (STATE_HEADER == state_ || STATE_BLOCK_HEADER == state_) {
+            const ParseResult result = ParseHeader(STATE_HEADER == state_);
+            if (PARSE_NEED_MORE == result) break;
+            ok = (PARSE_OK == result);
+        } else if (STATE_BITS == state_) {
+            // bytes of a finished stream are all loaded, the next stream starts at the next byte
+            if (0 == symbols_left_) {
+                ok = NextStream();
+                continue;
+            }
+            if (out == out_end) break;
+            ok = DecodeSymbols(out, out_end);
+            // more input is needed
+            if (ok && symbols_left_ && out < out_end) break;
+        } else {
+            ok = (STATE_DONE == state_);
+            break;
+        }
+    }
+    if (!ok) {
+        state_ = STATE_ERROR;
+        return false;
+    }
+    size = out - output;
+    output_pos_ += size;
+    return true;
+}
+
+#undef REFILL_BITS_
+#undef DECODE_SYMBOL_
+
 }  // namespace huffman
@@ -9,6 +9,54 @@
  *    Huffman huffman;
  *    huffman.Decode(stream_buffer, encode_buffer);
  *
+ *  3. large buffers, blocks are encoded/decoded on a thread pool
+ *    utility::ThreadPool pool;
+ *    Huffman huffman;
+ *    huffman.SetStreamVersion(VERSION_BLOCKED);
+ *    huffman.SetThreadPool(&pool);
+ *    huffman.Encode(stream_buffer, encode_buffer);
+ *    huffman.DecodeRange(encode_buffer, offset, length, stream_buffer);  // only blocks of the range
+ *
+ *  4. small buffers, one table trained from samples is shared by all of them
+ *    Huffman trainer;
+ *    trainer.TrainSharedTable(samples, table_buffer);  // stored once by the caller
+ *    Huffman huffman;
+ *    huffman.SetSharedTable(table_buffer);  // decode table is built once
+ *    huffman.SetStreamVersion(VERSION_SHARED);
+ *    huffman.Encode(stream_buffer, encode_buffer);
+ *    huffman.Decode(encode_buffer, stream_buffer);
+ *
+ *  5. decode a stream incrementally, input and output are chunks of any size
+ *    StreamDecoder decoder;
+ *    decoder.Push(chunk, chunk_size);  // more input
+ *    decoder.Pull(output, capacity, output_size);  // decoded bytes of the input pushed so far
+ *    decoder.Done();  // whole stream decoded and checked
+ *
+ *  Stream versions:
+ *    VERSION_FREQ_MAP   int(char count) | (char, int(freq))* | uint64(encode_bit_size) | encode bits
+ *    VERSION_CANONICAL  uint32(tag | version) | uint8(max code len) | uint8(flags) | uint16(symbol count)
+ *                       | code lengths | varint(output size) | varint(encode_bit_size) | encode bits
+ *    VERSION_INTERLEAVED  canonical code lengths header | varint(output size) | varint(stream count)
+ *                       | varint(encode_bit_size)* | encode bits of each stream (byte aligned)
+ *    VERSION_BLOCKED    uint32(tag | version) | varint(output size) | varint(block size) | varint(block count)
+ *                       | varint(encode block size)* | VERSION_INTERLEAVED stream of each block
+ *    VERSION_SHARED     uint32(tag | version) | varint(output size) | varint(encode_bit_size) | encode bits
+ *    shared table       canonical code lengths header of VERSION_SHARED, every symbol has a code
+ *    VERSION_INTERLEAVED splits the input into `stream count` equal segments coded with the same table,
+ *    the bit sizes are the jump table of streams, the decoder runs 4 bit readers in one loop.
+ *    VERSION_BLOCKED splits the input into blocks with their own code table, blocks are independent
+ *    so that they are coded in parallel and a range is decoded from the blocks covering it.
+ *    streams coded block by block (EncodeBlock) pad the encode block sizes to fixed width varints,
+ *    the header is reserved before the blocks and rewritten in place when their sizes are known.
+ *    VERSION_SHARED streams carry no code table, they are coded with the table set by SetSharedTable.
+ *    code lengths of VERSION_CANONICAL are stored in the smallest of 3 layouts:
+ *      LENGTHS_DENSE   256 lengths
+ *      LENGTHS_BITMAP  32 bytes symbol bitmap | lengths of present symbols
+ *      LENGTHS_LIST    symbols | lengths of the symbols
+ *    lengths are packed as nibbles (low nibble first) if max code len <= 15, bytes otherwise.
+ *    codes of VERSION_CANONICAL are length-limited (package-merge), 11 bits by default, so that
+ *    decoding takes a single table lookup; the max code len of the header bounds the decode depth.
+ *
  */
 
 #pragma once
@@ -18,24 +66,37 @@
 #include <map>
 #include <algorithm>
 #include <cstring>
+#include <cstdint>
 #include <cassert>
 #include <stdexcept>
 #include "log.h"
+#include "thread-pool.h"
 
 namespace huffman {
 
+enum StreamVersion {
+    VERSION_FREQ_MAP  = 0,  // frequency map header, the tree is rebuilt from frequencies
+    VERSION_CANONICAL = 1,  // canonical huffman, only code lengths are stored
+    VERSION_INTERLEAVED = 2,  // canonical huffman, input is split into independently coded streams
+    VERSION_BLOCKED = 3,  // independent VERSION_INTERLEAVED blocks with a block offset table
+    VERSION_SHARED = 4  // canonical huffman without code table, coded with a shared table
+};
+
+class StreamDecoder;
+
 class Huffman {
+    friend class StreamDecoder;
 
     // Huffman Tree Node
     struct HuffmanTree {
         char ch;
-        int freq; // frequency of ch
+        uint64_t freq; // frequency of ch
         HuffmanTree *left;
         HuffmanTree *right;
 
         // constructed functions
-        HuffmanTree(char ch, int freq) : ch(ch), freq(freq), left(nullptr), right(nullptr) {}
-        HuffmanTree(char ch, int freq, HuffmanTree *left, HuffmanTree *right) : ch(ch), freq(freq), left(left), right(right) {}
+        HuffmanTree(char ch, uint64_t freq) : ch(ch), freq(freq), left(nullptr), right(nullptr) {}
+        HuffmanTree(char ch, uint64_t freq, HuffmanTree *left, HuffmanTree *right) : ch(ch), freq(freq), left(left), right(right) {}
 
         // free left child and right child
         ~HuffmanTree() {
@@ -52,34 +113,235 @@ class Huffman {
             }
     };
 
-    typedef std::vector<bool> huffman_code_t;
-    typedef std::map<char, huffman_code_t> huffman_code_table_t;
+private:
+    // code of a symbol, bits are kept in stream order (the first bit at bit 0)
+    struct HuffmanCode {
+        uint64_t code;
+        uint32_t len;  // 0 if the symbol is not used
+    };
+
+    // decode table entry, a symbol or a link to a sub table
+    struct DecodeEntry {
+        uint16_t value;  // symbol, or offset of the sub table
+        uint8_t bits;  // code bits of the symbol at this level, or index bits of the sub table
+        uint8_t type;  // ENTRY_INVALID / ENTRY_SYMBOL / ENTRY_LINK
+    };
+
+    enum DecodeEntryType {
+        ENTRY_INVALID = 0,
+        ENTRY_SYMBOL  = 1,
+        ENTRY_LINK    = 2
+    };
+
+    // state of a bit stream decoder
+    struct BitReader {
+        const char *pstart;  // first byte of the bit stream
+        const char *pencode;  // next byte to load
+        const char *pencode_end;  // end of readable buffer
+        uint64_t bit_buf;
+        int bit_count;
+        uint64_t pad_bits;  // zero bits padded after pencode_end
+        uint64_t encode_bit_size;
+        char *out;
+        char *out_end;
+    };
+
+    // block offset table of VERSION_BLOCKED streams
+    struct BlockIndex {
+        uint64_t block_size;  // output size of a block, the last one may be smaller
+        std::vector<uint64_t> offsets;  // block offsets in encode buffer, block count + 1
+    };
+
+    static const int kPrimaryTableBits = 11;  // bits resolved by the primary decode table
+    static const int kSubTableBits = 8;  // max index bits of a sub table
+    static const int kMaxCodeLength = 56;  // a refilled bit buffer always holds a whole code
+    static const int kMinCodeLengthLimit = 8;  // 256 symbols fit 8 bits
+    static const int kDefaultCodeLengthLimit = kPrimaryTableBits;  // single level decode table
+    static const int kDefaultInterleavedStreams = 4;  // streams of VERSION_INTERLEAVED
+    static const int kMaxInterleavedStreams = 256;
+    static const uint64_t kDefaultBlockSize = 1 << 20;  // block size of VERSION_BLOCKED
+    static const uint64_t kMinBlockSize = 4 << 10;
+    static const int kPaddedVarintBytes = 5;  // encode block sizes of WriteBlockHeader, up to 32GB
+    static const int kMaxVarintBytes = 10;  // varint of 64 bits
+    static const size_t kHeaderReadSize = 4 << 10;  // bytes read first for the header of a stream read in parts
+
+    static const uint32_t kStreamTag = 0x48554600;  // "\0FUH", low 8 bits is the stream version
+    static const uint32_t kStreamTagMask = 0xFFFFFF00;
+
+    // code lengths layout of VERSION_CANONICAL
+    enum LengthsLayout {
+        LENGTHS_DENSE  = 0,
+        LENGTHS_BITMAP = 1,
+        LENGTHS_LIST   = 2
+    };
+    static const uint8_t kLengthsLayoutMask = 0x03;
+    static const uint8_t kLengthsNibble = 0x04;  // flag, lengths are packed as nibbles
 
 public:
-    Huffman() : root_(nullptr) {}
+    Huffman() : root_(nullptr), stream_version_(VERSION_CANONICAL), code_length_limit_(kDefaultCodeLengthLimit),
+                interleaved_streams_(kDefaultInterleavedStreams), block_size_(kDefaultBlockSize), thread_pool_(nullptr),
+                shared_table_(false), max_code_len_(0), primary_bits_(0) {
+        memset(char_freq_, 0, sizeof(char_freq_));
+    }
     ~Huffman() { if (nullptr != root_) delete root_, root_ = nullptr; }
 
+    /** @brief set version of encoded streams, VERSION_CANONICAL by default
+     *  @param version stream version
+     */
+    void SetStreamVersion(StreamVersion version) { stream_version_ = version; }
+
+    /** @brief set max code length of VERSION_CANONICAL streams, 11 by default
+     *  @param max_code_length max code length (8 ~ 56), codes up to 11 bits decode with a single
+     *      table lookup, up to 19 bits with two lookups. VERSION_FREQ_MAP streams are not limited.
+     */
+    void SetMaxCodeLength(int max_code_length) {
+        code_length_limit_ = std::max((int)kMinCodeLengthLimit, std::min(max_code_length, (int)kMaxCodeLength));
+    }
+
+    /** @brief set stream count of VERSION_INTERLEAVED streams, 4 by default
+     *  @param stream_count stream count (1 ~ 256)
+     */
+    void SetInterleavedStreams(int stream_count) {
+        interleaved_streams_ = std::max(1, std::min(stream_count, (int)kMaxInterleavedStreams));
+    }
+
+    /** @brief set block size of VERSION_BLOCKED streams, 1MB by default
+     *  @param block_size output size of a block (>= 4KB)
+     */
+    void SetBlockSize(uint64_t block_size) { block_size_ = std::max(block_size, (uint64_t)kMinBlockSize); }
+
+    /** @brief set thread pool for blocks of VERSION_BLOCKED streams, blocks are coded in the calling thread by default
+     *  @param thread_pool thread pool, not owned
+     */
+    void SetThreadPool(utility::ThreadPool *thread_pool) { thread_pool_ = thread_pool; }
+
+    /** @brief train a shared table from sample buffers, symbols absent from samples get long codes
+     *      so that any buffer can be coded, the table is set as the shared table
+     *  @param samples sample buffers
+     *  @param table_buffer output table buffer
+     *  @return success or fail
+     */
+    bool TrainSharedTable(const std::vector<std::vector<char> > &samples, std::vector<char> &table_buffer);
+
+    /** @brief set shared table of VERSION_SHARED streams, codes and decode table are built once,
+     *      the shared table is dropped by encoding or decoding streams of other versions
+     *  @param table_buffer table buffer of TrainSharedTable
+     *  @return success or fail
+     */
+    bool SetSharedTable(const std::vector<char> &table_buffer);
+
     /** @brief encode a stream buffer use huffman
      *  @param stream_buffer input stream buffer
-     *  @param encode_buffer outout encode buffer, code table | int(encode_bit_size) | encode buffer
+     *  @param encode_buffer outout encode buffer, code table | encode_bit_size | encode buffer
      *  @return success or fail
      */
     bool Encode(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer);
 
+    /** @brief encode one block of a VERSION_BLOCKED stream coded block by block, safe to call from many threads at once
+     *  @param input input block, block size of SetBlockSize except the last block
+     *  @param size input size
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool EncodeBlock(const char *input, size_t size, std::vector<char> &encode_buffer) const;
+
+    /** @brief write header and block offset table of a VERSION_BLOCKED stream coded block by block,
+     *      the header size only depends on the output size, blocks follow the header
+     *  @param output_size decoded size of the whole stream
+     *  @param block_sizes encode sizes of blocks, zeros to reserve the header before the blocks are coded
+     *  @param encode_buffer output header
+     *  @return success or fail
+     */
+    bool WriteBlockHeader(uint64_t output_size, const std::vector<uint64_t> &block_sizes, std::vector<char> &encode_buffer) const;
+
     /** @brief decode a compressed buffer use huffman
      *  @param encode_buffer input encode buffer
      *  @param stream_buffer outout stream buffer
      *  @return success or fail
      */
     template<typename streambuf_t>
-    bool Decode(const std::vector<char> &encode_buffer, streambuf_t &stream_buffer);
+    bool Decode(const std::vector<char> &encode_buffer, streambuf_t &stream_buffer) {
+        return Decode(encode_buffer.data(), encode_buffer.size(), stream_buffer);
+    }
+
+    /** @brief decode a compressed buffer use huffman, the buffer may be a view of a mapped file
+     *  @param encode_buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool Decode(const char *encode_buffer, size_t size, streambuf_t &stream_buffer);
+
+    /** @brief decode a VERSION_SHARED stream with the table set by SetSharedTable, the table is not changed,
+     *      so one table decodes streams of many threads at once
+     *  @param encode_buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool DecodeShared(const char *encode_buffer, size_t size, streambuf_t &stream_buffer) const;
+
+    /** @brief decode a range of a compressed buffer, VERSION_BLOCKED streams only decode the blocks of the range
+     *  @param encode_buffer input encode buffer
+     *  @param offset offset in decoded buffer
+     *  @param length length of range, cut at the end of decoded buffer
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool DecodeRange(const std::vector<char> &encode_buffer, uint64_t offset, uint64_t length, streambuf_t &stream_buffer) {
+        return DecodeRange(encode_buffer.data(), encode_buffer.size(), offset, length, stream_buffer);
+    }
+
+    /** @brief decode a range of a compressed buffer, the buffer may be a view of a mapped file
+     *  @param encode_buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param offset offset in decoded buffer
+     *  @param length length of range, cut at the end of decoded buffer
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool DecodeRange(const char *encode_buffer, size_t size, uint64_t offset, uint64_t length, streambuf_t &stream_buffer);
+
+    /** @brief decode a range of a compressed buffer read in parts, VERSION_BLOCKED streams only read the header and
+     *      the blocks of the range, block boundaries are the seek points. other streams are read whole
+     *  @param size encode buffer size
+     *  @param read_encode reads bytes of encode buffer, called with offset, size and output buffer
+     *  @param offset offset in decoded buffer
+     *  @param length length of range, cut at the end of decoded buffer
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool DecodeRange(uint64_t size, const std::function<bool(uint64_t, size_t, char *)> &read_encode,
+                     uint64_t offset, uint64_t length, streambuf_t &stream_buffer);
 
 private:
+    /** @brief encode a buffer as a single stream of stream_version_
+     *  @param input input buffer
+     *  @param size input size
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool EncodeStream(const char *input, size_t size, std::vector<char> &encode_buffer);
+
+    /** @brief encode a buffer as VERSION_BLOCKED stream, blocks are encoded on thread_pool_
+     *  @param input input buffer
+     *  @param size input size
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool EncodeBlocks(const char *input, size_t size, std::vector<char> &encode_buffer);
+
     /** @brief build frequency map
-     *  @param stream_buffer input stream buffer
+     *  @param input input buffer
+     *  @param size input size
      *  @return success or fail
      */
-    bool BuildFreqMap(const std::vector<char> &stream_buffer);
+    bool BuildFreqMap(const char *input, size_t size);
 
     /** @brief write frequency map to compressed buffer
      *  @param encode_buffer output encode buffer
@@ -88,108 +350,396 @@ private:
     bool WriteFreqMap(std::vector<char> &encode_buffer);
 
     /** @brief read frequency map from compressed buffer
-     *  @param encode_buffer input encode buffer
+     *  @param buffer input encode buffer
+     *  @param size encode buffer size
      *  @param table_size freq table size
      *  @return success or fail
      */
-    bool ReadFreqMap(const std::vector<char> &encode_buffer, size_t &table_size);
+    bool ReadFreqMap(const char *buffer, size_t size, size_t &table_size);
 
     /** @brief build a Huffman Tree
      *  @return success or fail
      */
     bool BuildTree();
 
-    /** @brief build code table
-     *  @param htree huffman tree
+    /** @brief collect codes of huffman tree into codes_
+     *  @return success or fail
+     */
+    bool BuildCodesFromTree();
+
+    /** @brief build length-limited code lengths from frequencies with package-merge
+     *  @param max_code_length max code length
+     *  @return success or fail
+     */
+    bool BuildLimitedCodeLengths(int max_code_length);
+
+    /** @brief assign canonical codes from code lengths in codes_
+     *  @return success or fail
+     */
+    bool BuildCanonicalCodes();
+
+    /** @brief write code lengths header of canonical stream
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool WriteCodeLengths(std::vector<char> &encode_buffer);
+
+    /** @brief read code lengths header of canonical stream
+     *  @param buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param table_size code lengths header size
+     *  @return success or fail
+     */
+    bool ReadCodeLengths(const char *buffer, size_t size, size_t &table_size);
+
+    /** @brief read stream header and build decode table, bit sizes of streams are kept in stream_bit_sizes_,
+     *      the block offset table of VERSION_BLOCKED streams is kept in block_index_
+     *  @param buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param header_size header size, encode bits follow the header
+     *  @param output_size decoded size
+     *  @return success or fail
+     */
+    bool ReadHeader(const char *buffer, size_t size, size_t &header_size, uint64_t &output_size);
+
+    /** @brief read block offset table of VERSION_BLOCKED stream into block_index_
+     *  @param buffer input encode buffer
+     *  @param size bytes of buffer, at least the header
+     *  @param stream_size encode buffer size, blocks are checked against it
+     *  @param header_size header size, blocks follow the header
+     *  @param output_size decoded size
+     *  @return success or fail
+     */
+    bool ReadBlockIndex(const char *buffer, size_t size, uint64_t stream_size, size_t &header_size, uint64_t &output_size);
+
+    /** @brief read block offset table of a stream read in parts into block_index_
+     *  @param size encode buffer size
+     *  @param read_encode reads bytes of encode buffer, called with offset, size and output buffer
+     *  @param blocked output, the stream is VERSION_BLOCKED. nothing else is read from other streams
+     *  @param output_size decoded size of VERSION_BLOCKED stream
+     *  @return success or fail
+     */
+    bool ReadBlockIndex(uint64_t size, const std::function<bool(uint64_t, size_t, char *)> &read_encode,
+                        bool &blocked, uint64_t &output_size);
+
+    /** @brief decode blocks [first, last) of block_index_ on thread_pool_
+     *  @param buffer input encode buffer
+     *  @param first first block
+     *  @param last end of blocks
+     *  @param output_size decoded size of the whole stream
+     *  @param output output buffer of the blocks, pre-sized
+     *  @param range_begin begin of decoded range in the whole stream, streams of blocks out of range are skipped
+     *  @param range_end end of decoded range in the whole stream
+     *  @return success or fail
      */
-    bool BuildCodeTable();
+    bool DecodeBlocks(const char *buffer, size_t first, size_t last, uint64_t output_size, char *output,
+                      uint64_t range_begin=0, uint64_t range_end=UINT64_MAX);
+
+    /** @brief read header of VERSION_SHARED stream, the shared table is not changed
+     *  @param buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param header_size header size, encode bits follow the header
+     *  @param output_size decoded size
+     *  @param bit_size encode bit size
+     *  @return success or fail
+     */
+    bool ReadSharedHeader(const char *buffer, size_t size, size_t &header_size, uint64_t &output_size, uint64_t &bit_size) const;
+
+    /** @brief encode symbols with codes_, 64bit words are written to output
+     *  @param input input symbols
+     *  @param size input size
+     *  @param pencode output buffer, holds encode bits and 8 bytes of slack
+     *  @return encode bit size
+     */
+    uint64_t EncodeBits(const char *input, size_t size, char *pencode);
+
+    /** @brief build multi-level decode table from codes_
+     *  @return success or fail
+     */
+    bool BuildDecodeTable();
+
+    /** @brief fill a decode table level for codes sharing the same prefix
+     *  @param symbols symbols of the codes
+     *  @param consumed prefix bits resolved by upper levels
+     *  @param bits index bits of this level
+     *  @param offset offset of this level in decode table
+     *  @return success or fail
+     */
+    bool BuildDecodeTableLevel(const std::vector<int> &symbols, int consumed, int bits, size_t offset);
+
+    /** @brief decode all streams, output is split into equal segments
+     *  @param pencode encode bits of the first stream
+     *  @param pencode_end end of encode buffer
+     *  @param bit_sizes bit sizes of streams
+     *  @param output output buffer, pre-sized
+     *  @param output_size output size
+     *  @param range_begin begin of decoded range, streams of segments out of range are skipped
+     *  @param range_end end of decoded range
+     *  @return success or fail
+     */
+    bool DecodeStreams(const char *pencode, const char *pencode_end, const std::vector<uint64_t> &bit_sizes,
+                       char *output, uint64_t output_size, uint64_t range_begin=0, uint64_t range_end=UINT64_MAX) const;
+
+    /** @brief decode the rest of a bit stream and check its bit size
+     *  @param reader bit stream decoder
+     *  @return success or fail
+     */
+    bool DecodeBits(BitReader &reader) const;
 
 private:
     HuffmanTree *root_;
-    huffman_code_table_t code_table_;
-    std::map<char, int> char_freq_map_;
+    StreamVersion stream_version_;  // version of encoded streams
+    int code_length_limit_;  // max code length of VERSION_CANONICAL streams
+    int interleaved_streams_;  // stream count of VERSION_INTERLEAVED streams
+    uint64_t block_size_;  // block size of VERSION_BLOCKED streams
+    utility::ThreadPool *thread_pool_;  // not owned, nullptr for the calling thread
+    bool shared_table_;  // codes_ and decode_table_ hold the shared table
+    std::vector<uint64_t> stream_bit_sizes_;  // bit sizes of streams to decode
+    BlockIndex block_index_;  // block offset table of the VERSION_BLOCKED stream to decode
+    uint64_t char_freq_[256];  // frequency of symbols, indexed by (uint8_t)ch
+    HuffmanCode codes_[256];  // flat code table, indexed by (uint8_t)ch
+    int max_code_len_;  // max code length in codes_
+    int primary_bits_;  // index bits of the primary decode table
+    std::vector<DecodeEntry> decode_table_;  // primary table followed by sub tables
+};
+
+/**
+ *  Resumable decoder of all stream versions. Input is pushed in chunks, only the bytes not decoded yet
+ *  are kept; output is pulled in chunks, code tables are kept across calls.
+ */
+class StreamDecoder {
+    enum State {
+        STATE_HEADER       = 0,  // wait for stream header
+        STATE_BLOCK_HEADER = 1,  // wait for header of the next block of VERSION_BLOCKED stream
+        STATE_BITS         = 2,  // decode bit streams of the current header
+        STATE_DONE         = 3,
+        STATE_ERROR        = 4
+    };
+
+    enum ParseResult {
+        PARSE_OK        = 0,
+        PARSE_NEED_MORE = 1,
+        PARSE_ERROR     = 2
+    };
+
+public:
+    StreamDecoder() : shared_table_(nullptr) { Reset(); }
+
+    /** @brief reset to decode a new stream, the shared table is kept
+     */
+    void Reset();
+
+    /** @brief set shared table of VERSION_SHARED streams
+     *  @param huffman huffman with shared table, not owned
+     *  @return success or fail
+     */
+    bool SetSharedTable(const Huffman *huffman);
+
+    /** @brief append input
+     *  @param data input chunk
+     *  @param size input chunk size
+     *  @return false if the decoder failed
+     */
+    bool Push(const char *data, size_t size);
+
+    /** @brief decode input pushed so far
+     *  @param output output buffer
+     *  @param capacity output buffer size
+     *  @param size output size, 0 if more input is needed or the stream is done
+     *  @return success or fail
+     */
+    bool Pull(char *output, size_t capacity, size_t &size);
+
+    /** @brief whole stream is decoded and checked
+     */
+    bool Done() const { return STATE_DONE == state_; }
+
+    /** @brief get decoded size of the stream
+     *  @param output_size decoded size
+     *  @return false if the stream header is not decoded yet
+     */
+    bool GetOutputSize(uint64_t &output_size) const;
+
+private:
+    /** @brief parse header of a stream from input_, VERSION_BLOCKED is only allowed at top level
+     *  @param top_level top level stream or a block
+     *  @return PARSE_OK / PARSE_NEED_MORE / PARSE_ERROR
+     */
+    ParseResult ParseHeader(bool top_level);
+
+    /** @brief start the next bit stream of the current header, or leave STATE_BITS
+     *  @return success or fail
+     */
+    bool NextStream();
+
+    /** @brief decode symbols of the current bit stream
+     *  @param out output pointer, moved after the decoded symbols
+     *  @param out_end end of output buffer
+     *  @return success or fail
+     */
+    bool DecodeSymbols(char *&out, char *out_end);
+
+private:
+    State state_;
+    Huffman table_;  // code table of the current header
+    const Huffman *shared_table_;  // not owned, table of VERSION_SHARED streams
+    const Huffman *decode_table_;  // table_ or shared_table_
+    std::vector<char> input_;  // input not decoded yet
+    size_t input_pos_;  // decoded bytes of input_
+    uint64_t consumed_;  // bytes consumed from the start of stream
+    bool header_ready_;  // output_size_ is known
+    uint64_t output_size_;  // decoded size of the stream
+    uint64_t output_pos_;  // decoded bytes of the stream
+    // VERSION_BLOCKED streams
+    uint64_t block_size_;  // output size of a block
+    std::vector<uint64_t> block_ends_;  // end of blocks, relative to consumed_ at stream begin
+    size_t block_;  // current block
+    // bit streams of the current header
+    std::vector<uint64_t> bit_sizes_;  // bit sizes of streams
+    uint64_t unit_size_;  // output size of the current header
+    size_t stream_;  // current stream
+    uint64_t symbols_left_;  // symbols left of the current stream
+    uint64_t bytes_left_;  // bytes left of the current stream
+    uint64_t bit_buf_;
+    int bit_count_;
+    uint64_t loaded_bits_;  // bits loaded into bit_buf_, padded zero bits included
 };
 
-/** @brief decode a compressed buffer use huffman
+/** @brief decode a compressed buffer use huffman, the buffer may be a view of a mapped file
  *  @param encode_buffer input encode buffer
+ *  @param size encode buffer size
  *  @param stream_buffer outout stream buffer
  *  @return success or fail
  */
 template<typename streambuf_t>
-bool Huffman::Decode(const std::vector<char> &encode_buffer, streambuf_t &stream_buffer) {
-    size_t table_size = 0;
+bool Huffman::Decode(const char *encode_buffer, size_t size, streambuf_t &stream_buffer) {
     stream_buffer.clear();
-    if (!ReadFreqMap(encode_buffer, table_size)) {
-        LOG_ERR << "read encode buffer error.";
+    size_t header_size = 0;
+    uint64_t output_size = 0;
+    const char *pencode = encode_buffer;
+    if (!ReadHeader(pencode, size, header_size, output_size)) {
+        LOG_ERR << "read encode buffer header error.";
         return false;
     }
 
-    if (!BuildTree()) {
-        LOG_ERR << "build huffman tree error.";
+    // empty buffer
+    if (output_size == 0) return true;
+    stream_buffer.resize(output_size);
+    if (!block_index_.offsets.empty()) {
+        return DecodeBlocks(pencode, 0, block_index_.offsets.size() - 1, output_size, &stream_buffer[0]);
+    }
+    return DecodeStreams(pencode + header_size, pencode + size, stream_bit_sizes_, &stream_buffer[0], output_size);
+}
+
+/** @brief decode a VERSION_SHARED stream with the table set by SetSharedTable, the table is not changed,
+ *      so one table decodes streams of many threads at once
+ *  @param encode_buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param stream_buffer outout stream buffer
+ *  @return success or fail
+ */
+template<typename streambuf_t>
+bool Huffman::DecodeShared(const char *encode_buffer, size_t size, streambuf_t &stream_buffer) const {
+    stream_buffer.clear();
+    size_t header_size = 0;
+    uint64_t output_size = 0, bit_size = 0;
+    if (!ReadSharedHeader(encode_buffer, size, header_size, output_size, bit_size)) {
+        LOG_ERR << "read encode buffer header error.";
         return false;
     }
 
     // empty buffer
-    if (nullptr == root_) return true;
-    if (table_size + sizeof(uint64_t) > encode_buffer.size()) {
-        LOG_ERR << "encode buffer size error.";
+    if (output_size == 0) return true;
+    stream_buffer.resize(output_size);
+    return DecodeStreams(encode_buffer + header_size, encode_buffer + size, std::vector<uint64_t>(1, bit_size),
+                         &stream_buffer[0], output_size);
+}
+
+/** @brief decode a range of a compressed buffer, the buffer may be a view of a mapped file
+ *  @param encode_buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param offset offset in decoded buffer
+ *  @param length length of range, cut at the end of decoded buffer
+ *  @param stream_buffer outout stream buffer
+ *  @return success or fail
+ */
+template<typename streambuf_t>
+bool Huffman::DecodeRange(const char *encode_buffer, size_t size, uint64_t offset, uint64_t length, streambuf_t &stream_buffer) {
+    stream_buffer.clear();
+    size_t header_size = 0;
+    uint64_t output_size = 0;
+    const char *pencode = encode_buffer;
+    if (!ReadHeader(pencode, size, header_size, output_size)) {
+        LOG_ERR << "read encode buffer header error.";
         return false;
     }
+    if (offset > output_size) {
+        LOG_ERR << "range offset error. offset:" << offset << ", size:" << output_size;
+        return false;
+    }
+    length = std::min(length, output_size - offset);
+    if (0 == length) return true;
 
-    const char *pencode = &encode_buffer[table_size];
-    const uint64_t encode_bit_size = *(uint64_t*)pencode; pencode += sizeof(uint64_t);
-    if (encode_bit_size == 0) return true;
-
-    uint64_t encode_8_bit_size = encode_bit_size/8*8;
-    uint64_t encode_remain_bit_size = encode_bit_size - encode_8_bit_size;
-    stream_buffer.reserve(encode_bit_size/8);
-    const HuffmanTree *node = root_;
-
-    // 8bit chunk, encode stream + align (zero) > 8bit
-    // only for performance
-    {
-        #define LOOP_INNER_(i) \
-            node = (ch & (1<<i)) ? node->right : node->left; \
-            if (nullptr == node->left) { \
-                stream_buffer.push_back(node->ch); \
-                node = root_; \
-            }
-
-        char ch = *pencode;
-        while (encode_8_bit_size) {
-            LOOP_INNER_(0);
-            LOOP_INNER_(1);
-            LOOP_INNER_(2);
-            LOOP_INNER_(3);
-            LOOP_INNER_(4);
-            LOOP_INNER_(5);
-            LOOP_INNER_(6);
-            LOOP_INNER_(7);
-            ch = *(++pencode);
-            encode_8_bit_size -= 8;
-        }
+    std::vector<char> output;
+    uint64_t output_offset = 0;  // offset of decoded data in output
+    if (!block_index_.offsets.empty()) {
+        const uint64_t block_size = block_index_.block_size;
+        const size_t first = offset / block_size, last = (offset + length + block_size - 1) / block_size;
+        output.resize(std::min(last * block_size, output_size) - first * block_size);
+        if (!DecodeBlocks(pencode, first, last, output_size, &output[0], offset, offset + length)) return false;
+        output_offset = first * block_size;
+    } else {
+        output.resize(output_size);
+        if (!DecodeStreams(pencode + header_size, pencode + size, stream_bit_sizes_, &output[0], output_size,
+                           offset, offset + length)) return false;
+    }
+    stream_buffer.assign(output.begin() + (offset - output_offset), output.begin() + (offset - output_offset + length));
+    return true;
+}
 
-        #undef LOOP_INNER_
+/** @brief decode a range of a compressed buffer read in parts, VERSION_BLOCKED streams only read the header and
+ *      the blocks of the range, block boundaries are the seek points. other streams are read whole
+ *  @param size encode buffer size
+ *  @param read_encode reads bytes of encode buffer, called with offset, size and output buffer
+ *  @param offset offset in decoded buffer
+ *  @param length length of range, cut at the end of decoded buffer
+ *  @param stream_buffer outout stream buffer
+ *  @return success or fail
+ */
+template<typename streambuf_t>
+bool Huffman::DecodeRange(uint64_t size, const std::function<bool(uint64_t, size_t, char *)> &read_encode,
+                          uint64_t offset, uint64_t length, streambuf_t &stream_buffer) {
+    stream_buffer.clear();
+    bool blocked = false;
+    uint64_t output_size = 0;
+    if (!ReadBlockIndex(size, read_encode, blocked, output_size)) {
+        LOG_ERR << "read encode buffer header error.";
+        return false;
     }
-    // remain bits
-    {
-        int bit_off = 0;
-        char ch = *pencode;
-        while (encode_remain_bit_size) {
-            node = (ch & (1<<bit_off)) ? node->right : node->left;
-            bit_off++;
-            if (!(bit_off = (bit_off & 7))) ch = *(++pencode);
-            encode_remain_bit_size--;
-            if (nullptr == node->left) {
-                stream_buffer.push_back(node->ch);
-                node = root_;
-            }
-        }
+    if (!blocked) {
+        std::vector<char> encode_buffer(size);
+        if (size && !read_encode(0, size, &encode_buffer[0])) return false;
+        return DecodeRange(encode_buffer.data(), encode_buffer.size(), offset, length, stream_buffer);
     }
-    if (node != root_) {
-        LOG_ERR << "missing some bits.";
+    if (offset > output_size) {
+        LOG_ERR << "range offset error. offset:" << offset << ", size:" << output_size;
         return false;
     }
+    length = std::min(length, output_size - offset);
+    if (0 == length) return true;
+
+    // blocks of the range are read at once, their offsets are moved to the read buffer
+    const uint64_t block_size = block_index_.block_size;
+    const size_t first = offset / block_size, last = (offset + length + block_size - 1) / block_size;
+    std::vector<uint64_t> &offsets = block_index_.offsets;
+    const uint64_t encode_offset = offsets[first];
+    std::vector<char> encode_blocks(offsets[last] - encode_offset);
+    if (!encode_blocks.empty() && !read_encode(encode_offset, encode_blocks.size(), &encode_blocks[0])) return false;
+    for (size_t i=first; i<=last; i++) offsets[i] -= encode_offset;
+    std::vector<char> output(std::min(last * block_size, output_size) - first * block_size);
+    if (!DecodeBlocks(encode_blocks.data(), first, last, output_size, &output[0], offset, offset + length)) return false;
+    const uint64_t output_offset = offset - first * block_size;
+    stream_buffer.assign(output.begin() + output_offset, output.begin() + (output_offset + length));
     return true;
 }
 
@@ -0,0 +1,344 @@
+/**
+ *  This is an implementation of LZ77 coding, literals/lengths/distances are huffman coded.
+ *  Usage:
+ *  1. encode a stream buffer
+ *    lz::Lz lz;
+ *    lz.Encode(stream_buffer, encode_buffer);
+ *
+ *  2. decode a stream buffer
+ *    lz::Lz lz;
+ *    lz.Decode(encode_buffer, stream_buffer);
+ *
+ */
+#include <iostream>
+#include "lz.h"
+
+namespace lz {
+
+/** @brief append a varint (7 bits per byte, low bits first) to buffer
+ *  @param buffer output buffer
+ *  @param val value
+ */
+static inline void WriteVarint(std::vector<char> &buffer, uint64_t val) {
+    while (val >= 0x80) {
+        buffer.push_back((char)(val | 0x80));
+        val >>= 7;
+    }
+    buffer.push_back((char)val);
+}
+
+/** @brief read a varint from buffer
+ *  @param ptr read pointer, moved after the varint
+ *  @param end end of buffer
+ *  @param val output value
+ *  @return success or fail
+ */
+static inline bool ReadVarint(const char *&ptr, const char *end, uint64_t &val) {
+    val = 0;
+    for (int shift = 0; shift < 64 && ptr < end; shift += 7) {
+        const uint8_t byte = (uint8_t)*ptr++;
+        val |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/** @brief append a length, 255 means the next byte is added
+ *  @param buffer output buffer
+ *  @param len length
+ */
+static inline void WriteLength(std::vector<char> &buffer, uint64_t len) {
+    while (len >= 255) {
+        buffer.push_back((char)255);
+        len -= 255;
+    }
+    buffer.push_back((char)len);
+}
+
+/** @brief read a length
+ *  @param ptr read pointer, moved after the length
+ *  @param end end of buffer
+ *  @param len output length
+ *  @return success or fail
+ */
+static inline bool ReadLength(const char *&ptr, const char *end, uint64_t &len) {
+    len = 0;
+    while (ptr < end) {
+        const uint8_t byte = (uint8_t)*ptr++;
+        len += byte;
+        if (byte != 255) return true;
+    }
+    return false;
+}
+
+/** @brief hash of 4 bytes prefix
+ */
+static inline uint32_t HashPrefix(const char *p, int hash_bits) {
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return (val * 2654435761u) >> (32 - hash_bits);
+}
+
+/** @brief encode a stream buffer
+ *  @param stream_buffer input stream buffer
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Lz::Encode(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer) {
+    encode_buffer.clear();
+
+    std::vector<char> literals, lengths, distances;
+    const uint64_t sequence_count = FindSequences(stream_buffer.data(), stream_buffer.size(), literals, lengths, distances);
+
+    // sub streams not smaller after huffman coding are stored raw
+    const std::vector<char> *streams[kSubStreams] = {&literals, &lengths, &distances};
+    std::vector<char> encode_streams[kSubStreams];
+    uint8_t raw_flags = 0;
+    for (int i=0; i<kSubStreams; i++) {
+        if (!EncodeStream(*streams[i], encode_streams[i])) {
+            LOG_ERR << "encode lz streams error.";
+            return false;
+        }
+        if (encode_streams[i].size() >= streams[i]->size()) {
+            encode_streams[i] = *streams[i];
+            raw_flags |= 1 << i;
+        }
+    }
+
+    encode_buffer.resize(sizeof(uint32_t));
+    *(uint32_t*)&encode_buffer[0] = kStreamTag | kStreamVersion;
+    encode_buffer.push_back((char)raw_flags);
+    WriteVarint(encode_buffer, stream_buffer.size());
+    WriteVarint(encode_buffer, sequence_count);
+    size_t result_size = encode_buffer.size();
+    for (int i=0; i<kSubStreams; i++) {
+        WriteVarint(encode_buffer, encode_streams[i].size());
+        result_size += encode_streams[i].size();
+    }
+    encode_buffer.reserve(result_size);
+    for (int i=0; i<kSubStreams; i++) encode_buffer.insert(encode_buffer.end(), encode_streams[i].begin(), encode_streams[i].end());
+    return true;
+}
+
+/** @brief split input into sequences with hash chain match finder
+ *  @param input input buffer
+ *  @param size input size
+ *  @param literals output literals
+ *  @param lengths output literal lengths and match lengths
+ *  @param distances output distances
+ *  @return sequence count
+ */
+uint64_t Lz::FindSequences(const char *input, size_t size, std::vector<char> &literals,
+                           std::vector<char> &lengths, std::vector<char> &distances) {
+    literals.clear(), lengths.clear(), distances.clear();
+    if (size < (size_t)kMinMatch) {
+        literals.assign(input, input + size);
+        return 0;
+    }
+
+    // chain of previous positions with the same hash, a ring buffer of the window
+    uint32_t window = 1 << 12;
+    while (window < kWindowSize && window < size) window <<= 1;
+    const uint32_t window_mask = window - 1;
+    std::vector<int64_t> head((size_t)1 << kHashBits, -1);
+    std::vector<int64_t> prev(window, -1);
+    const size_t hash_end = size - kMinMatch + 1;  // positions with a whole prefix
+
+    auto insert = [&] (size_t pos) {
+        const uint32_t h = HashPrefix(input + pos, kHashBits);
+        prev[pos & window_mask] = head[h];
+        head[h] = pos;
+    };
+    // longest match of pos in the window, candidates are checked from the nearest
+    auto find_match = [&] (size_t pos, size_t &best_len, size_t &best_dist) {
+        best_len = 0, best_dist = 0;
+        const char *cur = input + pos;
+        const size_t max_len = size - pos;
+        int64_t cand = head[HashPrefix(cur, kHashBits)];
+        for (int depth = chain_depth_; cand >= 0 && depth > 0; depth--) {
+            const size_t dist = pos - cand;
+            if (dist > window_mask) break;
+            const char *ref = input + cand;
+            // a longer match must differ from the best one at best_len
+            if (best_len < max_len && ref[best_len] == cur[best_len] && 0 == memcmp(ref, cur, kMinMatch)) {
+                size_t len = kMinMatch;
+                while (len < max_len && ref[len] == cur[len]) len++;
+                if (len > best_len) {
+                    best_len = len, best_dist = dist;
+                    if (len == max_len) break;
+                }
+            }
+            const int64_t next = prev[cand & window_mask];
+            // the slot is reused by a newer position out of the window
+            if (next >= cand) break;
+            cand = next;
+        }
+    };
+
+    uint64_t sequence_count = 0;
+    size_t pos = 0, anchor = 0;
+    while (pos < hash_end) {
+        size_t len = 0, dist = 0;
+        find_match(pos, len, dist);
+        insert(pos);
+        if (len < (size_t)kMinMatch) {
+            pos++;
+            continue;
+        }
+        // lazy evaluation, a longer match at the next position wins
+        while (pos + 1 < hash_end) {
+            size_t next_len = 0, next_dist = 0;
+            find_match(pos + 1, next_len, next_dist);
+            if (next_len <= len) break;
+            insert(++pos);
+            len = next_len, dist = next_dist;
+        }
+
+        WriteLength(lengths, pos - anchor);
+        literals.insert(literals.end(), input + anchor, input + pos);
+        WriteLength(lengths, len - kMinMatch);
+        WriteVarint(distances, dist);
+        sequence_count++;
+        const size_t match_end = pos + len;
+        for (pos++; pos < match_end && pos < hash_end; pos++) insert(pos);
+        pos = anchor = match_end;
+    }
+    literals.insert(literals.end(), input + anchor, input + size);
+    return sequence_count;
+}
+
+/** @brief huffman encode a sub stream, large streams are interleaved or blocked
+ *  @param stream_buffer input stream buffer
+ *  @param encode_buffer output encode buffer
+ *  @return success or fail
+ */
+bool Lz::EncodeStream(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer) {
+    huffman::Huffman huffman_encode;
+    if (stream_buffer.size() > kBlockedMinSize) {
+        huffman_encode.SetStreamVersion(huffman::VERSION_BLOCKED);
+        huffman_encode.SetThreadPool(thread_pool_);
+    } else if (stream_buffer.size() >= kInterleavedMinSize) {
+        huffman_encode.SetStreamVersion(huffman::VERSION_INTERLEAVED);
+    }
+    return huffman_encode.Encode(stream_buffer, encode_buffer);
+}
+
+/** @brief read header and huffman decode sub streams into literals_/lengths_/distances_
+ *  @param encode_buffer input encode buffer
+ *  @param output_size decoded size
+ *  @param sequence_count sequence count
+ *  @return success or fail
+ */
+bool Lz::ReadStreams(const char *encode_buffer, size_t size, uint64_t &output_size, uint64_t &sequence_count) {
+    output_size = 0, sequence_count = 0;
+    literals_.clear(), lengths_.clear(), distances_.clear();
+    if (size < sizeof(uint32_t)) {
+        LOG_ERR << "encode size error. size:" << size;
+        return false;
+    }
+    const char *pbegin = encode_buffer, *pend = pbegin + size;
+    const uint32_t tag = *(const uint32_t*)pbegin;
+    if ((tag & kStreamTagMask) != kStreamTag || (tag & ~kStreamTagMask) != kStreamVersion) {
+        LOG_ERR << "check lz stream tag error. tag:" << tag;
+        return false;
+    }
+
+    const char *pencode = pbegin + sizeof(uint32_t);
+    if (pencode >= pend) {
+        LOG_ERR << "read lz header error.";
+        return false;
+    }
+    const uint8_t raw_flags = (uint8_t)*pencode++;
+    uint64_t stream_sizes[kSubStreams] = {0};
+    bool ok = ReadVarint(pencode, pend, output_size) && ReadVarint(pencode, pend, sequence_count);
+    for (int i=0; i<kSubStreams; i++) ok = ok && ReadVarint(pencode, pend, stream_sizes[i]);
+    if (!ok || (raw_flags >> kSubStreams)) {
+        LOG_ERR << "read lz header error.";
+        return false;
+    }
+    std::vector<char> *streams[kSubStreams] = {&literals_, &lengths_, &distances_};
+    huffman::Huffman huffman_decode;
+    huffman_decode.SetThreadPool(thread_pool_);
+    for (int i=0; i<kSubStreams; i++) {
+        if (stream_sizes[i] > (uint64_t)(pend - pencode)) {
+            LOG_ERR << "check lz stream size error. size:" << stream_sizes[i];
+            return false;
+        }
+        if (raw_flags & (1 << i)) {
+            streams[i]->assign(pencode, pencode + stream_sizes[i]);
+        } else if (!huffman_decode.Decode(pencode, stream_sizes[i], *streams[i])) {
+            LOG_ERR << "decode lz stream error. stream:" << i;
+            return false;
+        }
+        pencode += stream_sizes[i];
+    }
+
+    // a sequence takes 2 length bytes and 1 distance byte at least, a length byte adds 255 at most
+    const uint64_t max_output_size = literals_.size() + sequence_count * kMinMatch + lengths_.size() * 255;
+    if (sequence_count > lengths_.size() / 2 || sequence_count > distances_.size() || output_size > max_output_size) {
+        LOG_ERR << "check lz header error. output size:" << output_size << ", sequence count:" << sequence_count;
+        return false;
+    }
+    return true;
+}
+
+/** @brief execute sequences of literals_/lengths_/distances_
+ *  @param sequence_count sequence count
+ *  @param output output buffer, pre-sized
+ *  @param output_size output size
+ *  @return success or fail
+ */
+bool Lz::DecodeSequences(uint64_t sequence_count, char *output, uint64_t output_size) {
+    const char *plit = literals_.data(), *plit_end = plit + literals_.size();
+    const char *plen = lengths_.data(), *plen_end = plen + lengths_.size();
+    const char *pdist = distances_.data(), *pdist_end = pdist + distances_.size();
+    char *out = output, *out_end = output + output_size;
+
+    for (uint64_t i=0; i<sequence_count; i++) {
+        uint64_t literal_len = 0, match_len = 0, dist = 0;
+        if (!ReadLength(plen, plen_end, literal_len) || !ReadLength(plen, plen_end, match_len)
+            || !ReadVarint(pdist, pdist_end, dist)) {
+            LOG_ERR << "read lz sequence error. sequence:" << i;
+            return false;
+        }
+        match_len += kMinMatch;
+        if (literal_len > (uint64_t)(plit_end - plit) || literal_len > (uint64_t)(out_end - out)) {
+            LOG_ERR << "check literal length error. length:" << literal_len;
+            return false;
+        }
+        memcpy(out, plit, literal_len);
+        out += literal_len, plit += literal_len;
+
+        if (0 == dist || dist > (uint64_t)(out - output) || match_len > (uint64_t)(out_end - out)) {
+            LOG_ERR << "check match error. length:" << match_len << ", distance:" << dist;
+            return false;
+        }
+        const char *ref = out - dist;
+        if (dist >= match_len) {
+            memcpy(out, ref, match_len);
+            out += match_len;
+        } else if (dist >= 8) {
+            // overlapped copy, 8 bytes apart never overlap in a single copy
+            char *match_end = out + match_len;
+            while (match_end - out >= 8) {
+                memcpy(out, ref, 8);
+                out += 8, ref += 8;
+            }
+            while (out < match_end) *out++ = *ref++;
+        } else {
+            // repeated pattern shorter than 8 bytes
+            char *match_end = out + match_len;
+            while (out < match_end) *out++ = *ref++;
+        }
+    }
+
+    // literals after the last sequence
+    if ((uint64_t)(plit_end - plit) != (uint64_t)(out_end - out) || plen != plen_end || pdist != pdist_end) {
+        LOG_ERR << "check lz streams size error.";
+        return false;
+    }
+    if (out < out_end) memcpy(out, plit, out_end - out);
+    return true;
+}
+
+}  // namespace lz
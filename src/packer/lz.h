@@ -0,0 +1,153 @@
+/**
+ *  This is an implementation of LZ77 coding, literals/lengths/distances are huffman coded.
+ *  Usage:
+ *  1. encode a stream buffer
+ *    lz::Lz lz;
+ *    lz.Encode(stream_buffer, encode_buffer);
+ *
+ *  2. decode a stream buffer
+ *    lz::Lz lz;
+ *    lz.Decode(encode_buffer, stream_buffer);
+ *
+ *  Stream format:
+ *    uint32(tag | version) | uint8(raw flags) | varint(output size) | varint(sequence count)
+ *    | varint(literals size) | varint(lengths size) | varint(distances size)
+ *    | huffman(literals) | huffman(lengths) | huffman(distances)
+ *    bit i of raw flags is set if sub stream i is stored raw, it does not shrink with huffman.
+ *    a sequence is literal length, literals, match length and distance, the literals left after
+ *    the last sequence fill the output. lengths are bytes, 255 means the next byte is added
+ *    (match length - kMinMatch is stored), distances are varints. matches are found with hash
+ *    chains of 4 byte prefixes and one step lazy evaluation.
+ *
+ */
+
+#pragma once
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "log.h"
+#include "huffman.h"
+#include "thread-pool.h"
+
+namespace lz {
+
+class Lz {
+private:
+    static const uint32_t kStreamTag = 0x5A4C5A00;  // "\0ZLZ", low 8 bits is the stream version
+    static const uint32_t kStreamTagMask = 0xFFFFFF00;
+    static const uint32_t kStreamVersion = 1;
+    static const int kSubStreams = 3;  // literals, lengths, distances
+    static const int kMinMatch = 4;  // hashed prefix bytes
+    static const int kHashBits = 16;
+    static const uint32_t kWindowSize = 1 << 20;  // max distance + 1
+    static const int kDefaultChainDepth = 32;
+    static const int kMaxChainDepth = 4096;
+    static const size_t kInterleavedMinSize = 16 << 10;  // sub streams not smaller are huffman coded interleaved
+    static const size_t kBlockedMinSize = 1 << 20;  // sub streams larger are huffman coded in blocks
+
+public:
+    Lz() : chain_depth_(kDefaultChainDepth), thread_pool_(nullptr) {}
+
+    /** @brief set max hash chain candidates checked for a match, 32 by default
+     *  @param chain_depth chain depth (1 ~ 4096), deeper chains find longer matches slower
+     */
+    void SetChainDepth(int chain_depth) { chain_depth_ = std::max(1, std::min(chain_depth, (int)kMaxChainDepth)); }
+
+    /** @brief set thread pool for huffman blocks of large streams, not owned
+     *  @param thread_pool thread pool
+     */
+    void SetThreadPool(utility::ThreadPool *thread_pool) { thread_pool_ = thread_pool; }
+
+    /** @brief encode a stream buffer
+     *  @param stream_buffer input stream buffer
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool Encode(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer);
+
+    /** @brief decode a compressed buffer
+     *  @param encode_buffer input encode buffer
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool Decode(const std::vector<char> &encode_buffer, streambuf_t &stream_buffer) {
+        return Decode(encode_buffer.data(), encode_buffer.size(), stream_buffer);
+    }
+
+    /** @brief decode a compressed buffer, the buffer may be a view of a mapped file
+     *  @param encode_buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param stream_buffer outout stream buffer
+     *  @return success or fail
+     */
+    template<typename streambuf_t>
+    bool Decode(const char *encode_buffer, size_t size, streambuf_t &stream_buffer);
+
+private:
+    /** @brief split input into sequences with hash chain match finder
+     *  @param input input buffer
+     *  @param size input size
+     *  @param literals output literals
+     *  @param lengths output literal lengths and match lengths
+     *  @param distances output distances
+     *  @return sequence count
+     */
+    uint64_t FindSequences(const char *input, size_t size, std::vector<char> &literals,
+                           std::vector<char> &lengths, std::vector<char> &distances);
+
+    /** @brief huffman encode a sub stream, large streams are interleaved or blocked
+     *  @param stream_buffer input stream buffer
+     *  @param encode_buffer output encode buffer
+     *  @return success or fail
+     */
+    bool EncodeStream(const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer);
+
+    /** @brief read header and huffman decode sub streams into literals_/lengths_/distances_
+     *  @param encode_buffer input encode buffer
+     *  @param size encode buffer size
+     *  @param output_size decoded size
+     *  @param sequence_count sequence count
+     *  @return success or fail
+     */
+    bool ReadStreams(const char *encode_buffer, size_t size, uint64_t &output_size, uint64_t &sequence_count);
+
+    /** @brief execute sequences of literals_/lengths_/distances_
+     *  @param sequence_count sequence count
+     *  @param output output buffer, pre-sized
+     *  @param output_size output size
+     *  @return success or fail
+     */
+    bool DecodeSequences(uint64_t sequence_count, char *output, uint64_t output_size);
+
+private:
+    int chain_depth_;  // max candidates of a match search
+    utility::ThreadPool *thread_pool_;  // not owned, nullptr for the calling thread
+    std::vector<char> literals_;  // decoded literals
+    std::vector<char> lengths_;  // decoded literal lengths and match lengths
+    std::vector<char> distances_;  // decoded distances
+};
+
+/** @brief decode a compressed buffer, the buffer may be a view of a mapped file
+ *  @param encode_buffer input encode buffer
+ *  @param size encode buffer size
+ *  @param stream_buffer outout stream buffer
+ *  @return success or fail
+ */
+template<typename streambuf_t>
+bool Lz::Decode(const char *encode_buffer, size_t size, streambuf_t &stream_buffer) {
+    stream_buffer.clear();
+    uint64_t output_size = 0, sequence_count = 0;
+    if (!ReadStreams(encode_buffer, size, output_size, sequence_count)) {
+        LOG_ERR << "read lz streams error.";
+        return false;
+    }
+
+    // empty buffer
+    if (output_size == 0) return true;
+    stream_buffer.resize(output_size);
+    return DecodeSequences(sequence_count, &stream_buffer[0], output_size);
+}
+
+}  // namespace lz
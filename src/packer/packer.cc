@@ -1,29 +1,306 @@
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fnmatch.h>
 #include <map>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <iterator>
 #include <vector>
 #include <cstring>
+#include <cmath>
 #include "packer.h"
 
 namespace packer {
 
+// seeds of the two XXH64 of ContentKey
+static const uint64_t global_content_seeds[2] = {0x0000000000000000, 0x9e3779b97f4a7c15};
+
+/** @brief estimate huffman coded size from the entropy of bytes, a lower bound of the coded size
+ *  @param file_stream input stream
+ *  @return estimated size in bytes
+ */
+static uint64_t EstimateHuffmanSize(const std::vector<char> &file_stream) {
+    uint64_t freq[256] = {0};
+    for (char ch : file_stream) freq[(uint8_t)ch]++;
+    const double size = (double)file_stream.size();
+    double bits = 0;
+    for (int sym=0; sym<256; sym++) {
+        if (freq[sym]) bits += freq[sym] * std::log2(size / freq[sym]);
+    }
+    return (uint64_t)(bits / 8);
+}
+
+/** @brief append bytes to a buffer
+ *  @param buffer output buffer
+ *  @param data bytes
+ *  @param size byte count
+ */
+static void AppendBytes(std::vector<char> &buffer, const void *data, size_t size) {
+    buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+}
+
+/** @brief append a section to the sectioned index
+ *  @param index_stream output index stream
+ *  @param section IndexSection
+ *  @param data section data
+ */
+static void AppendSection(std::vector<char> &index_stream, uint32_t section, const std::vector<char> &data) {
+    const uint32_t section_size = data.size();
+    AppendBytes(index_stream, &section, sizeof(section));
+    AppendBytes(index_stream, &section_size, sizeof(section_size));
+    AppendBytes(index_stream, data.data(), data.size());
+}
+
+/** @brief append an unsigned varint, 7 bits a byte, low bits first
+ *  @param buffer output buffer
+ *  @param value value
+ */
+static void AppendVarint(std::vector<char> &buffer, uint32_t value) {
+    for (; value >= 0x80; value >>= 7) buffer.push_back((char)(value | 0x80));
+    buffer.push_back((char)value);
+}
+
+/** @brief read an unsigned varint
+ *  @param data begin of varint, moved after it
+ *  @param end end of buffer
+ *  @param value output value
+ */
+static bool ReadVarint(const char *&data, const char *end, uint32_t &value) {
+    value = 0;
+    for (int shift=0; shift<35 && data < end; shift+=7) {
+        const uint8_t byte = *data++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/** @brief compare names in byte order, the order of std::string
+ *  @param a name
+ *  @param a_len length of a
+ *  @param b name
+ *  @param b_len length of b
+ */
+static int CompareNames(const char *a, size_t a_len, const char *b, size_t b_len) {
+    const int cmp = memcmp(a, b, std::min(a_len, b_len));
+    if (cmp) return cmp;
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+/** @brief get file name of a path
+ *  @param filename path name
+ *  @return name after the last '/'
+ */
+static const char *BaseName(const char *filename) {
+    const char *s_name = filename + strlen(filename);
+    while(s_name > filename && *s_name!='/') s_name--;
+    if (*s_name=='/') s_name++;
+    return s_name;
+}
+
 /** @brief add a single file to Package
  *  @param filename file name
  *  @param dstpath destination path
  */
 bool Packer::AddFile(const char *filename, const char *dstpath) {
-    if (open_mode_ != MODE_WRITE) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_WRITE.";
+    if (!IsWritable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a write mode.";
         return false;
     }
 
     if (nullptr==filename || *filename=='\0') return false;
-    if (file_index_.find(filename)!=file_index_.end()) {
+    // set as current in Packer
+    if (nullptr == dstpath) dstpath = "";
+    char inner_name[512];
+    JointPath(dstpath, BaseName(filename), inner_name);
+    // files of an updated package are replaced
+    if (MODE_WRITE == open_mode_ && file_index_.find(inner_name)!=file_index_.end()) {
         LOG_ERR << "conflict name in package file";
         return false;
     }
 
+    // large files are never loaded whole
+    uint64_t size = 0;
+    if (GetFileSize(filename, size) && size >= global_stream_file_size) {
+        return AddFileBlocks(filename, inner_name, size);
+    }
+    std::vector<char> file_stream;
+    if (!ReadFile(filename, file_stream)) return false;
+    // add stream to Packer
+    AddStream(file_stream, BaseName(filename), dstpath);
+    return true;
+}
+
+/** @brief add files to Package, files are read and coded on the workers of SetThreads
+ *  @param filenames file names
+ *  @param dstpath destination path
+ */
+bool Packer::AddFiles(const std::vector<std::string> &filenames, const char *dstpath) {
+    if (!IsWritable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a write mode.";
+        return false;
+    }
+
+    if (nullptr == dstpath) dstpath = "";
+    std::vector<std::pair<std::string, std::string> > files;
+    for (const std::string &filename : filenames) files.push_back(std::make_pair(filename, dstpath));
+    return AddFileList(files);
+}
+
+/** @brief get size of a file
+ *  @param filename file name
+ *  @param size output file size
+ */
+bool Packer::GetFileSize(const char *filename, uint64_t &size) {
+    struct stat s;
+    if (0 != stat(filename, &s)) return false;
+    size = s.st_size;
+    return true;
+}
+
+/** @brief add a large file block by block, a frequency pass over the blocks chooses the codec and a coding pass
+ *      writes huffman blocks coded on the workers of SetThreads. the file is stored if the codec does not win.
+ *      CODEC_LZ is tried as CODEC_HUFFMAN
+ *  @param filename file name
+ *  @param inner_name file name in Package
+ *  @param size file size
+ */
+bool Packer::AddFileBlocks(const char *filename, const char *inner_name, uint64_t size) {
+    std::ifstream new_file(filename, std::ios::binary);
+    if (!new_file.is_open()) {
+        LOG_ERR << "open file error. filename: " << filename;
+        return false;
+    }
+    huffman::Huffman huffman_encode;
+    huffman_encode.SetBlockSize(global_block_size);
+    const uint64_t block_count = (size + global_block_size - 1) / global_block_size;
+    // blocks in flight, one for each worker
+    const size_t batch_count = thread_pool_ ? thread_pool_->size() : 1;
+    std::vector<std::vector<char> > blocks(batch_count), encode_blocks(batch_count);
+    std::vector<uint64_t> estimate_sizes(batch_count);
+    std::vector<char> block_success(batch_count);
+    auto read_blocks = [&] (uint64_t first, size_t &count) {
+        count = std::min((uint64_t)batch_count, block_count - first);
+        for (size_t i=0; i<count; i++) {
+            blocks[i].resize(std::min((uint64_t)global_block_size, size - (first + i) * global_block_size));
+            if (!new_file.read(&blocks[i][0], blocks[i].size())) {
+                LOG_ERR << "read file error. filename: " << filename;
+                return false;
+            }
+        }
+        return true;
+    };
+    auto for_blocks = [this] (size_t count, const std::function<void(size_t)> &func) {
+        if (thread_pool_) {
+            thread_pool_->ParallelFor(count, func);
+        } else {
+            for (size_t i=0; i<count; i++) func(i);
+        }
+    };
+
+    // frequency pass, the entropy of blocks is a lower bound of the coded size. content is hashed on the way
+    const double max_coded_size = size * codec_ratio_;
+    bool coded = CODEC_STORED != codec_;
+    bool success = true;
+    size_t count = 0;
+    uint64_t estimate_size = 0;
+    utility::XxHash64 hashers[2] = {utility::XxHash64(global_content_seeds[0]), utility::XxHash64(global_content_seeds[1])};
+    for (uint64_t block=0; block<block_count && success; block+=count) {
+        success = read_blocks(block, count);
+        if (!success) break;
+        if (coded) {
+            for_blocks(count, [&] (size_t i) { estimate_sizes[i] = EstimateHuffmanSize(blocks[i]); });
+            for (size_t i=0; i<count; i++) estimate_size += estimate_sizes[i];
+            coded = estimate_size <= max_coded_size;
+        }
+        for (size_t i=0; i<count; i++) {
+            hashers[0].Update(blocks[i].data(), blocks[i].size());
+            hashers[1].Update(blocks[i].data(), blocks[i].size());
+        }
+    }
+    const ContentKey key = {size, {hashers[0].Digest(), hashers[1].Digest()}};
+    if (success && LinkContent(key, inner_name)) return true;
+
+    // coding pass, the block offset table is reserved and written when the blocks are coded
+    const uint64_t payload_offset = cur_offset_ + sizeof(global_codec_stream_head) + sizeof(StreamHeader);
+    StreamHeader header;
+    header.codec = CODEC_HUFFMAN, header.flags = 0, header.raw_size = size;
+    uint64_t payload_size = 0;
+    if (coded && success) {
+        new_file.clear();
+        new_file.seekg(0, std::ios::beg);
+        std::vector<uint64_t> block_sizes(block_count, 0);
+        std::vector<char> block_header;
+        success = huffman_encode.WriteBlockHeader(size, block_sizes, block_header);
+        if (success) {
+            of_stream_.write((char*)&global_codec_stream_head, sizeof(global_codec_stream_head));
+            of_stream_.write((char*)&header, sizeof(header));
+            of_stream_.write(&block_header[0], block_header.size());
+            payload_size = block_header.size();
+        }
+        for (uint64_t block=0; block<block_count && success; block+=count) {
+            success = read_blocks(block, count);
+            if (!success) break;
+            for_blocks(count, [&] (size_t i) {
+                block_success[i] = huffman_encode.EncodeBlock(blocks[i].data(), blocks[i].size(), encode_blocks[i]);
+            });
+            for (size_t i=0; i<count && success; i++) {
+                if (!block_success[i]) {
+                    LOG_ERR << "encode error.";
+                    success = false;
+                    break;
+                }
+                of_stream_.write(&encode_blocks[i][0], encode_blocks[i].size());
+                block_sizes[block + i] = encode_blocks[i].size();
+                payload_size += encode_blocks[i].size();
+            }
+        }
+        coded = payload_size <= max_coded_size;
+        if (coded && success) {
+            success = huffman_encode.WriteBlockHeader(size, block_sizes, block_header);
+            if (success) {
+                of_stream_.seekp(payload_offset, std::ios::beg);
+                of_stream_.write(&block_header[0], block_header.size());
+                of_stream_.seekp(payload_offset + payload_size, std::ios::beg);
+            }
+        }
+    }
+
+    // stored, a coded stream which does not win is overwritten
+    if (!coded && success) {
+        new_file.clear();
+        new_file.seekg(0, std::ios::beg);
+        header.codec = CODEC_STORED;
+        of_stream_.seekp(cur_offset_, std::ios::beg);
+        of_stream_.write((char*)&global_codec_stream_head, sizeof(global_codec_stream_head));
+        of_stream_.write((char*)&header, sizeof(header));
+        for (uint64_t block=0; block<block_count && success; block+=count) {
+            success = read_blocks(block, count);
+            for (size_t i=0; i<count && success; i++) of_stream_.write(&blocks[i][0], blocks[i].size());
+        }
+        payload_size = size;
+    }
+    if (!success || !of_stream_.good()) {
+        // streams after are written over the partial stream
+        of_stream_.clear();
+        of_stream_.seekp(cur_offset_, std::ios::beg);
+        return false;
+    }
+    return FinishStream(inner_name, key, header, payload_size, nullptr);
+}
+
+/** @brief read a whole file
+ *  @param filename file name
+ *  @param file_stream output file stream
+ */
+bool Packer::ReadFile(const char *filename, std::vector<char> &file_stream) {
     std::ifstream new_file(filename, std::ios::binary);
     if (!new_file.is_open()) {
         LOG_ERR << "open file error. filename: " << filename;
@@ -34,37 +311,175 @@ bool Packer::AddFile(const char *filename, const char *dstpath) {
     uint64_t size = new_file.tellg();
     new_file.seekg(0, std::ios::beg);
     // read file
-    std::vector<char> file_stream(size);
+    file_stream.resize(size);
     // check if good
     if (!new_file.read(&file_stream[0], size)) {
         LOG_ERR << "read file error. filename: " << filename;
-        new_file.close();
         return false;
     }
     // check size is ok.
     if (new_file.gcount() != size) {
         LOG_ERR << "check size error.";
-        new_file.close();
         return false;
     }
-    // set as current in Packer
-    if (nullptr == dstpath) dstpath = "";
-    // get filename
-    const char *s_name = filename + strlen(filename);
-    while(s_name > filename && *s_name!='/') s_name--;
-    if (*s_name=='/') s_name++;
-    // add stream to Packer
-    AddStream(file_stream, s_name, dstpath);
-    new_file.close();
     return true;
 }
 
 /** @brief check if filename exist
  *  @param filename file name
  */
-bool Packer::FileExist(const char *filename) {
+bool Packer::FileExist(const char *filename) const {
     if (nullptr==filename || *filename=='\0') return false;
-    return file_index_.find(filename)!=file_index_.end();
+    if (IsWritable()) return file_index_.find(filename)!=file_index_.end();
+    if (const Packer *delta = FindDelta(filename)) return delta->FileExist(filename);
+    StreamInfo si(0, 0);
+    return FindEntry(filename, si);
+}
+
+/** @brief list files whose name begins with a prefix, the range of the prefix is found by binary search of the
+ *      sorted index and only its entries are read. files of an overlaid delta are listed, removed files are not
+ *  @param prefix name prefix, nullptr or "" lists all files
+ *  @param names output file names in name order
+ */
+bool Packer::List(const char *prefix, std::vector<std::string> &names) const {
+    names.clear();
+    const std::string key = nullptr == prefix ? "" : prefix;
+    if (IsWritable()) {
+        for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.lower_bound(key);
+             it != file_index_.end() && 0 == it->first.compare(0, key.length(), key); ++it) {
+            names.push_back(it->first);
+        }
+        return true;
+    }
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+    if (!ListEntries(key.c_str(), key.length(), names)) return false;
+    if (!overlay_) return true;
+
+    // names of both packages are sorted
+    std::vector<std::string> package_names, delta_names;
+    if (!overlay_->ListEntries(key.c_str(), key.length(), delta_names)) return false;
+    package_names.swap(names);
+    package_names.erase(std::remove_if(package_names.begin(), package_names.end(),
+                                       [this] (const std::string &name) { return nullptr != FindDelta(name.c_str()); }),
+                        package_names.end());
+    std::merge(package_names.begin(), package_names.end(), delta_names.begin(), delta_names.end(), std::back_inserter(names));
+    return true;
+}
+
+/** @brief list files whose name matches a shell pattern, names in the range of the literal prefix of the pattern
+ *      are matched. '*' and '?' do not match '/'
+ *  @param pattern shell pattern of fnmatch
+ *  @param names output file names in name order
+ */
+bool Packer::Glob(const char *pattern, std::vector<std::string> &names) const {
+    names.clear();
+    if (nullptr == pattern) return false;
+    // the literal prefix ends at the first wildcard or escape
+    const std::string prefix(pattern, strcspn(pattern, "*?[\\"));
+    if (!List(prefix.c_str(), names)) return false;
+    names.erase(std::remove_if(names.begin(), names.end(),
+                               [pattern] (const std::string &name) { return 0 != fnmatch(pattern, name.c_str(), FNM_PATHNAME); }),
+                names.end());
+    return true;
+}
+
+/** @brief list files of this package whose name begins with a prefix, the overlaid delta is not read
+ *  @param prefix name prefix
+ *  @param prefix_len prefix length
+ *  @param names output file names in name order
+ */
+bool Packer::ListEntries(const char *prefix, size_t prefix_len, std::vector<std::string> &names) const {
+    StreamInfo si(0, 0);
+    if (nullptr != sorted_files_) {
+        const char *entry = nullptr;
+        std::string name;
+        if (!SeekSortedEntry(prefix, prefix_len, entry, name, si)) return true;
+        while (0 == name.compare(0, prefix_len, prefix, prefix_len)) {
+            names.push_back(name);
+            if (entry >= sorted_files_end_) break;
+            if (!ReadSortedEntry(entry, name, si)) {
+                LOG_ERR << "read file entry error.";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char *files = nullptr, *files_end = nullptr;
+    if (!GetListEntries(files, files_end)) return false;
+    // entries are in name order, the first one not less than the prefix is binary searched
+    auto entry_less = [files, files_end] (uint32_t offset, const std::string &key) {
+        const char *entry = files + offset, *name = nullptr;
+        uint32_t len = 0;
+        StreamInfo si(0, 0);
+        ReadEntry(entry, files_end, name, len, si);
+        return CompareNames(name, len, key.data(), key.length()) < 0;
+    };
+    const std::string key(prefix, prefix_len);
+    for (std::vector<uint32_t>::const_iterator it = std::lower_bound(list_offsets_.begin(), list_offsets_.end(), key, entry_less);
+         it != list_offsets_.end(); ++it) {
+        const char *entry = files + *it, *name = nullptr;
+        uint32_t len = 0;
+        ReadEntry(entry, files_end, name, len, si);
+        if (len < prefix_len || 0 != memcmp(name, prefix, prefix_len)) break;
+        names.push_back(std::string(name, len));
+    }
+    return true;
+}
+
+/** @brief get entries of an index which is not front coded in name order, the offsets of entries are collected
+ *      at the first call. entries of LAZY mode are read into list_buffer_
+ *  @param files output begin of entries
+ *  @param files_end output end of entries
+ */
+bool Packer::GetListEntries(const char *&files, const char *&files_end) const {
+    std::lock_guard<std::mutex> lock(list_mutex_);
+    if (!list_ready_) {
+        const char *name = nullptr;
+        uint32_t len = 0;
+        StreamInfo si(0, 0);
+        std::vector<uint32_t> offsets;
+        if (!GetFileEntries(list_buffer_, files, files_end)) return false;
+        for (const char *entry = files; entry < files_end; ) {
+            offsets.push_back(entry - files);
+            if (!ReadEntry(entry, files_end, name, len, si)) {
+                LOG_ERR << "read file entry error.";
+                return false;
+            }
+        }
+        list_offsets_.swap(offsets);
+        list_ready_ = true;
+    }
+    files = files_, files_end = files_end_;
+    if (nullptr == files) files = list_buffer_.data(), files_end = files + list_buffer_.size();
+    return true;
+}
+
+/** @brief remove a file from the index, its stream is left in the package file until Compact. write modes
+ *  @param filename filename in Package
+ *  @return fail if the file is not found
+ */
+bool Packer::RemoveFile(const char *filename) {
+    if (!IsWritable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a write mode.";
+        return false;
+    }
+
+    std::map<std::string, StreamInfo>::iterator it = nullptr==filename ? file_index_.end() : file_index_.find(filename);
+    if (it == file_index_.end()) {
+        LOG_ERR << "can not find filename:" << (nullptr==filename ? "" : filename);
+        return false;
+    }
+    // entries of kept shared streams are set when they are written
+    if (0 == it->second.offset) {
+        if (!FlushSharedStreams()) return false;
+        it = file_index_.find(filename);
+    }
+    file_index_.erase(it);
+    return true;
 }
 
 /** @brief add a directory to Package
@@ -72,8 +487,8 @@ bool Packer::FileExist(const char *filename) {
  *  @param dstpath destination path
  */
 bool Packer::AddDir(const char *path, const char *dstpath) {
-    if (open_mode_ != MODE_WRITE) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_WRITE.";
+    if (!IsWritable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a write mode.";
         return false;
     }
 
@@ -89,31 +504,152 @@ bool Packer::AddDir(const char *path, const char *dstpath) {
         return false;
     }
 
+    std::vector<std::pair<std::string, std::string> > files;
+    if (nullptr == dstpath) dstpath = "";
+    if (!CollectFiles(path, dstpath, files)) return false;
+    return AddFileList(files);
+}
+
+/** @brief collect files of a directory recursively, in the order of readdir
+ *  @param path source path
+ *  @param dstpath destination path
+ *  @param files output source file names and their destination paths
+ */
+bool Packer::CollectFiles(const char *path, const char *dstpath, std::vector<std::pair<std::string, std::string> > &files) {
     DIR *dir = opendir(path);
     if (nullptr == dir) {
         LOG_ERR << "can not open dir" << path;
         return false;
     }
 
-    // recursively add files
+    // recursively collect files
     struct dirent * filename;
+    struct stat s;
     char sub_path[512], sub_dstpath[512];
-    if (nullptr == dstpath) dstpath = "";
-    while ((filename = readdir(dir)) != nullptr) {
+    bool success = true;
+    while (success && (filename = readdir(dir)) != nullptr) {
         const char *name = filename->d_name;
         if ((name[0]=='.' && name[1]=='\0') || (name[0]=='.' && name[1]=='.' && name[2]=='\0')) continue;
         JointPath(path, name, sub_path);
         JointPath(dstpath, name, sub_dstpath);
         lstat(sub_path, &s);
         if (S_ISDIR(s.st_mode)) {
-            // name is a dir, add dir
-            if (!AddDir(sub_path, sub_dstpath)) return false;
+            // name is a dir, collect dir
+            success = CollectFiles(sub_path, sub_dstpath, files);
         } else {
-            // name is a file, add file
-            if (!AddFile(sub_path, dstpath)) return false;
+            // name is a file, collect file
+            files.push_back(std::make_pair(sub_path, dstpath));
         }
     }
-    return true;
+    closedir(dir);
+    return success;
+}
+
+/** @brief add files in order, files are read and coded on the workers of SetThreads, a window of files is
+ *      in flight and finished streams are written by the calling thread in order. pack bytes do not depend on
+ *      the thread count.
+ *  @param files source file names and their destination paths
+ */
+bool Packer::AddFileList(const std::vector<std::pair<std::string, std::string> > &files) {
+    if (!thread_pool_) {
+        for (const auto &file : files) {
+            if (!AddFile(file.first.c_str(), file.second.c_str())) return false;
+        }
+        return true;
+    }
+
+    // a file in flight, stream is the payload of coded streams
+    struct PendingFile {
+        std::vector<char> file_stream;
+        std::vector<char> encode_stream;
+        StreamHeader header;
+        ContentKey key;
+        uint64_t size;  // size of large files, they are added block by block by the calling thread
+        bool duplicate;  // content claimed by another file, not coded
+        bool done;
+        bool success;
+        PendingFile() : size(0), duplicate(false), done(false), success(false) {}
+    };
+    std::vector<PendingFile> pending(files.size());
+    // contents coded by a worker, a file of content claimed before is not coded
+    std::set<ContentKey> claimed;
+    std::mutex mutex;
+    std::condition_variable done_cond;
+    const size_t window = thread_pool_->size() * 4;
+    size_t submitted = 0;
+    bool success = true;
+    char inner_name[512];
+    for (size_t i=0; i<files.size() && success; i++) {
+        // keep a window of files read and coded ahead
+        for (; submitted<files.size() && submitted<i+window; submitted++) {
+            thread_pool_->Submit([this, &files, &pending, &claimed, &mutex, &done_cond, submitted] () {
+                PendingFile &file = pending[submitted];
+                const char *filename = files[submitted].first.c_str();
+                uint64_t size = 0;
+                bool success = true;
+                if (GetFileSize(filename, size) && size >= global_stream_file_size) {
+                    file.size = size;
+                } else {
+                    success = ReadFile(filename, file.file_stream);
+                }
+                if (success && 0 == file.size) {
+                    file.key = HashContent(file.file_stream);
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        file.duplicate = !claimed.insert(file.key).second;
+                    }
+                    // shared streams are coded when their group is flushed
+                    if (!file.duplicate && !IsSharedStream(file.file_stream)) {
+                        success = EncodeStream(file.file_stream, codec_, file.header, file.encode_stream);
+                    }
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                file.success = success;
+                file.done = true;
+                done_cond.notify_all();
+            });
+        }
+        PendingFile &file = pending[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cond.wait(lock, [&file] () { return file.done; });
+        }
+        if (!file.success) {
+            success = false;
+            break;
+        }
+        JointPath(files[i].second.c_str(), BaseName(files[i].first.c_str()), inner_name);
+        // names are checked in file order as AddFile does, files committed before are in the index
+        if (MODE_WRITE == open_mode_ && file_index_.find(inner_name) != file_index_.end()) {
+            LOG_ERR << "conflict name in package file";
+            success = false;
+            break;
+        }
+        if (file.size) {
+            success = AddFileBlocks(files[i].first.c_str(), inner_name, file.size);
+        } else if (LinkContent(file.key, inner_name)) {
+            success = true;
+        } else if (IsSharedStream(file.file_stream)) {
+            success = KeepSharedStream(inner_name, file.key, file.file_stream);
+        } else {
+            // the content is claimed by a file after, the first file writes it whatever the thread count
+            if (file.duplicate) success = EncodeStream(file.file_stream, codec_, file.header, file.encode_stream);
+            success = success && WriteStream(inner_name, file.key, file.header,
+                                             (CODEC_STORED == file.header.codec) ? file.file_stream : file.encode_stream);
+        }
+        std::vector<char>().swap(file.file_stream);
+        std::vector<char>().swap(file.encode_stream);
+    }
+
+    // files in flight refer to pending
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [&pending, submitted] () {
+        for (size_t i=0; i<submitted; i++) {
+            if (!pending[i].done) return false;
+        }
+        return true;
+    });
+    return success;
 }
 
 /** @brief open a package file
@@ -128,6 +664,9 @@ bool Packer::Open(const char *filename, OpenMode mode) {
 
     if (open_mode_ != MODE_UNKNOWN) this->Close();
     this->Reset();
+    memset(codec_stats_, 0, sizeof(codec_stats_));
+    memset(&dedup_stats_, 0, sizeof(dedup_stats_));
+    file_cache_.ResetStats();
 
     file_name_ = filename;
     open_mode_ = mode;
@@ -135,258 +674,2080 @@ bool Packer::Open(const char *filename, OpenMode mode) {
         of_stream_.open(filename, std::ios::binary);
         of_stream_.write((char*)&cur_offset_, sizeof(cur_offset_));
         cur_offset_ += sizeof(cur_offset_);
+        write_checksums_ = checksum_;
+        write_front_coding_ = front_coding_;
         return of_stream_.is_open();
-    } else if (MODE_READ == open_mode_) {
-        if_stream_.open(filename, std::ios::binary);
-        if (!if_stream_.is_open()) {
-            LOG_ERR << "open file error. filename:" << filename;
-            return false;
-        }
-        uint64_t index_offset = 0, file_size = 0;
-        if_stream_.seekg(0, std::ios::end);
-        file_size = if_stream_.tellg();
-        if_stream_.seekg(0, std::ios::beg);
-        if (file_size < sizeof(index_offset)) {
+    } else if (MODE_MMAP == open_mode_) {
+        if (!MapFile(filename)) return false;
+        uint64_t index_offset = 0;
+        if (map_size_ < sizeof(index_offset)) {
             LOG_ERR << "file size error.";
             return false;
         }
-        if_stream_.read((char*)&index_offset, sizeof(index_offset));
+        index_offset = *(const uint64_t*)map_data_;
         if (index_offset & 7) {
             LOG_ERR << "check index offset 64bit alignment error.";
             return false;
         }
-        int index_size = 0;
-        if (file_size < index_offset + sizeof(global_index_stream_head) + sizeof(version_) + sizeof(index_size) + sizeof(global_index_stream_tail)) {
-            LOG_ERR << "file size error.";
+        if (index_offset > map_size_) {
+            LOG_ERR << "check index offset error. offset:" << index_offset;
             return false;
         }
-        // read index stream
-        if_stream_.seekg(index_offset, std::ios::beg);
-        std::vector<char> index_stream(file_size - index_offset);
-        if_stream_.read(&index_stream[0], file_size - index_offset);
-        if (!if_stream_.good()) {
-            LOG_ERR << "read index stream error.";
+        // the index is parsed in place
+        uint64_t index_stream_size = 0;
+        if (!GetIndexStreamSize(index_offset, map_size_, index_stream_size)) return false;
+        index_offset_ = index_offset, index_stream_size_ = index_stream_size;
+        return ReadIndex(map_data_ + index_offset, index_stream_size) && (!verify_ || VerifyIndex());
+    } else if (MODE_READ == open_mode_ || MODE_LAZY == open_mode_ || MODE_UPDATE == open_mode_) {
+        read_fd_ = ::open(filename, O_RDONLY);
+        if (read_fd_ == -1) {
+            LOG_ERR << "open file error. filename:" << filename;
             return false;
         }
-        if (index_stream.size() & 7) {
-            LOG_ERR << "check 64bit alignment error.";
+        uint64_t index_offset = 0, file_size = 0;
+        struct stat s;
+        if (fstat(read_fd_, &s) == 0) file_size = s.st_size;
+        if (file_size < sizeof(index_offset) || !ReadAt(0, (char*)&index_offset, sizeof(index_offset))) {
+            LOG_ERR << "file size error.";
             return false;
         }
-        // check head and tail
-        const char *index = &index_stream[0], *index_end = index + index_stream.size() - sizeof(global_index_stream_tail);
-        if (*(uint64_t*)index != global_index_stream_head) {
-            LOG_ERR << "check index stream head error.";
+        if (index_offset & 7) {
+            LOG_ERR << "check index offset 64bit alignment error.";
             return false;
         }
-        if (*(uint64_t*)index_end != global_index_stream_tail) {
-            LOG_ERR << "check index stream tail error.";
+        if (index_offset > file_size) {
+            LOG_ERR << "check index offset error. offset:" << index_offset;
             return false;
         }
-        index += sizeof(global_index_stream_head);
-        index_size = *(int32_t*)index; index += sizeof(index_size);
-        version_ = *(int32_t*)index; index += sizeof(version_);
-        index_end = index + index_size - sizeof(index_size) - sizeof(version_);
-        // parse index stream, and create index map
-        while(index < index_end) {
-            if (index+sizeof(uint32_t) > index_end) return false;
-            // filename len
-            uint32_t len = *(uint32_t*)index;
-            index += sizeof(uint32_t);
-            if (index+len+sizeof(StreamInfo) > index_end) return false;
-            // filename & StreamInfo
-            std::string name(index, len);
-            StreamInfo stream_info = *(StreamInfo*)(index+len);
-            file_index_.insert(std::make_pair(name, stream_info));
-            index += len+sizeof(StreamInfo);
-        }
-        return index==index_end;
+        uint64_t index_stream_size = 0;
+        if (!GetIndexStreamSize(index_offset, file_size, index_stream_size)) return false;
+        index_offset_ = index_offset, index_stream_size_ = index_stream_size;
+        if (MODE_LAZY == open_mode_) return ReadIndexDirectory(index_offset, index_stream_size) && (!verify_ || VerifyIndex());
+        if (MODE_READ == open_mode_) return LoadIndex(index_offset, index_stream_size) && (!verify_ || VerifyIndex());
+        // the index is loaded as in READ mode, the old index is kept until the new one is written
+        return LoadIndex(index_offset, index_stream_size) && (!verify_ || VerifyIndex())
+               && UpdateIndex(index_offset + index_stream_size);
     }
     LOG_ERR << "unknow mode: " << mode;
     return false;
 }
 
-/** @brief close package file name
- *  @param null
+/** @brief get bytes of index stream from its head
+ *  @param index_offset index offset in package file
+ *  @param file_size package file size
+ *  @param size output index stream size, head to tail
  */
-bool Packer::Close() {
-    if (MODE_READ == open_mode_) {
-        if_stream_.close();
-        Reset();
-        return true;
+bool Packer::GetIndexStreamSize(uint64_t index_offset, uint64_t file_size, uint64_t &size) const {
+    int32_t index_size = 0;
+    const uint64_t size_offset = index_offset + sizeof(global_index_stream_head);
+    if (size_offset + sizeof(index_size) > file_size) {
+        LOG_ERR << "file size error.";
+        return false;
     }
-    if (MODE_WRITE != open_mode_) {
-        //LOG_ERR << "unknow mode: " << open_mode_;
-        //return false;
-        Reset();
-        return true;
+    if (nullptr != map_data_) {
+        memcpy(&index_size, map_data_ + size_offset, sizeof(index_size));
+    } else if (!ReadAt(size_offset, (char*)&index_size, sizeof(index_size))) {
+        return false;
     }
-    // write file
-    of_stream_.seekp(0, std::ios::beg);
-    of_stream_.write((char*)&cur_offset_, sizeof(cur_offset_));
-    of_stream_.seekp(0, std::ios::end);
-    of_stream_.write((char*)&global_index_stream_head, sizeof(global_index_stream_head));
-    int index_size = 0;
-    std::ios::pos_type pos = of_stream_.tellp();
-    of_stream_.write((char*)&index_size, sizeof(version_));
-    of_stream_.write((char*)&version_, sizeof(version_));
-    index_size = sizeof(index_size) + sizeof(version_);
-    // write file index
-    for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.begin(); it!=file_index_.end(); it++) {
-        uint32_t len = it->first.length();
-        of_stream_.write((char*)&len, sizeof(len));
-        of_stream_.write(it->first.c_str(), len);
-        of_stream_.write((char*)&it->second, sizeof(it->second));
-        index_size += sizeof(len) + len + sizeof(it->second);
+    if (index_size < (int)(sizeof(index_size) + sizeof(version_))) {
+        LOG_ERR << "check index size error. size:" << index_size;
+        return false;
     }
-    // 64bit alignment
-    if (const int align_size = 7&-(int)index_size) of_stream_.write((char*)&global_zero_alignment, align_size);
-    of_stream_.write((char*)&global_index_stream_tail, sizeof(global_index_stream_tail));
-    // write index size
-    of_stream_.seekp(pos, std::ios::beg);
-    of_stream_.write((char*)&index_size, sizeof(version_));
-    bool ok = of_stream_.good();
-    of_stream_.close();
-    Reset();
-    return ok;
+    // head | index | 64bit alignment | tail
+    size = sizeof(global_index_stream_head) + index_size + (7&-(int)index_size) + sizeof(global_index_stream_tail);
+    if (size > file_size - index_offset) {
+        LOG_ERR << "check index size error. size:" << index_size;
+        return false;
+    }
+    return true;
 }
 
-/** @brief set resource version
- *  @param version resource version (format: xx.xx[.xx][.xx], x must be digit, eg.  3.14 / 3.14.1 / 3.14.15.92)
+/** @brief move the loaded index to the file index of write modes, streams are appended after it. MODE_UPDATE
+ *  @param data_end end of the index in package file
  */
-void Packer::SetVersion(const char *version) {
-    int version_val = 0, val = 0;
-    const char *r = version, *e = r + std::strlen(version);
-    while(r < e) {
-        if (!('0'<=*r && *r<='9')) {
-            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
-            return;
-        }
-        val = 0;
-        while(r<e && '0'<=*r && *r<='9') val = val*10 + (*r++ - '0');
-        if (version_val & 0xFF000000){
-            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
-            return;
-        }
-        version_val = (version_val<<8) + (val|0x80);
-        if (val >= 100) {
-            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
-            return;
-        }
-        if (r==e) break;
-        if (*r=='.' && r[1]) { r++; continue; }
-        LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
-        return;
+bool Packer::UpdateIndex(uint64_t data_end) {
+    std::vector<FileEntry> entries;
+    if (!GetEntries(entries)) return false;
+    for (const FileEntry &entry : entries) file_index_.insert(file_index_.end(), std::make_pair(entry.name, entry.si));
+    // packages with checksums keep them
+    uint64_t checksum[2] = {0};  // stream offset | checksum
+    for (uint32_t i=0; i<checksum_count_; i++) {
+        memcpy(checksum, checksums_ + (uint64_t)i * sizeof(checksum), sizeof(checksum));
+        stream_checksums_.insert(std::make_pair(checksum[0], checksum[1]));
     }
-    version_ = version_val;
-}
+    write_checksums_ = checksum_ || 0 != index_checked_size_;
+    checksums_ = nullptr;
+    checksum_count_ = 0;
+    // packages with front coded names keep them
+    write_front_coding_ = front_coding_ || nullptr != sorted_files_;
+    sorted_files_ = sorted_files_end_ = restarts_ = nullptr;
+    restart_count_ = 0;
+    // shared tables are kept in shared_table_buffers_, new tables are numbered after them
+    index_buffer_.clear();
+    files_ = files_end_ = nullptr;
+    hash_slots_ = nullptr;
+    hash_buffer_.clear();
+    hash_mask_ = 0;
+    file_count_ = 0;
+    shared_tables_.clear();
+    ::close(read_fd_);
+    read_fd_ = -1;
 
-/** @brief get resource version
-*/
-std::string Packer::GetVersion() {
-    if (version_ == 0) return "";
-    char buffer[64], *w = buffer;
-    const char *r = (const char *)&version_;
-    for (int i=sizeof(version_)-1; i>=0; i--) {
-        if (!(r[i] & 0x80)) continue;
-        w += sprintf(w, i==0 ? "%d" : "%d.", r[i] & 0x7F);
+    of_stream_.open(file_name_.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    if (!of_stream_.is_open()) {
+        LOG_ERR << "open file error. filename:" << file_name_;
+        return false;
     }
-    *w = '\0';
-    return buffer;
+    cur_offset_ = data_end;
+    of_stream_.seekp(cur_offset_, std::ios::beg);
+    return of_stream_.good();
 }
 
-/** @brief extract a package file
- *  @param dstpath extract path, current path by default
+/** @brief sync the package file and write the index offset at its begin, MODE_UPDATE
+ *  @param index_offset offset of the index written
  */
-bool Packer::Extract(const char *dstpath) {
-    if (open_mode_ != MODE_READ) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_READ.";
+bool Packer::RepointIndex(uint64_t index_offset) {
+    const int fd = ::open(file_name_.c_str(), O_WRONLY);
+    if (fd == -1) {
+        LOG_ERR << "open file error. filename:" << file_name_;
         return false;
     }
-
-    const char *path = nullptr==dstpath ? "" : dstpath;
-    std::vector<char> file_stream;
-    for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.begin(); it != file_index_.end(); it++) {
-        if (!GetFileStream(it->first.c_str(), file_stream)) {
-            LOG_ERR << "extract file error, filename:" << it->first;
-            return false;
-        }
-        if (!ExtractFile(path, it->first.c_str(), file_stream)) {
-            LOG_ERR << "create file error, filename:" << it->first;
-            return false;
-        }
-    }
-    return true;
+    // streams and index are on disk before the package points at them, one aligned write switches the index
+    bool ok = 0 == fdatasync(fd);
+    ok = ok && sizeof(index_offset) == pwrite(fd, &index_offset, sizeof(index_offset), 0);
+    ok = ok && 0 == fdatasync(fd);
+    ::close(fd);
+    if (!ok) LOG_ERR << "write index offset error. filename:" << file_name_;
+    return ok;
 }
 
-/** @brief extract single file
- *  @param dstpath extract path
- *  @param filename extract filename
- *  @param file_stream file stream
+/** @brief parse index stream
+ *  @param index begin of index stream
+ *  @param size index stream size
  */
-bool Packer::ExtractFile(const char *dstpath, const char *filename, const std::vector<char> &file_stream) {
-    if (open_mode_ != MODE_READ) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_READ.";
+bool Packer::ReadIndex(const char *index, size_t size) {
+    int index_size = 0;
+    if (size < sizeof(global_index_stream_head) + sizeof(version_) + sizeof(index_size) + sizeof(global_index_stream_tail)) {
+        LOG_ERR << "file size error.";
         return false;
     }
-
-    char fullpath[512];
-    JointPath(dstpath, filename, fullpath);
-    if (!MakeDirs(fullpath)) {
-        LOG_ERR << "mkdir error, fullpath:" << fullpath;
+    if (size & 7) {
+        LOG_ERR << "check 64bit alignment error.";
         return false;
     }
-    std::ofstream ofh(fullpath, std::ios::binary);
-    if (!ofh.is_open()) {
-        LOG_ERR << "open file error, filename:" << fullpath;
+    // check head and tail
+    const char *index_begin = index, *index_end = index + size - sizeof(global_index_stream_tail);
+    const bool sectioned = (*(uint64_t*)index == global_index2_stream_head);
+    if (*(uint64_t*)index != global_index_stream_head && !sectioned) {
+        LOG_ERR << "check index stream head error.";
         return false;
     }
-    ofh.write((char*)&file_stream[0], file_stream.size());
-    if (!ofh.good()) {
-        LOG_ERR << "write file error, filename:" << fullpath;
+    if (*(uint64_t*)index_end != global_index_stream_tail) {
+        LOG_ERR << "check index stream tail error.";
         return false;
     }
-    ofh.close();
-    return true;
+    index += sizeof(global_index_stream_head);
+    index_size = *(int32_t*)index; index += sizeof(index_size);
+    version_ = *(int32_t*)index; index += sizeof(version_);
+    if (index_size < (int)(sizeof(index_size) + sizeof(version_))
+        || index_size - sizeof(index_size) - sizeof(version_) > (size_t)(index_end - index)) {
+        LOG_ERR << "check index size error. size:" << index_size;
+        return false;
+    }
+    index_end = index + index_size - sizeof(index_size) - sizeof(version_);
+    // parse index stream
+    if (!sectioned) return ReadFileIndex(index, index_end) && BuildHashTable();
+    files_ = files_end_ = index_end;
+    while (index < index_end) {
+        if (index + sizeof(uint32_t)*2 > index_end) return false;
+        const char *section_begin = index;
+        const uint32_t section = *(uint32_t*)index, section_size = *(uint32_t*)(index + sizeof(uint32_t));
+        index += sizeof(uint32_t)*2;
+        if (section_size > (size_t)(index_end - index)) {
+            LOG_ERR << "check index section size error. section:" << section << ", size:" << section_size;
+            return false;
+        }
+        if (SECTION_FILES == section && !ReadFileIndex(index, index + section_size)) return false;
+        if (SECTION_HASH_TABLE == section && !ReadHashTable(index, index + section_size)) return false;
+        if (SECTION_SHARED_TABLES == section && !ReadSharedTables(index, index + section_size)) return false;
+        if (SECTION_DELTA == section && !ReadDeltaSection(index, index + section_size)) return false;
+        if (SECTION_CHECKSUMS == section && !ReadChecksums(index, index + section_size, section_begin - index_begin)) return false;
+        if (SECTION_SORTED_FILES == section && !ReadSortedFiles(index, index + section_size)) return false;
+        index += section_size;
+    }
+    return nullptr != hash_slots_ || nullptr != sorted_files_ || BuildHashTable();
+}
+
+/** @brief build hash table of indexes without one
+ */
+bool Packer::BuildHashTable() {
+    if (!BuildHashSlots(files_, files_end_, hash_buffer_, file_count_)) {
+        LOG_ERR << "read file entries error.";
+        return false;
+    }
+    hash_slots_ = hash_buffer_.data();
+    hash_mask_ = hash_buffer_.size() - 1;
+    return true;
+}
+
+/** @brief read index stream into index_buffer_ and parse it, READ mode
+ *  @param index_offset index offset in package file
+ *  @param size index stream size
+ */
+bool Packer::LoadIndex(uint64_t index_offset, uint64_t size) {
+    index_buffer_.resize(size);
+    if (!index_buffer_.empty() && !ReadAt(index_offset, &index_buffer_[0], index_buffer_.size())) {
+        LOG_ERR << "read index stream error.";
+        return false;
+    }
+    return ReadIndex(index_buffer_.data(), index_buffer_.size());
+}
+
+/** @brief read head and sections of index stream, file entries and hash slots are left in package file.
+ *      indexes without hash table are loaded whole. LAZY mode
+ *  @param index_offset index offset in package file
+ *  @param size index stream size
+ */
+bool Packer::ReadIndexDirectory(uint64_t index_offset, uint64_t size) {
+    int32_t index_head[4] = {0};  // 64bit head | index size | version
+    uint64_t index_tail = 0;
+    if (size < sizeof(index_head) + sizeof(global_index_stream_tail) || (size & 7)) {
+        LOG_ERR << "file size error.";
+        return false;
+    }
+    if (!ReadAt(index_offset, (char*)index_head, sizeof(index_head))
+        || !ReadAt(index_offset + size - sizeof(index_tail), (char*)&index_tail, sizeof(index_tail))) return false;
+    uint64_t head = 0;
+    memcpy(&head, index_head, sizeof(head));
+    if (head != global_index2_stream_head || index_tail != global_index_stream_tail) {
+        return LoadIndex(index_offset, size);
+    }
+    const int32_t index_size = index_head[2];
+    if (index_size < (int)(sizeof(int32_t) * 2) || index_size - sizeof(int32_t) * 2 > size - sizeof(index_head) - sizeof(index_tail)) {
+        LOG_ERR << "check index size error. size:" << index_size;
+        return false;
+    }
+    version_ = index_head[3];
+    // sections of the directory
+    uint64_t offset = index_offset + sizeof(index_head), end = offset + index_size - sizeof(int32_t) * 2;
+    while (offset < end) {
+        uint32_t section_head[2] = {0};
+        if (offset + sizeof(section_head) > end || !ReadAt(offset, (char*)section_head, sizeof(section_head))) return false;
+        offset += sizeof(section_head);
+        const uint32_t section = section_head[0], section_size = section_head[1];
+        if (section_size > end - offset) {
+            LOG_ERR << "check index section size error. section:" << section << ", size:" << section_size;
+            return false;
+        }
+        if (SECTION_FILES == section) files_offset_ = offset, files_size_ = section_size;
+        if (SECTION_HASH_TABLE == section) {
+            uint32_t hash_head[2] = {0};  // slot count | file count
+            if (section_size < sizeof(hash_head) || !ReadAt(offset, (char*)hash_head, sizeof(hash_head))
+                || !CheckHashTable(hash_head[0], hash_head[1], section_size - sizeof(hash_head))) return false;
+            hash_offset_ = offset + sizeof(hash_head);
+            hash_mask_ = hash_head[0] - 1;
+            file_count_ = hash_head[1];
+        }
+        if (SECTION_SHARED_TABLES == section) {
+            std::vector<char> tables(section_size);
+            if (section_size && !ReadAt(offset, &tables[0], section_size)) return false;
+            if (!ReadSharedTables(tables.data(), tables.data() + tables.size())) return false;
+        }
+        if (SECTION_DELTA == section) {
+            std::vector<char> delta(section_size);
+            if (section_size && !ReadAt(offset, &delta[0], section_size)) return false;
+            if (!ReadDeltaSection(delta.data(), delta.data() + delta.size())) return false;
+        }
+        if (SECTION_CHECKSUMS == section) {
+            // stream checksums are left in package file
+            char checksum_head[sizeof(index_checksum_) + sizeof(checksum_count_)];
+            if (section_size < sizeof(checksum_head) || !ReadAt(offset, checksum_head, sizeof(checksum_head))) return false;
+            memcpy(&index_checksum_, checksum_head, sizeof(index_checksum_));
+            memcpy(&checksum_count_, checksum_head + sizeof(index_checksum_), sizeof(checksum_count_));
+            if ((uint64_t)checksum_count_ * sizeof(uint64_t) * 2 != section_size - sizeof(checksum_head)) {
+                LOG_ERR << "check checksums section error. count:" << checksum_count_;
+                return false;
+            }
+            checksums_offset_ = offset + sizeof(checksum_head);
+            index_checked_size_ = offset - sizeof(section_head) - index_offset;
+        }
+        offset += section_size;
+    }
+    // indexes without hash table are probed in memory, front coded indexes are searched in memory
+    if (0 == hash_offset_) {
+        shared_tables_.clear();
+        shared_table_buffers_.clear();
+        removed_files_.clear();
+        checksum_count_ = 0;
+        checksums_offset_ = index_checksum_ = index_checked_size_ = 0;
+        return LoadIndex(index_offset, size);
+    }
+    return true;
+}
+
+/** @brief map the package file, MODE_MMAP
+ *  @param filename package file name
+ */
+bool Packer::MapFile(const char *filename) {
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) {
+        LOG_ERR << "open file error. filename:" << filename;
+        return false;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size <= 0) {
+        LOG_ERR << "file size error.";
+        ::close(fd);
+        return false;
+    }
+    // the mapping is kept after the file is closed
+    void *data = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == data) {
+        LOG_ERR << "map file error. filename:" << filename;
+        return false;
+    }
+    map_data_ = (const char*)data;
+    map_size_ = s.st_size;
+    return true;
+}
+
+/** @brief unmap the package file
+ */
+void Packer::UnmapFile() {
+    if (map_data_) munmap((void*)map_data_, map_size_);
+    map_data_ = nullptr;
+    map_size_ = 0;
+}
+
+/** @brief set file entries of index, entries are parsed when they are probed
+ *  @param index begin of entries
+ *  @param index_end end of entries
+ */
+bool Packer::ReadFileIndex(const char *index, const char *index_end) {
+    files_ = index;
+    files_end_ = index_end;
+    return true;
+}
+
+/** @brief set front coded entries section of index, entries are parsed when they are searched
+ *  @param index begin of section
+ *  @param index_end end of section
+ */
+bool Packer::ReadSortedFiles(const char *index, const char *index_end) {
+    uint32_t sorted_head[2] = {0};  // file count | restart count
+    if (sizeof(sorted_head) > (size_t)(index_end - index)) return false;
+    memcpy(sorted_head, index, sizeof(sorted_head));
+    index += sizeof(sorted_head);
+    const uint32_t file_count = sorted_head[0], restart_count = sorted_head[1];
+    if (restart_count > file_count || (file_count && !restart_count)
+        || (uint64_t)restart_count * sizeof(uint32_t) > (size_t)(index_end - index)) {
+        LOG_ERR << "check sorted files section error. file count:" << file_count << ", restart count:" << restart_count;
+        return false;
+    }
+    restarts_ = index;
+    restart_count_ = restart_count;
+    sorted_files_ = restarts_ + (uint64_t)restart_count * sizeof(uint32_t);
+    sorted_files_end_ = index_end;
+    file_count_ = file_count;
+    return true;
+}
+
+/** @brief parse a front coded entry, the name is built on the name of the entry before
+ *  @param entry begin of entry, moved to next entry
+ *  @param name name of the entry before, output name of the entry
+ *  @param si output stream info
+ */
+bool Packer::ReadSortedEntry(const char *&entry, std::string &name, StreamInfo &si) const {
+    uint32_t shared = 0, suffix_len = 0;
+    if (!ReadVarint(entry, sorted_files_end_, shared) || !ReadVarint(entry, sorted_files_end_, suffix_len)) return false;
+    if (shared > name.length() || sizeof(StreamInfo) > (size_t)(sorted_files_end_ - entry)
+        || suffix_len > (size_t)(sorted_files_end_ - entry) - sizeof(StreamInfo)) return false;
+    name.resize(shared);
+    name.append(entry, suffix_len);
+    memcpy(&si, entry + suffix_len, sizeof(si));
+    entry += suffix_len + sizeof(si);
+    return true;
+}
+
+/** @brief find the first front coded entry whose name is not less than a key, restart points are binary searched
+ *  @param key name or prefix
+ *  @param key_len key length
+ *  @param entry output next entry
+ *  @param name output name of the entry found
+ *  @param si output stream info of the entry found
+ *  @return false if all names are less or entries are damaged, damaged entries are logged
+ */
+bool Packer::SeekSortedEntry(const char *key, size_t key_len, const char *&entry, std::string &name, StreamInfo &si) const {
+    // names of restart points are whole, they are compared in place
+    auto restart = [this] (uint32_t i, const char *&entry) {
+        uint32_t offset = 0;
+        memcpy(&offset, restarts_ + (uint64_t)i * sizeof(offset), sizeof(offset));
+        entry = sorted_files_ + offset;
+        return offset < (size_t)(sorted_files_end_ - sorted_files_);
+    };
+    uint32_t low = 0, high = restart_count_;
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        const char *restart_entry = nullptr;
+        uint32_t shared = 0, len = 0;
+        if (!restart(mid, restart_entry) || !ReadVarint(restart_entry, sorted_files_end_, shared)
+            || !ReadVarint(restart_entry, sorted_files_end_, len) || 0 != shared || len > (size_t)(sorted_files_end_ - restart_entry)) {
+            LOG_ERR << "read restart point error. restart:" << mid;
+            return false;
+        }
+        if (CompareNames(restart_entry, len, key, key_len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    // names before the restart point found are less than the key, entries are read from the restart point before it
+    if (0 == restart_count_ || !restart(low ? low - 1 : 0, entry)) return false;
+    name.clear();
+    while (entry < sorted_files_end_) {
+        if (!ReadSortedEntry(entry, name, si)) {
+            LOG_ERR << "read file entry error.";
+            return false;
+        }
+        if (CompareNames(name.data(), name.length(), key, key_len) >= 0) return true;
+    }
+    return false;
+}
+
+/** @brief find a file entry of a front coded index
+ *  @param filename file name
+ *  @param si output stream info
+ */
+bool Packer::FindSortedEntry(const char *filename, StreamInfo &si) const {
+    const size_t len = strlen(filename);
+    const char *entry = nullptr;
+    std::string name;
+    return SeekSortedEntry(filename, len, entry, name, si) && name.length() == len && 0 == memcmp(name.data(), filename, len);
+}
+
+/** @brief set hash table section of index, slots are checked when they are probed
+ *  @param index begin of section
+ *  @param index_end end of section
+ */
+bool Packer::ReadHashTable(const char *index, const char *index_end) {
+    if (index + sizeof(uint32_t)*2 > index_end) return false;
+    const uint32_t slot_count = *(uint32_t*)index, file_count = *(uint32_t*)(index + sizeof(uint32_t));
+    index += sizeof(uint32_t)*2;
+    if (!CheckHashTable(slot_count, file_count, index_end - index)) return false;
+    hash_slots_ = (const HashSlot*)index;
+    hash_mask_ = slot_count - 1;
+    file_count_ = file_count;
+    return true;
+}
+
+/** @brief check hash table section header
+ *  @param slot_count slot count
+ *  @param file_count file count
+ *  @param slots_size bytes of slots
+ */
+bool Packer::CheckHashTable(uint32_t slot_count, uint32_t file_count, uint64_t slots_size) {
+    if (0 == slot_count || (slot_count & (slot_count - 1)) || file_count >= slot_count
+        || slots_size != slot_count * sizeof(HashSlot)) {
+        LOG_ERR << "check hash table error. slot count:" << slot_count << ", file count:" << file_count;
+        return false;
+    }
+    return true;
+}
+
+/** @brief find a file entry of index, READ or MMAP mode
+ *  @param filename file name
+ *  @param si output stream info
+ */
+bool Packer::FindEntry(const char *filename, StreamInfo &si) const {
+    if (nullptr == filename) return false;
+    if (nullptr != sorted_files_) return FindSortedEntry(filename, si);
+    if (nullptr == hash_slots_) return 0 != hash_offset_ && ProbeEntry(filename, si);
+    const size_t len = strlen(filename);
+    const uint64_t hash = HashName(filename, len);
+    const uint32_t tag = (uint32_t)(hash >> 32);
+    // there is an empty slot at least, probes stop there
+    for (uint32_t i = (uint32_t)hash & hash_mask_, probes = 0; probes <= hash_mask_; i = (i + 1) & hash_mask_, probes++) {
+        const HashSlot &slot = hash_slots_[i];
+        if (global_empty_slot == slot.offset) return false;
+        if (slot.tag != tag || slot.offset >= (size_t)(files_end_ - files_)) continue;
+        const char *entry = files_ + slot.offset, *name = nullptr;
+        uint32_t name_len = 0;
+        if (!ReadEntry(entry, files_end_, name, name_len, si)) return false;
+        if (name_len == len && 0 == memcmp(name, filename, len)) return true;
+    }
+    return false;
+}
+
+/** @brief find a file entry by reading hash slots and entries of index in package file, LAZY mode
+ *  @param filename file name
+ *  @param si output stream info
+ */
+bool Packer::ProbeEntry(const char *filename, StreamInfo &si) const {
+    const size_t len = strlen(filename);
+    const uint64_t hash = HashName(filename, len);
+    const uint32_t tag = (uint32_t)(hash >> 32);
+    // entries of other names are not read whole
+    std::vector<char> entry(sizeof(uint32_t) + len + sizeof(StreamInfo));
+    for (uint32_t i = (uint32_t)hash & hash_mask_, probes = 0; probes <= hash_mask_; i = (i + 1) & hash_mask_, probes++) {
+        HashSlot slot;
+        if (!ReadAt(hash_offset_ + (uint64_t)i * sizeof(slot), (char*)&slot, sizeof(slot))) return false;
+        if (global_empty_slot == slot.offset) return false;
+        if (slot.tag != tag || slot.offset >= files_size_ || entry.size() > files_size_ - slot.offset) continue;
+        if (!ReadAt(files_offset_ + slot.offset, &entry[0], entry.size())) return false;
+        if (*(uint32_t*)&entry[0] == len && 0 == memcmp(&entry[sizeof(uint32_t)], filename, len)) {
+            memcpy(&si, &entry[sizeof(uint32_t) + len], sizeof(si));
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @brief parse a file entry
+ *  @param entry begin of entry, moved to next entry
+ *  @param end end of entries
+ *  @param name output name, not terminated
+ *  @param len output name length
+ *  @param si output stream info
+ */
+bool Packer::ReadEntry(const char *&entry, const char *end, const char *&name, uint32_t &len, StreamInfo &si) {
+    if (entry + sizeof(uint32_t) + sizeof(StreamInfo) > end) return false;
+    len = *(uint32_t*)entry;
+    if (len > (size_t)(end - entry) - sizeof(uint32_t) - sizeof(StreamInfo)) return false;
+    name = entry + sizeof(uint32_t);
+    memcpy(&si, name + len, sizeof(si));
+    entry = name + len + sizeof(si);
+    return true;
+}
+
+/** @brief build hash table of file entries, slot count is a power of 2 not less than twice the file count
+ *  @param files begin of entries
+ *  @param files_end end of entries
+ *  @param slots output slots
+ *  @param file_count output file count
+ */
+bool Packer::BuildHashSlots(const char *files, const char *files_end, std::vector<HashSlot> &slots, uint32_t &file_count) {
+    const char *entry = files, *name = nullptr;
+    uint32_t len = 0;
+    StreamInfo si(0, 0);
+    file_count = 0;
+    while (entry < files_end) {
+        if (!ReadEntry(entry, files_end, name, len, si)) return false;
+        file_count++;
+    }
+    uint32_t slot_count = 1;
+    while (slot_count < (uint64_t)file_count * 2) slot_count <<= 1;
+    const HashSlot empty_slot = {0, global_empty_slot};
+    slots.assign(slot_count, empty_slot);
+    for (entry = files; entry < files_end; ) {
+        const uint32_t offset = entry - files;
+        ReadEntry(entry, files_end, name, len, si);
+        const uint64_t hash = HashName(name, len);
+        uint32_t i = (uint32_t)hash & (slot_count - 1);
+        while (global_empty_slot != slots[i].offset) i = (i + 1) & (slot_count - 1);
+        slots[i].tag = (uint32_t)(hash >> 32);
+        slots[i].offset = offset;
+    }
+    return true;
+}
+
+/** @brief hash of file name, FNV-1a
+ *  @param name file name
+ *  @param len name length
+ */
+uint64_t Packer::HashName(const char *name, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i=0; i<len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/** @brief parse shared tables section of index, decode tables are built
+ *  @param index begin of section
+ *  @param index_end end of section
+ */
+bool Packer::ReadSharedTables(const char *index, const char *index_end) {
+    if (index + sizeof(uint32_t) > index_end) return false;
+    const uint32_t table_count = *(uint32_t*)index;
+    index += sizeof(uint32_t);
+    for (uint32_t i=0; i<table_count; i++) {
+        if (index + sizeof(uint32_t) > index_end) return false;
+        const uint32_t table_size = *(uint32_t*)index;
+        index += sizeof(uint32_t);
+        if (table_size > (size_t)(index_end - index)) return false;
+        std::unique_ptr<huffman::Huffman> shared_decode(new huffman::Huffman());
+        if (!shared_decode->SetSharedTable(std::vector<char>(index, index + table_size))) {
+            LOG_ERR << "read shared table error. table:" << i;
+            return false;
+        }
+        shared_tables_.push_back(std::move(shared_decode));
+        shared_table_buffers_.push_back(std::vector<char>(index, index + table_size));
+        index += table_size;
+    }
+    return index==index_end;
+}
+
+/** @brief parse delta section of index
+ *  @param index begin of section
+ *  @param index_end end of section
+ */
+bool Packer::ReadDeltaSection(const char *index, const char *index_end) {
+    uint32_t removed_count = 0;
+    if (index + sizeof(delta_base_hash_) + sizeof(removed_count) > index_end) return false;
+    memcpy(&delta_base_hash_, index, sizeof(delta_base_hash_));
+    index += sizeof(delta_base_hash_);
+    memcpy(&removed_count, index, sizeof(removed_count));
+    index += sizeof(removed_count);
+    for (uint32_t i=0; i<removed_count; i++) {
+        uint32_t len = 0;
+        if (index + sizeof(len) > index_end) return false;
+        memcpy(&len, index, sizeof(len));
+        index += sizeof(len);
+        if (len > (size_t)(index_end - index)) return false;
+        removed_files_.insert(std::string(index, len));
+        index += len;
+    }
+    is_delta_ = true;
+    return index==index_end;
+}
+
+/** @brief parse checksums section of index, checksums of streams are found when they are checked
+ *  @param index begin of section
+ *  @param index_end end of section
+ *  @param checked_size bytes of index stream before the section
+ */
+bool Packer::ReadChecksums(const char *index, const char *index_end, uint64_t checked_size) {
+    uint32_t count = 0;
+    if (index + sizeof(index_checksum_) + sizeof(count) > index_end) return false;
+    memcpy(&index_checksum_, index, sizeof(index_checksum_));
+    index += sizeof(index_checksum_);
+    memcpy(&count, index, sizeof(count));
+    index += sizeof(count);
+    if ((uint64_t)count * sizeof(uint64_t) * 2 != (uint64_t)(index_end - index)) {
+        LOG_ERR << "check checksums section error. count:" << count;
+        return false;
+    }
+    checksums_ = index;
+    checksum_count_ = count;
+    index_checked_size_ = checked_size;
+    return true;
+}
+
+/** @brief find the checksum of a stream
+ *  @param offset stream offset
+ *  @param checksum output checksum
+ *  @return false if the stream has no checksum
+ */
+bool Packer::FindChecksum(uint64_t offset, uint64_t &checksum) const {
+    uint64_t entry[2] = {0};  // stream offset | checksum
+    uint32_t low = 0, high = checksum_count_;
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        if (checksums_) {
+            memcpy(entry, checksums_ + (uint64_t)mid * sizeof(entry), sizeof(entry));
+        } else if (!ReadAt(checksums_offset_ + (uint64_t)mid * sizeof(entry), (char*)entry, sizeof(entry))) {
+            return false;
+        }
+        if (entry[0] == offset) {
+            checksum = entry[1];
+            return true;
+        }
+        if (entry[0] < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+/** @brief check the index checksum, indexes without checksum pass
+ */
+bool Packer::VerifyIndex() const {
+    if (0 == index_checked_size_) return true;
+    uint64_t hash = 0;
+    if (!HashRange(index_offset_, index_checked_size_, hash)) return false;
+    if (hash != index_checksum_) {
+        LOG_ERR << "check index checksum error. filename:" << file_name_;
+        return false;
+    }
+    return true;
+}
+
+/** @brief check head, tail and checksum of a stream, the whole stream is read
+ *  @param si stream info
+ */
+bool Packer::VerifyStream(const StreamInfo &si) const {
+    uint64_t head = 0, tail = 0, checksum = 0, hash = 0;
+    if (si.size < sizeof(head) + sizeof(tail) || !ReadAt(si.offset, (char*)&head, sizeof(head))
+        || !ReadAt(si.offset + si.size - sizeof(tail), (char*)&tail, sizeof(tail))) {
+        LOG_ERR << "stream size error, offset:" << si.offset << ", size:" << si.size;
+        return false;
+    }
+    if ((head != global_codec_stream_head && head != global_stream_head) || tail != global_stream_tail) {
+        LOG_ERR << "check stream error. offset:" << si.offset;
+        return false;
+    }
+    if (!FindChecksum(si.offset, checksum)) return true;
+    if (!HashRange(si.offset, si.size, hash)) return false;
+    if (hash != checksum) {
+        LOG_ERR << "check stream checksum error. offset:" << si.offset;
+        return false;
+    }
+    return true;
+}
+
+/** @brief hash bytes of package file, XXH64
+ *  @param offset offset in package file
+ *  @param size byte count
+ *  @param hash output hash
+ */
+bool Packer::HashRange(uint64_t offset, uint64_t size, uint64_t &hash) const {
+    // mapped bytes are hashed in place
+    if (nullptr != map_data_) {
+        if (offset > map_size_ || size > map_size_ - offset) {
+            LOG_ERR << "read file error. offset:" << offset << ", size:" << size;
+            return false;
+        }
+        hash = utility::XxHash64::Hash(map_data_ + offset, size);
+        return true;
+    }
+    utility::XxHash64 hasher;
+    std::vector<char> buffer((size_t)std::min((uint64_t)global_block_size, size));
+    for (uint64_t pos=0; pos<size; pos+=buffer.size()) {
+        const size_t read_size = (size_t)std::min((uint64_t)buffer.size(), size - pos);
+        if (!ReadAt(offset + pos, &buffer[0], read_size)) return false;
+        hasher.Update(buffer.data(), read_size);
+    }
+    hash = hasher.Digest();
+    return true;
+}
+
+/** @brief hash a stream written to the package file, read back from the file
+ *  @param si stream info
+ *  @param hash output hash
+ */
+bool Packer::HashWrittenStream(const StreamInfo &si, uint64_t &hash) {
+    of_stream_.flush();
+    std::ifstream stream(file_name_.c_str(), std::ios::binary);
+    stream.seekg(si.offset, std::ios::beg);
+    utility::XxHash64 hasher;
+    std::vector<char> buffer((size_t)std::min((uint64_t)global_block_size, si.size));
+    for (uint64_t pos=0; pos<si.size && stream; pos+=buffer.size()) {
+        const size_t read_size = (size_t)std::min((uint64_t)buffer.size(), si.size - pos);
+        stream.read(&buffer[0], read_size);
+        hasher.Update(buffer.data(), read_size);
+    }
+    if (!stream) {
+        LOG_ERR << "read stream error. offset:" << si.offset << ", size:" << si.size;
+        return false;
+    }
+    hash = hasher.Digest();
+    return true;
+}
+
+/** @brief close package file name
+ *  @param null
+ */
+bool Packer::Close() {
+    if (!IsWritable()) {
+        //LOG_ERR << "unknow mode: " << open_mode_;
+        //return false;
+        Reset();
+        return true;
+    }
+    // streams waiting for a shared table
+    bool ok = FlushSharedStreams();
+    // write file, an updated package points at the new index when it is written
+    const bool update = MODE_UPDATE == open_mode_;
+    if (!update) {
+        of_stream_.seekp(0, std::ios::beg);
+        of_stream_.write((char*)&cur_offset_, sizeof(cur_offset_));
+    }
+    // bytes after the last stream are left by large files which fail or are stored after coding
+    of_stream_.seekp(cur_offset_, std::ios::beg);
+    // packages with few files and without shared tables keep the index readable by old packers
+    const bool sectioned = !shared_table_buffers_.empty() || file_index_.size() >= global_hash_index_min_files || is_delta_
+                           || write_checksums_ || write_front_coding_;
+    std::vector<char> files_section, index_stream;
+    if (write_front_coding_) {
+        // a name keeps the prefix it shares with the name before, restart points share nothing
+        std::vector<char> entries;
+        std::vector<uint32_t> restarts;
+        const std::string *last_name = nullptr;
+        uint32_t entry_count = 0;
+        for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.begin(); it!=file_index_.end(); it++) {
+            const std::string &name = it->first;
+            uint32_t shared = 0;
+            if (0 == entry_count++ % global_restart_interval) {
+                restarts.push_back(entries.size());
+            } else {
+                while (shared < name.length() && shared < last_name->length() && name[shared] == (*last_name)[shared]) shared++;
+            }
+            AppendVarint(entries, shared);
+            AppendVarint(entries, name.length() - shared);
+            AppendBytes(entries, name.data() + shared, name.length() - shared);
+            AppendBytes(entries, &it->second, sizeof(it->second));
+            last_name = &name;
+        }
+        const uint32_t sorted_head[2] = {(uint32_t)file_index_.size(), (uint32_t)restarts.size()};  // file count | restart count
+        AppendBytes(files_section, sorted_head, sizeof(sorted_head));
+        AppendBytes(files_section, restarts.data(), restarts.size() * sizeof(uint32_t));
+        AppendBytes(files_section, entries.data(), entries.size());
+        // front coded entries are binary searched, there is no hash table
+        AppendSection(index_stream, SECTION_SORTED_FILES, files_section);
+    } else {
+        for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.begin(); it!=file_index_.end(); it++) {
+            const uint32_t len = it->first.length();
+            AppendBytes(files_section, &len, sizeof(len));
+            AppendBytes(files_section, it->first.c_str(), len);
+            AppendBytes(files_section, &it->second, sizeof(it->second));
+        }
+        if (sectioned) {
+            AppendSection(index_stream, SECTION_FILES, files_section);
+            // hash table of file entries
+            std::vector<HashSlot> slots;
+            uint32_t file_count = 0;
+            if (!BuildHashSlots(files_section.data(), files_section.data() + files_section.size(), slots, file_count)) ok = false;
+            const uint32_t slot_count = slots.size();
+            std::vector<char> hash_section;
+            AppendBytes(hash_section, &slot_count, sizeof(slot_count));
+            AppendBytes(hash_section, &file_count, sizeof(file_count));
+            AppendBytes(hash_section, slots.data(), slots.size() * sizeof(HashSlot));
+            AppendSection(index_stream, SECTION_HASH_TABLE, hash_section);
+        } else {
+            index_stream.swap(files_section);
+        }
+    }
+    if (!shared_table_buffers_.empty()) {
+        const uint32_t table_count = shared_table_buffers_.size();
+        std::vector<char> shared_section;
+        AppendBytes(shared_section, &table_count, sizeof(table_count));
+        for (const auto &table : shared_table_buffers_) {
+            const uint32_t table_size = table.size();
+            AppendBytes(shared_section, &table_size, sizeof(table_size));
+            AppendBytes(shared_section, table.data(), table_size);
+        }
+        AppendSection(index_stream, SECTION_SHARED_TABLES, shared_section);
+    }
+    if (is_delta_) {
+        const uint32_t removed_count = removed_files_.size();
+        std::vector<char> delta_section;
+        AppendBytes(delta_section, &delta_base_hash_, sizeof(delta_base_hash_));
+        AppendBytes(delta_section, &removed_count, sizeof(removed_count));
+        for (const std::string &removed : removed_files_) {
+            const uint32_t len = removed.length();
+            AppendBytes(delta_section, &len, sizeof(len));
+            AppendBytes(delta_section, removed.c_str(), len);
+        }
+        AppendSection(index_stream, SECTION_DELTA, delta_section);
+    }
+    const uint64_t &index_head = sectioned ? global_index2_stream_head : global_index_stream_head;
+    std::vector<char> checksum_section;
+    if (write_checksums_) {
+        // checksums of streams of the index in offset order, the index checksum is set when the index size is known
+        std::map<uint64_t, uint64_t> checksums;
+        for (std::map<std::string, StreamInfo>::const_iterator it = file_index_.begin(); it!=file_index_.end(); it++) {
+            std::map<uint64_t, uint64_t>::const_iterator checksum = stream_checksums_.find(it->second.offset);
+            if (checksum != stream_checksums_.end()) checksums.insert(*checksum);
+        }
+        const uint32_t checksum_count = checksums.size();
+        checksum_section.resize(sizeof(uint64_t));
+        AppendBytes(checksum_section, &checksum_count, sizeof(checksum_count));
+        for (const auto &checksum : checksums) {
+            AppendBytes(checksum_section, &checksum.first, sizeof(checksum.first));
+            AppendBytes(checksum_section, &checksum.second, sizeof(checksum.second));
+        }
+    }
+    const int index_size = sizeof(index_size) + sizeof(version_) + index_stream.size()
+                           + (write_checksums_ ? sizeof(uint32_t) * 2 + checksum_section.size() : 0);
+    if (write_checksums_) {
+        // the checksums section is the last one, the index checksum covers the index stream before it
+        utility::XxHash64 hasher;
+        hasher.Update(&index_head, sizeof(index_head));
+        hasher.Update(&index_size, sizeof(index_size));
+        hasher.Update(&version_, sizeof(version_));
+        hasher.Update(index_stream.data(), index_stream.size());
+        const uint64_t index_checksum = hasher.Digest();
+        memcpy(&checksum_section[0], &index_checksum, sizeof(index_checksum));
+        AppendSection(index_stream, SECTION_CHECKSUMS, checksum_section);
+    }
+    // write index
+    of_stream_.write((char*)&index_head, sizeof(index_head));
+    of_stream_.write((char*)&index_size, sizeof(index_size));
+    of_stream_.write((char*)&version_, sizeof(version_));
+    if (!index_stream.empty()) of_stream_.write(&index_stream[0], index_stream.size());
+    // 64bit alignment
+    if (const int align_size = 7&-(int)index_size) of_stream_.write((char*)&global_zero_alignment, align_size);
+    of_stream_.write((char*)&global_index_stream_tail, sizeof(global_index_stream_tail));
+    ok = ok && of_stream_.good();
+    const std::streamoff file_size = of_stream_.tellp();
+    of_stream_.close();
+    ok = ok && (!update || RepointIndex(cur_offset_));
+    if (ok && 0 != truncate(file_name_.c_str(), file_size)) {
+        LOG_ERR << "truncate package file error. filename: " << file_name_;
+        ok = false;
+    }
+    Reset();
+    return ok;
+}
+
+/** @brief set resource version
+ *  @param version resource version (format: xx.xx[.xx][.xx], x must be digit, eg.  3.14 / 3.14.1 / 3.14.15.92)
+ */
+void Packer::SetVersion(const char *version) {
+    int version_val = 0, val = 0;
+    const char *r = version, *e = r + std::strlen(version);
+    while(r < e) {
+        if (!('0'<=*r && *r<='9')) {
+            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
+            return;
+        }
+        val = 0;
+        while(r<e && '0'<=*r && *r<='9') val = val*10 + (*r++ - '0');
+        if (version_val & 0xFF000000){
+            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
+            return;
+        }
+        version_val = (version_val<<8) + (val|0x80);
+        if (val >= 100) {
+            LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
+            return;
+        }
+        if (r==e) break;
+        if (*r=='.' && r[1]) { r++; continue; }
+        LOG_WARN << "format must be: xx.xx[.xx][.xx], x is a digit, eg. 3.14 / 3.14.1 / 3.14.15.92";
+        return;
+    }
+    version_ = version_val;
+}
+
+/** @brief get resource version
+*/
+std::string Packer::GetVersion() {
+    if (version_ == 0) return "";
+    char buffer[64], *w = buffer;
+    const char *r = (const char *)&version_;
+    for (int i=sizeof(version_)-1; i>=0; i--) {
+        if (!(r[i] & 0x80)) continue;
+        w += sprintf(w, i==0 ? "%d" : "%d.", r[i] & 0x7F);
+    }
+    *w = '\0';
+    return buffer;
+}
+
+/** @brief extract a package file, files are extracted on the workers of SetThreads
+ *  @param dstpath extract path, current path by default
+ */
+bool Packer::Extract(const char *dstpath) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+
+    const char *path = nullptr==dstpath ? "" : dstpath;
+    std::vector<FileEntry> entries;
+    if (!GetEntries(entries)) return false;
+    // files of one stream are extracted together
+    std::vector<std::vector<std::string> > streams;
+    std::map<std::pair<const Packer*, uint64_t>, size_t> stream_ids;
+    std::set<std::string> dirs;
+    char fullpath[512];
+    for (const FileEntry &entry : entries) {
+        const size_t id = stream_ids.insert(std::make_pair(std::make_pair(entry.packer, entry.si.offset), streams.size())).first->second;
+        if (id == streams.size()) streams.push_back(std::vector<std::string>());
+        streams[id].push_back(entry.name);
+        JointPath(path, streams[id].back().c_str(), fullpath);
+        if (const char *slash = strrchr(fullpath, '/')) dirs.insert(std::string((const char*)fullpath, slash + 1));
+    }
+    // directories are created once, files are decoded and written on the workers
+    for (const std::string &dir : dirs) {
+        if (!MakeDirs(dir.c_str())) {
+            LOG_ERR << "mkdir error, path:" << dir;
+            return false;
+        }
+    }
+    std::atomic<bool> ok(true);
+    auto extract_file = [this, path, &streams, &ok] (size_t i) {
+        if (!ok) return;
+        if (!ExtractFile(path, streams[i])) {
+            LOG_ERR << "extract file error, filename:" << streams[i][0];
+            ok = false;
+        }
+    };
+    if (nullptr != thread_pool_) {
+        thread_pool_->ParallelFor(streams.size(), extract_file);
+    } else {
+        for (size_t i=0; i<streams.size(); i++) extract_file(i);
+    }
+    return ok;
+}
+
+/** @brief extract files of one stream, file stream is decoded once and written in chunks to every file,
+ *      directories are created by Extract
+ *  @param dstpath extract path
+ *  @param filenames extract filenames
+ */
+bool Packer::ExtractFile(const char *dstpath, const std::vector<std::string> &filenames) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+
+    char fullpath[512];
+    std::vector<std::ofstream> ofhs(filenames.size());
+    for (size_t i=0; i<filenames.size(); i++) {
+        JointPath(dstpath, filenames[i].c_str(), fullpath);
+        ofhs[i].open(fullpath, std::ios::binary);
+        if (!ofhs[i].is_open()) {
+            LOG_ERR << "open file error, filename:" << fullpath;
+            return false;
+        }
+    }
+    const bool read_ok = !filenames.empty() && ReadFileStream(filenames[0].c_str(), [&ofhs] (const char *data, size_t size) {
+        for (std::ofstream &ofh : ofhs) {
+            if (!ofh.write(data, size)) return false;
+        }
+        return true;
+    });
+    if (!read_ok) {
+        LOG_ERR << "write file error, filename:" << filenames[0];
+        return false;
+    }
+    for (std::ofstream &ofh : ofhs) ofh.close();
+    return true;
+}
+
+/** @brief get file entries of index, entries of LAZY mode are read into a buffer
+ *  @param files_buffer buffer of entries read
+ *  @param files output begin of entries
+ *  @param files_end output end of entries
+ */
+bool Packer::GetFileEntries(std::vector<char> &files_buffer, const char *&files, const char *&files_end) const {
+    files = files_, files_end = files_end_;
+    if (nullptr != files) return true;
+    files_buffer.resize(files_size_);
+    if (!files_buffer.empty() && !ReadAt(files_offset_, &files_buffer[0], files_buffer.size())) return false;
+    files = files_buffer.data(), files_end = files + files_buffer.size();
+    return true;
+}
+
+/** @brief get file entries in name order, entries of an overlaid delta replace or remove entries of the package
+ *  @param entries output file entries
+ */
+bool Packer::GetEntries(std::vector<FileEntry> &entries) const {
+    const char *name = nullptr, *files = nullptr, *files_end = nullptr;
+    uint32_t len = 0;
+    StreamInfo si(0, 0);
+    std::vector<char> files_buffer;
+    entries.clear();
+    if (nullptr != sorted_files_) {
+        std::string sorted_name;
+        for (const char *entry = sorted_files_; entry < sorted_files_end_; ) {
+            if (!ReadSortedEntry(entry, sorted_name, si)) {
+                LOG_ERR << "read file entry error.";
+                return false;
+            }
+            const FileEntry file_entry = {sorted_name, this, si};
+            if (nullptr == FindDelta(file_entry.name.c_str())) entries.push_back(file_entry);
+        }
+    }
+    if (!GetFileEntries(files_buffer, files, files_end)) return false;
+    for (const char *entry = files; entry < files_end; ) {
+        if (!ReadEntry(entry, files_end, name, len, si)) {
+            LOG_ERR << "read file entry error.";
+            return false;
+        }
+        const FileEntry file_entry = {std::string(name, len), this, si};
+        if (nullptr == FindDelta(file_entry.name.c_str())) entries.push_back(file_entry);
+    }
+    if (!overlay_) return true;
+
+    // entries of both indexes are sorted by name
+    std::vector<FileEntry> package_entries, delta_entries;
+    if (!overlay_->GetEntries(delta_entries)) return false;
+    package_entries.swap(entries);
+    std::merge(package_entries.begin(), package_entries.end(), delta_entries.begin(), delta_entries.end(), std::back_inserter(entries),
+               [] (const FileEntry &a, const FileEntry &b) { return a.name < b.name; });
+    return true;
+}
+
+/** @brief get the overlaid delta if it holds or removes a file
+ *  @param filename filename in Package
+ *  @return delta package, nullptr if the file is read from this package
+ */
+Packer *Packer::FindDelta(const char *filename) const {
+    if (!overlay_ || nullptr == filename) return nullptr;
+    StreamInfo si(0, 0);
+    if (overlay_->FindEntry(filename, si) || overlay_->removed_files_.count(filename)) return overlay_.get();
+    return nullptr;
+}
+
+/** @brief hash the index stream, a delta refers to its base by it
+ *  @param hash output XXH64 of the index stream
+ */
+bool Packer::GetIndexHash(uint64_t &hash) const {
+    return HashRange(index_offset_, index_stream_size_, hash);
+}
+
+/** @brief hash the content of a file, the file is decoded in chunks
+ *  @param filename filename in Package
+ *  @param key output content of file
+ */
+bool Packer::HashFile(const char *filename, ContentKey &key) {
+    utility::XxHash64 hashers[2] = {utility::XxHash64(global_content_seeds[0]), utility::XxHash64(global_content_seeds[1])};
+    key.size = 0;
+    const bool read_ok = ReadFileStream(filename, [&hashers, &key] (const char *data, size_t size) {
+        hashers[0].Update(data, size);
+        hashers[1].Update(data, size);
+        key.size += size;
+        return true;
+    }, global_block_size);
+    if (!read_ok) return false;
+    key.hash[0] = hashers[0].Digest(), key.hash[1] = hashers[1].Digest();
+    return true;
+}
+
+/** @brief copy a stream to the end of a package opened in MODE_WRITE, head and tail are checked
+ *  @param si stream info
+ *  @param table_base added to the table id of CODEC_SHARED_HUFFMAN streams
+ *  @param package output package
+ */
+bool Packer::CopyStream(const StreamInfo &si, uint32_t table_base, Packer &package) const {
+    uint64_t head = 0, tail = 0;
+    if (si.size < sizeof(head) + sizeof(tail) || (si.size & 7)) {
+        LOG_ERR << "stream size error, offset:" << si.offset << ", size:" << si.size;
+        return false;
+    }
+    // streams are copied in chunks
+    std::vector<char> buffer;
+    utility::XxHash64 hasher;
+    for (uint64_t offset=0; offset<si.size; offset+=global_block_size) {
+        const size_t size = (size_t)std::min((uint64_t)global_block_size, si.size - offset);
+        buffer.resize(size);
+        if (!ReadAt(si.offset + offset, &buffer[0], size)) return false;
+        if (0 == offset) {
+            memcpy(&head, &buffer[0], sizeof(head));
+            StreamHeader header;
+            if (global_codec_stream_head == head && size >= sizeof(head) + sizeof(header)) {
+                // shared tables are numbered in the tables of the package
+                memcpy(&header, &buffer[sizeof(head)], sizeof(header));
+                if (CODEC_SHARED_HUFFMAN == header.codec) header.flags += table_base;
+                memcpy(&buffer[sizeof(head)], &header, sizeof(header));
+            }
+        }
+        if (offset + size == si.size) memcpy(&tail, &buffer[size - sizeof(tail)], sizeof(tail));
+        if (package.write_checksums_) hasher.Update(buffer.data(), size);
+        package.of_stream_.write(&buffer[0], size);
+    }
+    if ((head != global_codec_stream_head && head != global_stream_head) || tail != global_stream_tail) {
+        LOG_ERR << "check stream error. offset:" << si.offset;
+        return false;
+    }
+    if (package.write_checksums_) package.stream_checksums_[package.cur_offset_] = hasher.Digest();
+    package.cur_offset_ += si.size;
+    return package.of_stream_.good();
+}
+
+/** @brief copy files to a package opened in MODE_WRITE, streams are copied without decoding in package order
+ *      and a stream of many files once. shared tables of the package and its delta are appended to the tables
+ *  @param entries file entries of this package or its delta
+ *  @param package output package
+ */
+bool Packer::CopyFiles(const std::vector<FileEntry> &entries, Packer &package) const {
+    // tables of the delta are numbered after the tables of the package
+    std::vector<std::vector<char> > &tables = package.shared_table_buffers_;
+    const uint32_t table_bases[2] = {(uint32_t)tables.size(), (uint32_t)(tables.size() + shared_table_buffers_.size())};
+    tables.insert(tables.end(), shared_table_buffers_.begin(), shared_table_buffers_.end());
+    if (overlay_) tables.insert(tables.end(), overlay_->shared_table_buffers_.begin(), overlay_->shared_table_buffers_.end());
+
+    // streams of the package in package order then streams of the delta, source 0 is the package and 1 the delta
+    std::map<std::pair<int, uint64_t>, StreamInfo> streams;
+    for (const FileEntry &entry : entries) {
+        streams.insert(std::make_pair(std::make_pair(entry.packer == this ? 0 : 1, entry.si.offset), entry.si));
+    }
+    for (auto &stream : streams) {
+        const Packer *source = stream.first.first ? overlay_.get() : this;
+        const uint64_t offset = package.cur_offset_;
+        if (!source->CopyStream(stream.second, table_bases[stream.first.first], package)) return false;
+        stream.second.offset = offset;
+    }
+    for (const FileEntry &entry : entries) {
+        const StreamInfo &si = streams.find(std::make_pair(entry.packer == this ? 0 : 1, entry.si.offset))->second;
+        package.file_index_.insert(std::make_pair(entry.name, si));
+    }
+    return true;
+}
+
+/** @brief write files of the package to a new package file, streams are copied without decoding in the order
+ *      of the package, streams of replaced and removed files are left out. files of an overlaid delta replace or
+ *      remove files of the package, the new package is the delta applied. read modes
+ *  @param filename new package file name, not the opened one
+ */
+bool Packer::Compact(const char *filename) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+    if (nullptr == filename || file_name_ == filename || (overlay_ && overlay_->file_name_ == filename)) {
+        LOG_ERR << "compact filename error.";
+        return false;
+    }
+
+    std::vector<FileEntry> entries;
+    if (!GetEntries(entries)) return false;
+    Packer compacted;
+    if (!compacted.Open(filename, MODE_WRITE)) return false;
+    compacted.version_ = version_;
+    compacted.write_checksums_ = checksum_ || 0 != index_checked_size_ || (overlay_ && 0 != overlay_->index_checked_size_);
+    compacted.write_front_coding_ = front_coding_ || nullptr != sorted_files_ || (overlay_ && nullptr != overlay_->sorted_files_);
+    // a compacted delta keeps its base, a package with a delta overlaid is a whole package
+    if (!overlay_) {
+        compacted.is_delta_ = is_delta_;
+        compacted.delta_base_hash_ = delta_base_hash_;
+        compacted.removed_files_ = removed_files_;
+    }
+    const bool success = CopyFiles(entries, compacted);
+    // a package which fails is not left
+    if (!compacted.Close() || !success) {
+        LOG_ERR << "compact package error. filename:" << filename;
+        remove(filename);
+        return false;
+    }
+    return true;
+}
+
+/** @brief write a delta package of the opened package against a base package. files are compared by the hash of
+ *      their content, streams of added and replaced files are copied without decoding, removed files are listed.
+ *      the delta refers to the exact index of the base. read modes
+ *  @param base_filename base package file name
+ *  @param filename delta package file name
+ *  @param stats output delta statistics
+ */
+bool Packer::MakeDelta(const char *base_filename, const char *filename, DeltaStats &stats) {
+    memset(&stats, 0, sizeof(stats));
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+    if (overlay_) {
+        LOG_ERR << "check delta fail. a delta is overlaid on the package.";
+        return false;
+    }
+    if (nullptr == base_filename || nullptr == filename || file_name_ == filename || 0 == strcmp(base_filename, filename)) {
+        LOG_ERR << "delta filename error.";
+        return false;
+    }
+
+    Packer base;
+    uint64_t base_hash = 0;
+    std::vector<FileEntry> base_entries, entries, delta_entries;
+    if (!base.Open(base_filename, MODE_MMAP) || !base.GetIndexHash(base_hash)) return false;
+    if (!base.GetEntries(base_entries) || !GetEntries(entries)) return false;
+    // a stream of files of the same content is hashed once
+    std::map<uint64_t, ContentKey> base_keys, keys;
+    auto hash_file = [] (Packer &package, const FileEntry &entry, std::map<uint64_t, ContentKey> &keys, ContentKey &key) {
+        std::map<uint64_t, ContentKey>::const_iterator it = keys.find(entry.si.offset);
+        if (it != keys.end()) {
+            key = it->second;
+            return true;
+        }
+        if (!package.HashFile(entry.name.c_str(), key)) return false;
+        keys.insert(std::make_pair(entry.si.offset, key));
+        return true;
+    };
+    // entries of both indexes are sorted by name
+    std::set<std::string> removed;
+    std::vector<FileEntry>::const_iterator base_entry = base_entries.begin();
+    for (const FileEntry &entry : entries) {
+        for (; base_entry != base_entries.end() && base_entry->name < entry.name; ++base_entry) removed.insert(base_entry->name);
+        if (base_entry == base_entries.end() || base_entry->name != entry.name) {
+            stats.added++;
+            delta_entries.push_back(entry);
+            continue;
+        }
+        ContentKey key, base_key;
+        if (!hash_file(*this, entry, keys, key) || !hash_file(base, *base_entry, base_keys, base_key)) return false;
+        ++base_entry;
+        if (key < base_key || base_key < key) {
+            stats.replaced++;
+            delta_entries.push_back(entry);
+        } else {
+            stats.unchanged++;
+        }
+    }
+    for (; base_entry != base_entries.end(); ++base_entry) removed.insert(base_entry->name);
+    stats.removed = removed.size();
+
+    Packer delta;
+    if (!delta.Open(filename, MODE_WRITE)) return false;
+    delta.version_ = version_;
+    delta.write_checksums_ = checksum_ || 0 != index_checked_size_;
+    delta.write_front_coding_ = front_coding_ || nullptr != sorted_files_;
+    delta.is_delta_ = true;
+    delta.delta_base_hash_ = base_hash;
+    delta.removed_files_.swap(removed);
+    const bool success = CopyFiles(delta_entries, delta);
+    // a package which fails is not left
+    if (!delta.Close() || !success) {
+        LOG_ERR << "make delta package error. filename:" << filename;
+        remove(filename);
+        return false;
+    }
+    return true;
+}
+
+/** @brief overlay a delta package made against the opened package, lookups resolve to the delta first and removed
+ *      files are not found. the delta is opened in the open mode of the package and closed by Close. read modes
+ *  @param filename delta package file name
+ *  @return fail if the delta is not made against the index of the package, or a delta is overlaid already
+ */
+bool Packer::OpenDelta(const char *filename) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+    if (overlay_ || nullptr == filename) {
+        LOG_ERR << "check delta fail. a delta is overlaid on the package.";
+        return false;
+    }
+
+    std::unique_ptr<Packer> delta(new Packer());
+    delta->SetVerify(verify_);
+    if (!delta->Open(filename, open_mode_)) return false;
+    if (!delta->is_delta_) {
+        LOG_ERR << "check delta fail. package is not a delta, filename:" << filename;
+        return false;
+    }
+    uint64_t index_hash = 0;
+    if (!GetIndexHash(index_hash) || index_hash != delta->delta_base_hash_) {
+        LOG_ERR << "check delta base fail. delta is not made against the package, filename:" << filename;
+        return false;
+    }
+    delta->SetCacheSize(file_cache_.capacity());
+    overlay_ = std::move(delta);
+    std::vector<FileEntry> entries;
+    if (!GetEntries(entries)) {
+        overlay_.reset();
+        return false;
+    }
+    version_ = overlay_->version_;
+    file_count_ = entries.size();
+    return true;
+}
+
+/** @brief check the index and all streams of the package and its delta, head, tail and checksum of streams are
+ *      checked on the workers of SetThreads. packages without checksums are checked by head and tail. read modes
+ *  @return fail if a stream or the index is damaged, damaged files are logged
+ */
+bool Packer::Verify() {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+
+    const bool index_ok = VerifyIndex() && (!overlay_ || overlay_->VerifyIndex());
+    std::vector<FileEntry> entries;
+    if (!GetEntries(entries)) return false;
+    // a stream of files of the same content is checked once, damaged streams are all logged
+    std::map<std::pair<const Packer*, uint64_t>, const FileEntry*> stream_entries;
+    for (const FileEntry &entry : entries) stream_entries.insert(std::make_pair(std::make_pair(entry.packer, entry.si.offset), &entry));
+    std::vector<const FileEntry*> streams;
+    for (const auto &stream : stream_entries) streams.push_back(stream.second);
+    std::atomic<bool> ok(index_ok);
+    auto verify_stream = [&streams, &ok] (size_t i) {
+        if (!streams[i]->packer->VerifyStream(streams[i]->si)) {
+            LOG_ERR << "verify stream error, filename:" << streams[i]->name;
+            ok = false;
+        }
+    };
+    if (nullptr != thread_pool_) {
+        thread_pool_->ParallelFor(streams.size(), verify_stream);
+    } else {
+        for (size_t i=0; i<streams.size(); i++) verify_stream(i);
+    }
+    return ok;
 }
 
 /** @brief add file stream to Package
  *  @param filename file name
  *  @param dstpath destination path
  */
-bool Packer::AddStream(const std::vector<char> &file_stream, const char *filename, const char *dstpath) {
-    if (open_mode_ != MODE_WRITE) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_WRITE.";
-        return false;
+bool Packer::AddStream(const std::vector<char> &file_stream, const char *filename, const char *dstpath) {
+    if (!IsWritable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a write mode.";
+        return false;
+    }
+
+    if (nullptr==filename || nullptr==dstpath) {
+        LOG_ERR << "filename/dstpath error.";
+        return false;
+    }
+    char inner_name[512];
+    JointPath(dstpath, filename, inner_name);
+    // a stream of the same content is coded once
+    const ContentKey key = HashContent(file_stream);
+    if (LinkContent(key, inner_name)) return true;
+    if (IsSharedStream(file_stream)) {
+        std::vector<char> shared_stream(file_stream);
+        return KeepSharedStream(inner_name, key, shared_stream);
+    }
+
+    StreamHeader header;
+    std::vector<char> encode_stream;
+    if (!EncodeStream(file_stream, codec_, header, encode_stream)) return false;
+    return WriteStream(inner_name, key, header, (CODEC_STORED == header.codec) ? file_stream : encode_stream);
+}
+
+/** @brief hash content of a stream
+ *  @param file_stream file stream
+ */
+Packer::ContentKey Packer::HashContent(const std::vector<char> &file_stream) {
+    const ContentKey key = {file_stream.size(), {utility::XxHash64::Hash(file_stream.data(), file_stream.size(), global_content_seeds[0]),
+                                                 utility::XxHash64::Hash(file_stream.data(), file_stream.size(), global_content_seeds[1])}};
+    return key;
+}
+
+/** @brief point a file at the stream of the same content added before
+ *  @param key content of file
+ *  @param inner_name file name in Package
+ *  @return false if the content is not added before
+ */
+bool Packer::LinkContent(const ContentKey &key, const char *inner_name) {
+    std::map<ContentKey, StreamInfo>::const_iterator it = content_index_.find(key);
+    if (it == content_index_.end()) return false;
+    if (0 == it->second.offset) {
+        // the stream is kept for a shared table, the entry is set when it is written
+        shared_aliases_.push_back(std::make_pair(std::string(inner_name), key));
+    } else {
+        dedup_stats_.stream_size += it->second.size;
     }
+    SetEntry(inner_name, it->second);
+    dedup_stats_.count++;
+    dedup_stats_.raw_size += key.size;
+    return true;
+}
 
-    if (nullptr==filename || nullptr==dstpath) {
-        LOG_ERR << "filename/dstpath error.";
-        return false;
+/** @brief set the index entry of a file
+ *  @param inner_name file name in Package
+ *  @param stream_info stream info
+ */
+void Packer::SetEntry(const char *inner_name, const StreamInfo &stream_info) {
+    std::map<std::string, StreamInfo>::iterator it = file_index_.find(inner_name);
+    if (it == file_index_.end()) {
+        file_index_.insert(std::make_pair(inner_name, stream_info));
+    } else {
+        it->second = stream_info;
     }
-    // encode
-    huffman::Huffman huffman_encode;
-    std::vector<char> encode_stream;
-    if (!huffman_encode.Encode(file_stream, encode_stream)) {
-        LOG_ERR << "encode error.";
-        return false;
+}
+
+/** @brief keep a small stream for the shared table of its group, the index entry is set when it is written
+ *  @param inner_name file name in Package
+ *  @param key content of file stream
+ *  @param file_stream file stream, moved into the group
+ */
+bool Packer::KeepSharedStream(const char *inner_name, const ContentKey &key, std::vector<char> &file_stream) {
+    SetEntry(inner_name, StreamInfo(0, 0));
+    content_index_.insert(std::make_pair(key, StreamInfo(0, 0)));
+    shared_names_.push_back(inner_name);
+    shared_keys_.push_back(key);
+    shared_size_ += file_stream.size();
+    shared_streams_.push_back(std::vector<char>());
+    shared_streams_.back().swap(file_stream);
+    return shared_size_ < global_shared_group_size || FlushSharedStreams();
+}
+
+/** @brief encode file stream, stored if the codec does not win by the codec ratio
+ *  @param file_stream file stream
+ *  @param codec codec to try, CODEC_SHARED_HUFFMAN is tried as CODEC_HUFFMAN
+ *  @param header output stream header
+ *  @param encode_stream output payload of coded streams, empty for stored streams
+ */
+bool Packer::EncodeStream(const std::vector<char> &file_stream, Codec codec, StreamHeader &header, std::vector<char> &encode_stream) {
+    // choose codec, incompressible streams are stored without trying huffman
+    const uint64_t raw_size = file_stream.size();
+    const double max_coded_size = raw_size * codec_ratio_;
+    header.codec = CODEC_STORED, header.flags = 0, header.raw_size = raw_size;
+    encode_stream.clear();
+    if (CODEC_LZ == codec) {
+        // repeated strings may beat the entropy of bytes, lz is always tried
+        lz::Lz lz_encode;
+        lz_encode.SetThreadPool(thread_pool_.get());
+        if (!lz_encode.Encode(file_stream, encode_stream)) {
+            LOG_ERR << "encode error.";
+            return false;
+        }
+        if (encode_stream.size() <= max_coded_size) header.codec = CODEC_LZ;
+    } else if ((CODEC_HUFFMAN == codec || CODEC_SHARED_HUFFMAN == codec) && EstimateHuffmanSize(file_stream) <= max_coded_size) {
+        huffman::Huffman huffman_encode;
+        // large streams are split into interleaved streams for faster decode, and into blocks coded on all workers
+        if (file_stream.size() > global_block_size) {
+            huffman_encode.SetStreamVersion(huffman::VERSION_BLOCKED);
+            huffman_encode.SetBlockSize(global_block_size);
+            huffman_encode.SetThreadPool(thread_pool_.get());
+        } else if (file_stream.size() >= global_interleaved_min_size) {
+            huffman_encode.SetStreamVersion(huffman::VERSION_INTERLEAVED);
+        }
+        if (!huffman_encode.Encode(file_stream, encode_stream)) {
+            LOG_ERR << "encode error.";
+            return false;
+        }
+        if (encode_stream.size() <= max_coded_size) header.codec = CODEC_HUFFMAN;
     }
+    if (CODEC_STORED == header.codec) encode_stream.clear();
+    return true;
+}
+
+/** @brief write a stream and set its index
+ *  @param inner_name file name in Package
+ *  @param key content of file stream
+ *  @param header stream header
+ *  @param payload payload of codec
+ */
+bool Packer::WriteStream(const char *inner_name, const ContentKey &key, const StreamHeader &header, const std::vector<char> &payload) {
     // write file stream
-    of_stream_.write((char*)&global_stream_head, sizeof(global_stream_head));
-    of_stream_.write(&encode_stream[0], encode_stream.size()*sizeof(char));
+    of_stream_.write((char*)&global_codec_stream_head, sizeof(global_codec_stream_head));
+    of_stream_.write((char*)&header, sizeof(header));
+    if (!payload.empty()) of_stream_.write(&payload[0], payload.size()*sizeof(char));
+    utility::XxHash64 hasher;
+    if (write_checksums_) {
+        hasher.Update(&global_codec_stream_head, sizeof(global_codec_stream_head));
+        hasher.Update(&header, sizeof(header));
+        hasher.Update(payload.data(), payload.size());
+    }
+    return FinishStream(inner_name, key, header, payload.size(), &hasher);
+}
+
+/** @brief write alignment and tail of a stream whose payload is written, and set its index, content and checksum
+ *  @param inner_name file name in Package
+ *  @param key content of file stream
+ *  @param header stream header
+ *  @param payload_size payload size
+ *  @param hasher hash of head, header and payload written, nullptr to read the stream back for its checksum
+ */
+bool Packer::FinishStream(const char *inner_name, const ContentKey &key, const StreamHeader &header, uint64_t payload_size,
+                          utility::XxHash64 *hasher) {
     // 64bit alignment
-    const int align_size = 7&-(int)encode_stream.size();
+    const int align_size = 7&-(int)payload_size;
     if (align_size) of_stream_.write((char*)&global_zero_alignment, align_size);
     of_stream_.write((char*)&global_stream_tail, sizeof(global_stream_tail));
-    // set index
-    char inner_name[512];
-    JointPath(dstpath, filename, inner_name);
-    uint64_t stream_size = sizeof(global_stream_head) + sizeof(global_stream_tail) + encode_stream.size()*sizeof(char) + align_size;
-    file_index_.insert(std::make_pair(inner_name, StreamInfo(cur_offset_, stream_size)));
+    CodecStats &stats = codec_stats_[header.codec];
+    stats.count++;
+    stats.raw_size += header.raw_size;
+    stats.stream_size += payload_size;
+    // set index, entries of shared streams are added before
+    uint64_t stream_size = sizeof(global_codec_stream_head) + sizeof(header) + sizeof(global_stream_tail) + payload_size + align_size;
+    const StreamInfo stream_info(cur_offset_, stream_size);
+    if (write_checksums_) {
+        uint64_t checksum = 0;
+        if (hasher) {
+            hasher->Update(&global_zero_alignment, align_size);
+            hasher->Update(&global_stream_tail, sizeof(global_stream_tail));
+            checksum = hasher->Digest();
+        } else if (!HashWrittenStream(stream_info, checksum)) {
+            // streams after are written over the stream
+            of_stream_.seekp(cur_offset_, std::ios::beg);
+            return false;
+        }
+        stream_checksums_[stream_info.offset] = checksum;
+    }
+    SetEntry(inner_name, stream_info);
+    std::map<ContentKey, StreamInfo>::iterator content = content_index_.find(key);
+    if (content == content_index_.end()) {
+        content_index_.insert(std::make_pair(key, stream_info));
+    } else {
+        content->second = stream_info;
+    }
     // mode to next file
     cur_offset_ += stream_size;
     return of_stream_.good();
 }
 
+/** @brief train a shared table from kept streams, write them with the table or their own codec
+ *  @return success or fail
+ */
+bool Packer::FlushSharedStreams() {
+    if (shared_streams_.empty()) return true;
+    std::vector<char> table_buffer;
+    huffman::Huffman trainer;
+    if (!trainer.TrainSharedTable(shared_streams_, table_buffer)) {
+        LOG_ERR << "train shared table error.";
+        return false;
+    }
+    const uint32_t table_id = shared_table_buffers_.size();
+
+    // a stream keeps the smallest of shared table, its own table and stored.
+    // streams are coded in one slice for each worker, every slice has its own copy of the table
+    const size_t count = shared_streams_.size();
+    const size_t slices = thread_pool_ ? std::min(count, (size_t)thread_pool_->size()) : 1;
+    std::vector<StreamHeader> headers(count);
+    std::vector<std::vector<char> > encode_streams(count);
+    std::atomic<bool> success(true);
+    auto encode_slice = [&] (size_t slice) {
+        huffman::Huffman shared_encode;
+        if (!shared_encode.SetSharedTable(table_buffer)) {
+            success = false;
+            return;
+        }
+        shared_encode.SetStreamVersion(huffman::VERSION_SHARED);
+        std::vector<char> shared_stream;
+        for (size_t i=count*slice/slices; i<count*(slice+1)/slices && success; i++) {
+            const std::vector<char> &file_stream = shared_streams_[i];
+            StreamHeader &header = headers[i];
+            if (!EncodeStream(file_stream, CODEC_HUFFMAN, header, encode_streams[i]) || !shared_encode.Encode(file_stream, shared_stream)) {
+                LOG_ERR << "encode error.";
+                success = false;
+                break;
+            }
+            if (shared_stream.size() <= file_stream.size() * codec_ratio_
+                && (CODEC_STORED == header.codec || shared_stream.size() < encode_streams[i].size())) {
+                header.codec = CODEC_SHARED_HUFFMAN, header.flags = table_id;
+                encode_streams[i].swap(shared_stream);
+            }
+        }
+    };
+    if (thread_pool_) {
+        thread_pool_->ParallelFor(slices, encode_slice);
+    } else {
+        encode_slice(0);
+    }
+
+    // streams are written in the order they are added
+    uint64_t shared_count = 0;
+    for (size_t i=0; i<count && success; i++) {
+        const StreamHeader &header = headers[i];
+        if (CODEC_SHARED_HUFFMAN == header.codec) shared_count++;
+        success = WriteStream(shared_names_[i].c_str(), shared_keys_[i], header,
+                              (CODEC_STORED == header.codec) ? shared_streams_[i] : encode_streams[i]);
+    }
+    if (shared_count) shared_table_buffers_.push_back(table_buffer);
+    // files of the content of a kept stream point at it
+    for (const auto &alias : shared_aliases_) {
+        const StreamInfo &stream_info = content_index_.find(alias.second)->second;
+        SetEntry(alias.first.c_str(), stream_info);
+        dedup_stats_.stream_size += stream_info.size;
+    }
+    shared_names_.clear();
+    shared_keys_.clear();
+    shared_aliases_.clear();
+    shared_streams_.clear();
+    shared_size_ = 0;
+    return success;
+}
+
+/** @brief read file stream in chunks, stored and huffman streams are read and decoded incrementally,
+ *      memory is bounded by the chunk size. lz streams are decoded at once and passed in chunks.
+ *  @param filename filename in Package
+ *  @param consumer called with chunks of file stream in order, returns false to stop reading
+ *  @param chunk_size max chunk size
+ */
+bool Packer::ReadFileStream(const char *filename, const std::function<bool(const char *, size_t)> &consumer, size_t chunk_size) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+
+    if (Packer *delta = FindDelta(filename)) return delta->ReadFileStream(filename, consumer, chunk_size);
+
+    StreamInfo si(0, 0);
+    StreamHeader header;
+    bool has_header = false;
+    uint64_t payload_offset = 0, payload_size = 0;
+    const char *payload = nullptr;
+    if (!LocateStream(filename, si, header, has_header, payload_offset, payload, payload_size)) return false;
+    chunk_size = std::max(chunk_size, (size_t)1);
+
+    // lz matches reach back the whole window
+    if (CODEC_LZ == header.codec) {
+        std::vector<char> file_stream;
+        if (!GetFileStream(filename, file_stream)) return false;
+        for (size_t offset=0; offset<file_stream.size(); offset+=chunk_size) {
+            if (!consumer(&file_stream[offset], std::min(chunk_size, file_stream.size() - offset))) return false;
+        }
+        return true;
+    }
+
+    // mapped streams are passed or pushed in slices of the mapping
+    std::vector<char> input(payload ? 0 : (size_t)std::min((uint64_t)chunk_size, payload_size));
+    uint64_t remain_size = (CODEC_STORED == header.codec) ? header.raw_size : payload_size;
+    if (CODEC_STORED == header.codec && payload) {
+        for (uint64_t offset=0; offset<remain_size; offset+=chunk_size) {
+            if (!consumer(payload + offset, (size_t)std::min((uint64_t)chunk_size, remain_size - offset))) return false;
+        }
+        return true;
+    }
+    if (CODEC_STORED == header.codec) {
+        while (remain_size) {
+            const size_t size = (size_t)std::min((uint64_t)input.size(), remain_size);
+            if (!ReadAt(payload_offset, &input[0], size)) return false;
+            if (!consumer(&input[0], size)) return false;
+            payload_offset += size;
+            remain_size -= size;
+        }
+        return ReadStreamTail(si);
+    }
+
+    huffman::StreamDecoder decoder;
+    if (CODEC_SHARED_HUFFMAN == header.codec) {
+        if (header.flags >= shared_tables_.size()) {
+            LOG_ERR << "check shared table id error. id:" << header.flags;
+            return false;
+        }
+        decoder.SetSharedTable(shared_tables_[header.flags].get());
+    }
+    std::vector<char> output(chunk_size);
+    uint64_t output_size = 0;
+    while (!decoder.Done()) {
+        size_t size = 0;
+        if (!decoder.Pull(&output[0], output.size(), size)) {
+            LOG_ERR << "decode error.";
+            return false;
+        }
+        if (size) {
+            if (!consumer(&output[0], size)) return false;
+            output_size += size;
+            continue;
+        }
+        if (decoder.Done()) break;
+        // more input, alignment after the payload is ignored by the decoder
+        if (0 == remain_size) {
+            LOG_ERR << "check stream size error, stream is truncated.";
+            return false;
+        }
+        if (payload) {
+            const size_t input_size = (size_t)std::min((uint64_t)chunk_size, remain_size);
+            decoder.Push(payload + payload_size - remain_size, input_size);
+            remain_size -= input_size;
+            continue;
+        }
+        const size_t input_size = (size_t)std::min((uint64_t)input.size(), remain_size);
+        if (!ReadAt(payload_offset, &input[0], input_size)) return false;
+        decoder.Push(&input[0], input_size);
+        payload_offset += input_size;
+        remain_size -= input_size;
+    }
+    if (has_header && output_size != header.raw_size) {
+        LOG_ERR << "check decode size error. size:" << output_size << ", raw size:" << header.raw_size;
+        return false;
+    }
+    return payload ? true : ReadStreamTail(si);
+}
+
+/** @brief read a range of a file, huffman files larger than global_block_size only read and decode the blocks
+ *      of the range, stored files are read in place, other files are decoded whole. safe to call from many threads
+ *  @param filename filename in Package
+ *  @param offset offset in file
+ *  @param length length of range, cut at the end of file
+ *  @param file_stream output range of file stream
+ */
+bool Packer::ReadRange(const char *filename, uint64_t offset, uint64_t length, std::vector<char> &file_stream) {
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+
+    if (Packer *delta = FindDelta(filename)) return delta->ReadRange(filename, offset, length, file_stream);
+
+    file_stream.clear();
+    StreamInfo si(0, 0);
+    StreamHeader header;
+    bool has_header = false;
+    uint64_t payload_offset = 0, payload_size = 0;
+    const char *payload = nullptr;
+    if (!LocateStream(filename, si, header, has_header, payload_offset, payload, payload_size)) return false;
+
+    if (CODEC_STORED == header.codec) {
+        if (offset > header.raw_size) {
+            LOG_ERR << "range offset error. offset:" << offset << ", size:" << header.raw_size;
+            return false;
+        }
+        length = std::min(length, header.raw_size - offset);
+        if (payload) {
+            file_stream.assign(payload + offset, payload + offset + length);
+            return true;
+        }
+        file_stream.resize(length);
+        return 0 == length || ReadAt(payload_offset + offset, &file_stream[0], length);
+    }
+    if (CODEC_HUFFMAN == header.codec) {
+        huffman::Huffman huffman_decode;
+        huffman_decode.SetThreadPool(thread_pool_.get());
+        bool decoded = false;
+        if (payload) {
+            decoded = huffman_decode.DecodeRange(payload, payload_size, offset, length, file_stream);
+        } else {
+            decoded = huffman_decode.DecodeRange(payload_size, [this, payload_offset] (uint64_t offset, size_t size, char *buffer) {
+                return ReadAt(payload_offset + offset, buffer, size);
+            }, offset, length, file_stream);
+        }
+        if (!decoded) LOG_ERR << "decode error.";
+        return decoded;
+    }
+
+    // shared huffman streams are small, lz matches reach back the whole window
+    std::vector<char> whole_stream;
+    if (!GetFileStream(filename, whole_stream)) return false;
+    if (offset > whole_stream.size()) {
+        LOG_ERR << "range offset error. offset:" << offset << ", size:" << whole_stream.size();
+        return false;
+    }
+    length = std::min(length, whole_stream.size() - offset);
+    file_stream.assign(whole_stream.begin() + offset, whole_stream.begin() + (offset + length));
+    return true;
+}
+
+/** @brief find a file and read its StreamHeader, payload is mapped in MMAP mode
+ *  @param filename filename in Package
+ *  @param si output stream info
+ *  @param header output stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+ *  @param has_header output, stream has StreamHeader, raw_size of header is valid
+ *  @param payload_offset output payload offset in package file
+ *  @param payload output mapped payload, nullptr if the package file is not mapped
+ *  @param payload_size output payload size, alignment included
+ */
+bool Packer::LocateStream(const char *filename, StreamInfo &si, StreamHeader &header, bool &has_header,
+                          uint64_t &payload_offset, const char *&payload, uint64_t &payload_size) const {
+    if (!FindEntry(filename, si)) {
+        LOG_ERR << "can not find filename:" << filename;
+        return false;
+    }
+    if (verify_ && !VerifyStream(si)) {
+        LOG_ERR << "verify stream error, filename:" << filename;
+        return false;
+    }
+    payload = nullptr;
+    if (MODE_MMAP == open_mode_) {
+        if (!MapStream(si, header, has_header, payload, payload_size)) {
+            LOG_ERR << "map stream error, filename:" << filename;
+            return false;
+        }
+    } else if (!ReadStreamHeader(si, header, has_header, payload_offset, payload_size)) {
+        LOG_ERR << "read stream header error, filename:" << filename;
+        return false;
+    }
+    return true;
+}
+
+/** @brief read head and StreamHeader of a stream
+ *  @param si stream info
+ *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+ *  @param has_header stream has StreamHeader, raw_size of header is valid
+ *  @param payload_offset payload offset in package file
+ *  @param payload_size payload size, alignment included
+ */
+bool Packer::ReadStreamHeader(const StreamInfo &si, StreamHeader &header, bool &has_header, uint64_t &payload_offset, uint64_t &payload_size) const {
+    char stream[sizeof(uint64_t) + sizeof(StreamHeader)];
+    if (si.size < sizeof(uint64_t) + sizeof(global_stream_tail)) {
+        LOG_ERR << "stream size error, size:" << si.size;
+        return false;
+    }
+    if (!ReadAt(si.offset, stream, std::min((uint64_t)sizeof(stream), si.size))) return false;
+    if (!ParseStreamHeader(stream, si, header, has_header, payload_size)) return false;
+    payload_offset = si.offset + sizeof(uint64_t) + (has_header ? sizeof(header) : 0);
+    return true;
+}
+
+/** @brief parse head and StreamHeader of a stream
+ *  @param stream begin of stream, at least min(stream size, head + StreamHeader) bytes
+ *  @param si stream info
+ *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+ *  @param has_header stream has StreamHeader, raw_size of header is valid
+ *  @param payload_size payload size, alignment included
+ */
+bool Packer::ParseStreamHeader(const char *stream, const StreamInfo &si, StreamHeader &header, bool &has_header, uint64_t &payload_size) const {
+    const uint64_t stream_head = *(const uint64_t*)stream;
+    if (global_stream_head == stream_head) {
+        header.codec = CODEC_HUFFMAN, header.flags = 0, header.raw_size = 0;
+        has_header = false;
+        payload_size = si.size - sizeof(stream_head) - sizeof(global_stream_tail);
+        return true;
+    }
+    if (global_codec_stream_head != stream_head) {
+        LOG_ERR << "check stream head error.";
+        return false;
+    }
+    if (si.size < sizeof(stream_head) + sizeof(header) + sizeof(global_stream_tail)) {
+        LOG_ERR << "stream size error, size:" << si.size;
+        return false;
+    }
+    memcpy(&header, stream + sizeof(stream_head), sizeof(header));
+    has_header = true;
+    payload_size = si.size - sizeof(stream_head) - sizeof(header) - sizeof(global_stream_tail);
+    if (header.codec >= CODEC_COUNT || (CODEC_STORED == header.codec && header.raw_size > payload_size)) {
+        LOG_ERR << "check stream header error. codec:" << header.codec << ", raw size:" << header.raw_size;
+        return false;
+    }
+    return true;
+}
+
+/** @brief check a stream of the mapped package file, MODE_MMAP
+ *  @param si stream info
+ *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+ *  @param has_header stream has StreamHeader, raw_size of header is valid
+ *  @param payload output pointer to payload in the mapping
+ *  @param payload_size payload size, alignment included
+ */
+bool Packer::MapStream(const StreamInfo &si, StreamHeader &header, bool &has_header, const char *&payload, uint64_t &payload_size) const {
+    if (si.size < sizeof(uint64_t) + sizeof(global_stream_tail) || si.offset > map_size_ || si.size > map_size_ - si.offset) {
+        LOG_ERR << "stream size error, offset:" << si.offset << ", size:" << si.size;
+        return false;
+    }
+    const char *stream = map_data_ + si.offset;
+    if (!ParseStreamHeader(stream, si, header, has_header, payload_size)) return false;
+    uint64_t stream_tail = 0;
+    memcpy(&stream_tail, stream + si.size - sizeof(stream_tail), sizeof(stream_tail));
+    if (global_stream_tail != stream_tail) {
+        LOG_ERR << "check stream tail error.";
+        return false;
+    }
+    payload = stream + sizeof(uint64_t) + (has_header ? sizeof(header) : 0);
+    return true;
+}
+
+/** @brief get a shared read-only handle of a decoded file, files found in the file cache are not copied.
+ *      the handle stays valid after eviction and Close. safe to call from many threads at once
+ *  @param filename filename in Package
+ *  @param handle output decoded file
+ */
+bool Packer::GetFileHandle(const char *filename, FileHandle &handle) {
+    handle.reset();
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
+        return false;
+    }
+    if (Packer *delta = FindDelta(filename)) return delta->GetFileHandle(filename, handle);
+
+    StreamInfo si(0, 0);
+    if (!FindEntry(filename, si)) {
+        LOG_ERR << "can not find filename:" << filename;
+        return false;
+    }
+    if (file_cache_.capacity()) return GetCachedFile(filename, si, handle);
+
+    std::shared_ptr<std::vector<char> > file_stream = std::make_shared<std::vector<char> >();
+    if (!DecodeFile(filename, si, *file_stream)) return false;
+    handle = file_stream;
+    return true;
+}
+
+/** @brief get a decoded file from the file cache, it is decoded and kept on a miss
+ *  @param filename filename in Package
+ *  @param si stream info, the stream offset is the cache key
+ *  @param handle output decoded file
+ */
+bool Packer::GetCachedFile(const char *filename, const StreamInfo &si, FileHandle &handle) const {
+    if (file_cache_.Get(si.offset, handle)) return true;
+
+    // threads missing the same file decode it each, the last one is kept
+    std::shared_ptr<std::vector<char> > file_stream = std::make_shared<std::vector<char> >();
+    if (!DecodeFile(filename, si, *file_stream)) return false;
+    handle = file_stream;
+    file_cache_.Put(si.offset, handle, file_stream->size());
+    return true;
+}
+
+/** @brief get a view of a stored file in the mapped package file, MODE_MMAP only
+ *  @param filename filename in Package
+ *  @param data output pointer to file data, valid until Close
+ *  @param size output file size
+ *  @return fail if the file is not found or it is not stored
+ */
+bool Packer::GetFileView(const char *filename, const char *&data, uint64_t &size) {
+    if (open_mode_ != MODE_MMAP) {
+        LOG_ERR << "check open mode fail. OpenMode is not MODE_MMAP.";
+        return false;
+    }
+    if (Packer *delta = FindDelta(filename)) return delta->GetFileView(filename, data, size);
+
+    StreamInfo si(0, 0);
+    if (!FindEntry(filename, si)) {
+        LOG_ERR << "can not find filename:" << filename;
+        return false;
+    }
+    if (verify_ && !VerifyStream(si)) {
+        LOG_ERR << "verify stream error, filename:" << filename;
+        return false;
+    }
+    StreamHeader header;
+    bool has_header = false;
+    uint64_t payload_size = 0;
+    if (!MapStream(si, header, has_header, data, payload_size)) {
+        LOG_ERR << "map stream error, filename:" << filename;
+        return false;
+    }
+    if (CODEC_STORED != header.codec) {
+        LOG_ERR << "file is not stored, filename:" << filename << ", codec:" << CodecName((Codec)header.codec);
+        return false;
+    }
+    size = header.raw_size;
+    return true;
+}
+
+/** @brief check tail of a stream
+ *  @param si stream info
+ */
+bool Packer::ReadStreamTail(const StreamInfo &si) const {
+    uint64_t stream_tail = 0;
+    if (!ReadAt(si.offset + si.size - sizeof(stream_tail), (char*)&stream_tail, sizeof(stream_tail))) return false;
+    if (global_stream_tail != stream_tail) {
+        LOG_ERR << "check stream tail error.";
+        return false;
+    }
+    return true;
+}
+
+/** @brief read bytes at an offset of package file, no file position is shared. MMAP mode copies from the mapping
+ *  @param offset offset in package file
+ *  @param buffer output buffer
+ *  @param size bytes to read
+ */
+bool Packer::ReadAt(uint64_t offset, char *buffer, size_t size) const {
+    if (nullptr != map_data_) {
+        if (offset > map_size_ || size > map_size_ - offset) {
+            LOG_ERR << "read file error. offset:" << offset << ", size:" << size;
+            return false;
+        }
+        memcpy(buffer, map_data_ + offset, size);
+        return true;
+    }
+    while (size) {
+        const ssize_t read_size = pread(read_fd_, buffer, size, (off_t)offset);
+        if (read_size < 0 && errno == EINTR) continue;
+        if (read_size <= 0) {
+            LOG_ERR << "read file error. offset:" << offset << ", size:" << size;
+            return false;
+        }
+        buffer += read_size, offset += read_size, size -= read_size;
+    }
+    return true;
+}
+
+/** @brief get codec name
+ *  @param codec codec
+ */
+const char *Packer::CodecName(Codec codec) {
+    switch (codec) {
+    case CODEC_STORED: return "stored";
+    case CODEC_HUFFMAN: return "huffman";
+    case CODEC_LZ: return "lz";
+    case CODEC_SHARED_HUFFMAN: return "shared-huffman";
+    default: return "unknown";
+    }
+}
+
+/** @brief set worker threads of AddDir/AddFiles, huffman blocks and Extract, work is done in the calling thread by default
+ *  @param thread_count thread count, 0 for all cores, 1 for the calling thread
+ */
+void Packer::SetThreads(int thread_count) {
+    if (1 == thread_count) {
+        thread_pool_.reset();
+    } else {
+        thread_pool_.reset(new utility::ThreadPool(thread_count));
+    }
+}
+
 /** @brief joint path
  *  @param path path name
  *  @param name file name
@@ -448,4 +2809,154 @@ void Packer::DeleteTempFile(const std::string &tempfile) {
     if (!tempfile.empty()) unlink(tempfile.c_str());
 }
 
+/** @brief open a file of Package
+ *  @param packer package opened in a read mode, not owned
+ *  @param filename filename in Package
+ */
+bool PackStreamBuf::open(Packer *packer, const char *filename) {
+    close();
+    if (nullptr == packer || nullptr == filename || !packer->IsReadable()) {
+        LOG_ERR << "check packer fail. package is not opened in a read mode.";
+        return false;
+    }
+    // files of an overlaid delta are read from it
+    if (Packer *delta = packer->FindDelta(filename)) packer = delta;
+    Packer::StreamInfo si(0, 0);
+    bool has_header = false;
+    if (!packer->LocateStream(filename, si, header_, has_header, payload_offset_, payload_, payload_size_)) return false;
+    packer_ = packer;
+    filename_ = filename;
+    file_size_ = header_.raw_size;
+
+    if (CODEC_STORED == header_.codec && payload_) {
+        // mapped files are read in place
+        char *data = const_cast<char*>(payload_);
+        setg(data, data, data + file_size_);
+        whole_ = true;
+    } else if (!has_header || CODEC_LZ == header_.codec) {
+        // lz matches reach back the whole window, streams without StreamHeader have no raw size
+        if (!packer->GetFileStream(filename, buffer_)) {
+            close();
+            return false;
+        }
+        file_size_ = buffer_.size();
+        setg(buffer_.data(), buffer_.data(), buffer_.data() + buffer_.size());
+        whole_ = true;
+    } else if (CODEC_SHARED_HUFFMAN == header_.codec) {
+        if (header_.flags >= packer->shared_tables_.size()) {
+            LOG_ERR << "check shared table id error. id:" << header_.flags;
+            close();
+            return false;
+        }
+        decoder_.SetSharedTable(packer->shared_tables_[header_.flags].get());
+        sequential_ = true;
+    } else {
+        sequential_ = CODEC_HUFFMAN == header_.codec;
+    }
+    return true;
+}
+
+/** @brief close the file, buffers are released
+ */
+void PackStreamBuf::close() {
+    packer_ = nullptr;
+    filename_.clear();
+    payload_ = nullptr;
+    payload_offset_ = payload_size_ = 0;
+    file_size_ = buffer_offset_ = input_offset_ = 0;
+    whole_ = sequential_ = false;
+    decoder_.SetSharedTable(nullptr);
+    decoder_.Reset();
+    std::vector<char>().swap(buffer_);
+    std::vector<char>().swap(input_);
+    setg(nullptr, nullptr, nullptr);
+}
+
+/** @brief decode the next chunk of the file
+ */
+PackStreamBuf::int_type PackStreamBuf::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    const uint64_t offset = buffer_offset_ + GetAreaSize();
+    if (!is_open() || whole_ || offset >= file_size_) return traits_type::eof();
+    if (!(sequential_ ? ReadSequential() : ReadWindow(offset)) || gptr() == egptr()) return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+}
+
+/** @brief decode the next chunk of a huffman stream from the begin
+ */
+bool PackStreamBuf::ReadSequential() {
+    buffer_offset_ += GetAreaSize();
+    buffer_.resize(global_chunk_size);
+    size_t size = 0;
+    while (0 == size) {
+        if (!decoder_.Pull(&buffer_[0], buffer_.size(), size)) {
+            LOG_ERR << "decode error, filename:" << filename_;
+            return false;
+        }
+        if (size) break;
+        // more input, alignment after the payload is ignored by the decoder
+        if (decoder_.Done() || input_offset_ >= payload_size_) {
+            LOG_ERR << "check stream size error, stream is truncated. filename:" << filename_;
+            return false;
+        }
+        const size_t input_size = (size_t)std::min((uint64_t)global_chunk_size, payload_size_ - input_offset_);
+        if (payload_) {
+            decoder_.Push(payload_ + input_offset_, input_size);
+        } else {
+            input_.resize(input_size);
+            if (!packer_->ReadAt(payload_offset_ + input_offset_, &input_[0], input_size)) return false;
+            decoder_.Push(&input_[0], input_size);
+        }
+        input_offset_ += input_size;
+    }
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + size);
+    return true;
+}
+
+/** @brief read the window at a file offset with ReadRange, huffman windows are the stream segments of
+ *      a block so that a window decodes one segment
+ *  @param offset file offset
+ */
+bool PackStreamBuf::ReadWindow(uint64_t offset) {
+    const uint64_t window = (CODEC_STORED == header_.codec) ? global_chunk_size : global_block_size / 4;
+    const uint64_t begin = offset - offset % window;
+    if (!packer_->ReadRange(filename_.c_str(), begin, window, buffer_) || begin + buffer_.size() <= offset) {
+        buffer_offset_ = offset;
+        setg(nullptr, nullptr, nullptr);
+        return false;
+    }
+    buffer_offset_ = begin;
+    setg(buffer_.data(), buffer_.data() + (offset - begin), buffer_.data() + buffer_.size());
+    return true;
+}
+
+/** @brief seek the get area, the sequential decoder is left for ReadRange windows when a seek leaves the get area
+ */
+PackStreamBuf::pos_type PackStreamBuf::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) {
+    if (!is_open() || !(which & std::ios::in)) return pos_type(off_type(-1));
+    off_type base = 0;
+    if (std::ios::cur == dir) {
+        base = buffer_offset_ + (gptr() - eback());
+    } else if (std::ios::end == dir) {
+        base = file_size_;
+    }
+    return seekpos(pos_type(base + off), which);
+}
+
+/** @brief seek the get area
+ */
+PackStreamBuf::pos_type PackStreamBuf::seekpos(pos_type pos, std::ios::openmode which) {
+    const off_type offset = off_type(pos);
+    if (!is_open() || !(which & std::ios::in) || offset < 0 || (uint64_t)offset > file_size_) return pos_type(off_type(-1));
+    if ((uint64_t)offset >= buffer_offset_ && (uint64_t)offset <= buffer_offset_ + GetAreaSize()) {
+        setg(eback(), eback() + (offset - buffer_offset_), egptr());
+        return pos;
+    }
+    // whole files are in the get area
+    sequential_ = false;
+    buffer_offset_ = offset;
+    setg(nullptr, nullptr, nullptr);
+    return pos;
+}
+
 }  // namespace packer
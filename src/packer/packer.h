@@ -17,6 +17,87 @@
  *      GetFileSream(filename, file_stream)
  *      ...
  *      Close();
+ *  4. use a mapped package file, stored files are read without copy
+ *      Open(filename, MODE_MMAP);
+ *      GetFileView(filename, data, size)
+ *      GetFileSream(filename, file_stream)
+ *      ...
+ *      Close();
+ *  5. read a few files of a large package, Open reads no file entry
+ *      Open(filename, MODE_LAZY);
+ *      GetVersion();
+ *      GetFileSream(filename, file_stream)
+ *      Close();
+ *  6. read a file through std::istream, decoded on demand
+ *      Open(filename, MODE_READ);
+ *      ifmstream ifms;
+ *      ifms.set_packbuf(packer, filename);
+ *      ...
+ *  7. update a package file, streams are appended and the package points at a new index at Close
+ *      Open(filename, MODE_UPDATE);
+ *      AddFile(filename);  // added or replaced
+ *      RemoveFile(filename);
+ *      Close();
+ *  8. compact a package file, streams of replaced and removed files are not copied
+ *      Open(filename, MODE_READ);
+ *      Compact(newfilename);
+ *      Close();
+ *  9. make a delta of a package against its base, and read the base with the delta overlaid
+ *      Open(newfilename, MODE_READ);
+ *      MakeDelta(basefilename, deltafilename, stats);
+ *      Close();
+ *      Open(basefilename, MODE_MMAP);
+ *      OpenDelta(deltafilename);  // files of the delta replace or remove files of the base
+ *      GetFileSream(filename, file_stream)
+ *      Compact(newfilename);  // apply the delta
+ *      Close();
+ *  10. check a package, streams and index carry checksums when the package is written with SetChecksum(true)
+ *      Open(filename, MODE_READ);
+ *      Verify();  // all streams, on the workers of SetThreads
+ *      SetVerify(true);  // or every stream when it is read
+ *      GetFileSream(filename, file_stream)
+ *      Close();
+ *  11. list files of a directory, names are found by binary search of the sorted index
+ *      SetFrontCoding(true);  // a smaller index for deep trees, names are front coded
+ *      Open(filename, MODE_WRITE);
+ *      ...
+ *      Close();
+ *      Open(filename, MODE_READ);
+ *      List("assets/textures/", names);
+ *      Glob("assets/textures/[a-c]*.png", names);
+ *      Close();
+ *  GetFileStream / GetFileHandle / ReadFileStream / ReadRange / GetFileView / Extract / List / Glob of a package opened
+ *  in a read mode may be called from many threads at once, Open / OpenDelta / Close / SetThreads may not.
+ *
+ *  Package layout:
+ *      uint64(index offset) | streams | index
+ *      an update appends streams and a new index after the index, then rewrites the index offset. the index ends
+ *      at its tail, bytes after it are left by an update which did not finish and are not read.
+ *
+ *  Stream layout:
+ *      global_codec_stream_head | StreamHeader | payload of codec | 64bit alignment | global_stream_tail
+ *      streams of old packages are huffman streams without StreamHeader:
+ *      global_stream_head | huffman stream | 64bit alignment | global_stream_tail
+ *
+ *  Index layout:
+ *      global_index_stream_head | int32(index size) | int32(version) | file entries | 64bit alignment | global_index_stream_tail
+ *      packages with shared huffman tables, checksums, front coded names or global_hash_index_min_files files use the
+ *      sectioned index:
+ *      global_index2_stream_head | int32(index size) | int32(version) | (uint32(IndexSection) | uint32(size) | section)*
+ *      | 64bit alignment | global_index_stream_tail
+ *      file entry: uint32(name length) | name | StreamInfo, entries are sorted by name
+ *      SECTION_HASH_TABLE: uint32(slot count, power of 2) | uint32(file count) | HashSlot[slot count]
+ *      SECTION_SHARED_TABLES: uint32(table count) | (uint32(table size) | huffman shared table)*
+ *      SECTION_DELTA: uint64(XXH64 of the base index stream) | uint32(removed count) | (uint32(name length) | name)*
+ *      SECTION_CHECKSUMS: uint64(XXH64 of index stream before the section) | uint32(stream count)
+ *      | (uint64(stream offset) | uint64(XXH64 of stream))*, the last section, streams are sorted by offset
+ *      SECTION_SORTED_FILES: uint32(file count) | uint32(restart count) | uint32(restart offset)[restart count]
+ *      | front coded entry*, in place of SECTION_FILES and SECTION_HASH_TABLE
+ *      front coded entry: varint(length shared with the name before) | varint(suffix length) | suffix | StreamInfo,
+ *      entries are sorted by name, every global_restart_interval entry is a restart point sharing nothing
+ *      files are found by probing the hash table in place, indexes without it get a hash table at Open. files of
+ *      front coded indexes are found by binary search of the restart points and a scan of the entries after one.
+ *      files of the same content share one stream, their entries have the same StreamInfo.
  */
 
 #pragma once
@@ -24,64 +105,237 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unistd.h>
 #include <vector>
 #include "log.h"
 #include "huffman.h"
+#include "lz.h"
+#include "thread-pool.h"
+#include "lru-cache.h"
+#include "xxhash.h"
 
 namespace packer {
 
 static const uint64_t global_stream_head        = 0xf9e8d7c6b5a44a5b;  // 64bit stream head
+static const uint64_t global_codec_stream_head  = 0xf9e8d7c6b5a44b5a;  // 64bit stream head, followed by StreamHeader
 static const uint64_t global_stream_tail        = 0xb5a44a5b6c7d8e9f;  // 64bit stream tail
 static const uint64_t global_index_stream_head  = 0x9f8e7d6c5b4aa4b5;  // 64bit index stream head
+static const uint64_t global_index2_stream_head = 0x9f8e7d6c5b4ab4a5;  // 64bit index stream head, followed by sections
 static const uint64_t global_index_stream_tail  = 0x5b4aa4b5c6d7e8f9;  // 64bit index stream tail
 static const uint64_t global_zero_alignment     = 0x0000000000000000;  // 64bit zero alignment
+static const size_t global_interleaved_min_size  = 16*1024;  // streams not smaller are huffman coded interleaved
+static const size_t global_block_size           = 1024*1024;  // streams larger are huffman coded in blocks
+static const size_t global_shared_group_size    = 16*1024*1024;  // small streams coded with one shared table
+static const size_t global_chunk_size           = 64*1024;  // chunk size of file streams read incrementally
+static const uint64_t global_stream_file_size   = 64*1024*1024;  // files not smaller are added block by block
+static const size_t global_hash_index_min_files = 1024;  // packages with more files carry a hash table in the index
+static const uint32_t global_empty_slot         = 0xffffffff;  // offset of empty hash slots
+static const uint32_t global_restart_interval   = 16;  // front coded entries restart from a whole name as often
 
 enum OpenMode {
     MODE_UNKNOWN = 0,
     MODE_WRITE   = 1,
-    MODE_READ    = 2
+    MODE_READ    = 2,
+    MODE_MMAP    = 3,  // read mode, the package file is mapped
+    MODE_LAZY    = 4,  // read mode, only the index directory is read at Open, entries are read when probed
+    MODE_UPDATE  = 5   // write mode on an existing package, streams are appended, files may be replaced or removed
+};
+
+enum Codec {
+    CODEC_STORED  = 0,  // raw bytes, read without decoding
+    CODEC_HUFFMAN = 1,  // huffman stream
+    CODEC_LZ      = 2,  // lz77 stream with huffman coded literals/lengths/distances
+    CODEC_SHARED_HUFFMAN = 3,  // huffman stream coded with a shared table of the index, flags is the table id
+    CODEC_COUNT
 };
 
+// sections of the sectioned index, unknown sections are skipped
+enum IndexSection {
+    SECTION_FILES         = 1,  // file entries
+    SECTION_SHARED_TABLES = 2,  // huffman tables of CODEC_SHARED_HUFFMAN streams
+    SECTION_HASH_TABLE    = 3,  // hash table of file entries, linear probing
+    SECTION_DELTA         = 4,  // base index and removed files of a delta package
+    SECTION_CHECKSUMS     = 5,  // checksums of the index and of streams
+    SECTION_SORTED_FILES  = 6   // front coded file entries with restart points
+};
+
+// header of streams with global_codec_stream_head
+struct StreamHeader {
+    uint32_t codec;  // Codec of payload
+    uint32_t flags;  // table id of CODEC_SHARED_HUFFMAN, 0 otherwise
+    uint64_t raw_size;  // decoded size
+};
+
+// statistics of streams added with a codec
+struct CodecStats {
+    uint64_t count;  // stream count
+    uint64_t raw_size;  // bytes before coding
+    uint64_t stream_size;  // bytes of coded payload
+};
+
+// statistics of files whose content was added before, their entries point at the stream of the first one
+struct DedupStats {
+    uint64_t count;  // duplicate files
+    uint64_t raw_size;  // bytes not coded again
+    uint64_t stream_size;  // stream bytes not written again
+};
+
+// statistics of a delta package, files of the new package compared with the base by content
+struct DeltaStats {
+    uint64_t added;  // files not in the base
+    uint64_t replaced;  // files of other content in the base
+    uint64_t removed;  // files of the base not in the new package
+    uint64_t unchanged;  // files of the same content in the base, left out of the delta
+};
+
+// decoded file shared by the file cache and its readers, read only
+typedef std::shared_ptr<const std::vector<char> > FileHandle;
+
+// statistics of the decoded file cache: hits, misses, evictions, bytes and count of cached files
+typedef utility::LruCache<uint64_t, std::vector<char> >::Stats CacheStats;
+
 class Packer {
+    friend class PackStreamBuf;
+
 public:
-    Packer() { Reset(); }
+    Packer() : read_fd_(-1), codec_(CODEC_HUFFMAN), codec_ratio_(0.95), map_data_(nullptr), map_size_(0), checksum_(false), verify_(false),
+               front_coding_(false) {
+        memset(codec_stats_, 0, sizeof(codec_stats_));
+        memset(&dedup_stats_, 0, sizeof(dedup_stats_));
+        Reset();
+    }
     ~Packer() { Close(); }
 
-    /** @brief add a single file to Package
+    /** @brief add a single file to Package, files not smaller than global_stream_file_size are read and coded
+     *      block by block, memory does not depend on the file size. a file of content added before points at its stream
      *  @param filename file name
      *  @param dstpath destination path, root path by default
      */
     bool AddFile(const char *filename, const char *dstpath=nullptr);
 
+    /** @brief add files to Package, files are read and coded on the workers of SetThreads and written in order,
+     *      package file is the same for any thread count
+     *  @param filenames file names
+     *  @param dstpath destination path, root path by default
+     */
+    bool AddFiles(const std::vector<std::string> &filenames, const char *dstpath=nullptr);
+
     /** @brief check if filename exist
      *  @param filename file name
      */
-    bool FileExist(const char *filename);
+    bool FileExist(const char *filename) const;
+
+    /** @brief get file count of Package, files of an overlaid delta included
+     */
+    size_t GetFileCount() const { return IsWritable() ? file_index_.size() : file_count_; }
 
-    /** @brief add a directory to Package
+    /** @brief list files whose name begins with a prefix, the range of the prefix is found by binary search of the
+     *      sorted index and only its entries are read. files of an overlaid delta are listed, removed files are not.
+     *      safe to call from many threads at once
+     *  @param prefix name prefix, "dir/" lists all files under dir, nullptr or "" lists all files
+     *  @param names output file names in name order
+     */
+    bool List(const char *prefix, std::vector<std::string> &names) const;
+
+    /** @brief list files whose name matches a shell pattern, names in the range of the literal prefix of the pattern
+     *      are matched. '*' and '?' do not match '/'. safe to call from many threads at once
+     *  @param pattern shell pattern of fnmatch, eg. "assets/level_?.json"
+     *  @param names output file names in name order
+     */
+    bool Glob(const char *pattern, std::vector<std::string> &names) const;
+
+    /** @brief remove a file from the index, its stream is left in the package file until Compact. write modes
+     *  @param filename filename in Package
+     *  @return fail if the file is not found
+     */
+    bool RemoveFile(const char *filename);
+
+    /** @brief add a directory to Package, files are read and coded on the workers of SetThreads
      *  @param path source path
      *  @param dstpath destination path, root path by default
      */
     bool AddDir(const char *path, const char *dstpath=nullptr);
 
-    /** @brief get file stream
+    /** @brief get file stream, safe to call from many threads at once
      *  @param filename filename in Package
      *  @param file_stream outout file stream
      */
     template<typename streambuf_t>
     bool GetFileStream(const char *filename, streambuf_t &file_stream);
 
+    /** @brief get a shared read-only handle of a decoded file, files found in the file cache are not copied.
+     *      the handle stays valid after eviction and Close. safe to call from many threads at once
+     *  @param filename filename in Package
+     *  @param handle output decoded file
+     */
+    bool GetFileHandle(const char *filename, FileHandle &handle);
+
+    /** @brief read a range of a file, huffman files larger than global_block_size only read and decode the blocks
+     *      of the range, stored files are read in place, other files are decoded whole. safe to call from many threads
+     *  @param filename filename in Package
+     *  @param offset offset in file
+     *  @param length length of range, cut at the end of file
+     *  @param file_stream output range of file stream
+     */
+    bool ReadRange(const char *filename, uint64_t offset, uint64_t length, std::vector<char> &file_stream);
+
+    /** @brief get a view of a stored file in the mapped package file, MODE_MMAP only
+     *  @param filename filename in Package
+     *  @param data output pointer to file data, valid until Close
+     *  @param size output file size
+     *  @return fail if the file is not found or it is not stored
+     */
+    bool GetFileView(const char *filename, const char *&data, uint64_t &size);
+
+    /** @brief read file stream in chunks, stored and huffman streams are read and decoded incrementally,
+     *      memory is bounded by the chunk size. lz streams are decoded at once and passed in chunks.
+     *      safe to call from many threads at once.
+     *  @param filename filename in Package
+     *  @param consumer called with chunks of file stream in order, returns false to stop reading
+     *  @param chunk_size max chunk size
+     */
+    bool ReadFileStream(const char *filename, const std::function<bool(const char *, size_t)> &consumer,
+                        size_t chunk_size=global_chunk_size);
+
     /** @brief open a package file
      *  @param filename package file name
      *  @param mode open mode
      */
     bool Open(const char *filename, OpenMode mode);
 
-    /** @brief close package file name
+    /** @brief close package file name. the index of a package opened with MODE_UPDATE is written after the
+     *      streams, both are synced and then the index offset is rewritten, the old index is valid until then
      *  @param null
      */
     bool Close();
 
+    /** @brief write files of the package to a new package file, streams are copied without decoding in the order
+     *      of the package, streams of replaced and removed files are left out. files of an overlaid delta replace or
+     *      remove files of the package, the new package is the delta applied. read modes
+     *  @param filename new package file name, not the opened one
+     */
+    bool Compact(const char *filename);
+
+    /** @brief write a delta package of the opened package against a base package. files are compared by the hash of
+     *      their content, streams of added and replaced files are copied without decoding, removed files are listed.
+     *      the delta refers to the exact index of the base. read modes
+     *  @param base_filename base package file name
+     *  @param filename delta package file name
+     *  @param stats output delta statistics
+     */
+    bool MakeDelta(const char *base_filename, const char *filename, DeltaStats &stats);
+
+    /** @brief overlay a delta package made against the opened package, lookups resolve to the delta first and removed
+     *      files are not found. the delta is opened in the open mode of the package and closed by Close. read modes
+     *  @param filename delta package file name
+     *  @return fail if the delta is not made against the index of the package, or a delta is overlaid already
+     */
+    bool OpenDelta(const char *filename);
+
     /** @brief set resource version
      *  @param version resource version (format: xx.xx[.xx][.xx], x must be digit, eg.  3.14 / 3.14.1 / 3.14.15.92)
      */
@@ -91,7 +345,81 @@ public:
      */
     std::string GetVersion();
 
-    /** @brief extract a package file
+    /** @brief set codec of streams added next, CODEC_HUFFMAN by default
+     *  @param codec codec, a stream is stored anyway if the codec does not win by the codec ratio.
+     *      CODEC_SHARED_HUFFMAN streams smaller than global_interleaved_min_size are kept until Close, or until
+     *      global_shared_group_size bytes are kept, one table is trained from them and stored in the index.
+     *      larger streams are coded as CODEC_HUFFMAN.
+     */
+    void SetCodec(Codec codec) { codec_ = codec; }
+
+    /** @brief set codec ratio, a coded stream is kept if its size <= raw size * ratio, otherwise it is stored
+     *  @param ratio codec ratio, 0.95 by default, 0 stores all streams
+     */
+    void SetCodecRatio(double ratio) { codec_ratio_ = ratio; }
+
+    /** @brief get statistics of streams added since Open, kept after Close
+     *  @param codec codec
+     */
+    const CodecStats &GetCodecStats(Codec codec) const { return codec_stats_[codec]; }
+
+    /** @brief get statistics of files deduplicated since Open, kept after Close
+     */
+    const DedupStats &GetDedupStats() const { return dedup_stats_; }
+
+    /** @brief get codec name
+     *  @param codec codec
+     */
+    static const char *CodecName(Codec codec);
+
+    /** @brief write checksums of streams and index in packages opened next for writing, the index is sectioned.
+     *      updated packages with checksums keep them, compacted packages and deltas have them if the source has
+     *  @param checksum write checksums, false by default
+     */
+    void SetChecksum(bool checksum) { checksum_ = checksum; }
+
+    /** @brief write file names front coded in packages opened next for writing, a name keeps the prefix it shares
+     *      with the name before. the index is sectioned, smaller for deep trees and has no hash table, files are
+     *      found by binary search. updated packages with front coded names keep them, so do compacted packages and deltas
+     *  @param front_coding front code names, false by default
+     */
+    void SetFrontCoding(bool front_coding) { front_coding_ = front_coding; }
+
+    /** @brief check the index checksum at Open and the checksum of a stream when it is read. streams in the file
+     *      cache are not checked again, streams without checksum are not checked
+     *  @param verify verify on read, false by default
+     */
+    void SetVerify(bool verify) {
+        verify_ = verify;
+        if (overlay_) overlay_->SetVerify(verify);
+    }
+
+    /** @brief check the index and all streams of the package and its delta, head, tail and checksum of streams are
+     *      checked on the workers of SetThreads. packages without checksums are checked by head and tail. read modes
+     *  @return fail if a stream or the index is damaged, damaged files are logged
+     */
+    bool Verify();
+
+    /** @brief set byte budget of the decoded file cache, files decoded by GetFileStream / GetFileHandle are kept
+     *      and the least recently used are evicted. files larger than the budget are not kept. kept by Close
+     *  @param size cache size in bytes, 0 disables the cache (default)
+     */
+    void SetCacheSize(uint64_t size) {
+        file_cache_.SetCapacity(size);
+        if (overlay_) overlay_->SetCacheSize(size);
+    }
+
+    /** @brief get statistics of the decoded file cache, counters are cleared by Open
+     */
+    CacheStats GetCacheStats() const { return file_cache_.GetStats(); }
+
+    /** @brief set worker threads of AddDir/AddFiles, huffman blocks and Extract, work is done in the calling thread by default
+     *  @param thread_count thread count, 0 for all cores, 1 for the calling thread
+     */
+    void SetThreads(int thread_count);
+
+    /** @brief extract a package file, files are extracted on the workers of SetThreads, a stream shared by
+     *      files of the same content is decoded once
      *  @param dstpath extract path, current path by default
      */
     bool Extract(const char *dstpath=nullptr);
@@ -109,6 +437,36 @@ public:
     static void DeleteTempFile(const std::string &tempfile);
 
 private:
+    // stream file info
+    struct StreamInfo {
+        uint64_t offset;  // stream offset
+        uint64_t size;  // stream size
+        StreamInfo(uint64_t off, uint64_t s) : offset(off), size(s) {}
+    };
+
+    // content of a stream, 128 bits of two seeded XXH64 and the size
+    struct ContentKey {
+        uint64_t size;
+        uint64_t hash[2];
+        bool operator<(const ContentKey &other) const {
+            if (size != other.size) return size < other.size;
+            return hash[0] != other.hash[0] ? hash[0] < other.hash[0] : hash[1] < other.hash[1];
+        }
+    };
+
+    // file entry of the package or its overlaid delta
+    struct FileEntry {
+        std::string name;
+        const Packer *packer;  // package of the stream
+        StreamInfo si;
+    };
+
+    // slot of the index hash table
+    struct HashSlot {
+        uint32_t tag;  // high 32 bits of name hash, low bits select the first slot
+        uint32_t offset;  // entry offset in file entries, global_empty_slot for empty slots
+    };
+
     /** @brief reset
      *  @return null
      */
@@ -117,17 +475,256 @@ private:
         version_ = 0;
         open_mode_ = MODE_UNKNOWN;
         file_name_.clear();
-        if (if_stream_.is_open()) if_stream_.close();
+        if (read_fd_ != -1) ::close(read_fd_);
+        read_fd_ = -1;
         if (of_stream_.is_open()) of_stream_.close();
         file_index_.clear();
+        index_buffer_.clear();
+        files_ = files_end_ = nullptr;
+        hash_slots_ = nullptr;
+        hash_buffer_.clear();
+        hash_mask_ = 0;
+        file_count_ = 0;
+        files_offset_ = files_size_ = hash_offset_ = 0;
+        content_index_.clear();
+        shared_keys_.clear();
+        shared_aliases_.clear();
+        shared_names_.clear();
+        shared_streams_.clear();
+        shared_size_ = 0;
+        shared_table_buffers_.clear();
+        shared_tables_.clear();
+        file_cache_.Clear();
+        index_offset_ = index_stream_size_ = 0;
+        is_delta_ = false;
+        delta_base_hash_ = 0;
+        removed_files_.clear();
+        overlay_.reset();
+        write_checksums_ = false;
+        stream_checksums_.clear();
+        checksums_ = nullptr;
+        checksum_count_ = 0;
+        checksums_offset_ = index_checksum_ = index_checked_size_ = 0;
+        write_front_coding_ = false;
+        sorted_files_ = sorted_files_end_ = restarts_ = nullptr;
+        restart_count_ = 0;
+        list_ready_ = false;
+        list_buffer_.clear();
+        list_offsets_.clear();
+        UnmapFile();
     }
 
-    /** @brief extract single file
+    /** @brief check if the package file is opened for reading
+     */
+    bool IsReadable() const { return MODE_READ == open_mode_ || MODE_MMAP == open_mode_ || MODE_LAZY == open_mode_; }
+
+    /** @brief check if the package file is opened for writing
+     */
+    bool IsWritable() const { return MODE_WRITE == open_mode_ || MODE_UPDATE == open_mode_; }
+
+    /** @brief map the package file, MODE_MMAP
+     *  @param filename package file name
+     */
+    bool MapFile(const char *filename);
+
+    /** @brief unmap the package file
+     */
+    void UnmapFile();
+
+    /** @brief get bytes of index stream from its head
+     *  @param index_offset index offset in package file
+     *  @param file_size package file size
+     *  @param size output index stream size, head to tail
+     */
+    bool GetIndexStreamSize(uint64_t index_offset, uint64_t file_size, uint64_t &size) const;
+
+    /** @brief move the loaded index to the file index of write modes, streams are appended after it. MODE_UPDATE
+     *  @param data_end end of the index in package file
+     */
+    bool UpdateIndex(uint64_t data_end);
+
+    /** @brief sync the package file and write the index offset at its begin, MODE_UPDATE
+     *  @param index_offset offset of the index written
+     */
+    bool RepointIndex(uint64_t index_offset);
+
+    /** @brief get file entries of index, entries of LAZY mode are read into a buffer
+     *  @param files_buffer buffer of entries read
+     *  @param files output begin of entries
+     *  @param files_end output end of entries
+     */
+    bool GetFileEntries(std::vector<char> &files_buffer, const char *&files, const char *&files_end) const;
+
+    /** @brief get file entries in name order, entries of an overlaid delta replace or remove entries of the package
+     *  @param entries output file entries
+     */
+    bool GetEntries(std::vector<FileEntry> &entries) const;
+
+    /** @brief get the overlaid delta if it holds or removes a file
+     *  @param filename filename in Package
+     *  @return delta package, nullptr if the file is read from this package
+     */
+    Packer *FindDelta(const char *filename) const;
+
+    /** @brief hash the index stream, a delta refers to its base by it
+     *  @param hash output XXH64 of the index stream
+     */
+    bool GetIndexHash(uint64_t &hash) const;
+
+    /** @brief parse delta section of index
+     *  @param index begin of section
+     *  @param index_end end of section
+     */
+    bool ReadDeltaSection(const char *index, const char *index_end);
+
+    /** @brief parse checksums section of index, checksums of streams are found when they are checked
+     *  @param index begin of section
+     *  @param index_end end of section
+     *  @param checked_size bytes of index stream before the section
+     */
+    bool ReadChecksums(const char *index, const char *index_end, uint64_t checked_size);
+
+    /** @brief find the checksum of a stream
+     *  @param offset stream offset
+     *  @param checksum output checksum
+     *  @return false if the stream has no checksum
+     */
+    bool FindChecksum(uint64_t offset, uint64_t &checksum) const;
+
+    /** @brief check the index checksum, indexes without checksum pass
+     */
+    bool VerifyIndex() const;
+
+    /** @brief check head, tail and checksum of a stream, the whole stream is read
+     *  @param si stream info
+     */
+    bool VerifyStream(const StreamInfo &si) const;
+
+    /** @brief hash bytes of package file, XXH64
+     *  @param offset offset in package file
+     *  @param size byte count
+     *  @param hash output hash
+     */
+    bool HashRange(uint64_t offset, uint64_t size, uint64_t &hash) const;
+
+    /** @brief hash a stream written to the package file, read back from the file
+     *  @param si stream info
+     *  @param hash output hash
+     */
+    bool HashWrittenStream(const StreamInfo &si, uint64_t &hash);
+
+    /** @brief copy files to a package opened in MODE_WRITE, streams are copied without decoding in package order
+     *      and a stream of many files once. shared tables of the package and its delta are appended to the tables
+     *  @param entries file entries of this package or its delta
+     *  @param package output package
+     */
+    bool CopyFiles(const std::vector<FileEntry> &entries, Packer &package) const;
+
+    /** @brief copy a stream to the end of a package opened in MODE_WRITE, head and tail are checked and the checksum
+     *      of the copy is kept
+     *  @param si stream info
+     *  @param table_base added to the table id of CODEC_SHARED_HUFFMAN streams
+     *  @param package output package
+     */
+    bool CopyStream(const StreamInfo &si, uint32_t table_base, Packer &package) const;
+
+    /** @brief hash the content of a file, the file is decoded in chunks
+     *  @param filename filename in Package
+     *  @param key output content of file
+     */
+    bool HashFile(const char *filename, ContentKey &key);
+
+    /** @brief parse index stream
+     *  @param index begin of index stream
+     *  @param size index stream size
+     */
+    bool ReadIndex(const char *index, size_t size);
+
+    /** @brief read index stream into index_buffer_ and parse it, READ mode
+     *  @param index_offset index offset in package file
+     *  @param size index stream size
+     */
+    bool LoadIndex(uint64_t index_offset, uint64_t size);
+
+    /** @brief read head and sections of index stream, file entries and hash slots are left in package file.
+     *      indexes without hash table are loaded whole. LAZY mode
+     *  @param index_offset index offset in package file
+     *  @param size index stream size
+     */
+    bool ReadIndexDirectory(uint64_t index_offset, uint64_t size);
+
+    /** @brief extract files of one stream, file stream is decoded once and written in chunks to every file,
+     *      directories are created by Extract
      *  @param dstpath extract path
-     *  @param filename extract filename
+     *  @param filenames extract filenames
+     */
+    bool ExtractFile(const char *dstpath, const std::vector<std::string> &filenames);
+
+    /** @brief read a whole file
+     *  @param filename file name
+     *  @param file_stream output file stream
+     */
+    static bool ReadFile(const char *filename, std::vector<char> &file_stream);
+
+    /** @brief get size of a file
+     *  @param filename file name
+     *  @param size output file size
+     */
+    static bool GetFileSize(const char *filename, uint64_t &size);
+
+    /** @brief add a large file block by block, a frequency pass over the blocks chooses the codec and a coding pass
+     *      writes huffman blocks coded on the workers of SetThreads. the file is stored if the codec does not win.
+     *      CODEC_LZ is tried as CODEC_HUFFMAN
+     *  @param filename file name
+     *  @param inner_name file name in Package
+     *  @param size file size
+     */
+    bool AddFileBlocks(const char *filename, const char *inner_name, uint64_t size);
+
+    /** @brief collect files of a directory recursively, in the order of readdir
+     *  @param path source path
+     *  @param dstpath destination path
+     *  @param files output source file names and their destination paths
+     */
+    bool CollectFiles(const char *path, const char *dstpath, std::vector<std::pair<std::string, std::string> > &files);
+
+    /** @brief add files in order, files are read and coded on the workers of SetThreads, finished streams are
+     *      written by the calling thread in order
+     *  @param files source file names and their destination paths
+     */
+    bool AddFileList(const std::vector<std::pair<std::string, std::string> > &files);
+
+    /** @brief hash content of a stream
      *  @param file_stream file stream
      */
-    bool ExtractFile(const char *dstpath, const char *filename, const std::vector<char> &file_stream);
+    static ContentKey HashContent(const std::vector<char> &file_stream);
+
+    /** @brief point a file at the stream of the same content added before
+     *  @param key content of file
+     *  @param inner_name file name in Package
+     *  @return false if the content is not added before
+     */
+    bool LinkContent(const ContentKey &key, const char *inner_name);
+
+    /** @brief set the index entry of a file
+     *  @param inner_name file name in Package
+     *  @param stream_info stream info
+     */
+    void SetEntry(const char *inner_name, const StreamInfo &stream_info);
+
+    /** @brief check if a stream waits for the shared table of its group
+     *  @param file_stream file stream
+     */
+    bool IsSharedStream(const std::vector<char> &file_stream) const {
+        return CODEC_SHARED_HUFFMAN == codec_ && !file_stream.empty() && file_stream.size() < global_interleaved_min_size;
+    }
+
+    /** @brief keep a small stream for the shared table of its group, the index entry is set when it is written
+     *  @param inner_name file name in Package
+     *  @param key content of file stream
+     *  @param file_stream file stream, moved into the group
+     */
+    bool KeepSharedStream(const char *inner_name, const ContentKey &key, std::vector<char> &file_stream);
 
     /** @brief add file stream to Package file
      *  @param filename file name
@@ -135,6 +732,210 @@ private:
      */
     bool AddStream(const std::vector<char> &file_stream, const char *filename, const char *dstpath);
 
+    /** @brief encode file stream, stored if the codec does not win by the codec ratio
+     *  @param file_stream file stream
+     *  @param codec codec to try, CODEC_SHARED_HUFFMAN is tried as CODEC_HUFFMAN
+     *  @param header output stream header
+     *  @param encode_stream output payload of coded streams, empty for stored streams
+     */
+    bool EncodeStream(const std::vector<char> &file_stream, Codec codec, StreamHeader &header, std::vector<char> &encode_stream);
+
+    /** @brief write a stream and set its index
+     *  @param inner_name file name in Package
+     *  @param key content of file stream
+     *  @param header stream header
+     *  @param payload payload of codec
+     */
+    bool WriteStream(const char *inner_name, const ContentKey &key, const StreamHeader &header, const std::vector<char> &payload);
+
+    /** @brief write alignment and tail of a stream whose payload is written, and set its index, content and checksum
+     *  @param inner_name file name in Package
+     *  @param key content of file stream
+     *  @param header stream header
+     *  @param payload_size payload size
+     *  @param hasher hash of head, header and payload written, nullptr to read the stream back for its checksum
+     */
+    bool FinishStream(const char *inner_name, const ContentKey &key, const StreamHeader &header, uint64_t payload_size,
+                      utility::XxHash64 *hasher);
+
+    /** @brief train a shared table from kept streams, write them with the table or their own codec
+     *  @return success or fail
+     */
+    bool FlushSharedStreams();
+
+    /** @brief set file entries of index, entries are parsed when they are probed
+     *  @param index begin of entries
+     *  @param index_end end of entries
+     */
+    bool ReadFileIndex(const char *index, const char *index_end);
+
+    /** @brief set front coded entries section of index, entries are parsed when they are searched
+     *  @param index begin of section
+     *  @param index_end end of section
+     */
+    bool ReadSortedFiles(const char *index, const char *index_end);
+
+    /** @brief parse a front coded entry, the name is built on the name of the entry before
+     *  @param entry begin of entry, moved to next entry
+     *  @param name name of the entry before, output name of the entry
+     *  @param si output stream info
+     */
+    bool ReadSortedEntry(const char *&entry, std::string &name, StreamInfo &si) const;
+
+    /** @brief find the first front coded entry whose name is not less than a key, restart points are binary searched
+     *  @param key name or prefix
+     *  @param key_len key length
+     *  @param entry output next entry
+     *  @param name output name of the entry found
+     *  @param si output stream info of the entry found
+     *  @return false if all names are less or entries are damaged, damaged entries are logged
+     */
+    bool SeekSortedEntry(const char *key, size_t key_len, const char *&entry, std::string &name, StreamInfo &si) const;
+
+    /** @brief find a file entry of a front coded index
+     *  @param filename file name
+     *  @param si output stream info
+     */
+    bool FindSortedEntry(const char *filename, StreamInfo &si) const;
+
+    /** @brief list files of this package whose name begins with a prefix, the overlaid delta is not read
+     *  @param prefix name prefix
+     *  @param prefix_len prefix length
+     *  @param names output file names in name order
+     */
+    bool ListEntries(const char *prefix, size_t prefix_len, std::vector<std::string> &names) const;
+
+    /** @brief get entries of an index which is not front coded in name order, the offsets of entries are collected
+     *      at the first call. entries of LAZY mode are read into list_buffer_
+     *  @param files output begin of entries
+     *  @param files_end output end of entries
+     */
+    bool GetListEntries(const char *&files, const char *&files_end) const;
+
+    /** @brief set hash table section of index, slots are checked when they are probed
+     *  @param index begin of section
+     *  @param index_end end of section
+     */
+    bool ReadHashTable(const char *index, const char *index_end);
+
+    /** @brief build hash table of indexes without one
+     */
+    bool BuildHashTable();
+
+    /** @brief find a file entry of index, READ or MMAP mode
+     *  @param filename file name
+     *  @param si output stream info
+     */
+    bool FindEntry(const char *filename, StreamInfo &si) const;
+
+    /** @brief find a file entry by reading hash slots and entries of index in package file, LAZY mode
+     *  @param filename file name
+     *  @param si output stream info
+     */
+    bool ProbeEntry(const char *filename, StreamInfo &si) const;
+
+    /** @brief check hash table section header
+     *  @param slot_count slot count
+     *  @param file_count file count
+     *  @param slots_size bytes of slots
+     */
+    static bool CheckHashTable(uint32_t slot_count, uint32_t file_count, uint64_t slots_size);
+
+    /** @brief parse a file entry
+     *  @param entry begin of entry, moved to next entry
+     *  @param end end of entries
+     *  @param name output name, not terminated
+     *  @param len output name length
+     *  @param si output stream info
+     */
+    static bool ReadEntry(const char *&entry, const char *end, const char *&name, uint32_t &len, StreamInfo &si);
+
+    /** @brief build hash table of file entries, slot count is a power of 2 not less than twice the file count
+     *  @param files begin of entries
+     *  @param files_end end of entries
+     *  @param slots output slots
+     *  @param file_count output file count
+     */
+    static bool BuildHashSlots(const char *files, const char *files_end, std::vector<HashSlot> &slots, uint32_t &file_count);
+
+    /** @brief hash of file name, FNV-1a
+     *  @param name file name
+     *  @param len name length
+     */
+    static uint64_t HashName(const char *name, size_t len);
+
+    /** @brief parse shared tables section of index, decode tables are built
+     *  @param index begin of section
+     *  @param index_end end of section
+     */
+    bool ReadSharedTables(const char *index, const char *index_end);
+
+    /** @brief find a file and read its StreamHeader, payload is mapped in MMAP mode
+     *  @param filename filename in Package
+     *  @param si output stream info
+     *  @param header output stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+     *  @param has_header output, stream has StreamHeader, raw_size of header is valid
+     *  @param payload_offset output payload offset in package file
+     *  @param payload output mapped payload, nullptr if the package file is not mapped
+     *  @param payload_size output payload size, alignment included
+     */
+    bool LocateStream(const char *filename, StreamInfo &si, StreamHeader &header, bool &has_header,
+                      uint64_t &payload_offset, const char *&payload, uint64_t &payload_size) const;
+
+    /** @brief decode a file of a found entry
+     *  @param filename filename in Package
+     *  @param si stream info
+     *  @param file_stream output file stream
+     */
+    template<typename streambuf_t>
+    bool DecodeFile(const char *filename, const StreamInfo &si, streambuf_t &file_stream) const;
+
+    /** @brief get a decoded file from the file cache, it is decoded and kept on a miss
+     *  @param filename filename in Package
+     *  @param si stream info, the stream offset is the cache key
+     *  @param handle output decoded file
+     */
+    bool GetCachedFile(const char *filename, const StreamInfo &si, FileHandle &handle) const;
+
+    /** @brief read head and StreamHeader of a stream
+     *  @param si stream info
+     *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+     *  @param has_header stream has StreamHeader, raw_size of header is valid
+     *  @param payload_offset payload offset in package file
+     *  @param payload_size payload size, alignment included
+     */
+    bool ReadStreamHeader(const StreamInfo &si, StreamHeader &header, bool &has_header, uint64_t &payload_offset, uint64_t &payload_size) const;
+
+    /** @brief parse head and StreamHeader of a stream
+     *  @param stream begin of stream, at least min(stream size, head + StreamHeader) bytes
+     *  @param si stream info
+     *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+     *  @param has_header stream has StreamHeader, raw_size of header is valid
+     *  @param payload_size payload size, alignment included
+     */
+    bool ParseStreamHeader(const char *stream, const StreamInfo &si, StreamHeader &header, bool &has_header, uint64_t &payload_size) const;
+
+    /** @brief check a stream of the mapped package file, MODE_MMAP
+     *  @param si stream info
+     *  @param header stream header, codec is CODEC_HUFFMAN for streams without StreamHeader
+     *  @param has_header stream has StreamHeader, raw_size of header is valid
+     *  @param payload output pointer to payload in the mapping
+     *  @param payload_size payload size, alignment included
+     */
+    bool MapStream(const StreamInfo &si, StreamHeader &header, bool &has_header, const char *&payload, uint64_t &payload_size) const;
+
+    /** @brief check tail of a stream
+     *  @param si stream info
+     */
+    bool ReadStreamTail(const StreamInfo &si) const;
+
+    /** @brief read bytes at an offset of package file, no file position is shared. MMAP mode copies from the mapping
+     *  @param offset offset in package file
+     *  @param buffer output buffer
+     *  @param size bytes to read
+     */
+    bool ReadAt(uint64_t offset, char *buffer, size_t size) const;
+
     /** @brief joint path
      *  @param path path name
      *  @param name file name
@@ -147,78 +948,229 @@ private:
      */
     bool MakeDirs(const char *fullpath);
 
-    // stream file info
-    struct StreamInfo {
-        uint64_t offset;  // stream offset
-        uint64_t size;  // stream size
-        StreamInfo(uint64_t off, uint64_t s) : offset(off), size(s) {}
-    };
-
 private:
     uint64_t cur_offset_;  // current file offset
     int32_t version_; // file version
     OpenMode open_mode_;  // file open mode
     std::string file_name_;  // package file name
-    std::ifstream if_stream_;  // package file stream, READ mode
+    int read_fd_;  // package file, READ mode, read with pread so readers share no file position
     std::ofstream of_stream_;  // package file stream, WRITE mode
-    std::map<std::string, StreamInfo> file_index_;  // file index in package file
+    std::map<std::string, StreamInfo> file_index_;  // file index in package file, WRITE mode
+    std::map<ContentKey, StreamInfo> content_index_;  // streams by content, offset 0 for kept shared streams, WRITE mode
+    DedupStats dedup_stats_;  // statistics of duplicate files, cleared by Open
+    std::vector<char> index_buffer_;  // index stream, READ mode
+    const char *files_;  // file entries of index stream or mapping, READ / MMAP mode
+    const char *files_end_;  // end of file entries
+    const HashSlot *hash_slots_;  // hash table of index stream, mapping or hash_buffer_
+    std::vector<HashSlot> hash_buffer_;  // hash table built at Open for indexes without one
+    uint32_t hash_mask_;  // slot count - 1
+    uint32_t file_count_;  // file count of index, of the package and its delta when a delta is overlaid
+    uint64_t files_offset_;  // offset of file entries in package file, LAZY mode
+    uint64_t files_size_;  // bytes of file entries, LAZY mode
+    uint64_t hash_offset_;  // offset of hash slots in package file, LAZY mode
+    std::unique_ptr<utility::ThreadPool> thread_pool_;  // workers of huffman blocks, kept by Reset
+    Codec codec_;  // codec of streams added next, kept by Reset
+    double codec_ratio_;  // max coded size / raw size of a kept coded stream, kept by Reset
+    CodecStats codec_stats_[CODEC_COUNT];  // statistics of added streams, cleared by Open
+    std::vector<std::string> shared_names_;  // names of streams waiting for a shared table, WRITE mode
+    std::vector<std::vector<char> > shared_streams_;  // streams waiting for a shared table, WRITE mode
+    std::vector<ContentKey> shared_keys_;  // content of shared_streams_
+    std::vector<std::pair<std::string, ContentKey> > shared_aliases_;  // files of the content of a kept stream, WRITE mode
+    uint64_t shared_size_;  // bytes of shared_streams_
+    std::vector<std::vector<char> > shared_table_buffers_;  // shared tables of index, written by write modes
+    std::vector<std::unique_ptr<huffman::Huffman> > shared_tables_;  // shared table decoders, READ mode
+    const char *map_data_;  // mapped package file, MMAP mode
+    uint64_t map_size_;  // mapped size
+    mutable utility::LruCache<uint64_t, std::vector<char> > file_cache_;  // decoded files by stream offset, READ modes
+    uint64_t index_offset_;  // index offset in package file, READ modes
+    uint64_t index_stream_size_;  // index stream size, head to tail
+    bool is_delta_;  // the index has a delta section
+    uint64_t delta_base_hash_;  // hash of the index of the base of a delta
+    std::set<std::string> removed_files_;  // files of the base removed by a delta
+    std::unique_ptr<Packer> overlay_;  // delta overlaid on the package, READ modes
+    bool checksum_;  // write checksums in packages opened next, kept by Reset
+    bool verify_;  // check checksums on read, kept by Reset
+    bool write_checksums_;  // checksums are written at Close, write modes
+    std::map<uint64_t, uint64_t> stream_checksums_;  // checksums of streams by offset, write modes
+    const char *checksums_;  // stream checksums of index stream or mapping, READ / MMAP mode
+    uint32_t checksum_count_;  // streams with checksum
+    uint64_t checksums_offset_;  // offset of stream checksums in package file, LAZY mode
+    uint64_t index_checksum_;  // checksum of the index stream before the checksums section
+    uint64_t index_checked_size_;  // bytes of index stream covered by index_checksum_, 0 without checksums
+    bool front_coding_;  // write front coded names in packages opened next, kept by Reset
+    bool write_front_coding_;  // names are front coded at Close, write modes
+    const char *sorted_files_;  // front coded entries of index stream or mapping, READ / MMAP mode
+    const char *sorted_files_end_;  // end of front coded entries
+    const char *restarts_;  // offsets of restart points in front coded entries, uint32 not aligned
+    uint32_t restart_count_;  // restart points
+    mutable std::mutex list_mutex_;  // guards collecting list_offsets_
+    mutable bool list_ready_;  // list_offsets_ are collected
+    mutable std::vector<char> list_buffer_;  // file entries read for List, LAZY mode
+    mutable std::vector<uint32_t> list_offsets_;  // offsets of file entries in name order, indexes not front coded
 };
 
-/** @brief get file stream
+/** @brief get file stream, safe to call from many threads at once
  *  @param filename filename in Package
  *  @param file_stream outout file stream
  */
 template<typename streambuf_t>
 bool Packer::GetFileStream(const char *filename, streambuf_t &file_stream) {
-    if (open_mode_ != MODE_READ) {
-        LOG_ERR << "check open mode fail. OpenMode is not MODE_READ.";
+    if (!IsReadable()) {
+        LOG_ERR << "check open mode fail. OpenMode is not a read mode.";
         return false;
     }
 
+    if (Packer *delta = FindDelta(filename)) return delta->GetFileStream(filename, file_stream);
+
     file_stream.clear();
-    std::map<std::string, StreamInfo>::const_iterator it = file_index_.find(filename);
-    if (it == file_index_.end()) {
+    StreamInfo si(0, 0);
+    if (!FindEntry(filename, si)) {
         LOG_ERR << "can not find filename:" << filename;
         return false;
     }
-    const StreamInfo & si = it->second;
-    uint64_t stream_head = 0, stream_tail = 0;
-    if (si.size < sizeof(stream_head) + sizeof(stream_tail)) {
-        LOG_ERR << "stream size error, size:" << si.size;
-        return false;
-    }
+    if (0 == file_cache_.capacity()) return DecodeFile(filename, si, file_stream);
 
-    std::vector<char> encode_stream;
-    uint64_t size = si.size - sizeof(stream_head) - sizeof(stream_tail);
-    encode_stream.resize(size);
-    if_stream_.seekg(si.offset, std::ios::beg);
-    if_stream_.read((char*)&stream_head, sizeof(stream_head));
-    if_stream_.read(&encode_stream[0], size);
-    if_stream_.read((char*)&stream_tail, sizeof(stream_tail));
-    if (!if_stream_.good()) {
-        LOG_ERR << "read file error.";
+    FileHandle handle;
+    if (!GetCachedFile(filename, si, handle)) return false;
+    file_stream.assign(handle->begin(), handle->end());
+    return true;
+}
+
+/** @brief decode a file of a found entry
+ *  @param filename filename in Package
+ *  @param si stream info
+ *  @param file_stream output file stream
+ */
+template<typename streambuf_t>
+bool Packer::DecodeFile(const char *filename, const StreamInfo &si, streambuf_t &file_stream) const {
+    if (verify_ && !VerifyStream(si)) {
+        LOG_ERR << "verify stream error, filename:" << filename;
         return false;
     }
+    StreamHeader header;
+    bool has_header = false;
+    uint64_t payload_offset = 0, payload_size = 0;
+    std::vector<char> encode_stream;
+    const char *payload = nullptr;
+    if (MODE_MMAP == open_mode_) {
+        // payload is decoded in place
+        if (!MapStream(si, header, has_header, payload, payload_size)) {
+            LOG_ERR << "map stream error, filename:" << filename;
+            return false;
+        }
+        if (CODEC_STORED == header.codec) {
+            file_stream.assign(payload, payload + header.raw_size);
+            return true;
+        }
+    } else {
+        if (!ReadStreamHeader(si, header, has_header, payload_offset, payload_size)) {
+            LOG_ERR << "read stream header error, filename:" << filename;
+            return false;
+        }
 
-    if (global_stream_head != stream_head || global_stream_tail != stream_tail) {
-        LOG_ERR << "check stream head or tail error.";
-        return false;
+        // stored streams are read into file stream directly
+        if (CODEC_STORED == header.codec) {
+            file_stream.resize(header.raw_size);
+            if (header.raw_size && !ReadAt(payload_offset, &file_stream[0], header.raw_size)) return false;
+            return ReadStreamTail(si);
+        }
+
+        encode_stream.resize(payload_size);
+        if (payload_size && !ReadAt(payload_offset, &encode_stream[0], payload_size)) return false;
+        if (!ReadStreamTail(si)) return false;
+        payload = encode_stream.data();
     }
 
-    huffman::Huffman huffman_decode;
-    if (!huffman_decode.Decode(encode_stream, file_stream)) {
+    bool decoded = false;
+    if (CODEC_SHARED_HUFFMAN == header.codec) {
+        // the decode table is built when the index is read
+        if (header.flags >= shared_tables_.size()) {
+            LOG_ERR << "check shared table id error. id:" << header.flags;
+            return false;
+        }
+        decoded = shared_tables_[header.flags]->DecodeShared(payload, payload_size, file_stream);
+    } else if (CODEC_LZ == header.codec) {
+        lz::Lz lz_decode;
+        lz_decode.SetThreadPool(thread_pool_.get());
+        decoded = lz_decode.Decode(payload, payload_size, file_stream);
+    } else {
+        huffman::Huffman huffman_decode;
+        huffman_decode.SetThreadPool(thread_pool_.get());
+        decoded = huffman_decode.Decode(payload, payload_size, file_stream);
+    }
+    if (!decoded) {
         LOG_ERR << "decode error.";
         return false;
     }
+    if (has_header && file_stream.size() != header.raw_size) {
+        LOG_ERR << "check decode size error. size:" << file_stream.size() << ", raw size:" << header.raw_size;
+        return false;
+    }
     return true;
 }
 
+// streambuf of a file in Package, decoded on demand by underflow. memory does not depend on the file size:
+// huffman files are decoded incrementally from the begin, stored and huffman files seek with ReadRange windows.
+// lz files and streams without StreamHeader are decoded whole when opened. the Package must stay open.
+class PackStreamBuf : public std::streambuf {
+public:
+    PackStreamBuf() : packer_(nullptr), payload_(nullptr) { close(); }
+
+    /** @brief open a file of Package
+     *  @param packer package opened in a read mode, not owned
+     *  @param filename filename in Package
+     */
+    bool open(Packer *packer, const char *filename);
+
+    /** @brief close the file, buffers are released
+     */
+    void close();
+
+    bool is_open() const { return nullptr != packer_; }
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+
+private:
+    /** @brief decode the next chunk of a huffman stream from the begin
+     */
+    bool ReadSequential();
+
+    /** @brief read the window at a file offset with ReadRange
+     *  @param offset file offset
+     */
+    bool ReadWindow(uint64_t offset);
+
+    /** @brief decoded bytes of get area
+     */
+    uint64_t GetAreaSize() const { return egptr() - eback(); }
+
+private:
+    Packer *packer_;  // not owned, nullptr if closed
+    std::string filename_;  // filename in Package
+    StreamHeader header_;  // stream header of the file
+    uint64_t payload_offset_;  // payload offset in package file
+    const char *payload_;  // mapped payload, MMAP mode
+    uint64_t payload_size_;  // payload size
+    uint64_t file_size_;  // decoded file size
+    uint64_t buffer_offset_;  // file offset of eback()
+    uint64_t input_offset_;  // payload bytes pushed to decoder_
+    bool whole_;  // the whole file is in the get area
+    bool sequential_;  // decoded by decoder_ from the begin, until the first seek out of the get area
+    huffman::StreamDecoder decoder_;
+    std::vector<char> buffer_;  // get area
+    std::vector<char> input_;  // payload chunk read for decoder_
+};
+
 // ifmstrem   input file / memory stream
 class ifmstream : public std::istream {
     enum StreamMode{
         MODE_UNKNOW = 0,
         MODE_FILE = 1,
-        MODE_MEM = 2
+        MODE_MEM = 2,
+        MODE_PACK = 3
     };
 
     static std::stringbuf & __InnerStringBuf() { static std::stringbuf _(std::ios::in); return _; }
@@ -265,11 +1217,21 @@ public:
         return *this;
     }
 
+    ifmstream& set_packbuf(Packer &packer, const char* filename) {
+        reset();
+        stream_mode_ = MODE_PACK;
+        is_open_ = pack_buf_.open(&packer, filename);
+        if (is_open_) rdbuf(&pack_buf_);
+        return *this;
+    }
+
     void reset() {
         if (stream_mode_ == MODE_FILE) {
             file_buf_.close();
         } else if (stream_mode_ == MODE_MEM) {
             string_buf_.str("");
+        } else if (stream_mode_ == MODE_PACK) {
+            pack_buf_.close();
         }
         is_open_ = false;
         this->clear();
@@ -280,6 +1242,7 @@ private:
     StreamMode stream_mode_;
     std::stringbuf string_buf_;
     std::filebuf file_buf_;
+    PackStreamBuf pack_buf_;
 };
 
 }  // namespace packer
@@ -1,34 +1,78 @@
 #include <iostream>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <cstring>
+#include <cstdlib>
 #include "packer.h"
 
 void Usage() {
-    std::cout << "Usage: resource-packer [OPTIONAL] [version] inputpath outputpath" << std::endl;
-    std::cout << "    -c compress, version src_dir dst_file." << std::endl;
+    std::cout << "Usage: resource-packer [-j threads] [OPTIONAL] [version] inputpath outputpath" << std::endl;
+    std::cout << "    -j worker threads of packing and extracting, 0 for all cores, 1 by default." << std::endl;
+    std::cout << "    -c compress, version src_dir dst_file, streams and index carry checksums, names are front coded." << std::endl;
     std::cout << "    -x extract, src_file dst_dir." << std::endl;
+    std::cout << "    -u update, version src_dir dst_file, files of src_dir are added to dst_file or replace its files." << std::endl;
+    std::cout << "    -z compact, src_file dst_file, space of replaced and removed files is reclaimed, dst_file may be src_file." << std::endl;
+    std::cout << "    -d delta, base_file new_file dst_file, files of new_file added, replaced or removed against base_file." << std::endl;
+    std::cout << "    -a apply delta, base_file delta_file dst_file, dst_file may be base_file." << std::endl;
+    std::cout << "    -v verify, src_file, checksums of index and streams are checked." << std::endl;
+    std::cout << "    -l list, src_file [pattern], files matching the shell pattern, all files by default." << std::endl;
+}
+
+int64_t FileSize(const char *filename) {
+    struct stat s;
+    return 0 == stat(filename, &s) ? (int64_t)s.st_size : -1;
+}
+
+void PrintCodecStats(const packer::Packer &res_packer) {
+    printf("%-16s %10s %16s %16s %16s\n", "Codec", "Files", "Raw Bytes", "Stream Bytes", "Saved Bytes");
+    for (int codec=0; codec<packer::CODEC_COUNT; codec++) {
+        const packer::CodecStats &stats = res_packer.GetCodecStats((packer::Codec)codec);
+        printf("%-16s %10llu %16llu %16llu %16lld\n", packer::Packer::CodecName((packer::Codec)codec),
+               (unsigned long long)stats.count, (unsigned long long)stats.raw_size, (unsigned long long)stats.stream_size,
+               (long long)stats.raw_size - (long long)stats.stream_size);
+    }
+    // files of content added before point at its stream
+    const packer::DedupStats &dedup = res_packer.GetDedupStats();
+    printf("%-16s %10llu %16llu %16s %16llu\n", "duplicate", (unsigned long long)dedup.count,
+           (unsigned long long)dedup.raw_size, "0", (unsigned long long)dedup.stream_size);
 }
 
 int main(int argc, char **argv) {
-    if (argc != 4 && argc!=5) {
+    // worker threads, options are shifted out
+    int thread_count = 1;
+    if (argc > 2 && 0==strcmp("-j", argv[1])) {
+        thread_count = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc < 3 || argc > 5) {
         Usage();
         return 1;
     }
 
-    if (0!=strcmp("-c", argv[1]) && 0!=strcmp("-x", argv[1])) {
+    if (0!=strcmp("-c", argv[1]) && 0!=strcmp("-x", argv[1]) && 0!=strcmp("-u", argv[1]) && 0!=strcmp("-z", argv[1])
+        && 0!=strcmp("-d", argv[1]) && 0!=strcmp("-a", argv[1]) && 0!=strcmp("-v", argv[1])
+        && 0!=strcmp("-l", argv[1])) {
         Usage();
         return 1;
     }
 
     bool success = false;
     bool compress = (0==strcmp("-c", argv[1]));
+    bool update = (0==strcmp("-u", argv[1]));
+    bool compact = (0==strcmp("-z", argv[1]));
+    bool delta = (0==strcmp("-d", argv[1]));
+    bool apply = (0==strcmp("-a", argv[1]));
+    bool verify = (0==strcmp("-v", argv[1]));
+    bool list = (0==strcmp("-l", argv[1]));
 
     struct timeval start, stop;
     memset(&start,0,sizeof(struct timeval));
     memset(&stop,0,sizeof(struct timeval));
     gettimeofday(&start,0);
     packer::Packer res_packer;
-    if (compress) {
+    res_packer.SetThreads(thread_count);
+    if (compress || update) {
         if (argc != 5) {
             Usage();
             return 1;
@@ -36,11 +80,85 @@ int main(int argc, char **argv) {
         const char *version = argv[2];
         const char *src_path = argv[3];
         const char *out_path = argv[4];
-        if (res_packer.Open(out_path, packer::MODE_WRITE)) {
+        res_packer.SetChecksum(true);
+        res_packer.SetFrontCoding(true);
+        if (res_packer.Open(out_path, update ? packer::MODE_UPDATE : packer::MODE_WRITE)) {
             res_packer.SetVersion(version);
             res_packer.AddDir(src_path);
+            success = res_packer.Close();
+            PrintCodecStats(res_packer);
+        }
+    } else if (compact) {
+        if (argc != 4) {
+            Usage();
+            return 1;
+        }
+        // the compacted package replaces dst_file when it is written
+        const char *src_path = argv[2];
+        const std::string out_path = std::string(argv[3]) + ".compact";
+        const int64_t src_size = FileSize(src_path);
+        if (res_packer.Open(src_path, packer::MODE_MMAP)) {
+            success = res_packer.Compact(out_path.c_str());
             res_packer.Close();
-            success = true;
+            success = success && 0 == rename(out_path.c_str(), argv[3]);
+            if (success) printf("Package Bytes: %lld -> %lld\n", (long long)src_size, (long long)FileSize(argv[3]));
+        }
+    } else if (delta) {
+        if (argc != 5) {
+            Usage();
+            return 1;
+        }
+        const char *base_path = argv[2];
+        const char *new_path = argv[3];
+        const char *out_path = argv[4];
+        packer::DeltaStats stats;
+        if (res_packer.Open(new_path, packer::MODE_MMAP)) {
+            success = res_packer.MakeDelta(base_path, out_path, stats);
+            res_packer.Close();
+            if (success) {
+                printf("Added: %llu, Replaced: %llu, Removed: %llu, Unchanged: %llu\n", (unsigned long long)stats.added,
+                       (unsigned long long)stats.replaced, (unsigned long long)stats.removed, (unsigned long long)stats.unchanged);
+                printf("Package Bytes: %lld -> %lld\n", (long long)FileSize(new_path), (long long)FileSize(out_path));
+            }
+        }
+    } else if (apply) {
+        if (argc != 5) {
+            Usage();
+            return 1;
+        }
+        // the applied package replaces dst_file when it is written
+        const char *base_path = argv[2];
+        const char *delta_path = argv[3];
+        const std::string out_path = std::string(argv[4]) + ".apply";
+        if (res_packer.Open(base_path, packer::MODE_MMAP) && res_packer.OpenDelta(delta_path)) {
+            success = res_packer.Compact(out_path.c_str());
+            std::cout << "Resource Version: " << res_packer.GetVersion() << std::endl;
+        }
+        res_packer.Close();
+        success = success && 0 == rename(out_path.c_str(), argv[4]);
+    } else if (verify) {
+        if (argc != 3) {
+            Usage();
+            return 1;
+        }
+        const char *src_path = argv[2];
+        if (res_packer.Open(src_path, packer::MODE_MMAP)) {
+            success = res_packer.Verify();
+            res_packer.Close();
+            if (success) printf("Package Verified: %lld bytes\n", (long long)FileSize(src_path));
+        }
+    } else if (list) {
+        if (argc > 4) {
+            Usage();
+            return 1;
+        }
+        const char *src_path = argv[2];
+        std::vector<std::string> names;
+        if (res_packer.Open(src_path, packer::MODE_MMAP)) {
+            success = 4 == argc ? res_packer.Glob(argv[3], names) : res_packer.List(nullptr, names);
+            res_packer.Close();
+            for (const std::string &name : names) std::cout << name << std::endl;
+            if (success) printf("Files: %zu\n", names.size());
         }
     } else {
         if (argc != 4) {
@@ -49,7 +167,7 @@ int main(int argc, char **argv) {
         }
         const char *src_path = argv[2];
         const char *out_path = argv[3];
-        if (res_packer.Open(src_path, packer::MODE_READ)) {
+        if (res_packer.Open(src_path, packer::MODE_MMAP)) {
             const std::string version = res_packer.GetVersion();
             std::cout << "Resource Version: " << version << std::endl;
             res_packer.Extract(out_path);
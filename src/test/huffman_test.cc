@@ -1,7 +1,11 @@
 #include <iostream>
 #include <fstream>
 #include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <random>
 #include "log.h"
+#include "utility.h"
 
 #define __USE_CUSTOM_TEST__
 #ifdef __USE_CUSTOM_TEST__
@@ -23,10 +27,24 @@ class HuffmanEnvironment : public testing::Environment {
 public:
     HuffmanEnvironment() {}
 
+    bool ParseOption(int argc, char **argv) {
+        for (int i=1; i<argc; i++) {
+            if (0==strncmp(argv[i], "--data_path=", 12)){
+                test_data_path = argv[i] + 12;
+                return true;
+            }
+        }
+        std::cout << "Usage: huffman_test --data_path=datapath" << std::endl;
+        return false;
+    }
+
 protected:
     virtual void SetUp() {}
 
     virtual void TearDown() {}
+
+public:
+    std::string test_data_path;
 };
 
 HuffmanEnvironment *env;
@@ -123,6 +141,637 @@ protected:
         EXPECT_TRUE("aaaaaaaaaa" == stream_buffer_x);
     }
 
+    // reference decoder, walk huffman tree bit by bit
+    static bool TreeDecode(Huffman &huffman, const std::vector<char> &encode_buffer, std::vector<char> &stream_buffer) {
+        size_t table_size = 0;
+        stream_buffer.clear();
+        if (!huffman.ReadFreqMap(encode_buffer.data(), encode_buffer.size(), table_size) || !huffman.BuildTree()) return false;
+        if (nullptr == huffman.root_) return true;
+        const char *pencode = &encode_buffer[table_size];
+        uint64_t encode_bit_size = *(uint64_t*)pencode; pencode += sizeof(uint64_t);
+        auto node = huffman.root_;
+        for (uint64_t i=0; i<encode_bit_size; i++) {
+            node = (pencode[i/8] & (1<<(i&7))) ? node->right : node->left;
+            if (nullptr == node->left) {
+                stream_buffer.push_back(node->ch);
+                node = huffman.root_;
+            }
+        }
+        return node == huffman.root_;
+    }
+
+    // text like buffer, repeat words of different frequency
+    static void MakeTextBuffer(size_t size, std::vector<char> &stream_buffer) {
+        const char *words[] = {"the ", "resource ", "packer ", "huffman ", "{\"name\": ", "0.5, ", "\n", "shader ", "texture_", "\x00\x01\xff"};
+        std::mt19937 rng(12345);
+        std::geometric_distribution<int> dist(0.3);
+        stream_buffer.clear();
+        stream_buffer.reserve(size);
+        while (stream_buffer.size() < size) {
+            const char *w = words[dist(rng) % 10];
+            const size_t len = (w[0]=='\x00') ? 3 : strlen(w);
+            stream_buffer.insert(stream_buffer.end(), w, w+len);
+        }
+        stream_buffer.resize(size);
+    }
+
+    void TableDecodeTest() {
+        std::mt19937 rng(54321);
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x, stream_buffer_ref;
+        // uniform bytes, codes fit the primary table
+        for (int i=0; i<100000; i++) stream_buffer.push_back((char)rng());
+        Huffman huffman_encode, huffman_decode;
+        huffman_encode.Encode(stream_buffer, encode_buffer);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // fibonacci frequencies, long codes go through multi-level sub tables
+        stream_buffer.clear();
+        uint32_t fib[2] = {1, 1};
+        for (int sym=0; sym<28; sym++) {
+            for (uint32_t i=0; i<fib[0]; i++) stream_buffer.push_back((char)(sym*9));
+            uint32_t next = fib[0] + fib[1];
+            fib[0] = fib[1], fib[1] = next;
+        }
+        std::shuffle(stream_buffer.begin(), stream_buffer.end(), rng);
+        huffman_encode.SetStreamVersion(VERSION_FREQ_MAP);
+        huffman_encode.Encode(stream_buffer, encode_buffer);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(huffman_decode.max_code_len_ > 11 + 8);  // primary table + one sub table level
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        EXPECT_TRUE(TreeDecode(huffman_decode, encode_buffer, stream_buffer_ref));
+        EXPECT_TRUE(stream_buffer_ref == stream_buffer_x);
+
+        // short buffers end in the byte by byte tail
+        for (int len=1; len<40; len++) {
+            stream_buffer.clear();
+            for (int i=0; i<len; i++) stream_buffer.push_back((char)(rng() % (len/3+1)));
+            huffman_encode.Encode(stream_buffer, encode_buffer);
+            EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+            EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        }
+
+        // truncated bits
+        encode_buffer.resize(encode_buffer.size() - 1);
+        EXPECT_FALSE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+    }
+
+    void CanonicalTest() {
+        std::mt19937 rng(2468);
+        std::vector<char> stream_buffer, encode_buffer, legacy_buffer, stream_buffer_x;
+        Huffman huffman_legacy, huffman_encode, huffman_decode;
+        huffman_legacy.SetStreamVersion(VERSION_FREQ_MAP);
+
+        // few symbols, lengths are listed with symbols
+        std::string str = "hello world, hello huffman";
+        stream_buffer.assign(str.begin(), str.end());
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE(huffman_legacy.Encode(stream_buffer, legacy_buffer));
+        EXPECT_TRUE(*(uint32_t*)&encode_buffer[0] == (kStreamTag | VERSION_CANONICAL));
+        EXPECT_TRUE((encode_buffer[5] & kLengthsLayoutMask) == LENGTHS_LIST);
+        EXPECT_TRUE(encode_buffer.size() + 40 < legacy_buffer.size());
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        EXPECT_TRUE(huffman_decode.Decode(legacy_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // all symbols, dense nibble lengths
+        stream_buffer.clear();
+        for (int i=0; i<100000; i++) stream_buffer.push_back((char)(rng() % 256));
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE((encode_buffer[5] & kLengthsLayoutMask) == LENGTHS_DENSE);
+        EXPECT_TRUE(encode_buffer[5] & kLengthsNibble);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // 100 symbols, bitmap
+        stream_buffer.clear();
+        for (int i=0; i<100000; i++) stream_buffer.push_back((char)(rng() % 100 + 50));
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE((encode_buffer[5] & kLengthsLayoutMask) == LENGTHS_BITMAP);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // codes longer than 15 bits, byte lengths
+        stream_buffer.clear();
+        uint32_t fib[2] = {1, 1};
+        for (int sym=0; sym<24; sym++) {
+            for (uint32_t i=0; i<fib[0]; i++) stream_buffer.push_back((char)(sym*7));
+            uint32_t next = fib[0] + fib[1];
+            fib[0] = fib[1], fib[1] = next;
+        }
+        std::shuffle(stream_buffer.begin(), stream_buffer.end(), rng);
+        huffman_encode.SetMaxCodeLength(kMaxCodeLength);
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        huffman_encode.SetMaxCodeLength(kDefaultCodeLengthLimit);
+        EXPECT_FALSE(encode_buffer[5] & kLengthsNibble);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // single symbol and empty buffer
+        stream_buffer.assign(1000, '\0');
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        stream_buffer.clear();
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer_x.empty());
+
+        // over-subscribed code lengths
+        stream_buffer.assign(str.begin(), str.end());
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        const size_t count = *(uint16_t*)&encode_buffer[6];
+        encode_buffer[4] = 1;
+        for (size_t i=0; i<(count+1)/2; i++) encode_buffer[8 + count + i] = 0x11;
+        EXPECT_FALSE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+    }
+
+    void LengthLimitTest() {
+        std::mt19937 rng(1357);
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x;
+        uint32_t fib[2] = {1, 1};
+        for (int sym=0; sym<30; sym++) {
+            for (uint32_t i=0; i<fib[0]; i++) stream_buffer.push_back((char)(sym*5));
+            uint32_t next = fib[0] + fib[1];
+            fib[0] = fib[1], fib[1] = next;
+        }
+        std::shuffle(stream_buffer.begin(), stream_buffer.end(), rng);
+
+        // unlimited huffman tree
+        Huffman huffman_tree;
+        EXPECT_TRUE(huffman_tree.BuildFreqMap(stream_buffer.data(), stream_buffer.size()) && huffman_tree.BuildTree() && huffman_tree.BuildCodesFromTree());
+        uint64_t tree_bits = 0;
+        uint32_t tree_max_len = 0;
+        for (int sym=0; sym<256; sym++) {
+            tree_bits += huffman_tree.char_freq_[sym] * huffman_tree.codes_[sym].len;
+            tree_max_len = std::max(tree_max_len, huffman_tree.codes_[sym].len);
+        }
+        EXPECT_TRUE(tree_max_len > 15);
+
+        const int limits[] = {8, 11, 15, 56};
+        uint64_t last_bits = ~(uint64_t)0;
+        for (int limit : limits) {
+            Huffman huffman_encode, huffman_decode;
+            huffman_encode.SetMaxCodeLength(limit);
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+            EXPECT_TRUE((uint8_t)encode_buffer[4] <= limit);
+            uint64_t bits = 0, kraft = 0;
+            for (int sym=0; sym<256; sym++) {
+                const uint32_t len = huffman_encode.codes_[sym].len;
+                bits += huffman_encode.char_freq_[sym] * len;
+                if (len) kraft += (uint64_t)1 << (kMaxCodeLength - len);
+            }
+            // complete prefix code, longer limit never costs more bits
+            EXPECT_TRUE(kraft == ((uint64_t)1 << kMaxCodeLength));
+            EXPECT_TRUE(bits <= last_bits);
+            last_bits = bits;
+            EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+            EXPECT_TRUE(stream_buffer == stream_buffer_x);
+            if (limit <= kPrimaryTableBits) EXPECT_TRUE(huffman_decode.decode_table_.size() == ((size_t)1 << huffman_decode.primary_bits_));
+            std::cout << "max code length " << limit << ": " << bits << " bits" << std::endl;
+        }
+        // package-merge is optimal when the limit is not reached
+        EXPECT_TRUE(last_bits == tree_bits);
+
+        // all 256 symbols with the smallest limit
+        stream_buffer.clear();
+        for (int i=0; i<256; i++) stream_buffer.insert(stream_buffer.end(), i + 1, (char)i);
+        Huffman huffman_encode, huffman_decode;
+        huffman_encode.SetMaxCodeLength(1);
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE((uint8_t)encode_buffer[4] == kMinCodeLengthLimit);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+    }
+
+    void InterleavedTest() {
+        std::mt19937 rng(2468);
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x;
+        Huffman huffman_encode, huffman_decode;
+        huffman_encode.SetStreamVersion(VERSION_INTERLEAVED);
+
+        // sizes around the segment boundaries, stream counts below, at and above 4
+        const int stream_counts[] = {1, 3, 4, 7, 8};
+        for (int stream_count : stream_counts) {
+            huffman_encode.SetInterleavedStreams(stream_count);
+            for (size_t size = 0; size < 100; size++) {
+                stream_buffer.resize(size);
+                for (auto &ch : stream_buffer) ch = (char)(rng() % 40);
+                EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+                EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+                EXPECT_TRUE(stream_buffer == stream_buffer_x);
+                if (size) EXPECT_TRUE(huffman_decode.stream_bit_sizes_.size() == (size_t)stream_count);
+            }
+        }
+
+        // long codes take the single stream path
+        huffman_encode.SetInterleavedStreams(4);
+        MakeTextBuffer(100000, stream_buffer);
+        const int limits[] = {8, 11, 15, 20, 56};
+        for (int limit : limits) {
+            huffman_encode.SetMaxCodeLength(limit);
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+            EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+            EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        }
+        huffman_encode.SetMaxCodeLength(kDefaultCodeLengthLimit);
+
+        // the jump table is checked against buffer size and every stream against its bit size
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        std::vector<char> truncated(encode_buffer.begin(), encode_buffer.end() - 1);
+        EXPECT_FALSE(huffman_decode.Decode(truncated, stream_buffer_x));
+        size_t header_size = 0;
+        uint64_t output_size = 0;
+        EXPECT_TRUE(huffman_decode.ReadHeader(encode_buffer.data(), encode_buffer.size(), header_size, output_size));
+        encode_buffer[header_size + (huffman_decode.stream_bit_sizes_[0] + 7)/8 - 1] ^= 0x5A;
+        EXPECT_FALSE(huffman_decode.Decode(encode_buffer, stream_buffer_x) && stream_buffer == stream_buffer_x);
+    }
+
+    void BlockedTest() {
+        std::mt19937 rng(8642);
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x;
+        std::string str_buffer;
+        utility::ThreadPool pool(4);
+        Huffman huffman_encode, huffman_decode;
+        huffman_encode.SetStreamVersion(VERSION_BLOCKED);
+        huffman_encode.SetBlockSize(1);
+        EXPECT_TRUE(huffman_encode.block_size_ == kMinBlockSize);
+
+        // sizes around block boundaries, with and without thread pool
+        const size_t sizes[] = {0, 1, 4095, 4096, 4097, 3*4096, 10000, 100000};
+        for (size_t size : sizes) {
+            MakeTextBuffer(size, stream_buffer);
+            huffman_encode.SetThreadPool(nullptr);
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+            std::vector<char> encode_buffer_pool;
+            huffman_encode.SetThreadPool(&pool);
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer_pool));
+            EXPECT_TRUE(encode_buffer == encode_buffer_pool);
+            huffman_decode.SetThreadPool((size & 1) ? &pool : nullptr);
+            EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+            EXPECT_TRUE(stream_buffer == stream_buffer_x);
+            EXPECT_TRUE(huffman_decode.block_index_.offsets.size() == (size + 4095)/4096 + 1);
+        }
+
+        // ranges only decode the blocks they cover
+        MakeTextBuffer(100000, stream_buffer);
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        for (int round=0; round<50; round++) {
+            const uint64_t offset = rng() % 100001, length = rng() % 20000;
+            EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer, offset, length, str_buffer));
+            const size_t end = std::min((size_t)(offset + length), stream_buffer.size());
+            EXPECT_TRUE(str_buffer == std::string(stream_buffer.begin() + offset, stream_buffer.begin() + end));
+        }
+        EXPECT_FALSE(huffman_decode.DecodeRange(encode_buffer, 100001, 1, str_buffer));
+
+        // ranges of a stream read in parts only read the header and the blocks they cover
+        uint64_t read_size = 0;
+        auto read_encode = [&encode_buffer, &read_size] (uint64_t offset, size_t size, char *buffer) {
+            if (offset + size > encode_buffer.size()) return false;
+            memcpy(buffer, &encode_buffer[offset], size);
+            read_size += size;
+            return true;
+        };
+        for (int round=0; round<50; round++) {
+            const uint64_t offset = rng() % 100001, length = rng() % 20000;
+            EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer.size(), read_encode, offset, length, str_buffer));
+            const size_t end = std::min((size_t)(offset + length), stream_buffer.size());
+            EXPECT_TRUE(str_buffer == std::string(stream_buffer.begin() + offset, stream_buffer.begin() + end));
+        }
+        read_size = 0;
+        EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer.size(), read_encode, 50000, 100, stream_buffer_x));
+        EXPECT_TRUE(std::vector<char>(stream_buffer.begin() + 50000, stream_buffer.begin() + 50100) == stream_buffer_x);
+        EXPECT_TRUE(read_size < encode_buffer.size() / 4);
+        EXPECT_FALSE(huffman_decode.DecodeRange(encode_buffer.size(), read_encode, 100001, 1, str_buffer));
+        // a corrupt block after the range is not decoded
+        encode_buffer[encode_buffer.size() - 10] ^= 0x5A;
+        EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer, 0, 4096, stream_buffer_x));
+        EXPECT_FALSE(huffman_decode.Decode(encode_buffer, stream_buffer_x) && stream_buffer == stream_buffer_x);
+        encode_buffer.resize(encode_buffer.size() - 20);
+        EXPECT_FALSE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+
+        // ranges of single streams
+        Huffman huffman_single;
+        EXPECT_TRUE(huffman_single.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer, 500, 1000, stream_buffer_x));
+        EXPECT_TRUE(std::vector<char>(stream_buffer.begin() + 500, stream_buffer.begin() + 1500) == stream_buffer_x);
+
+        // ranges of interleaved streams only decode the segments they cover, streams of other segments are skipped
+        Huffman huffman_interleaved;
+        huffman_interleaved.SetStreamVersion(VERSION_INTERLEAVED);
+        EXPECT_TRUE(huffman_interleaved.Encode(stream_buffer, encode_buffer));
+        for (int round=0; round<50; round++) {
+            const uint64_t offset = rng() % 100001, length = (round & 1) ? rng() % 100 : rng() % 60000;
+            EXPECT_TRUE(huffman_decode.DecodeRange(encode_buffer, offset, length, str_buffer));
+            const size_t end = std::min((size_t)(offset + length), stream_buffer.size());
+            EXPECT_TRUE(str_buffer == std::string(stream_buffer.begin() + offset, stream_buffer.begin() + end));
+        }
+    }
+
+    // reference encoder, append std::vector<bool> codes of the tree
+    static bool VectorEncode(Huffman &huffman, const std::vector<char> &stream_buffer, std::vector<char> &encode_buffer) {
+        encode_buffer.clear();
+        if (!huffman.BuildFreqMap(stream_buffer.data(), stream_buffer.size()) || !huffman.BuildTree()) return false;
+        std::map<char, std::vector<bool> > code_table;
+        std::deque<std::pair<decltype(huffman.root_), std::vector<bool> > > q;
+        if (nullptr != huffman.root_) q.push_back(std::make_pair(huffman.root_, std::vector<bool>()));
+        while (!q.empty()) {
+            auto node = q.front().first;
+            std::vector<bool> code = q.front().second;
+            q.pop_front();
+            if (nullptr != node->left && nullptr != node->right) {
+                std::vector<bool> copy_code(code);
+                q.push_back(std::make_pair(node->left, (code.push_back(0), code)));
+                q.push_back(std::make_pair(node->right, (copy_code.push_back(1), copy_code)));
+            } else {
+                code_table.insert(std::make_pair(node->ch, code));
+            }
+        }
+        std::vector<bool> result;
+        for (auto ch : stream_buffer) {
+            const std::vector<bool> &code = code_table[ch];
+            result.insert(result.end(), code.begin(), code.end());
+        }
+        if (!huffman.WriteFreqMap(encode_buffer)) return false;
+        size_t code_table_size = encode_buffer.size();
+        encode_buffer.resize(code_table_size + (result.size() + 7)/8 + sizeof(uint64_t), 0);
+        char *pencode = &encode_buffer[code_table_size];
+        *(uint64_t*)pencode = (uint64_t)result.size(); pencode += sizeof(uint64_t);
+        for (size_t i=0; i<result.size(); i++) {
+            if (result[i]) pencode[i/8] |= (1<<(i&7));
+        }
+        return true;
+    }
+
+    void SharedTableTest() {
+        std::vector<std::vector<char> > samples(20);
+        for (size_t i=0; i<samples.size(); i++) MakeTextBuffer(200 + i*50, samples[i]);
+        std::vector<char> table_buffer, stream_buffer, encode_buffer, shared_buffer, stream_buffer_x;
+        Huffman trainer;
+        EXPECT_TRUE(trainer.TrainSharedTable(samples, table_buffer));
+
+        // small buffers are smaller without their code tables, bytes absent from samples are coded too
+        Huffman huffman_encode, huffman_decode, huffman_single;
+        huffman_encode.SetStreamVersion(VERSION_SHARED);
+        EXPECT_FALSE(huffman_encode.Encode(samples[0], shared_buffer));
+        EXPECT_TRUE(huffman_encode.SetSharedTable(table_buffer));
+        EXPECT_TRUE(huffman_decode.SetSharedTable(table_buffer));
+        for (int size : {0, 1, 100, 1000, 5000}) {
+            MakeTextBuffer(size, stream_buffer);
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, shared_buffer));
+            EXPECT_TRUE(huffman_single.Encode(stream_buffer, encode_buffer));
+            EXPECT_TRUE(shared_buffer.size() < encode_buffer.size() || size >= 5000);
+            EXPECT_TRUE(huffman_decode.Decode(shared_buffer, stream_buffer_x));
+            EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        }
+        stream_buffer.resize(256);
+        for (int sym=0; sym<256; sym++) stream_buffer[sym] = (char)sym;
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, shared_buffer));
+        EXPECT_TRUE(huffman_decode.Decode(shared_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        EXPECT_TRUE(huffman_decode.max_code_len_ <= kDefaultCodeLengthLimit);
+
+        // DecodeShared leaves the table unchanged, other streams are rejected
+        const Huffman &shared_table = huffman_decode;
+        std::string str_buffer;
+        EXPECT_TRUE(shared_table.DecodeShared(&shared_buffer[0], shared_buffer.size(), str_buffer));
+        EXPECT_TRUE(std::string(stream_buffer.begin(), stream_buffer.end()) == str_buffer);
+        EXPECT_FALSE(shared_table.DecodeShared(&encode_buffer[0], encode_buffer.size(), stream_buffer_x));
+        EXPECT_FALSE(shared_table.DecodeShared(&shared_buffer[0], shared_buffer.size() - 1, stream_buffer_x));
+        EXPECT_FALSE(huffman_single.DecodeShared(&shared_buffer[0], shared_buffer.size(), stream_buffer_x));
+
+        // the shared table is dropped by other streams
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_FALSE(huffman_decode.Decode(shared_buffer, stream_buffer_x));
+        EXPECT_TRUE(huffman_decode.SetSharedTable(table_buffer));
+        EXPECT_TRUE(huffman_decode.Decode(shared_buffer, stream_buffer_x));
+
+        // corrupt tables and streams
+        std::vector<char> bad_table(table_buffer.begin(), table_buffer.end() - 1);
+        EXPECT_FALSE(huffman_decode.SetSharedTable(bad_table));
+        EXPECT_FALSE(huffman_decode.SetSharedTable(encode_buffer));
+        EXPECT_TRUE(huffman_decode.SetSharedTable(table_buffer));
+        shared_buffer.resize(shared_buffer.size() - 1);
+        EXPECT_FALSE(huffman_decode.Decode(shared_buffer, stream_buffer_x));
+    }
+
+    // push input in chunks of random size, pull output in chunks of random size
+    static bool StreamDecode(StreamDecoder &decoder, const std::vector<char> &encode_buffer, std::mt19937 &rng,
+                             size_t max_chunk, std::vector<char> &stream_buffer) {
+        stream_buffer.clear();
+        std::vector<char> output(max_chunk);
+        size_t input_pos = 0, size = 0;
+        while (!decoder.Done()) {
+            if (!decoder.Pull(&output[0], 1 + rng() % max_chunk, size)) return false;
+            stream_buffer.insert(stream_buffer.end(), output.begin(), output.begin() + size);
+            if (size || decoder.Done()) continue;
+            if (input_pos == encode_buffer.size()) return false;
+            const size_t chunk = std::min((size_t)(1 + rng() % max_chunk), encode_buffer.size() - input_pos);
+            if (!decoder.Push(&encode_buffer[input_pos], chunk)) return false;
+            input_pos += chunk;
+            // input is kept only until it is decoded
+            if (decoder.input_.size() - decoder.input_pos_ > max_chunk + 4096) return false;
+        }
+        return true;
+    }
+
+    void StreamDecodeTest() {
+        std::mt19937 rng(97531);
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x;
+        std::vector<std::vector<char> > samples(1);
+        MakeTextBuffer(3000, samples[0]);
+        std::vector<char> table_buffer;
+        Huffman trainer;
+        EXPECT_TRUE(trainer.TrainSharedTable(samples, table_buffer));
+
+        // every stream version, chunks from single bytes to larger than the stream
+        const StreamVersion versions[] = {VERSION_FREQ_MAP, VERSION_CANONICAL, VERSION_INTERLEAVED, VERSION_BLOCKED, VERSION_SHARED};
+        const size_t sizes[] = {0, 1, 7, 100, 5000, 20000};
+        const size_t chunks[] = {1, 3, 64, 100000};
+        for (StreamVersion version : versions) {
+            Huffman huffman_encode;
+            huffman_encode.SetStreamVersion(version);
+            huffman_encode.SetBlockSize(4096);
+            huffman_encode.SetSharedTable(table_buffer);
+            for (size_t size : sizes) {
+                MakeTextBuffer(size, stream_buffer);
+                if (size == 7) stream_buffer.assign(7, 'z');
+                EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+                for (size_t chunk : chunks) {
+                    StreamDecoder decoder;
+                    EXPECT_TRUE(decoder.SetSharedTable(&trainer));
+                    const bool decoded = StreamDecode(decoder, encode_buffer, rng, chunk, stream_buffer_x);
+                    EXPECT_TRUE(decoded && stream_buffer == stream_buffer_x);
+                    if (!decoded || stream_buffer != stream_buffer_x) {
+                        std::cout << "version " << version << ", size " << size << ", chunk " << chunk << std::endl;
+                    }
+                    uint64_t output_size = 0;
+                    EXPECT_TRUE(decoder.GetOutputSize(output_size) && output_size == size);
+                }
+            }
+        }
+
+        // long codes, reset and reuse
+        Huffman huffman_long;
+        huffman_long.SetMaxCodeLength(24);
+        stream_buffer.clear();
+        for (int sym=0; sym<24; sym++) stream_buffer.insert(stream_buffer.end(), (size_t)1 << (sym % 20), (char)sym);
+        EXPECT_TRUE(huffman_long.Encode(stream_buffer, encode_buffer));
+        StreamDecoder decoder;
+        EXPECT_TRUE(StreamDecode(decoder, encode_buffer, rng, 1000, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        decoder.Reset();
+        EXPECT_FALSE(decoder.Done());
+        EXPECT_TRUE(StreamDecode(decoder, encode_buffer, rng, 5, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        // truncated streams never finish, corrupt streams never crash
+        MakeTextBuffer(20000, stream_buffer);
+        Huffman huffman_encode;
+        huffman_encode.SetStreamVersion(VERSION_BLOCKED);
+        huffman_encode.SetBlockSize(4096);
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        std::vector<char> truncated(encode_buffer.begin(), encode_buffer.end() - 1);
+        decoder.Reset();
+        EXPECT_FALSE(StreamDecode(decoder, truncated, rng, 100, stream_buffer_x));
+        EXPECT_FALSE(decoder.Done());
+        for (int round=0; round<100; round++) {
+            std::vector<char> corrupt(encode_buffer);
+            corrupt[rng() % corrupt.size()] ^= (char)(1 << (rng() % 8));
+            decoder.Reset();
+            StreamDecode(decoder, corrupt, rng, 100, stream_buffer_x);
+        }
+        std::vector<char> shared_stream;
+        Huffman huffman_shared;
+        huffman_shared.SetStreamVersion(VERSION_SHARED);
+        huffman_shared.SetSharedTable(table_buffer);
+        EXPECT_TRUE(huffman_shared.Encode(stream_buffer, shared_stream));
+        decoder.Reset();
+        EXPECT_FALSE(decoder.SetSharedTable(&huffman_encode));
+        EXPECT_TRUE(decoder.SetSharedTable(nullptr));
+        EXPECT_FALSE(StreamDecode(decoder, shared_stream, rng, 100, stream_buffer_x));
+        EXPECT_FALSE(decoder.Push(&shared_stream[0], 1));
+    }
+
+    // read all files of a directory
+    static void ReadDir(const std::string &path, std::vector<char> &stream_buffer) {
+        DIR *dir = opendir(path.c_str());
+        if (nullptr == dir) return;
+        struct dirent *filename;
+        while ((filename = readdir(dir)) != nullptr) {
+            const char *name = filename->d_name;
+            if ((name[0]=='.' && name[1]=='\0') || (name[0]=='.' && name[1]=='.' && name[2]=='\0')) continue;
+            std::string sub_path = path + "/" + name;
+            struct stat s;
+            lstat(sub_path.c_str(), &s);
+            if (S_ISDIR(s.st_mode)) {
+                ReadDir(sub_path, stream_buffer);
+            } else {
+                std::ifstream fh(sub_path.c_str(), std::ios::binary);
+                stream_buffer.insert(stream_buffer.end(), std::istreambuf_iterator<char>(fh), std::istreambuf_iterator<char>());
+            }
+        }
+        closedir(dir);
+    }
+
+    void EncodeSpeedTest(const std::string &testdatapath) {
+        std::vector<char> testdata, stream_buffer, encode_buffer, encode_buffer_ref, stream_buffer_x;
+        ReadDir(testdatapath, testdata);
+        EXPECT_TRUE(!testdata.empty());
+        if (testdata.empty()) return;
+        while (stream_buffer.size() < (16<<20)) stream_buffer.insert(stream_buffer.end(), testdata.begin(), testdata.end());
+
+        Huffman huffman_ref, huffman_encode, huffman_decode;
+        huffman_encode.SetStreamVersion(VERSION_FREQ_MAP);
+        utility::Timer timer;
+        EXPECT_TRUE(VectorEncode(huffman_ref, stream_buffer, encode_buffer_ref));
+        const double vector_ms = timer.elapsed_ms();
+        timer.reset();
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+        const double word_ms = timer.elapsed_ms();
+        EXPECT_TRUE(encode_buffer == encode_buffer_ref);
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+
+        const double mb = stream_buffer.size() / 1048576.0;
+        std::cout << "vector<bool> encode: " << mb * 1000 / vector_ms << " MB/s" << std::endl;
+        std::cout << "64bit word encode: " << mb * 1000 / word_ms << " MB/s" << std::endl;
+
+        // legacy streams are byte-identical on random data too
+        std::mt19937 rng(97531);
+        for (int round=0; round<20; round++) {
+            stream_buffer.resize(rng() % 5000);
+            for (auto &ch : stream_buffer) ch = (char)(rng() % (round * 13 + 1));
+            EXPECT_TRUE(VectorEncode(huffman_ref, stream_buffer, encode_buffer_ref));
+            EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+            EXPECT_TRUE(encode_buffer == encode_buffer_ref);
+        }
+    }
+
+    void DecodeSpeedTest() {
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x, stream_buffer_ref;
+        MakeTextBuffer(32<<20, stream_buffer);
+        Huffman huffman_encode, huffman_decode;
+        huffman_encode.SetStreamVersion(VERSION_FREQ_MAP);
+        EXPECT_TRUE(huffman_encode.Encode(stream_buffer, encode_buffer));
+
+        utility::Timer timer;
+        EXPECT_TRUE(TreeDecode(huffman_decode, encode_buffer, stream_buffer_ref));
+        const double tree_ms = timer.elapsed_ms();
+        timer.reset();
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        const double table_ms = timer.elapsed_ms();
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        EXPECT_TRUE(stream_buffer_ref == stream_buffer_x);
+
+        const double mb = stream_buffer.size() / 1048576.0;
+        std::cout << "tree decode: " << mb * 1000 / tree_ms << " MB/s" << std::endl;
+        std::cout << "table decode: " << mb * 1000 / table_ms << " MB/s" << std::endl;
+
+        // canonical stream, length-limited to a single table level
+        Huffman huffman_canonical;
+        EXPECT_TRUE(huffman_canonical.Encode(stream_buffer, encode_buffer));
+        timer.reset();
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        const double canonical_ms = timer.elapsed_ms();
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        std::cout << "canonical decode: " << mb * 1000 / canonical_ms << " MB/s" << std::endl;
+
+        // the same code table, 4 interleaved streams
+        huffman_canonical.SetStreamVersion(VERSION_INTERLEAVED);
+        EXPECT_TRUE(huffman_canonical.Encode(stream_buffer, encode_buffer));
+        timer.reset();
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        const double interleaved_ms = timer.elapsed_ms();
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        std::cout << "interleaved 4-stream decode: " << mb * 1000 / interleaved_ms << " MB/s" << std::endl;
+
+        // 1MB blocks on a thread pool of all cores
+        utility::ThreadPool pool;
+        huffman_canonical.SetStreamVersion(VERSION_BLOCKED);
+        timer.reset();
+        EXPECT_TRUE(huffman_canonical.Encode(stream_buffer, encode_buffer));
+        const double block_encode_ms = timer.elapsed_ms();
+        huffman_canonical.SetThreadPool(&pool);
+        timer.reset();
+        EXPECT_TRUE(huffman_canonical.Encode(stream_buffer, encode_buffer));
+        const double pool_encode_ms = timer.elapsed_ms();
+        timer.reset();
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        const double block_decode_ms = timer.elapsed_ms();
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        huffman_decode.SetThreadPool(&pool);
+        timer.reset();
+        EXPECT_TRUE(huffman_decode.Decode(encode_buffer, stream_buffer_x));
+        const double pool_decode_ms = timer.elapsed_ms();
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        std::cout << "blocked encode, 1 thread: " << mb * 1000 / block_encode_ms << " MB/s, "
+                  << pool.size() << " threads: " << mb * 1000 / pool_encode_ms << " MB/s" << std::endl;
+        std::cout << "blocked decode, 1 thread: " << mb * 1000 / block_decode_ms << " MB/s, "
+                  << pool.size() << " threads: " << mb * 1000 / pool_decode_ms << " MB/s" << std::endl;
+    }
+
 
 };
 
@@ -130,12 +779,22 @@ TEST_F(HuffmanTest, EmptyTest) { EmptyTest(); }
 TEST_F(HuffmanTest, CharTest) { CharTest(); }
 TEST_F(HuffmanTest, HexTest) { HexTest(); }
 TEST_F(HuffmanTest, HexStringTest) { HexTest(); }
+TEST_F(HuffmanTest, TableDecodeTest) { TableDecodeTest(); }
+TEST_F(HuffmanTest, CanonicalTest) { CanonicalTest(); }
+TEST_F(HuffmanTest, LengthLimitTest) { LengthLimitTest(); }
+TEST_F(HuffmanTest, InterleavedTest) { InterleavedTest(); }
+TEST_F(HuffmanTest, BlockedTest) { BlockedTest(); }
+TEST_F(HuffmanTest, SharedTableTest) { SharedTableTest(); }
+TEST_F(HuffmanTest, StreamDecodeTest) { StreamDecodeTest(); }
+TEST_F(HuffmanTest, EncodeSpeedTest) { EncodeSpeedTest(env->test_data_path); }
+TEST_F(HuffmanTest, DecodeSpeedTest) { DecodeSpeedTest(); }
 
 }  // namespace
 }  // namespace huffman
 
 GTEST_API_ int main(int argc, char **argv) {
     env = new HuffmanEnvironment();
+    if (!env->ParseOption(argc, argv)) return 1;
     testing::AddGlobalTestEnvironment(env);
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
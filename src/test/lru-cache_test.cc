@@ -0,0 +1,143 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log.h"
+
+#define __USE_CUSTOM_TEST__
+#ifdef __USE_CUSTOM_TEST__
+#include "ctest.h"
+#else
+#include "gtest/gtest.h"
+#endif
+
+#define private public  // hack complier
+#define protected public
+#include "lru-cache.h"
+#undef private
+#undef protected
+
+/*
+ * set global environment
+ */
+class LruCacheEnvironment : public testing::Environment {
+public:
+    LruCacheEnvironment() {}
+
+protected:
+    virtual void SetUp() {}
+
+    virtual void TearDown() {}
+};
+
+LruCacheEnvironment *env;
+
+namespace lrucachetest {
+namespace {
+
+typedef utility::LruCache<int, std::string> Cache;
+
+/*
+ * LruCacheTest, use googletest
+ */
+class LruCacheTest: public ::testing::Test {
+
+protected:
+
+    static Cache::handle_t Value(const char *str) { return std::make_shared<const std::string>(str); }
+
+    void GetPutTest() {
+        Cache cache(10);
+        Cache::handle_t handle;
+        EXPECT_FALSE(cache.Get(1, handle));
+        EXPECT_TRUE(cache.Put(1, Value("aaaa"), 4));
+        EXPECT_TRUE(cache.Get(1, handle));
+        EXPECT_TRUE(*handle == "aaaa");
+
+        // replaced value is charged once
+        EXPECT_TRUE(cache.Put(1, Value("bbb"), 3));
+        EXPECT_TRUE(cache.Get(1, handle));
+        EXPECT_TRUE(*handle == "bbb");
+        Cache::Stats stats = cache.GetStats();
+        EXPECT_TRUE(stats.hits == 2 && stats.misses == 1 && stats.evictions == 0);
+        EXPECT_TRUE(stats.bytes == 3 && stats.count == 1);
+
+        // larger than capacity, not cached
+        EXPECT_FALSE(cache.Put(2, Value("01234567890"), 11));
+        EXPECT_FALSE(cache.Get(2, handle));
+
+        cache.Erase(1);
+        EXPECT_FALSE(cache.Get(1, handle));
+        EXPECT_TRUE(cache.GetStats().bytes == 0);
+        cache.ResetStats();
+        stats = cache.GetStats();
+        EXPECT_TRUE(stats.hits == 0 && stats.misses == 0 && stats.evictions == 0);
+
+        // disabled cache keeps nothing
+        Cache disabled;
+        EXPECT_FALSE(disabled.Put(1, Value("a"), 1));
+        EXPECT_TRUE(disabled.GetStats().count == 0);
+    }
+
+    void EvictTest() {
+        Cache cache(10);
+        Cache::handle_t handle, kept;
+        EXPECT_TRUE(cache.Put(1, Value("1111"), 4));
+        EXPECT_TRUE(cache.Put(2, Value("2222"), 4));
+        EXPECT_TRUE(cache.Get(1, kept));  // 2 is the least recently used
+
+        EXPECT_TRUE(cache.Put(3, Value("3333"), 4));
+        EXPECT_FALSE(cache.Get(2, handle));
+        EXPECT_TRUE(cache.Get(1, handle));
+        EXPECT_TRUE(cache.Get(3, handle));
+        EXPECT_TRUE(cache.GetStats().evictions == 1);
+
+        // handles stay valid after eviction and Clear
+        cache.SetCapacity(4);
+        EXPECT_TRUE(cache.GetStats().count == 1);
+        EXPECT_FALSE(cache.Get(1, handle));
+        cache.Clear();
+        EXPECT_TRUE(cache.GetStats().count == 0 && cache.GetStats().bytes == 0);
+        EXPECT_TRUE(*kept == "1111");
+        EXPECT_TRUE(kept.use_count() == 1);
+    }
+
+    void ThreadTest() {
+        Cache cache(1000);
+        std::vector<std::thread> threads;
+        for (int t=0; t<4; t++) {
+            threads.emplace_back([&cache, t] () {
+                Cache::handle_t handle;
+                for (int i=0; i<10000; i++) {
+                    const int key = (i * 7 + t) % 300;
+                    if (cache.Get(key, handle)) {
+                        if (*handle != std::to_string(key)) std::cout << "wrong value of key " << key << std::endl;
+                    } else {
+                        cache.Put(key, std::make_shared<const std::string>(std::to_string(key)), 10);
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        Cache::Stats stats = cache.GetStats();
+        EXPECT_TRUE(stats.hits + stats.misses == 40000);
+        EXPECT_TRUE(stats.bytes <= 1000 && stats.bytes == stats.count * 10);
+        EXPECT_TRUE(stats.evictions > 0);
+    }
+};
+
+TEST_F(LruCacheTest, GetPutTest) { GetPutTest(); }
+TEST_F(LruCacheTest, EvictTest) { EvictTest(); }
+TEST_F(LruCacheTest, ThreadTest) { ThreadTest(); }
+
+}  // namespace
+}  // namespace lrucachetest
+
+GTEST_API_ int main(int argc, char **argv) {
+    env = new LruCacheEnvironment();
+    testing::AddGlobalTestEnvironment(env);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,243 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <random>
+#include "log.h"
+#include "utility.h"
+
+#define __USE_CUSTOM_TEST__
+#ifdef __USE_CUSTOM_TEST__
+#include "ctest.h"
+#else
+#include "gtest/gtest.h"
+#endif
+
+#define private public  // hack complier
+#define protected public
+#include "lz.h"
+#undef private
+#undef protected
+
+/*
+ * set global environment
+ */
+class LzEnvironment : public testing::Environment {
+public:
+    LzEnvironment() {}
+
+    bool ParseOption(int argc, char **argv) {
+        for (int i=1; i<argc; i++) {
+            if (0==strncmp(argv[i], "--data_path=", 12)){
+                test_data_path = argv[i] + 12;
+                return true;
+            }
+        }
+        std::cout << "Usage: lz_test --data_path=datapath" << std::endl;
+        return false;
+    }
+
+public:
+    std::string test_data_path;
+
+protected:
+    virtual void SetUp() {}
+
+    virtual void TearDown() {}
+};
+
+LzEnvironment *env;
+
+namespace lz {
+namespace {
+
+/*
+ * LzTest, use googletest
+ */
+class LzTest: public ::testing::Test {
+
+protected:
+
+    // json-like config text, keys and structure repeat with different values
+    static void MakeConfigBuffer(size_t size, std::vector<char> &stream_buffer) {
+        const char *keys[] = {"name", "texture", "shader", "position", "scale", "visible", "children", "material"};
+        std::mt19937 rng(4321);
+        char line[256];
+        stream_buffer.clear();
+        while (stream_buffer.size() < size) {
+            const int len = snprintf(line, sizeof(line), "    {\"%s\": \"%s_%u\", \"%s\": [%u.%u, %u.%u], \"id\": %u},\n",
+                                     keys[rng() % 8], keys[rng() % 8], (unsigned)(rng() % 100), keys[rng() % 8],
+                                     (unsigned)(rng() % 10), (unsigned)(rng() % 100), (unsigned)(rng() % 10),
+                                     (unsigned)(rng() % 100), (unsigned)(rng() % 100000));
+            stream_buffer.insert(stream_buffer.end(), line, line + len);
+        }
+        stream_buffer.resize(size);
+    }
+
+    // read all files of a directory, one buffer for each file
+    static void ReadDir(const std::string &path, std::vector<std::vector<char> > &files) {
+        DIR *dir = opendir(path.c_str());
+        if (nullptr == dir) return;
+        struct dirent *filename;
+        while ((filename = readdir(dir)) != nullptr) {
+            const char *name = filename->d_name;
+            if ((name[0]=='.' && name[1]=='\0') || (name[0]=='.' && name[1]=='.' && name[2]=='\0')) continue;
+            std::string sub_path = path + "/" + name;
+            struct stat s;
+            lstat(sub_path.c_str(), &s);
+            if (S_ISDIR(s.st_mode)) {
+                ReadDir(sub_path, files);
+            } else {
+                std::ifstream fh(sub_path.c_str(), std::ios::binary);
+                files.push_back(std::vector<char>(std::istreambuf_iterator<char>(fh), std::istreambuf_iterator<char>()));
+            }
+        }
+        closedir(dir);
+    }
+
+    void RoundTrip(Lz &lz, const std::vector<char> &stream_buffer) {
+        std::vector<char> encode_buffer, stream_buffer_x;
+        std::string str_buffer;
+        EXPECT_TRUE(lz.Encode(stream_buffer, encode_buffer));
+        EXPECT_TRUE(lz.Decode(encode_buffer, stream_buffer_x));
+        EXPECT_TRUE(stream_buffer == stream_buffer_x);
+        EXPECT_TRUE(lz.Decode(encode_buffer, str_buffer));
+        EXPECT_TRUE(std::string(stream_buffer.begin(), stream_buffer.end()) == str_buffer);
+    }
+
+    void RoundTripTest() {
+        Lz lz;
+        std::vector<char> stream_buffer;
+        // empty and shorter than a match
+        RoundTrip(lz, stream_buffer);
+        stream_buffer = {'a', 'b', 'c'};
+        RoundTrip(lz, stream_buffer);
+
+        // runs, overlapped matches shorter and longer than 8 bytes, lengths over 255
+        stream_buffer.assign(1000, 'x');
+        RoundTrip(lz, stream_buffer);
+        const std::string patterns[] = {"ab", "abcdefg", "abcdefghijk", "0123456789abcdefghij"};
+        for (const std::string &pattern : patterns) {
+            stream_buffer.clear();
+            for (int i=0; i<300; i++) stream_buffer.insert(stream_buffer.end(), pattern.begin(), pattern.end());
+            stream_buffer.push_back('!');
+            RoundTrip(lz, stream_buffer);
+        }
+
+        // random bytes, random small alphabets
+        std::mt19937 rng(1234);
+        for (int round=0; round<20; round++) {
+            stream_buffer.resize(rng() % 20000);
+            const int alphabet = (round % 5) * 3 + 2;
+            for (auto &ch : stream_buffer) ch = (char)(rng() % alphabet);
+            RoundTrip(lz, stream_buffer);
+        }
+
+        // matches across the window and chain depths
+        MakeConfigBuffer(3 << 20, stream_buffer);
+        stream_buffer.insert(stream_buffer.end(), stream_buffer.begin(), stream_buffer.begin() + 100000);
+        RoundTrip(lz, stream_buffer);
+        lz.SetChainDepth(1);
+        RoundTrip(lz, stream_buffer);
+        lz.SetChainDepth(0);
+        EXPECT_TRUE(lz.chain_depth_ == 1);
+    }
+
+    void CorruptTest() {
+        Lz lz;
+        std::vector<char> stream_buffer, encode_buffer, stream_buffer_x;
+        MakeConfigBuffer(50000, stream_buffer);
+        EXPECT_TRUE(lz.Encode(stream_buffer, encode_buffer));
+
+        // truncated buffer, wrong tag
+        std::vector<char> truncated(encode_buffer.begin(), encode_buffer.end() - 1);
+        EXPECT_FALSE(lz.Decode(truncated, stream_buffer_x));
+        std::vector<char> bad_tag(encode_buffer);
+        bad_tag[3] ^= 0x01;
+        EXPECT_FALSE(lz.Decode(bad_tag, stream_buffer_x));
+
+        // matches cover most of config text
+        std::vector<char> literals, lengths, distances;
+        const uint64_t sequence_count = lz.FindSequences(stream_buffer.data(), stream_buffer.size(), literals, lengths, distances);
+        EXPECT_TRUE(sequence_count > 0);
+        EXPECT_TRUE(literals.size() < stream_buffer.size() / 2);
+
+        // flipped bytes never crash the decoder
+        std::mt19937 rng(999);
+        for (int round=0; round<200; round++) {
+            std::vector<char> corrupt(encode_buffer);
+            corrupt[4 + rng() % (corrupt.size() - 4)] ^= (char)(1 << (rng() % 8));
+            lz.Decode(corrupt, stream_buffer_x);
+        }
+    }
+
+    // compare with plain huffman, ratio and decode speed
+    void Compare(const char *name, const std::vector<std::vector<char> > &files, int decode_rounds) {
+        uint64_t raw_size = 0, huffman_size = 0, lz_size = 0;
+        std::vector<std::vector<char> > huffman_buffers, lz_buffers;
+        for (const auto &file : files) {
+            huffman::Huffman huffman_encode;
+            Lz lz_encode;
+            huffman_buffers.push_back(std::vector<char>());
+            lz_buffers.push_back(std::vector<char>());
+            if (file.size() >= (16 << 10)) huffman_encode.SetStreamVersion(huffman::VERSION_INTERLEAVED);
+            EXPECT_TRUE(huffman_encode.Encode(file, huffman_buffers.back()));
+            EXPECT_TRUE(lz_encode.Encode(file, lz_buffers.back()));
+            raw_size += file.size();
+            huffman_size += huffman_buffers.back().size();
+            lz_size += lz_buffers.back().size();
+        }
+
+        std::vector<char> stream_buffer_x;
+        utility::Timer timer;
+        for (int round=0; round<decode_rounds; round++) {
+            for (size_t i=0; i<files.size(); i++) {
+                huffman::Huffman huffman_decode;
+                EXPECT_TRUE(huffman_decode.Decode(huffman_buffers[i], stream_buffer_x));
+            }
+        }
+        const double huffman_ms = timer.elapsed_ms();
+        timer.reset();
+        for (int round=0; round<decode_rounds; round++) {
+            for (size_t i=0; i<files.size(); i++) {
+                Lz lz_decode;
+                EXPECT_TRUE(lz_decode.Decode(lz_buffers[i], stream_buffer_x));
+                if (0 == round) EXPECT_TRUE(files[i] == stream_buffer_x);
+            }
+        }
+        const double lz_ms = timer.elapsed_ms();
+        const double mb = raw_size * (double)decode_rounds / 1048576.0;
+        std::cout << name << ": " << raw_size << " bytes" << std::endl;
+        std::cout << "  huffman: " << huffman_size << " bytes, ratio " << (double)huffman_size / raw_size
+                  << ", decode " << mb * 1000 / huffman_ms << " MB/s" << std::endl;
+        std::cout << "  lz:      " << lz_size << " bytes, ratio " << (double)lz_size / raw_size
+                  << ", decode " << mb * 1000 / lz_ms << " MB/s" << std::endl;
+    }
+
+    void CompareTest(const std::string &testdatapath) {
+        std::vector<std::vector<char> > files;
+        ReadDir(testdatapath, files);
+        EXPECT_TRUE(!files.empty());
+        Compare("testdata/mytestdata", files, 1000);
+
+        std::vector<char> config;
+        MakeConfigBuffer(8 << 20, config);
+        Compare("json config", std::vector<std::vector<char> >(1, config), 1);
+    }
+};
+
+TEST_F(LzTest, RoundTripTest) { RoundTripTest(); }
+TEST_F(LzTest, CorruptTest) { CorruptTest(); }
+TEST_F(LzTest, CompareTest) { CompareTest(env->test_data_path); }
+
+}  // namespace
+}  // namespace lz
+
+GTEST_API_ int main(int argc, char **argv) {
+    env = new LzEnvironment();
+    if (!env->ParseOption(argc, argv)) return 1;
+    testing::AddGlobalTestEnvironment(env);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -4,8 +4,14 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <fnmatch.h>
 #include "unistd.h"
 #include "log.h"
+#include "utility.h"
 
 #define __USE_CUSTOM_TEST__
 #ifdef __USE_CUSTOM_TEST__
@@ -312,6 +318,1693 @@ protected:
         remove("test_tmp_file");
     }
 
+    void LargeStreamTest() {
+        // large streams are stored as interleaved huffman streams, streams over a block in blocks
+        std::vector<char> blocked_stream, large_stream, small_stream(1000, 'a');
+        unsigned int seed = 12345;
+        for (size_t i=0; i<3*global_block_size+100; i++) {
+            seed = seed * 1103515245 + 12345;
+            blocked_stream.push_back("etaoin shrdlu\n"[(seed >> 16) % 14]);
+        }
+        large_stream.assign(blocked_stream.begin(), blocked_stream.begin() + 200000);
+
+        Packer res_packer;
+        res_packer.SetThreads(4);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(blocked_stream, "blocked_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(small_stream, "small_file", ""));
+        res_packer.Close();
+
+        std::vector<char> read_stream;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("blocked_file", read_stream));
+        EXPECT_TRUE(blocked_stream == read_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("large_file", read_stream));
+        EXPECT_TRUE(large_stream == read_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("small_file", read_stream));
+        EXPECT_TRUE(small_stream == read_stream);
+
+        // stream version in the huffman tag after the stream header
+        const char *names[] = {"blocked_file", "large_file", "small_file"};
+        uint32_t tags[3] = {0};
+        for (int i=0; i<3; i++) {
+            Packer::StreamInfo si(0, 0);
+            EXPECT_TRUE(res_packer.FindEntry(names[i], si));
+            res_packer.ReadAt(si.offset + sizeof(global_codec_stream_head) + sizeof(StreamHeader), (char*)&tags[i], sizeof(tags[i]));
+        }
+        res_packer.Close();
+        EXPECT_TRUE((tags[0] & 0xFF) == huffman::VERSION_BLOCKED);
+        EXPECT_TRUE((tags[1] & 0xFF) == huffman::VERSION_INTERLEAVED);
+        EXPECT_TRUE((tags[2] & 0xFF) == huffman::VERSION_CANONICAL);
+
+        // blocked streams decode in the calling thread too
+        res_packer.SetThreads(1);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("blocked_file", read_stream));
+        EXPECT_TRUE(blocked_stream == read_stream);
+        res_packer.Close();
+        remove("test_tmp_file");
+    }
+
+    void CodecTest() {
+        std::vector<char> random_stream(50000), text_stream, empty_stream;
+        unsigned int seed = 24680;
+        for (auto &ch : random_stream) {
+            seed = seed * 1103515245 + 12345;
+            ch = (char)(seed >> 16);
+        }
+        for (int i=0; i<5000; i++) text_stream.insert(text_stream.end(), "shader texture\n", "shader texture\n" + 15);
+
+        // incompressible streams are stored, text is huffman coded
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(random_stream, "random_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(text_stream, "text_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(empty_stream, "empty_file", ""));
+        const CodecStats &stored = res_packer.GetCodecStats(CODEC_STORED);
+        const CodecStats &huffman = res_packer.GetCodecStats(CODEC_HUFFMAN);
+        EXPECT_TRUE(stored.count == 2 && stored.raw_size == random_stream.size() && stored.stream_size == random_stream.size());
+        EXPECT_TRUE(huffman.count == 1 && huffman.raw_size == text_stream.size() && huffman.stream_size < text_stream.size()/2);
+        res_packer.Close();
+
+        std::vector<char> read_stream;
+        std::string str_stream;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("random_file", read_stream));
+        EXPECT_TRUE(random_stream == read_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("random_file", str_stream));
+        EXPECT_TRUE(std::string(random_stream.begin(), random_stream.end()) == str_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("text_file", read_stream));
+        EXPECT_TRUE(text_stream == read_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("empty_file", read_stream));
+        EXPECT_TRUE(read_stream.empty());
+        res_packer.Close();
+
+        // ratio 0 stores everything
+        res_packer.SetCodecRatio(0);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(text_stream, "text_file", ""));
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_STORED).count == 1);
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_HUFFMAN).count == 0);
+        res_packer.Close();
+        res_packer.SetCodecRatio(0.95);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("text_file", read_stream));
+        EXPECT_TRUE(text_stream == read_stream);
+        res_packer.Close();
+
+        // lz codec, random streams are still stored
+        res_packer.SetCodec(CODEC_LZ);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(text_stream, "text_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(random_stream, "random_file", ""));
+        const CodecStats &lz = res_packer.GetCodecStats(CODEC_LZ);
+        EXPECT_TRUE(lz.count == 1 && lz.raw_size == text_stream.size() && lz.stream_size < text_stream.size()/20);
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_STORED).count == 1);
+        res_packer.Close();
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("text_file", read_stream));
+        EXPECT_TRUE(text_stream == read_stream);
+        EXPECT_TRUE(res_packer.GetFileStream("random_file", read_stream));
+        EXPECT_TRUE(random_stream == read_stream);
+        res_packer.Close();
+
+        // streams of old packages have no stream header
+        std::vector<char> encode_stream;
+        huffman::Huffman huffman_encode;
+        huffman_encode.SetStreamVersion(huffman::VERSION_FREQ_MAP);
+        EXPECT_TRUE(huffman_encode.Encode(text_stream, encode_stream));
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        const int align_size = 7&-(int)encode_stream.size();
+        res_packer.of_stream_.write((char*)&global_stream_head, sizeof(global_stream_head));
+        res_packer.of_stream_.write(&encode_stream[0], encode_stream.size());
+        res_packer.of_stream_.write((char*)&global_zero_alignment, align_size);
+        res_packer.of_stream_.write((char*)&global_stream_tail, sizeof(global_stream_tail));
+        const uint64_t stream_size = sizeof(global_stream_head) + encode_stream.size() + align_size + sizeof(global_stream_tail);
+        res_packer.file_index_.insert(std::make_pair("legacy_file", Packer::StreamInfo(res_packer.cur_offset_, stream_size)));
+        res_packer.cur_offset_ += stream_size;
+        res_packer.Close();
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("legacy_file", read_stream));
+        EXPECT_TRUE(text_stream == read_stream);
+        res_packer.Close();
+        remove("test_tmp_file");
+    }
+
+    // small json-like config files, keys repeat across files
+    static void MakeConfigFiles(size_t count, std::vector<std::vector<char> > &files) {
+        const char *keys[] = {"name", "texture", "shader", "position", "scale", "visible", "children", "material"};
+        unsigned int seed = 13579;
+        char line[256];
+        files.resize(count);
+        for (auto &file : files) {
+            seed = seed * 1103515245 + 12345;
+            const size_t size = 200 + (seed >> 16) % 1800;
+            file.clear();
+            while (file.size() < size) {
+                seed = seed * 1103515245 + 12345;
+                const unsigned int r = seed >> 8;
+                const int len = snprintf(line, sizeof(line), "{\"%s\": \"%s_%u\", \"id\": %u},\n",
+                                         keys[r % 8], keys[(r >> 3) % 8], (r >> 6) % 100, (r >> 12) % 100000);
+                file.insert(file.end(), line, line + len);
+            }
+        }
+    }
+
+    void SharedTableTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(2000, files);
+        std::vector<char> large_stream;
+        for (int i=0; i<20; i++) large_stream.insert(large_stream.end(), files[i].begin(), files[i].end());
+        char name[64];
+
+        // small streams share tables, a flush in the middle starts a new table
+        Packer res_packer;
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        for (size_t i=0; i<files.size(); i++) {
+            sprintf(name, "file_%zu", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, "config"));
+            EXPECT_TRUE(res_packer.FileExist((std::string("config/") + name).c_str()));
+            if (i == files.size()/2) EXPECT_TRUE(res_packer.FlushSharedStreams());
+        }
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large_file", ""));
+        EXPECT_TRUE(res_packer.Close());
+        // a few streams are smaller with their own table
+        const CodecStats &shared = res_packer.GetCodecStats(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(shared.count > files.size()*9/10);
+        EXPECT_TRUE(shared.count + res_packer.GetCodecStats(CODEC_HUFFMAN).count == files.size() + 1);
+        std::ifstream fh("test_tmp_file", std::ios::binary | std::ios::ate);
+        const uint64_t shared_pack_size = fh.tellg();
+        fh.close();
+
+        std::vector<char> read_stream;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.shared_tables_.size() == 2);
+        bool same = true;
+        for (size_t i=0; i<files.size(); i++) {
+            sprintf(name, "config/file_%zu", i);
+            same = same && res_packer.GetFileStream(name, read_stream) && files[i] == read_stream;
+        }
+        EXPECT_TRUE(same);
+        EXPECT_TRUE(res_packer.GetFileStream("large_file", read_stream));
+        EXPECT_TRUE(large_stream == read_stream);
+        res_packer.Close();
+
+        // compare with a table for each stream, size and read speed
+        const int rounds = 20;
+        double ms[2] = {0};
+        uint64_t pack_size[2] = {0}, stream_size[2] = {0};
+        const Codec codecs[2] = {CODEC_HUFFMAN, CODEC_SHARED_HUFFMAN};
+        for (int c=0; c<2; c++) {
+            res_packer.SetCodec(codecs[c]);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+            for (size_t i=0; i<files.size(); i++) {
+                sprintf(name, "file_%zu", i);
+                EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+            }
+            EXPECT_TRUE(res_packer.Close());
+            stream_size[c] = res_packer.GetCodecStats(codecs[c]).stream_size;
+            std::ifstream fh("test_tmp_file", std::ios::binary | std::ios::ate);
+            pack_size[c] = fh.tellg();
+            fh.close();
+
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+            utility::Timer timer;
+            for (int round=0; round<rounds; round++) {
+                for (size_t i=0; i<files.size(); i++) {
+                    sprintf(name, "file_%zu", i);
+                    res_packer.GetFileStream(name, read_stream);
+                }
+            }
+            ms[c] = timer.elapsed_ms();
+            res_packer.Close();
+        }
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(stream_size[1] < stream_size[0] && pack_size[1] < pack_size[0]);
+        EXPECT_TRUE(shared_pack_size > pack_size[1]);
+        uint64_t raw_size = 0;
+        for (const auto &file : files) raw_size += file.size();
+        std::cout << files.size() << " files, " << raw_size << " bytes" << std::endl;
+        for (int c=0; c<2; c++) {
+            std::cout << "  " << CodecName(codecs[c]) << ": streams " << stream_size[c] << " bytes, package " << pack_size[c]
+                      << " bytes, " << rounds * files.size() * 1000.0 / ms[c] << " reads/s" << std::endl;
+        }
+
+        // only packages with shared tables use the sectioned index
+        uint64_t index_offset = 0, index_head = 0;
+        fh.open("test_tmp_file", std::ios::binary);
+        fh.read((char*)&index_offset, sizeof(index_offset));
+        fh.seekg(index_offset, std::ios::beg);
+        fh.read((char*)&index_head, sizeof(index_head));
+        fh.close();
+        EXPECT_TRUE(index_head == global_index2_stream_head);
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large_file", ""));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        fh.open("test_tmp_file", std::ios::binary);
+        fh.read((char*)&index_offset, sizeof(index_offset));
+        fh.seekg(index_offset, std::ios::beg);
+        fh.read((char*)&index_head, sizeof(index_head));
+        fh.close();
+        EXPECT_TRUE(index_head == global_index_stream_head);
+        remove("test_tmp_file");
+    }
+
+    void ReadFileStreamTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(10, files);
+        std::vector<char> large_stream, random_stream(100000);
+        while (large_stream.size() < (8 << 20)) large_stream.insert(large_stream.end(), files[large_stream.size() % 10].begin(), files[large_stream.size() % 10].end());
+        unsigned int seed = 97531;
+        for (auto &ch : random_stream) {
+            seed = seed * 1103515245 + 12345;
+            ch = (char)(seed >> 16);
+        }
+        std::vector<char> medium_stream(large_stream.begin(), large_stream.begin() + 100000);
+
+        // every codec and huffman stream version
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "blocked_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(medium_stream, "interleaved_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(random_stream, "stored_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(std::vector<char>(), "empty_file", ""));
+        res_packer.SetCodec(CODEC_LZ);
+        EXPECT_TRUE(res_packer.AddStream(medium_stream, "lz_file", ""));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(files[0], "shared_file", ""));
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.Close());
+
+        const std::pair<const char *, const std::vector<char> *> entries[] = {
+            {"blocked_file", &large_stream}, {"interleaved_file", &medium_stream}, {"stored_file", &random_stream},
+            {"lz_file", &medium_stream}, {"shared_file", &files[0]}};
+        std::vector<char> read_stream;
+        size_t max_chunk = 0;
+        auto consumer = [&read_stream, &max_chunk] (const char *data, size_t size) {
+            read_stream.insert(read_stream.end(), data, data + size);
+            max_chunk = std::max(max_chunk, size);
+            return true;
+        };
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        for (const auto &entry : entries) {
+            for (size_t chunk_size : {(size_t)1000, global_chunk_size}) {
+                read_stream.clear();
+                max_chunk = 0;
+                EXPECT_TRUE(res_packer.ReadFileStream(entry.first, consumer, chunk_size));
+                EXPECT_TRUE(*entry.second == read_stream && max_chunk <= chunk_size);
+            }
+        }
+        read_stream.clear();
+        EXPECT_TRUE(res_packer.ReadFileStream("empty_file", consumer));
+        EXPECT_TRUE(read_stream.empty());
+        EXPECT_FALSE(res_packer.ReadFileStream("no_file", consumer));
+        // the consumer stops reading
+        int chunks = 0;
+        EXPECT_FALSE(res_packer.ReadFileStream("blocked_file", [&chunks] (const char *, size_t) { return ++chunks < 3; }));
+        EXPECT_TRUE(chunks == 3);
+
+        // the first chunk is ready before the whole stream is decoded
+        utility::Timer timer;
+        EXPECT_TRUE(res_packer.GetFileStream("blocked_file", read_stream));
+        const double full_ms = timer.elapsed_ms();
+        timer.reset();
+        double first_ms = -1;
+        EXPECT_TRUE(res_packer.ReadFileStream("blocked_file", [&timer, &first_ms] (const char *, size_t) {
+            if (first_ms < 0) first_ms = timer.elapsed_ms();
+            return true;
+        }));
+        const double stream_ms = timer.elapsed_ms();
+        std::cout << "8MB stream: GetFileStream " << full_ms << " ms, ReadFileStream first chunk " << first_ms
+                  << " ms, all chunks " << stream_ms << " ms" << std::endl;
+        EXPECT_TRUE(first_ms < full_ms);
+        res_packer.Close();
+        remove("test_tmp_file");
+    }
+
+    void MmapTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(2000, files);
+        std::vector<char> text_stream, random_stream(100000);
+        for (int i=0; i<20; i++) text_stream.insert(text_stream.end(), files[i].begin(), files[i].end());
+        unsigned int seed = 86420;
+        for (auto &ch : random_stream) {
+            seed = seed * 1103515245 + 12345;
+            ch = (char)(seed >> 16);
+        }
+
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(text_stream, "huffman_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(random_stream, "stored_file", ""));
+        EXPECT_TRUE(res_packer.AddStream(std::vector<char>(), "empty_file", ""));
+        res_packer.SetCodec(CODEC_LZ);
+        EXPECT_TRUE(res_packer.AddStream(text_stream, "lz_file", ""));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(files[0], "shared_file", ""));
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.Close());
+
+        // every codec decodes from the mapping
+        const std::pair<const char *, const std::vector<char> *> entries[] = {
+            {"huffman_file", &text_stream}, {"stored_file", &random_stream}, {"lz_file", &text_stream}, {"shared_file", &files[0]}};
+        std::vector<char> read_stream;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        EXPECT_TRUE(res_packer.map_data_ != nullptr && res_packer.GetFileCount() == 5);
+        for (const auto &entry : entries) {
+            EXPECT_TRUE(res_packer.GetFileStream(entry.first, read_stream));
+            EXPECT_TRUE(*entry.second == read_stream);
+            read_stream.clear();
+            EXPECT_TRUE(res_packer.ReadFileStream(entry.first, [&read_stream] (const char *data, size_t size) {
+                read_stream.insert(read_stream.end(), data, data + size);
+                return true;
+            }, 1000));
+            EXPECT_TRUE(*entry.second == read_stream);
+        }
+
+        // stored files are views of the mapping, compressed files have no view
+        const char *data = nullptr;
+        uint64_t size = 0;
+        EXPECT_TRUE(res_packer.GetFileView("stored_file", data, size));
+        EXPECT_TRUE(size == random_stream.size() && 0 == memcmp(data, &random_stream[0], size));
+        EXPECT_TRUE(data > res_packer.map_data_ && data + size < res_packer.map_data_ + res_packer.map_size_);
+        EXPECT_TRUE(res_packer.GetFileView("empty_file", data, size));
+        EXPECT_TRUE(size == 0);
+        EXPECT_FALSE(res_packer.GetFileView("huffman_file", data, size));
+        EXPECT_FALSE(res_packer.GetFileView("no_file", data, size));
+        EXPECT_TRUE(res_packer.Extract("test_tmp_dir"));
+        res_packer.Close();
+        EXPECT_TRUE(res_packer.map_data_ == nullptr);
+        std::ifstream extracted("test_tmp_dir/lz_file", std::ios::binary);
+        EXPECT_TRUE(std::vector<char>(std::istreambuf_iterator<char>(extracted), std::istreambuf_iterator<char>()) == text_stream);
+        RemoveDir("test_tmp_dir");
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_FALSE(res_packer.GetFileView("stored_file", data, size));
+        res_packer.Close();
+
+        // bad package files
+        std::ofstream("test_tmp_file", std::ios::binary).write((const char *)&global_stream_head, 4);
+        EXPECT_FALSE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        EXPECT_FALSE(res_packer.Open("no_tmp_file", MODE_MMAP));
+
+        // lookups of small stored files, copied reads against views
+        res_packer.SetCodecRatio(0);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        char name[32];
+        for (size_t i=0; i<files.size(); i++) {
+            snprintf(name, sizeof(name), "config_%zu", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+        }
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodecRatio(0.95);
+        const int rounds = 20;
+        uint64_t read_bytes = 0, view_bytes = 0;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        utility::Timer timer;
+        for (int round=0; round<rounds; round++) {
+            for (size_t i=0; i<files.size(); i++) {
+                snprintf(name, sizeof(name), "config_%zu", i);
+                res_packer.GetFileStream(name, read_stream);
+                read_bytes += read_stream.size();
+            }
+        }
+        const double read_ms = timer.elapsed_ms();
+        res_packer.Close();
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        timer.reset();
+        for (int round=0; round<rounds; round++) {
+            for (size_t i=0; i<files.size(); i++) {
+                snprintf(name, sizeof(name), "config_%zu", i);
+                res_packer.GetFileView(name, data, size);
+                view_bytes += size;
+            }
+        }
+        const double view_ms = timer.elapsed_ms();
+        res_packer.Close();
+        EXPECT_TRUE(read_bytes == view_bytes);
+        std::cout << files.size() * rounds << " stored reads: MODE_READ " << read_ms << " ms, MODE_MMAP views "
+                  << view_ms << " ms" << std::endl;
+        remove("test_tmp_file");
+    }
+
+    void ConcurrentReadTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(1000, files);
+        std::vector<char> large_stream;
+        for (size_t i=0; large_stream.size() < (2 << 20); i++) large_stream.insert(large_stream.end(), files[i % 1000].begin(), files[i % 1000].end());
+
+        // huffman, stored, shared and lz streams
+        Packer res_packer;
+        char name[32];
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        for (size_t i=0; i<files.size(); i++) {
+            const Codec codecs[] = {CODEC_HUFFMAN, CODEC_SHARED_HUFFMAN, CODEC_LZ, CODEC_STORED};
+            res_packer.SetCodec(codecs[i % 4]);
+            res_packer.SetCodecRatio(CODEC_STORED == codecs[i % 4] ? 0 : 0.95);
+            snprintf(name, sizeof(name), "config_%zu", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+        }
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        res_packer.SetCodecRatio(0.95);
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large_file", ""));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_SHARED_HUFFMAN).count > 0);
+
+        // every thread reads every file of one opened package
+        const int rounds = 5;
+        for (OpenMode mode : {MODE_READ, MODE_MMAP}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            for (int thread_count : {1, 2, 4, 8}) {
+                std::atomic<int> errors(0);
+                std::atomic<uint64_t> read_bytes(0);
+                utility::Timer timer;
+                std::vector<std::thread> threads;
+                for (int t=0; t<thread_count; t++) {
+                    threads.push_back(std::thread([&res_packer, &files, &large_stream, &errors, &read_bytes, t] () {
+                        std::vector<char> read_stream;
+                        char thread_name[32];
+                        for (int round=0; round<rounds; round++) {
+                            for (size_t n=0; n<files.size(); n++) {
+                                const size_t i = (n + t * 97) % files.size();
+                                snprintf(thread_name, sizeof(thread_name), "config_%zu", i);
+                                if (!res_packer.GetFileStream(thread_name, read_stream) || read_stream != files[i]) errors++;
+                                read_bytes += read_stream.size();
+                            }
+                            size_t offset = 0;
+                            if (!res_packer.ReadFileStream("large_file", [&large_stream, &offset] (const char *data, size_t size) {
+                                    const bool same = 0 == memcmp(data, &large_stream[offset], size);
+                                    offset += size;
+                                    return same;
+                                }) || offset != large_stream.size()) errors++;
+                            read_bytes += offset;
+                        }
+                    }));
+                }
+                for (auto &thread : threads) thread.join();
+                const double ms = timer.elapsed_ms();
+                EXPECT_TRUE(errors == 0);
+                std::cout << (MODE_READ == mode ? "MODE_READ" : "MODE_MMAP") << " " << thread_count << " threads: "
+                          << read_bytes / 1048576.0 * 1000 / ms << " MB/s" << std::endl;
+            }
+            res_packer.Close();
+        }
+        remove("test_tmp_file");
+    }
+
+    void HashIndexTest() {
+        // many files carry a hash table in the index
+        const size_t file_count = 50000;
+        Packer res_packer;
+        char name[64];
+        res_packer.SetCodecRatio(0);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        for (size_t i=0; i<file_count; i++) {
+            const int len = snprintf(name, sizeof(name), "assets/dir_%zu/file_%zu.cfg", i % 100, i);
+            EXPECT_TRUE(res_packer.AddStream(std::vector<char>(name, name + len), name, ""));
+        }
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodecRatio(0.95);
+
+        std::vector<char> read_stream;
+        for (OpenMode mode : {MODE_READ, MODE_MMAP}) {
+            utility::Timer timer;
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            const double open_ms = timer.elapsed_ms();
+            // the table is probed in place
+            EXPECT_TRUE(res_packer.hash_buffer_.empty() && res_packer.GetFileCount() == file_count);
+            const char *index_begin = MODE_READ == mode ? res_packer.index_buffer_.data() : res_packer.map_data_;
+            const char *index_end = MODE_READ == mode ? index_begin + res_packer.index_buffer_.size() : index_begin + res_packer.map_size_;
+            EXPECT_TRUE((const char *)res_packer.hash_slots_ > index_begin && (const char *)res_packer.hash_slots_ < index_end);
+            bool all_found = true;
+            timer.reset();
+            for (size_t i=0; i<file_count; i++) {
+                const int len = snprintf(name, sizeof(name), "assets/dir_%zu/file_%zu.cfg", i % 100, i);
+                all_found = all_found && res_packer.GetFileStream(name, read_stream) && read_stream == std::vector<char>(name, name + len);
+            }
+            const double lookup_ms = timer.elapsed_ms();
+            EXPECT_TRUE(all_found);
+            EXPECT_TRUE(res_packer.FileExist("assets/dir_0/file_0.cfg"));
+            EXPECT_FALSE(res_packer.FileExist("assets/dir_0/file_1.cfg"));
+            EXPECT_FALSE(res_packer.FileExist("assets/dir_0/file_0.cf"));
+            EXPECT_FALSE(res_packer.GetFileStream("no_file", read_stream));
+            std::cout << file_count << " files, " << (MODE_READ == mode ? "MODE_READ" : "MODE_MMAP") << ": open " << open_ms
+                      << " ms, read all " << lookup_ms << " ms" << std::endl;
+            res_packer.Close();
+        }
+
+        // a map of all names, as indexes were loaded before
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        utility::Timer timer;
+        std::map<std::string, Packer::StreamInfo> name_map;
+        const char *entry = res_packer.files_, *entry_name = nullptr;
+        uint32_t len = 0;
+        Packer::StreamInfo si(0, 0);
+        while (Packer::ReadEntry(entry, res_packer.files_end_, entry_name, len, si)) {
+            name_map.insert(std::make_pair(std::string(entry_name, len), si));
+        }
+        const double map_ms = timer.elapsed_ms();
+        EXPECT_TRUE(name_map.size() == file_count);
+        uint64_t found = 0;
+        timer.reset();
+        for (int round=0; round<5; round++) {
+            for (size_t i=0; i<file_count; i++) {
+                snprintf(name, sizeof(name), "assets/dir_%zu/file_%zu.cfg", i % 100, i);
+                found += name_map.count(name);
+            }
+        }
+        const double map_lookup_ms = timer.elapsed_ms();
+        timer.reset();
+        for (int round=0; round<5; round++) {
+            for (size_t i=0; i<file_count; i++) {
+                snprintf(name, sizeof(name), "assets/dir_%zu/file_%zu.cfg", i % 100, i);
+                found += res_packer.FindEntry(name, si);
+            }
+        }
+        const double hash_lookup_ms = timer.elapsed_ms();
+        EXPECT_TRUE(found == file_count * 10);
+        std::cout << file_count * 5 << " lookups: std::map built in " << map_ms << " ms, looked up in " << map_lookup_ms
+                  << " ms, hash table looked up in " << hash_lookup_ms << " ms" << std::endl;
+        res_packer.Close();
+
+        // few files keep the old index, the table is built at open
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        for (size_t i=0; i<10; i++) {
+            snprintf(name, sizeof(name), "file_%zu", i);
+            EXPECT_TRUE(res_packer.AddStream(std::vector<char>(i, 'x'), name, ""));
+        }
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        uint64_t index_offset = 0, index_head = 0;
+        EXPECT_TRUE(res_packer.ReadAt(0, (char*)&index_offset, sizeof(index_offset)));
+        EXPECT_TRUE(res_packer.ReadAt(index_offset, (char*)&index_head, sizeof(index_head)));
+        EXPECT_TRUE(global_index_stream_head == index_head);
+        EXPECT_TRUE(res_packer.hash_buffer_.size() == 32 && res_packer.GetFileCount() == 10);
+        for (size_t i=0; i<10; i++) {
+            snprintf(name, sizeof(name), "file_%zu", i);
+            EXPECT_TRUE(res_packer.GetFileStream(name, read_stream) && read_stream == std::vector<char>(i, 'x'));
+        }
+        // bad slots are not followed
+        for (auto &slot : res_packer.hash_buffer_) {
+            if (global_empty_slot != slot.offset) slot.offset = 0x7fffffff;
+        }
+        EXPECT_FALSE(res_packer.FileExist("file_1"));
+        res_packer.Close();
+        remove("test_tmp_file");
+    }
+
+    void LazyOpenTest() {
+        char name[64];
+        std::vector<char> read_stream;
+        for (size_t file_count : {(size_t)10, (size_t)10000, (size_t)1000000}) {
+            Packer res_packer;
+            res_packer.SetCodecRatio(0);
+            utility::Timer timer;
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+            res_packer.SetVersion("3.14");
+            for (size_t i=0; i<file_count; i++) {
+                const int len = snprintf(name, sizeof(name), "dir_%zu/file_%zu", i % 100, i);
+                EXPECT_TRUE(res_packer.AddStream(std::vector<char>(name, name + len), name, ""));
+            }
+            EXPECT_TRUE(res_packer.Close());
+            const double write_ms = timer.elapsed_ms();
+
+            // open, read the version and one file
+            const int rounds = 10;
+            std::cout << file_count << " files, write " << write_ms << " ms, open latency:";
+            for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+                bool read_ok = true;
+                timer.reset();
+                for (int round=0; round<rounds; round++) {
+                    read_ok = read_ok && res_packer.Open("test_tmp_file", mode);
+                    const size_t i = file_count - 1 - round;
+                    const int len = snprintf(name, sizeof(name), "dir_%zu/file_%zu", i % 100, i);
+                    read_ok = read_ok && res_packer.GetVersion() == "3.14" && res_packer.GetFileStream(name, read_stream)
+                              && read_stream == std::vector<char>(name, name + len);
+                    res_packer.Close();
+                }
+                EXPECT_TRUE(read_ok);
+                std::cout << " " << (MODE_READ == mode ? "MODE_READ " : MODE_MMAP == mode ? "MODE_MMAP " : "MODE_LAZY ")
+                          << timer.elapsed_ms() / rounds << " ms";
+            }
+            std::cout << std::endl;
+
+            // no entry is read at open, small packages keep the index without hash table
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_LAZY));
+            EXPECT_TRUE(res_packer.GetFileCount() == file_count);
+            EXPECT_TRUE(res_packer.index_buffer_.empty() == (file_count >= global_hash_index_min_files));
+            EXPECT_TRUE(res_packer.FileExist("dir_0/file_0"));
+            EXPECT_FALSE(res_packer.FileExist("dir_0/file_1"));
+            EXPECT_FALSE(res_packer.GetFileStream("no_file", read_stream));
+            if (file_count < 100000) {
+                EXPECT_TRUE(res_packer.Extract("test_tmp_dir"));
+                std::ifstream extracted("test_tmp_dir/dir_9/file_9", std::ios::binary);
+                EXPECT_TRUE(std::string(std::istreambuf_iterator<char>(extracted), std::istreambuf_iterator<char>()) == "dir_9/file_9");
+                RemoveDir("test_tmp_dir");
+            }
+            res_packer.Close();
+        }
+        remove("test_tmp_file");
+    }
+
+    void ParallelExtractTest() {
+        // small files in nested directories and a few large files
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(3000, files);
+        std::vector<std::string> names;
+        char name[64];
+        for (size_t i=0; i<files.size(); i++) {
+            snprintf(name, sizeof(name), "level_%zu/zone_%zu/config_%zu.json", i % 10, i % 70, i);
+            names.push_back(name);
+        }
+        for (size_t i=0; i<4; i++) {
+            std::vector<char> large_stream;
+            while (large_stream.size() < (4 << 20)) large_stream.insert(large_stream.end(), files[large_stream.size() % 3000].begin(), files[large_stream.size() % 3000].end());
+            files.push_back(large_stream);
+            snprintf(name, sizeof(name), "large_%zu.bin", i);
+            names.push_back(name);
+        }
+        Packer res_packer;
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        for (size_t i=0; i<files.size(); i++) EXPECT_TRUE(res_packer.AddStream(files[i], names[i].c_str(), ""));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+
+        for (int thread_count : {1, 2, 4}) {
+            res_packer.SetThreads(thread_count);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+            utility::Timer timer;
+            EXPECT_TRUE(res_packer.Extract("test_tmp_dir"));
+            const double extract_ms = timer.elapsed_ms();
+            res_packer.Close();
+            bool same = true;
+            for (size_t i=0; i<files.size(); i++) {
+                std::ifstream extracted(("test_tmp_dir/" + names[i]).c_str(), std::ios::binary);
+                same = same && std::vector<char>(std::istreambuf_iterator<char>(extracted), std::istreambuf_iterator<char>()) == files[i];
+            }
+            EXPECT_TRUE(same);
+            RemoveDir("test_tmp_dir");
+            std::cout << "extract " << files.size() << " files, " << thread_count << " threads: " << extract_ms << " ms" << std::endl;
+        }
+        res_packer.SetThreads(1);
+
+        // a file can not be written, extraction stops
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.MakeDirs("test_tmp_dir/large_0.bin/"));
+        EXPECT_FALSE(res_packer.Extract("test_tmp_dir"));
+        res_packer.Close();
+        RemoveDir("test_tmp_dir");
+        remove("test_tmp_file");
+    }
+
+    void ParallelBuildTest() {
+        // small files in nested directories, a few large and incompressible files
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(3000, files);
+        std::vector<std::string> names;
+        char name[64];
+        for (size_t i=0; i<files.size(); i++) {
+            snprintf(name, sizeof(name), "level_%zu/zone_%zu/config_%zu.json", i % 10, i % 70, i);
+            names.push_back(name);
+        }
+        std::mt19937 rng(2468);
+        for (size_t i=0; i<4; i++) {
+            std::vector<char> large_stream;
+            while (large_stream.size() < (3 << 20)) large_stream.insert(large_stream.end(), files[large_stream.size() % 3000].begin(), files[large_stream.size() % 3000].end());
+            if (i & 1) for (auto &ch : large_stream) ch = (char)rng();
+            files.push_back(large_stream);
+            snprintf(name, sizeof(name), "large_%zu.bin", i);
+            names.push_back(name);
+        }
+        Packer res_packer;
+        for (size_t i=0; i<files.size(); i++) {
+            const std::string path = "test_tmp_dir/" + names[i];
+            EXPECT_TRUE(res_packer.MakeDirs(path.substr(0, path.rfind('/') + 1).c_str()));
+            std::ofstream out(path.c_str(), std::ios::binary);
+            out.write(files[i].data(), files[i].size());
+        }
+
+        // pack bytes are the same for any thread count
+        for (Codec codec : {CODEC_HUFFMAN, CODEC_SHARED_HUFFMAN}) {
+            std::vector<char> pack_stream;
+            for (int thread_count : {1, 2, 4}) {
+                res_packer.SetThreads(thread_count);
+                res_packer.SetCodec(codec);
+                EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+                utility::Timer timer;
+                EXPECT_TRUE(res_packer.AddDir("test_tmp_dir", "res"));
+                EXPECT_TRUE(res_packer.Close());
+                const double build_ms = timer.elapsed_ms();
+                std::ifstream packed("test_tmp_file", std::ios::binary);
+                const std::vector<char> stream((std::istreambuf_iterator<char>(packed)), std::istreambuf_iterator<char>());
+                if (1 == thread_count) pack_stream = stream;
+                EXPECT_TRUE(stream == pack_stream);
+                std::cout << "build " << CodecName(codec) << " " << files.size() << " files, " << thread_count << " threads: " << build_ms << " ms" << std::endl;
+            }
+        }
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        bool same = true;
+        std::vector<char> file_stream;
+        for (size_t i=0; i<files.size(); i++) {
+            same = same && res_packer.GetFileStream(("res/" + names[i]).c_str(), file_stream) && file_stream == files[i];
+        }
+        EXPECT_TRUE(same);
+        res_packer.Close();
+
+        // files of AddFiles are added to one path, a missing file stops adding
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddFiles({"test_tmp_dir/large_0.bin", "test_tmp_dir/level_1/zone_1/config_1.json"}, "files"));
+        EXPECT_TRUE(res_packer.FileExist("files/large_0.bin") && res_packer.FileExist("files/config_1.json"));
+        EXPECT_FALSE(res_packer.AddFiles({"test_tmp_dir/large_1.bin", "test_tmp_dir/missing.bin", "test_tmp_dir/large_2.bin"}));
+        EXPECT_TRUE(res_packer.Close());
+
+        // a duplicate name fails, the files before it are added whatever the thread count
+        for (int thread_count : {1, 4}) {
+            res_packer.SetThreads(thread_count);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+            EXPECT_TRUE(res_packer.AddFiles({"test_tmp_dir/level_1/zone_1/config_1.json"}, "files"));
+            EXPECT_FALSE(res_packer.AddFiles({"test_tmp_dir/large_1.bin", "test_tmp_dir/level_1/zone_1/config_1.json"}, "files"));
+            EXPECT_FALSE(res_packer.AddFiles({"test_tmp_dir/level_2/zone_2/config_2.json", "test_tmp_dir/level_2/zone_2/config_2.json"}, "files"));
+            EXPECT_TRUE(res_packer.GetFileCount() == 3 && res_packer.FileExist("files/large_1.bin"));
+            EXPECT_TRUE(res_packer.Close());
+        }
+        res_packer.SetThreads(1);
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        RemoveDir("test_tmp_dir");
+        remove("test_tmp_file");
+    }
+
+    void ReadRangeTest() {
+        // a large blocked huffman file and small files of each codec
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(5000, files);
+        std::vector<char> large_stream, stored_stream(300000), small_stream(files[7]);
+        for (size_t i=0; large_stream.size() < (24 << 20); i++) {
+            large_stream.insert(large_stream.end(), files[i % 5000].begin(), files[i % 5000].end());
+        }
+        std::mt19937 rng(8642);
+        for (auto &ch : stored_stream) ch = (char)rng();
+        while (small_stream.size() < 50000) small_stream.insert(small_stream.end(), files[small_stream.size() % 5000].begin(), files[small_stream.size() % 5000].end());
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(stored_stream, "stored.bin", ""));
+        EXPECT_TRUE(res_packer.AddStream(small_stream, "small.json", ""));
+        // lz content differs from small.json, or it points at the huffman stream
+        const std::vector<char> lz_stream(small_stream.begin() + 1, small_stream.end());
+        res_packer.SetCodec(CODEC_LZ);
+        EXPECT_TRUE(res_packer.AddStream(lz_stream, "lz.json", ""));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(files[9], "shared.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_LZ).count == 1 && res_packer.GetCodecStats(CODEC_SHARED_HUFFMAN).count == 1);
+
+        const std::vector<std::pair<const char*, const std::vector<char>*> > names = {
+            {"large.json", &large_stream}, {"stored.bin", &stored_stream}, {"small.json", &small_stream},
+            {"lz.json", &lz_stream}, {"shared.json", &files[9]}};
+        std::vector<char> range;
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            bool same = true;
+            for (const auto &name : names) {
+                const std::vector<char> &stream = *name.second;
+                // ranges inside and across blocks, at the end and cut at the end
+                for (int round=0; round<50; round++) {
+                    const uint64_t offset = rng() % stream.size();
+                    const uint64_t length = (round % 5) ? rng() % 5000 : rng() % (3 << 20);
+                    const uint64_t end = std::min(stream.size(), (size_t)(offset + length));
+                    same = same && res_packer.ReadRange(name.first, offset, length, range)
+                           && range == std::vector<char>(stream.begin() + offset, stream.begin() + end);
+                }
+                same = same && res_packer.ReadRange(name.first, stream.size(), 100, range) && range.empty();
+                same = same && res_packer.ReadRange(name.first, 0, stream.size() + 100, range) && range == stream;
+                EXPECT_FALSE(res_packer.ReadRange(name.first, stream.size() + 1, 100, range));
+            }
+            EXPECT_TRUE(same);
+            EXPECT_FALSE(res_packer.ReadRange("missing.json", 0, 100, range));
+
+            // small random reads against full decode
+            std::vector<char> file_stream;
+            utility::Timer timer;
+            for (int round=0; round<1000; round++) {
+                EXPECT_TRUE(res_packer.ReadRange("large.json", rng() % large_stream.size(), 4096, range));
+            }
+            const double range_ms = timer.elapsed_ms();
+            timer.reset();
+            for (int round=0; round<5; round++) EXPECT_TRUE(res_packer.GetFileStream("large.json", file_stream));
+            const double full_ms = timer.elapsed_ms() / 5;
+            std::cout << "mode " << mode << ", " << (large_stream.size() >> 20) << " MB file, 4KB random read: "
+                      << range_ms / 1000 << " ms, full decode: " << full_ms << " ms" << std::endl;
+            res_packer.Close();
+        }
+        remove("test_tmp_file");
+    }
+
+    void PackStreamBufTest() {
+        // a large blocked huffman file and small files of each codec
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(3000, files);
+        std::vector<char> large_stream, stored_stream(200000), small_stream;
+        for (size_t i=0; large_stream.size() < (6 << 20); i++) {
+            large_stream.insert(large_stream.end(), files[i % 3000].begin(), files[i % 3000].end());
+        }
+        std::mt19937 rng(97531);
+        for (auto &ch : stored_stream) ch = (char)rng();
+        for (size_t i=0; small_stream.size() < 100000; i++) small_stream.insert(small_stream.end(), files[i].begin(), files[i].end());
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(stored_stream, "stored.bin", ""));
+        EXPECT_TRUE(res_packer.AddStream(small_stream, "small.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(std::vector<char>(), "empty.json", ""));
+        // lz content differs from small.json, or it points at the huffman stream
+        const std::vector<char> lz_stream(small_stream.begin() + 1, small_stream.end());
+        res_packer.SetCodec(CODEC_LZ);
+        EXPECT_TRUE(res_packer.AddStream(lz_stream, "lz.json", ""));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(files[5], "shared.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+
+        const std::vector<std::pair<const char*, const std::vector<char>*> > names = {
+            {"large.json", &large_stream}, {"stored.bin", &stored_stream}, {"small.json", &small_stream},
+            {"lz.json", &lz_stream}, {"shared.json", &files[5]}};
+        const std::vector<char> empty_stream;
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            ifmstream ifms;
+            EXPECT_FALSE(ifms.set_packbuf(res_packer, "missing.json").is_open());
+            EXPECT_TRUE(ifms.set_packbuf(res_packer, "empty.json").is_open());
+            EXPECT_TRUE(std::vector<char>(std::istreambuf_iterator<char>(ifms), std::istreambuf_iterator<char>()) == empty_stream);
+            for (const auto &name : names) {
+                const std::vector<char> &stream = *name.second;
+                // read from the begin, the get area is bounded
+                EXPECT_TRUE(ifms.set_packbuf(res_packer, name.first).is_open());
+                EXPECT_TRUE(std::vector<char>(std::istreambuf_iterator<char>(ifms), std::istreambuf_iterator<char>()) == stream);
+                EXPECT_TRUE(ifms.pack_buf_.buffer_.capacity() <= global_block_size || 0 == strcmp(name.first, "lz.json"));
+
+                // seek from the begin, the current position and the end
+                ifms.set_packbuf(res_packer, name.first);
+                char buffer[3000];
+                bool same = true;
+                for (int round=0; round<40; round++) {
+                    const uint64_t offset = rng() % stream.size();
+                    const size_t length = std::min((size_t)(rng() % sizeof(buffer)), (size_t)(stream.size() - offset));
+                    if (round % 3 == 0) {
+                        ifms.seekg(offset);
+                    } else if (round % 3 == 1) {
+                        ifms.seekg((std::streamoff)offset - (std::streamoff)ifms.tellg(), std::ios::cur);
+                    } else {
+                        ifms.seekg((std::streamoff)offset - (std::streamoff)stream.size(), std::ios::end);
+                    }
+                    same = same && (uint64_t)ifms.tellg() == offset && ifms.read(buffer, length)
+                           && 0 == memcmp(buffer, &stream[offset], length) && (uint64_t)ifms.tellg() == offset + length;
+                }
+                EXPECT_TRUE(same);
+                ifms.clear();
+                EXPECT_FALSE(ifms.seekg(stream.size() + 1));
+                ifms.clear();
+                EXPECT_TRUE(ifms.seekg(0, std::ios::end) && ifms.tellg() == (std::streamoff)stream.size());
+                EXPECT_TRUE(ifms.get() == EOF);
+            }
+
+            // lines of a large file
+            ifms.set_packbuf(res_packer, "large.json");
+            std::string line;
+            size_t line_count = 0, line_size = 0;
+            while (std::getline(ifms, line)) line_count++, line_size += line.size() + 1;
+            EXPECT_TRUE(line_count == (size_t)std::count(large_stream.begin(), large_stream.end(), '\n'));
+            EXPECT_TRUE(line_size == large_stream.size());
+            ifms.reset();
+            res_packer.Close();
+        }
+        remove("test_tmp_file");
+    }
+
+    void FileCacheTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(64, files);
+        std::vector<char> hot_stream;
+        for (size_t i=0; hot_stream.size() < (2 << 20); i++) hot_stream.insert(hot_stream.end(), files[i % 64].begin(), files[i % 64].end());
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        char name[64];
+        for (size_t i=0; i<files.size(); i++) {
+            snprintf(name, sizeof(name), "file_%zu.json", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+        }
+        EXPECT_TRUE(res_packer.AddStream(hot_stream, "hot.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            // disabled by default, handles are decoded for each call
+            FileHandle handle, handle_x;
+            EXPECT_TRUE(res_packer.GetFileHandle("hot.json", handle) && *handle == hot_stream);
+            EXPECT_TRUE(res_packer.GetFileHandle("hot.json", handle_x) && handle.get() != handle_x.get());
+            EXPECT_FALSE(res_packer.GetFileHandle("missing.json", handle));
+            EXPECT_TRUE(res_packer.GetCacheStats().hits == 0 && res_packer.GetCacheStats().count == 0);
+
+            // hits share one decoded file
+            res_packer.SetCacheSize(4 << 20);
+            EXPECT_TRUE(res_packer.GetFileHandle("hot.json", handle));
+            EXPECT_TRUE(res_packer.GetFileHandle("hot.json", handle_x) && handle.get() == handle_x.get());
+            std::string str_stream;
+            EXPECT_TRUE(res_packer.GetFileStream("hot.json", str_stream));
+            EXPECT_TRUE(std::string(hot_stream.begin(), hot_stream.end()) == str_stream);
+            CacheStats stats = res_packer.GetCacheStats();
+            EXPECT_TRUE(stats.hits == 2 && stats.misses == 1 && stats.count == 1 && stats.bytes == hot_stream.size());
+
+            // small files evict the least recently used, the budget is kept
+            bool same = true;
+            for (int round=0; round<2; round++) {
+                for (size_t i=0; i<files.size(); i++) {
+                    std::vector<char> file_stream;
+                    snprintf(name, sizeof(name), "file_%zu.json", i);
+                    same = same && res_packer.GetFileStream(name, file_stream) && file_stream == files[i];
+                }
+            }
+            EXPECT_TRUE(same);
+            res_packer.SetCacheSize(hot_stream.size());
+            stats = res_packer.GetCacheStats();
+            EXPECT_TRUE(stats.hits == 2 + files.size() && stats.evictions > 0 && stats.bytes <= hot_stream.size());
+            EXPECT_TRUE(*handle == hot_stream);
+
+            // files larger than the budget are decoded and not kept
+            res_packer.SetCacheSize(1024);
+            EXPECT_TRUE(res_packer.GetFileHandle("hot.json", handle) && *handle == hot_stream);
+            EXPECT_TRUE(res_packer.GetCacheStats().bytes <= 1024);
+
+            // concurrent readers of the cache
+            res_packer.SetCacheSize(4 << 20);
+            std::atomic<int> fails(0);
+            std::vector<std::thread> threads;
+            for (int t=0; t<4; t++) {
+                threads.emplace_back([&res_packer, &files, &fails, t] () {
+                    char thread_name[64];
+                    for (int i=0; i<500; i++) {
+                        const size_t id = (i * 7 + t) % files.size();
+                        snprintf(thread_name, sizeof(thread_name), "file_%zu.json", id);
+                        FileHandle thread_handle;
+                        if (!res_packer.GetFileHandle(thread_name, thread_handle) || *thread_handle != files[id]) fails++;
+                    }
+                });
+            }
+            for (auto &thread : threads) thread.join();
+            EXPECT_TRUE(fails == 0);
+
+            // Close drops cached files, handles stay valid. Open clears counters
+            EXPECT_TRUE(res_packer.Close());
+            EXPECT_TRUE(res_packer.GetCacheStats().count == 0 && *handle == hot_stream);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            EXPECT_TRUE(res_packer.GetCacheStats().hits == 0 && res_packer.GetCacheStats().misses == 0);
+
+            // hot file read with and without the cache
+            utility::Timer timer;
+            std::vector<char> file_stream;
+            for (int i=0; i<20; i++) EXPECT_TRUE(res_packer.GetFileStream("hot.json", file_stream));
+            const double cached_ms = timer.elapsed_ms();
+            res_packer.SetCacheSize(0);
+            timer.reset();
+            for (int i=0; i<20; i++) EXPECT_TRUE(res_packer.GetFileStream("hot.json", file_stream));
+            const double decode_ms = timer.elapsed_ms();
+            EXPECT_TRUE(file_stream == hot_stream);
+            std::cout << "mode " << mode << ": 20 reads of " << hot_stream.size() << " bytes, cached "
+                      << cached_ms << " ms, decoded " << decode_ms << " ms" << std::endl;
+            res_packer.Close();
+        }
+        remove("test_tmp_file");
+    }
+
+    void DedupTest() {
+        // each content under three names, in stored, huffman, shared and empty streams
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(200, files);
+        std::vector<char> stored_stream(50000);
+        std::mt19937 rng(1357);
+        for (auto &ch : stored_stream) ch = (char)rng();
+        files.push_back(stored_stream);
+        files.push_back(std::vector<char>());
+        std::vector<char> large_stream;
+        for (size_t i=0; large_stream.size() < (3 << 20); i++) large_stream.insert(large_stream.end(), files[i % 200].begin(), files[i % 200].end());
+        files.push_back(large_stream);
+        Packer res_packer;
+        char name[64];
+        for (size_t i=0; i<files.size(); i++) {
+            for (int copy=0; copy<3; copy++) {
+                snprintf(name, sizeof(name), "test_tmp_dir/copy_%d/file_%zu.bin", copy, i);
+                EXPECT_TRUE(res_packer.MakeDirs((std::string(name).substr(0, strrchr(name, '/') - name + 1)).c_str()));
+                std::ofstream out(name, std::ios::binary);
+                out.write(files[i].data(), files[i].size());
+            }
+        }
+
+        // duplicates point at the first stream, pack bytes are the same for any thread count
+        for (Codec codec : {CODEC_HUFFMAN, CODEC_SHARED_HUFFMAN}) {
+            std::vector<char> pack_stream;
+            for (int thread_count : {1, 4}) {
+                res_packer.SetThreads(thread_count);
+                res_packer.SetCodec(codec);
+                EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+                EXPECT_TRUE(res_packer.AddDir("test_tmp_dir", "res"));
+                EXPECT_TRUE(res_packer.Close());
+                std::ifstream packed("test_tmp_file", std::ios::binary);
+                const std::vector<char> stream((std::istreambuf_iterator<char>(packed)), std::istreambuf_iterator<char>());
+                if (1 == thread_count) pack_stream = stream;
+                EXPECT_TRUE(stream == pack_stream);
+
+                const DedupStats &dedup = res_packer.GetDedupStats();
+                uint64_t stream_count = 0, raw_size = 0;
+                for (int i=0; i<CODEC_COUNT; i++) stream_count += res_packer.GetCodecStats((Codec)i).count;
+                for (const auto &file : files) raw_size += file.size();
+                EXPECT_TRUE(stream_count == files.size() && dedup.count == 2 * files.size());
+                EXPECT_TRUE(dedup.raw_size == 2 * raw_size && dedup.stream_size > 0);
+            }
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+            EXPECT_TRUE(res_packer.GetFileCount() == 3 * files.size());
+            bool same = true;
+            std::vector<char> file_stream;
+            for (size_t i=0; i<files.size(); i++) {
+                Packer::StreamInfo first(0, 0), si(0, 0);
+                for (int copy=0; copy<3; copy++) {
+                    snprintf(name, sizeof(name), "res/copy_%d/file_%zu.bin", copy, i);
+                    same = same && res_packer.FindEntry(name, si) && res_packer.GetFileStream(name, file_stream) && file_stream == files[i];
+                    if (0 == copy) first = si;
+                    same = same && si.offset == first.offset && si.size == first.size;
+                }
+            }
+            EXPECT_TRUE(same);
+
+            // files of one stream are extracted together
+            res_packer.SetThreads(4);
+            EXPECT_TRUE(res_packer.Extract("test_tmp_extract"));
+            for (size_t i=0; i<files.size(); i++) {
+                for (int copy=0; copy<3; copy++) {
+                    snprintf(name, sizeof(name), "test_tmp_extract/res/copy_%d/file_%zu.bin", copy, i);
+                    std::ifstream extracted(name, std::ios::binary);
+                    same = same && std::vector<char>((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>()) == files[i];
+                }
+            }
+            EXPECT_TRUE(same);
+            res_packer.Close();
+            RemoveDir("test_tmp_extract");
+        }
+
+        // large files added block by block and streams of AddStream share content too
+        res_packer.SetThreads(1);
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        {
+            std::ofstream out("test_tmp_large_0", std::ios::binary), out2("test_tmp_large_1", std::ios::binary);
+            for (size_t size=0; size<global_stream_file_size; size+=large_stream.size()) {
+                out.write(large_stream.data(), large_stream.size());
+                out2.write(large_stream.data(), large_stream.size());
+            }
+        }
+        EXPECT_TRUE(res_packer.AddFile("test_tmp_large_0"));
+        EXPECT_TRUE(res_packer.AddFile("test_tmp_large_1"));
+        EXPECT_TRUE(res_packer.AddStream(files[0], "a.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(files[0], "b.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(files[1], "c.json", ""));
+        EXPECT_TRUE(res_packer.GetDedupStats().count == 2 && res_packer.GetCodecStats(CODEC_HUFFMAN).count == 3);
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        std::vector<char> file_stream, file_stream_x;
+        EXPECT_TRUE(res_packer.GetFileStream("test_tmp_large_1", file_stream) && file_stream.size() >= global_stream_file_size);
+        EXPECT_TRUE(res_packer.GetFileStream("test_tmp_large_0", file_stream_x) && file_stream == file_stream_x);
+        EXPECT_TRUE(res_packer.GetFileStream("b.json", file_stream) && file_stream == files[0]);
+        res_packer.Close();
+        remove("test_tmp_large_0");
+        remove("test_tmp_large_1");
+        RemoveDir("test_tmp_dir");
+        remove("test_tmp_file");
+    }
+
+    // content of all files of a package, empty if it does not open
+    static std::map<std::string, std::vector<char> > ReadPackage(const char *filename, OpenMode mode, const char *delta_filename=nullptr) {
+        std::map<std::string, std::vector<char> > contents;
+        Packer res_packer;
+        if (!res_packer.Open(filename, mode)) return contents;
+        if (delta_filename && !res_packer.OpenDelta(delta_filename)) return contents;
+        std::vector<Packer::FileEntry> entries;
+        if (!res_packer.GetEntries(entries)) return contents;
+        for (const auto &entry : entries) {
+            if (!res_packer.GetFileStream(entry.name.c_str(), contents[entry.name])) contents.erase(entry.name);
+        }
+        return contents;
+    }
+
+    void UpdateTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(300, files);
+        std::vector<char> large_stream;
+        for (size_t i=0; large_stream.size() < (2 << 20); i++) large_stream.insert(large_stream.end(), files[i % 300].begin(), files[i % 300].end());
+        std::map<std::string, std::vector<char> > expected;
+        char name[64];
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        res_packer.SetVersion("1.0");
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        for (size_t i=0; i<200; i++) {
+            snprintf(name, sizeof(name), "config/file_%zu.json", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+            expected[name] = files[i];
+        }
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        expected["large.json"] = large_stream;
+        EXPECT_TRUE(res_packer.Close());
+        const std::map<std::string, std::vector<char> > first_expected(expected);
+        std::ifstream first_file("test_tmp_file", std::ios::binary);
+        uint64_t first_index_offset = 0;
+        first_file.read((char*)&first_index_offset, sizeof(first_index_offset));
+        first_file.close();
+
+        // a reader of the mapped package is not disturbed by an update
+        Packer reader;
+        EXPECT_TRUE(reader.Open("test_tmp_file", MODE_MMAP));
+
+        // replace, add and remove files, new shared streams use a new table
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_UPDATE));
+        EXPECT_TRUE(res_packer.GetFileCount() == 201 && res_packer.FileExist("config/file_7.json"));
+        EXPECT_TRUE(res_packer.GetVersion() == "1.0");
+        res_packer.SetVersion("1.1");
+        for (size_t i=150; i<300; i++) {
+            snprintf(name, sizeof(name), "config/file_%zu.json", i);
+            EXPECT_TRUE(res_packer.AddStream(files[(i + 1) % 300], name, ""));
+            expected[name] = files[(i + 1) % 300];
+        }
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        large_stream.resize(large_stream.size() / 2);
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        expected["large.json"] = large_stream;
+        EXPECT_TRUE(res_packer.RemoveFile("config/file_3.json") && res_packer.RemoveFile("config/file_299.json"));
+        expected.erase("config/file_3.json");
+        expected.erase("config/file_299.json");
+        EXPECT_FALSE(res_packer.RemoveFile("config/file_3.json"));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_SHARED_HUFFMAN).count > 0);
+
+        bool same = true;
+        std::vector<char> file_stream;
+        for (const auto &file : first_expected) same = same && reader.GetFileStream(file.first.c_str(), file_stream) && file_stream == file.second;
+        EXPECT_TRUE(same);
+        reader.Close();
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) EXPECT_TRUE(ReadPackage("test_tmp_file", mode) == expected);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetVersion() == "1.1" && res_packer.GetFileCount() == expected.size());
+        EXPECT_TRUE(res_packer.shared_table_buffers_.size() == 2);
+        res_packer.Close();
+
+        // an update which did not rewrite the index offset leaves the package as before
+        uint64_t update_index_offset = 0;
+        {
+            std::fstream package("test_tmp_file", std::ios::binary | std::ios::in | std::ios::out);
+            package.read((char*)&update_index_offset, sizeof(update_index_offset));
+            package.seekp(0, std::ios::beg);
+            package.write((char*)&first_index_offset, sizeof(first_index_offset));
+        }
+        EXPECT_TRUE(ReadPackage("test_tmp_file", MODE_LAZY) == first_expected);
+        EXPECT_TRUE(ReadPackage("test_tmp_file", MODE_MMAP) == first_expected);
+        {
+            std::fstream package("test_tmp_file", std::ios::binary | std::ios::in | std::ios::out);
+            package.write((char*)&update_index_offset, sizeof(update_index_offset));
+        }
+
+        // compaction drops superseded streams
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            EXPECT_FALSE(res_packer.Compact("test_tmp_file"));
+            EXPECT_TRUE(res_packer.Compact("test_tmp_compact"));
+            res_packer.Close();
+            uint64_t size = 0, compact_size = 0;
+            EXPECT_TRUE(Packer::GetFileSize("test_tmp_file", size) && Packer::GetFileSize("test_tmp_compact", compact_size));
+            EXPECT_TRUE(compact_size < size - (2 << 20) / 4);
+            EXPECT_TRUE(ReadPackage("test_tmp_compact", MODE_READ) == expected);
+            EXPECT_TRUE(ReadPackage("test_tmp_compact", MODE_LAZY) == expected);
+            EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_READ));
+            EXPECT_TRUE(res_packer.GetVersion() == "1.1");
+            res_packer.Close();
+        }
+
+        // an update of a compacted package
+        EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_UPDATE));
+        EXPECT_TRUE(res_packer.AddStream(files[0], "new.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        expected["new.json"] = files[0];
+        EXPECT_TRUE(ReadPackage("test_tmp_compact", MODE_MMAP) == expected);
+
+        // a file replaced by a kept shared stream and then removed is not written at Close
+        std::vector<char> replaced(files[10]);
+        replaced.push_back('\n');
+        EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_UPDATE));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(replaced, "config/file_10.json", ""));
+        EXPECT_TRUE(res_packer.file_index_.find("config/file_10.json")->second.offset == 0);
+        EXPECT_TRUE(res_packer.RemoveFile("config/file_10.json"));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        expected.erase("config/file_10.json");
+        EXPECT_TRUE(ReadPackage("test_tmp_compact", MODE_MMAP) == expected);
+        EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_READ));
+        EXPECT_FALSE(res_packer.FileExist("config/file_10.json"));
+        res_packer.Close();
+        EXPECT_FALSE(res_packer.Open("test_tmp_missing", MODE_UPDATE));
+        res_packer.Close();
+        remove("test_tmp_compact");
+        remove("test_tmp_file");
+    }
+
+    void DeltaTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(300, files);
+        std::vector<char> large_stream;
+        for (size_t i=0; large_stream.size() < (2 << 20); i++) large_stream.insert(large_stream.end(), files[i % 300].begin(), files[i % 300].end());
+        std::map<std::string, std::vector<char> > expected;
+        char name[64];
+        Packer res_packer;
+        EXPECT_TRUE(res_packer.Open("test_tmp_base", MODE_WRITE));
+        res_packer.SetVersion("1.0");
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        for (size_t i=0; i<200; i++) {
+            snprintf(name, sizeof(name), "config/file_%zu.json", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+        }
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+
+        // the new package is coded with other tables, files of the same content are unchanged
+        EXPECT_TRUE(res_packer.Open("test_tmp_new", MODE_WRITE));
+        res_packer.SetVersion("1.1");
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        for (size_t i=5; i<210; i++) {
+            snprintf(name, sizeof(name), "config/file_%zu.json", i);
+            const std::vector<char> &file = files[(i >= 190 && i < 200) ? i + 100 : i];
+            EXPECT_TRUE(res_packer.AddStream(file, name, ""));
+            expected[name] = file;
+        }
+        EXPECT_TRUE(res_packer.AddStream(files[0], "copy.json", ""));
+        expected["copy.json"] = files[0];
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddStream(large_stream, "large.json", ""));
+        expected["large.json"] = large_stream;
+        EXPECT_TRUE(res_packer.Close());
+
+        DeltaStats stats;
+        EXPECT_TRUE(res_packer.Open("test_tmp_new", MODE_READ));
+        EXPECT_FALSE(res_packer.MakeDelta("test_tmp_base", "test_tmp_new", stats));
+        EXPECT_TRUE(res_packer.MakeDelta("test_tmp_base", "test_tmp_delta", stats));
+        res_packer.Close();
+        EXPECT_TRUE(stats.added == 11 && stats.replaced == 10 && stats.removed == 5 && stats.unchanged == 186);
+        uint64_t new_size = 0, delta_size = 0;
+        EXPECT_TRUE(Packer::GetFileSize("test_tmp_new", new_size) && Packer::GetFileSize("test_tmp_delta", delta_size));
+        EXPECT_TRUE(delta_size * 2 < new_size);
+
+        // lookups resolve to the delta first, removed files are not found
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(ReadPackage("test_tmp_base", mode, "test_tmp_delta") == expected);
+            EXPECT_TRUE(res_packer.Open("test_tmp_base", mode));
+            EXPECT_FALSE(res_packer.OpenDelta("test_tmp_new"));
+            EXPECT_TRUE(res_packer.OpenDelta("test_tmp_delta"));
+            EXPECT_FALSE(res_packer.OpenDelta("test_tmp_delta"));
+            EXPECT_TRUE(res_packer.GetVersion() == "1.1" && res_packer.GetFileCount() == expected.size());
+            EXPECT_FALSE(res_packer.FileExist("config/file_3.json"));
+            EXPECT_TRUE(res_packer.FileExist("config/file_205.json") && res_packer.FileExist("config/file_100.json"));
+            // files of the delta are listed in order, removed files are not
+            std::vector<std::string> names, expected_names;
+            for (const auto &file : expected) {
+                if (0 == file.first.compare(0, 13, "config/file_1")) expected_names.push_back(file.first);
+            }
+            EXPECT_TRUE(res_packer.List("config/file_1", names) && names == expected_names);
+            EXPECT_TRUE(res_packer.Glob("config/file_?.json", names) && names.size() == 5 && names[0] == "config/file_5.json");
+            std::vector<char> file_stream;
+            EXPECT_FALSE(res_packer.GetFileStream("config/file_3.json", file_stream));
+            FileHandle handle;
+            EXPECT_TRUE(res_packer.GetFileHandle("config/file_195.json", handle) && *handle == expected["config/file_195.json"]);
+            EXPECT_TRUE(res_packer.ReadRange("large.json", 990, 20, file_stream));
+            EXPECT_TRUE(file_stream == std::vector<char>(large_stream.begin() + 990, large_stream.begin() + 1010));
+            const std::vector<char> &replaced = expected["config/file_195.json"];
+            EXPECT_TRUE(res_packer.ReadRange("config/file_195.json", 10, 20, file_stream));
+            EXPECT_TRUE(file_stream == std::vector<char>(replaced.begin() + 10, replaced.begin() + 30));
+            ifmstream ifms;
+            EXPECT_TRUE(ifms.set_packbuf(res_packer, "config/file_195.json").is_open());
+            const std::string text((std::istreambuf_iterator<char>(ifms)), std::istreambuf_iterator<char>());
+            EXPECT_TRUE(std::vector<char>(text.begin(), text.end()) == expected["config/file_195.json"]);
+            ifms.reset();
+
+            // the delta applied, shared tables of the delta are numbered after the tables of the base
+            EXPECT_FALSE(res_packer.Compact("test_tmp_delta"));
+            EXPECT_TRUE(res_packer.Compact("test_tmp_file"));
+            const size_t table_count = res_packer.shared_table_buffers_.size() + res_packer.overlay_->shared_table_buffers_.size();
+            res_packer.Close();
+            EXPECT_TRUE(ReadPackage("test_tmp_file", MODE_READ) == expected);
+            EXPECT_TRUE(ReadPackage("test_tmp_file", MODE_LAZY) == expected);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+            EXPECT_TRUE(res_packer.GetVersion() == "1.1" && !res_packer.is_delta_);
+            EXPECT_TRUE(res_packer.shared_table_buffers_.size() == table_count && table_count > 1);
+            res_packer.Close();
+        }
+
+        // a delta is refused by an updated base
+        EXPECT_TRUE(res_packer.Open("test_tmp_base", MODE_UPDATE));
+        EXPECT_TRUE(res_packer.AddStream(files[0], "update.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.Open("test_tmp_base", MODE_READ));
+        EXPECT_FALSE(res_packer.OpenDelta("test_tmp_delta"));
+        EXPECT_TRUE(res_packer.GetVersion() == "1.0" && res_packer.FileExist("config/file_3.json"));
+        res_packer.Close();
+        remove("test_tmp_base");
+        remove("test_tmp_new");
+        remove("test_tmp_delta");
+        remove("test_tmp_file");
+    }
+
+    void SortedIndexTest() {
+        // a deep tree, neighbouring names share long prefixes
+        const size_t file_count = 20000;
+        std::map<std::string, std::vector<char> > expected;
+        std::vector<std::string> all_names;
+        char name[128];
+        for (size_t i=0; i<file_count; i++) {
+            const int len = snprintf(name, sizeof(name), "assets/level_%zu/textures/characters/dir_%zu/file_%zu.png", i % 10, i % 100, i);
+            expected[name] = std::vector<char>(name, name + len);
+        }
+        for (const auto &file : expected) all_names.push_back(file.first);
+        auto list_expected = [&all_names] (const char *prefix) {
+            std::vector<std::string> names;
+            for (const std::string &name : all_names) {
+                if (0 == name.compare(0, strlen(prefix), prefix)) names.push_back(name);
+            }
+            return names;
+        };
+        auto glob_expected = [&all_names] (const char *pattern) {
+            std::vector<std::string> names;
+            for (const std::string &name : all_names) {
+                if (0 == fnmatch(pattern, name.c_str(), FNM_PATHNAME)) names.push_back(name);
+            }
+            return names;
+        };
+
+        Packer res_packer;
+        uint64_t index_sizes[2] = {0};
+        for (int front_coding=0; front_coding<2; front_coding++) {
+            res_packer.SetFrontCoding(1 == front_coding);
+            res_packer.SetCodecRatio(0);
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+            for (const auto &file : expected) EXPECT_TRUE(res_packer.AddStream(file.second, file.first.c_str(), ""));
+            std::vector<std::string> names;
+            EXPECT_TRUE(res_packer.List("assets/level_3/", names) && names == list_expected("assets/level_3/"));
+            EXPECT_TRUE(res_packer.Close());
+            res_packer.SetCodecRatio(0.95);
+            res_packer.SetFrontCoding(false);
+
+            for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+                EXPECT_TRUE(ReadPackage("test_tmp_file", mode) == expected);
+                EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+                index_sizes[front_coding] = res_packer.index_stream_size_;
+                // front coded indexes have no hash table
+                EXPECT_TRUE((nullptr != res_packer.sorted_files_) == (1 == front_coding));
+                EXPECT_TRUE((nullptr == res_packer.hash_slots_ && 0 == res_packer.hash_offset_) == (1 == front_coding));
+                EXPECT_TRUE(res_packer.GetFileCount() == file_count);
+                // names before the first, after the last and between names are not found
+                EXPECT_FALSE(res_packer.FileExist("a") || res_packer.FileExist("zzz") || res_packer.FileExist("assets/level_0/"));
+                EXPECT_FALSE(res_packer.FileExist("assets/level_0/textures/characters/dir_0/file_0.pn"));
+                EXPECT_FALSE(res_packer.FileExist("assets/level_0/textures/characters/dir_0/file_0.pngx"));
+                EXPECT_TRUE(res_packer.FileExist("assets/level_0/textures/characters/dir_0/file_0.png"));
+                EXPECT_TRUE(res_packer.FileExist(all_names.front().c_str()) && res_packer.FileExist(all_names.back().c_str()));
+                utility::Timer timer;
+                bool all_found = true;
+                for (const std::string &file_name : all_names) all_found = all_found && res_packer.FileExist(file_name.c_str());
+                const double lookup_ms = timer.elapsed_ms();
+                EXPECT_TRUE(all_found);
+
+                // the range of a prefix is listed in name order
+                timer.reset();
+                EXPECT_TRUE(res_packer.List("assets/level_3/textures/characters/dir_13/", names));
+                const double list_ms = timer.elapsed_ms();
+                EXPECT_TRUE(names == list_expected("assets/level_3/textures/characters/dir_13/") && names.size() == file_count / 100);
+                EXPECT_TRUE(res_packer.List(nullptr, names) && names == all_names);
+                EXPECT_TRUE(res_packer.List("assets/level_", names) && names == all_names);
+                EXPECT_TRUE(res_packer.List("assets/level_3/", names) && names == list_expected("assets/level_3/"));
+                EXPECT_TRUE(res_packer.List("assets/level_9/textures/characters/dir_99/file_19999", names) && names.size() == 1);
+                EXPECT_TRUE(res_packer.List("assets/level_3/textures/characters/dir_14/", names) && names.empty());
+                EXPECT_TRUE(res_packer.List("zzz", names) && names.empty());
+                EXPECT_TRUE(res_packer.List("a", names) && names == all_names);
+
+                // a pattern is matched in the range of its literal prefix, '*' and '?' do not match '/'
+                for (const char *pattern : {"assets/level_3/*/characters/dir_?3/file_*.png", "assets/level_[12]/textures/characters/dir_*/file_1??.png",
+                                            "assets/level_7/textures/characters/dir_77/file_1*7.png"}) {
+                    EXPECT_TRUE(res_packer.Glob(pattern, names) && names == glob_expected(pattern) && !names.empty());
+                }
+                EXPECT_TRUE(res_packer.Glob("assets/level_1/*", names) && names.empty());
+                EXPECT_TRUE(res_packer.Glob("*.png", names) && names.empty());
+                std::cout << file_count << " files, " << (front_coding ? "front coded" : "hash table") << " index " << index_sizes[front_coding]
+                          << " bytes, mode " << mode << ": find all " << lookup_ms << " ms, list dir " << list_ms << " ms" << std::endl;
+                res_packer.Close();
+            }
+        }
+        // names share most of their bytes with the name before, the index has no hash table
+        EXPECT_TRUE(index_sizes[1] * 2 < index_sizes[0]);
+
+        // updated and compacted packages keep front coded names
+        expected.erase(all_names.front());
+        expected["assets/readme.txt"] = std::vector<char>(10, 'a');
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_UPDATE));
+        EXPECT_TRUE(res_packer.RemoveFile(all_names.front().c_str()));
+        EXPECT_TRUE(res_packer.AddStream(expected["assets/readme.txt"], "assets/readme.txt", ""));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_MMAP));
+        EXPECT_TRUE(nullptr != res_packer.sorted_files_ && res_packer.GetFileCount() == file_count);
+        EXPECT_TRUE(res_packer.Compact("test_tmp_compact"));
+        res_packer.Close();
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) EXPECT_TRUE(ReadPackage("test_tmp_compact", mode) == expected);
+        EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_READ));
+        std::vector<std::string> names;
+        EXPECT_TRUE(nullptr != res_packer.sorted_files_ && res_packer.List("assets/r", names) && names.size() == 1);
+        res_packer.Close();
+        remove("test_tmp_file");
+        remove("test_tmp_compact");
+    }
+
+    // flip a byte of a file
+    static void FlipByte(const char *filename, uint64_t offset) {
+        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+        char ch = 0;
+        file.seekg(offset, std::ios::beg);
+        file.read(&ch, 1);
+        ch ^= 0x20;
+        file.seekp(offset, std::ios::beg);
+        file.write(&ch, 1);
+    }
+
+    void ChecksumTest() {
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(100, files);
+        char name[64];
+        Packer res_packer;
+        res_packer.SetChecksum(true);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        res_packer.SetCodec(CODEC_SHARED_HUFFMAN);
+        for (size_t i=0; i<90; i++) {
+            snprintf(name, sizeof(name), "config/file_%zu.json", i);
+            EXPECT_TRUE(res_packer.AddStream(files[i], name, ""));
+        }
+        res_packer.SetCodec(CODEC_STORED);
+        EXPECT_TRUE(res_packer.AddStream(files[90], "stored.json", ""));
+        EXPECT_TRUE(res_packer.AddStream(files[90], "copy.json", ""));
+        // streams added block by block are read back for their checksum
+        std::vector<char> config;
+        for (const auto &file : files) config.insert(config.end(), file.begin(), file.end());
+        std::ofstream("test_tmp_config", std::ios::binary).write(config.data(), config.size());
+        res_packer.SetCodec(CODEC_HUFFMAN);
+        EXPECT_TRUE(res_packer.AddFileBlocks("test_tmp_config", "config", config.size()));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetChecksum(false);
+        remove("test_tmp_config");
+
+        res_packer.SetThreads(2);
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            EXPECT_TRUE(res_packer.checksum_count_ == 92 && res_packer.index_checked_size_ > 0);
+            EXPECT_TRUE(res_packer.Verify());
+            res_packer.Close();
+        }
+        res_packer.SetThreads(1);
+
+        // a damaged stream is found by Verify and by reads with verify on
+        Packer::StreamInfo si(0, 0);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ) && res_packer.FindEntry("stored.json", si));
+        res_packer.Close();
+        FlipByte("test_tmp_file", si.offset + sizeof(uint64_t) + sizeof(StreamHeader) + 10);
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            std::vector<char> file_stream;
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            EXPECT_TRUE(res_packer.GetFileStream("stored.json", file_stream) && file_stream != files[90]);
+            EXPECT_FALSE(res_packer.Verify());
+            res_packer.SetVerify(true);
+            EXPECT_FALSE(res_packer.GetFileStream("stored.json", file_stream));
+            EXPECT_FALSE(res_packer.GetFileStream("copy.json", file_stream));
+            EXPECT_FALSE(res_packer.ReadRange("stored.json", 0, 10, file_stream));
+            EXPECT_FALSE(res_packer.ReadFileStream("stored.json", [] (const char *, size_t) { return true; }));
+            EXPECT_TRUE(res_packer.GetFileStream("config/file_7.json", file_stream) && file_stream == files[7]);
+            EXPECT_TRUE(res_packer.GetFileStream("config", file_stream) && file_stream == config);
+            res_packer.SetVerify(false);
+            res_packer.Close();
+        }
+        FlipByte("test_tmp_file", si.offset + sizeof(uint64_t) + sizeof(StreamHeader) + 10);
+
+        // a damaged index is refused at Open with verify on
+        uint64_t index_offset = 0;
+        std::ifstream("test_tmp_file", std::ios::binary).read((char*)&index_offset, sizeof(index_offset));
+        const uint64_t name_offset = index_offset + sizeof(uint64_t) + sizeof(int32_t) * 2 + sizeof(uint32_t) * 3;
+        FlipByte("test_tmp_file", name_offset);
+        for (OpenMode mode : {MODE_READ, MODE_MMAP, MODE_LAZY}) {
+            EXPECT_TRUE(res_packer.Open("test_tmp_file", mode));
+            EXPECT_FALSE(res_packer.Verify());
+            res_packer.SetVerify(true);
+            EXPECT_FALSE(res_packer.Open("test_tmp_file", mode));
+            res_packer.SetVerify(false);
+            res_packer.Close();
+        }
+        FlipByte("test_tmp_file", name_offset);
+
+        // updated and compacted packages keep checksums
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_UPDATE));
+        EXPECT_TRUE(res_packer.AddStream(files[95], "update.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        res_packer.SetVerify(true);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.checksum_count_ == 93 && res_packer.Verify());
+        EXPECT_TRUE(res_packer.Compact("test_tmp_compact"));
+        res_packer.Close();
+        EXPECT_TRUE(res_packer.Open("test_tmp_compact", MODE_MMAP));
+        EXPECT_TRUE(res_packer.checksum_count_ == 93 && res_packer.Verify());
+        res_packer.Close();
+        EXPECT_TRUE(ReadPackage("test_tmp_compact", MODE_LAZY) == ReadPackage("test_tmp_file", MODE_READ));
+
+        // packages without checksums are checked by head and tail
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddStream(files[0], "file.json", ""));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.checksum_count_ == 0 && res_packer.index_checked_size_ == 0 && res_packer.Verify());
+        res_packer.Close();
+        res_packer.SetVerify(false);
+        remove("test_tmp_compact");
+        remove("test_tmp_file");
+    }
+
+    // a field of /proc/self/status in kB, 0 if it is not found
+    static uint64_t ReadStatusKb(const char *key) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (0 == line.compare(0, strlen(key), key)) return strtoull(line.c_str() + strlen(key) + 1, nullptr, 10);
+        }
+        return 0;
+    }
+
+    void StreamingAddTest() {
+        // sparse file of 2GB with config text at the begin, the middle and the end
+        const uint64_t large_size = 2ULL << 30;
+        std::vector<std::vector<char> > files;
+        MakeConfigFiles(200, files);
+        std::vector<char> config;
+        for (const auto &file : files) config.insert(config.end(), file.begin(), file.end());
+        {
+            std::ofstream out("test_tmp_large", std::ios::binary);
+            for (uint64_t offset : {(uint64_t)0, large_size / 2 - 1000, large_size - config.size()}) {
+                out.seekp(offset, std::ios::beg);
+                out.write(config.data(), config.size());
+            }
+        }
+        EXPECT_TRUE(0 == truncate("test_tmp_large", large_size));
+
+        // peak memory of packing does not depend on the file size
+        Packer res_packer;
+        res_packer.SetThreads(2);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        std::ofstream("/proc/self/clear_refs") << "5";
+        const uint64_t rss_kb = ReadStatusKb("VmRSS:");
+        utility::Timer timer;
+        EXPECT_TRUE(res_packer.AddFile("test_tmp_large", "res"));
+        EXPECT_TRUE(res_packer.Close());
+        const double add_ms = timer.elapsed_ms();
+        const uint64_t peak_kb = ReadStatusKb("VmHWM:");
+        EXPECT_TRUE(peak_kb < rss_kb + (64 << 10));
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_HUFFMAN).count == 1);
+        std::cout << "add " << (large_size >> 20) << " MB file: " << add_ms << " ms, rss " << rss_kb
+                  << " kB, peak " << peak_kb << " kB" << std::endl;
+
+        // read back in chunks
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        std::ifstream source("test_tmp_large", std::ios::binary);
+        std::vector<char> source_chunk;
+        uint64_t read_size = 0;
+        bool same = true;
+        EXPECT_TRUE(res_packer.ReadFileStream("res/test_tmp_large", [&] (const char *data, size_t size) {
+            source_chunk.resize(size);
+            source.read(&source_chunk[0], size);
+            same = same && 0 == memcmp(data, source_chunk.data(), size);
+            read_size += size;
+            return true;
+        }, 1 << 20));
+        EXPECT_TRUE(same && read_size == large_size);
+        res_packer.Close();
+        res_packer.SetThreads(1);
+        remove("test_tmp_large");
+
+        // incompressible large files are stored
+        std::mt19937 rng(1357);
+        std::vector<char> random_stream(global_stream_file_size + 12345);
+        for (auto &ch : random_stream) ch = (char)rng();
+        std::ofstream("test_tmp_random", std::ios::binary).write(random_stream.data(), random_stream.size());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddFile("test_tmp_random"));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_STORED).count == 1);
+        std::vector<char> file_stream;
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("test_tmp_random", file_stream) && file_stream == random_stream);
+        res_packer.Close();
+        remove("test_tmp_random");
+
+        // a coded stream which wins by its entropy but not by its size is overwritten as stored
+        std::ofstream("test_tmp_config", std::ios::binary).write(config.data(), config.size());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddFileBlocks("test_tmp_config", "config", config.size()));
+        EXPECT_TRUE(res_packer.Close());
+        const double coded_size = res_packer.GetCodecStats(CODEC_HUFFMAN).stream_size;
+        double entropy_size = 0;
+        for (size_t begin=0; begin<config.size(); begin+=global_block_size) {
+            const size_t end = std::min(config.size(), begin + global_block_size);
+            uint64_t freq[256] = {0};
+            for (size_t i=begin; i<end; i++) freq[(uint8_t)config[i]]++;
+            for (int sym=0; sym<256; sym++) {
+                if (freq[sym]) entropy_size += freq[sym] * std::log2((double)(end - begin) / freq[sym]) / 8;
+            }
+        }
+        EXPECT_TRUE(entropy_size < coded_size);
+        res_packer.SetCodecRatio((entropy_size + coded_size) / 2 / config.size());
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
+        EXPECT_TRUE(res_packer.AddFileBlocks("test_tmp_config", "config", config.size()));
+        res_packer.SetCodecRatio(0.95);
+        EXPECT_TRUE(res_packer.AddStream(files[0], "next", ""));
+        EXPECT_TRUE(res_packer.Close());
+        EXPECT_TRUE(res_packer.GetCodecStats(CODEC_STORED).count == 1);
+        EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_READ));
+        EXPECT_TRUE(res_packer.GetFileStream("config", file_stream) && file_stream == config);
+        EXPECT_TRUE(res_packer.GetFileStream("next", file_stream) && file_stream == files[0]);
+        res_packer.Close();
+        remove("test_tmp_config");
+        remove("test_tmp_file");
+    }
+
     void VersionTest() {
         Packer res_packer;
         EXPECT_TRUE(res_packer.Open("test_tmp_file", MODE_WRITE));
@@ -441,6 +2134,25 @@ TEST_F(PackerTest, AddDirTest) { AddDirTest(env->test_data_path); }
 TEST_F(PackerTest, TempFileTest) { TempFileTest(env->test_data_path); }
 TEST_F(PackerTest, BinaryFormatTest) { BinaryFormatTest(); }
 TEST_F(PackerTest, TextFormatTest) { TextFormatTest(); }
+TEST_F(PackerTest, LargeStreamTest) { LargeStreamTest(); }
+TEST_F(PackerTest, CodecTest) { CodecTest(); }
+TEST_F(PackerTest, SharedTableTest) { SharedTableTest(); }
+TEST_F(PackerTest, ReadFileStreamTest) { ReadFileStreamTest(); }
+TEST_F(PackerTest, MmapTest) { MmapTest(); }
+TEST_F(PackerTest, ConcurrentReadTest) { ConcurrentReadTest(); }
+TEST_F(PackerTest, HashIndexTest) { HashIndexTest(); }
+TEST_F(PackerTest, LazyOpenTest) { LazyOpenTest(); }
+TEST_F(PackerTest, ParallelExtractTest) { ParallelExtractTest(); }
+TEST_F(PackerTest, ParallelBuildTest) { ParallelBuildTest(); }
+TEST_F(PackerTest, StreamingAddTest) { StreamingAddTest(); }
+TEST_F(PackerTest, ReadRangeTest) { ReadRangeTest(); }
+TEST_F(PackerTest, PackStreamBufTest) { PackStreamBufTest(); }
+TEST_F(PackerTest, FileCacheTest) { FileCacheTest(); }
+TEST_F(PackerTest, DedupTest) { DedupTest(); }
+TEST_F(PackerTest, UpdateTest) { UpdateTest(); }
+TEST_F(PackerTest, DeltaTest) { DeltaTest(); }
+TEST_F(PackerTest, ChecksumTest) { ChecksumTest(); }
+TEST_F(PackerTest, SortedIndexTest) { SortedIndexTest(); }
 TEST_F(PackerTest, VersionTest) { VersionTest(); }
 TEST_F(IfmstreamTest, TestFileMem) { TestFileMem(env->test_data_path); }
 
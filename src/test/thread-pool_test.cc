@@ -0,0 +1,103 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include "log.h"
+
+#define __USE_CUSTOM_TEST__
+#ifdef __USE_CUSTOM_TEST__
+#include "ctest.h"
+#else
+#include "gtest/gtest.h"
+#endif
+
+#define private public  // hack complier
+#define protected public
+#include "thread-pool.h"
+#undef private
+#undef protected
+
+/*
+ * set global environment
+ */
+class ThreadPoolEnvironment : public testing::Environment {
+public:
+    ThreadPoolEnvironment() {}
+
+protected:
+    virtual void SetUp() {}
+
+    virtual void TearDown() {}
+};
+
+ThreadPoolEnvironment *env;
+
+namespace threadpooltest {
+namespace {
+
+/*
+ * ThreadPoolTest, use googletest
+ */
+class ThreadPoolTest: public ::testing::Test {
+
+protected:
+
+    void SubmitTest() {
+        utility::ThreadPool pool(4);
+        EXPECT_TRUE(pool.size() == 4);
+        std::atomic<int> sum(0);
+        for (int i=1; i<=1000; i++) pool.Submit([&sum, i] () { sum += i; });
+        pool.Wait();
+        EXPECT_TRUE(sum == 500500);
+
+        // the pool is reusable after Wait
+        for (int i=1; i<=10; i++) pool.Submit([&sum] () { usleep(1000); sum -= 1; });
+        pool.Wait();
+        EXPECT_TRUE(sum == 500490);
+
+        utility::ThreadPool default_pool;
+        EXPECT_TRUE(default_pool.size() >= 1);
+    }
+
+    void ParallelForTest() {
+        utility::ThreadPool pool(3);
+        std::vector<int> hits(10000, 0);
+        pool.ParallelFor(hits.size(), [&hits] (size_t i) { hits[i]++; });
+        bool once = true;
+        for (int hit : hits) once = once && (1 == hit);
+        EXPECT_TRUE(once);
+
+        // empty and single item run in the calling thread
+        int count = 0;
+        pool.ParallelFor(0, [&count] (size_t) { count++; });
+        EXPECT_TRUE(count == 0);
+        pool.ParallelFor(1, [&count] (size_t) { count++; });
+        EXPECT_TRUE(count == 1);
+    }
+
+    void NestedTest() {
+        // every worker blocks in an inner ParallelFor, the callers finish the items themselves
+        utility::ThreadPool pool(2);
+        std::atomic<int> sum(0);
+        pool.ParallelFor(8, [&pool, &sum] (size_t) {
+            pool.ParallelFor(100, [&sum] (size_t j) { sum += (int)j; });
+        });
+        EXPECT_TRUE(sum == 8 * 4950);
+        pool.Wait();
+    }
+};
+
+TEST_F(ThreadPoolTest, SubmitTest) { SubmitTest(); }
+TEST_F(ThreadPoolTest, ParallelForTest) { ParallelForTest(); }
+TEST_F(ThreadPoolTest, NestedTest) { NestedTest(); }
+
+}  // namespace
+}  // namespace threadpooltest
+
+GTEST_API_ int main(int argc, char **argv) {
+    env = new ThreadPoolEnvironment();
+    testing::AddGlobalTestEnvironment(env);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <string>
+#include <random>
+#include <vector>
+#include "log.h"
+#include "utility.h"
+
+#define __USE_CUSTOM_TEST__
+#ifdef __USE_CUSTOM_TEST__
+#include "ctest.h"
+#else
+#include "gtest/gtest.h"
+#endif
+
+#define private public  // hack complier
+#define protected public
+#include "xxhash.h"
+#undef private
+#undef protected
+
+/*
+ * set global environment
+ */
+class XxHashEnvironment : public testing::Environment {
+public:
+    XxHashEnvironment() {}
+
+protected:
+    virtual void SetUp() {}
+
+    virtual void TearDown() {}
+};
+
+XxHashEnvironment *env;
+
+namespace xxhashtest {
+namespace {
+
+/*
+ * XxHashTest, use googletest
+ */
+class XxHashTest: public ::testing::Test {
+
+protected:
+
+    void VectorTest() {
+        const char *inputs[] = {"", "a", "abc", "Nobody inspects the spammish repetition"};
+        const uint64_t hashes[] = {0xEF46DB3751D8E999ULL, 0xD24EC4F1A98C6E5BULL, 0x44BC2CF5AD770999ULL, 0xFBCEA83C8A378BF1ULL};
+        for (int i=0; i<4; i++) EXPECT_TRUE(utility::XxHash64::Hash(inputs[i], strlen(inputs[i])) == hashes[i]);
+        EXPECT_TRUE(utility::XxHash64::Hash("abc", 3, 1) != utility::XxHash64::Hash("abc", 3));
+    }
+
+    void StreamTest() {
+        // pieces of any size hash the same as the whole buffer, around the 32 byte stripes
+        std::mt19937 rng(2468);
+        std::vector<char> buffer(5000);
+        for (auto &ch : buffer) ch = (char)rng();
+        for (size_t size : {0, 1, 31, 32, 33, 63, 64, 100, 5000}) {
+            const uint64_t hash = utility::XxHash64::Hash(buffer.data(), size, 7);
+            utility::XxHash64 hasher(7);
+            for (size_t offset=0; offset<size; ) {
+                const size_t piece = std::min((size_t)(rng() % 70), size - offset);
+                hasher.Update(&buffer[offset], piece);
+                offset += piece;
+            }
+            EXPECT_TRUE(hasher.Digest() == hash);
+            hasher.Reset(7);
+            hasher.Update(buffer.data(), size);
+            EXPECT_TRUE(hasher.Digest() == hash);
+        }
+    }
+
+    void SpeedTest() {
+        std::vector<char> buffer(64 << 20, 'x');
+        utility::Timer timer;
+        const uint64_t hash = utility::XxHash64::Hash(buffer.data(), buffer.size());
+        const double ms = timer.elapsed_ms();
+        std::cout << "hash " << hash << " of 64MB, " << 64 * 1000 / ms << " MB/s" << std::endl;
+    }
+};
+
+TEST_F(XxHashTest, VectorTest) { VectorTest(); }
+TEST_F(XxHashTest, StreamTest) { StreamTest(); }
+TEST_F(XxHashTest, SpeedTest) { SpeedTest(); }
+
+}  // namespace
+}  // namespace xxhashtest
+
+GTEST_API_ int main(int argc, char **argv) {
+    env = new XxHashEnvironment();
+    testing::AddGlobalTestEnvironment(env);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}